@@ -40,6 +40,8 @@
 #include <vscp.h>
 #include <vscp-espnow.h>
 
+#include "imgcache.h"
+
 // ----------------------------------------------------------------------------
 
 // Beta node states
@@ -120,8 +122,9 @@ typedef struct {
   int mqttRetain;
   char mqttSub[128];
   char mqttPub[128];
+  uint8_t mqttFormat; // Payload format for events published on mqttPub (mqtt_format_t)
   char mqttPubLog[128];
-  char mqttVerification[32 * 1024]; // For server certificate
+  uint16_t mqttVerificationLen; // Length of server certificate in flash (zero for none)
   char mqttLwTopic[128];
   char mqttLwMessage[128];
   uint8_t mqttLwQos;
@@ -251,23 +254,31 @@ int
 app_initiate_firmware_upload(const char *url);
 
 /**
- * @brief
+ * @brief Send firmware to the nodes of the cluster
+ *
+ * Nodes that run the source image of the delta get the delta. Nodes
+ * that don't, and delta nodes that did not update, get the full image.
  *
- * @param firmware_size
- * @param sha
+ * @param firmware_size Size of image
+ * @param sha Digest of image. The image must be in the image cache.
+ * @param pdelta Pointer to delta for the image. Can be NULL.
+ * @param deltaSize Size of delta
  */
 
 void
-app_firmware_send(size_t firmware_size, uint8_t sha[ESPNOW_OTA_HASH_LEN]);
+app_firmware_send(size_t firmware_size, uint8_t sha[ESPNOW_OTA_HASH_LEN], const uint8_t *pdelta, size_t deltaSize);
 
 /**
- * @brief Download firmware form server
+ * @brief Download firmware form server to the image cache
+ *
+ * Nothing is downloaded if the image from the same URL is already cached.
  *
  * @param url Url to resource
- * @return size_t Size of downloaded image
+ * @param pentry Pointer to entry that get the cached image
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
  */
 
-size_t
-app_firmware_download(const char *url);
+int
+app_firmware_download(const char *url, imgcache_entry_t *pentry);
 
 #endif
\ No newline at end of file
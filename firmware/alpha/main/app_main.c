@@ -35,6 +35,7 @@
 #include <esp_event.h>
 #include "esp_mac.h"
 #include <esp_ota_ops.h>
+#include <esp_app_format.h>
 #include <esp_https_ota.h>
 #include <esp_http_server.h>
 
@@ -77,6 +78,14 @@
 #include "websrv.h"
 #include "mqtt.h"
 #include "tcpsrv.h"
+#include "eventbus.h"
+#include "mailbox.h"
+#include "nodes.h"
+#include "cfgstore.h"
+#include "imgcache.h"
+#include "ota.h"
+#include "vscp-delta.h"
+#include "vscp-fota.h"
 
 #include "vscp-compiler.h"
 #include "vscp-projdefs.h"
@@ -106,10 +115,6 @@ extern bool g_vscp_espnow_probe;
 // MQTT
 extern esp_mqtt_client_handle_t g_mqtt_client;
 
-// Forward declarations
-static esp_err_t
-readPersistentConfigs(void);
-
 /*
   The event queue is handled in the main loop and it
   react on events from different parts of the system
@@ -188,22 +193,23 @@ node_persistent_config_t g_persistent = {
   .vscpLinkKey      = { 0 }, // VSCP_DEFAULT_KEY32,
 
   // MQTT
-  .mqttEnable       = true,
-  .mqttUrl          = { 0 },
-  .mqttPort         = 1883,
-  .mqttClientid     = "{{node}}-{{guid}}",
-  .mqttUsername     = "vscp",
-  .mqttPassword     = "secret",
-  .mqttQos          = 0,
-  .mqttRetain       = 0,
-  .mqttSub          = "vscp/{{guid}}/pub/#",
-  .mqttPub          = "vscp/{{guid}}/{{class}}/{{type}}/{{index}}",
-  .mqttPubLog       = "vscp/log/{{guid}}",
-  .mqttVerification = { 0 },
-  .mqttLwTopic      = { 0 },
-  .mqttLwMessage    = { 0 },
-  .mqttLwQos        = 0,
-  .mqttLwRetain     = false,
+  .mqttEnable          = true,
+  .mqttUrl             = { 0 },
+  .mqttPort            = 1883,
+  .mqttClientid        = "{{node}}-{{guid}}",
+  .mqttUsername        = "vscp",
+  .mqttPassword        = "secret",
+  .mqttQos             = 0,
+  .mqttRetain          = 0,
+  .mqttSub             = "vscp/{{guid}}/pub/#",
+  .mqttPub             = "vscp/{{guid}}/{{class}}/{{type}}/{{index}}",
+  .mqttFormat          = MQTT_FORMAT_JSON,
+  .mqttPubLog          = "vscp/log/{{guid}}",
+  .mqttVerificationLen = 0,
+  .mqttLwTopic         = { 0 },
+  .mqttLwMessage       = { 0 },
+  .mqttLwQos           = 0,
+  .mqttLwRetain        = false,
 
   // espnow
   .espnowEnable                = true,
@@ -435,31 +441,27 @@ void
 ota_task(void *pvParameter)
 {
   ESP_LOGI(TAG, "Starting OTA ");
-#ifdef CONFIG_EXAMPLE_FIRMWARE_UPGRADE_BIND_IF
-  esp_netif_t *netif = get_example_netif_from_desc(bind_interface_name);
-  if (netif == NULL) {
-    ESP_LOGE(TAG, "Can't find netif from interface description");
-    abort();
+  if (VSCP_ERROR_SUCCESS != imgcache_self_update()) {
+    ESP_LOGE(TAG, "Firmware upgrade not started, OTA partition in use");
+    vTaskDelete(NULL);
   }
   struct ifreq ifr;
-  esp_netif_get_netif_impl_name(netif, ifr.ifr_name);
-  ESP_LOGI(TAG, "Bind interface name is %s", ifr.ifr_name);
-#endif
   esp_http_client_config_t config_http = {
     .url = CONFIG_APP_OTA_URL,
     //.cert_pem          = (char *) server_cert_pem_start,
     .crt_bundle_attach = esp_crt_bundle_attach,
     .event_handler     = _http_event_handler,
     .keep_alive_enable = true,
-#ifdef CONFIG_APP_OTA_BIND_IF
-    .if_name = &ifr,
-#endif
   };
 
 #ifdef CONFIG_APP_OTA_SKIP_COMMON_NAME_CHECK
   config_http.skip_cert_common_name_check = true;
 #endif
 
+  if (VSCP_ERROR_SUCCESS != ota_bind_if(&config_http, &ifr)) {
+    abort();
+  }
+
   esp_https_ota_config_t config = {
     .http_config           = &config_http,
     .bulk_flash_erase      = true,
@@ -473,6 +475,7 @@ ota_task(void *pvParameter)
   }
   else {
     ESP_LOGE(TAG, "Firmware upgrade failed");
+    imgcache_self_update_failed();
   }
   while (1) {
     vTaskDelay(1000 / portTICK_PERIOD_MS);
@@ -533,120 +536,104 @@ get_sha256_of_partitions(void)
 ///////////////////////////////////////////////////////////////////////////////
 // firmware_download
 //
+// An image fetched from the same URL a short while ago is taken from the
+// cache, the whole fleet is served from one download.
+//
 
-size_t
-app_firmware_download(const char *url)
+int
+app_firmware_download(const char *url, imgcache_entry_t *pentry)
 {
-#define OTA_DATA_PAYLOAD_LEN 1024
-
-  esp_err_t ret               = ESP_OK;
-  esp_ota_handle_t ota_handle = 0;
-  uint8_t *data               = malloc(OTA_DATA_PAYLOAD_LEN); // TODO ESP MALLOC
-  size_t total_size           = 0;
-  uint32_t start_time         = xTaskGetTickCount();
-
-  esp_http_client_config_t config = {
-    .url               = url,
-    .transport_type    = HTTP_TRANSPORT_UNKNOWN,
-    .crt_bundle_attach = esp_crt_bundle_attach,
-    .event_handler     = _http_event_handler,
-    .keep_alive_enable = true,
-#ifdef CONFIG_EXAMPLE_FIRMWARE_UPGRADE_BIND_IF
-    .if_name = &ifr,
-#endif
-  };
-
-  /**
-   * @brief 1. Connect to the server
-   */
-  esp_http_client_handle_t client = esp_http_client_init(&config);
-  ESP_GOTO_ON_ERROR(!client, EXIT, TAG, "Initialise HTTP connection");
+  if (VSCP_ERROR_SUCCESS == imgcache_find_url(url, pentry)) {
+    ESP_LOGI(TAG, "Firmware from %s is cached (%.32s %.32s)", url, pentry->projectName, pentry->version);
+    return VSCP_ERROR_SUCCESS;
+  }
 
-  ESP_LOGI(TAG, "Open HTTP connection: %s", url);
+  return ota_download(url, pentry);
+}
 
-  /**
-   * @brief First, the firmware is obtained from the http server and stored
-   */
-  do {
-    ret = esp_http_client_open(client, 0);
+///////////////////////////////////////////////////////////////////////////////
+// ota_initiator_data_cb
+//
+// Data for a full image transfer comes from the image cache
+//
 
-    if (ret != ESP_OK) {
-      vTaskDelay(pdMS_TO_TICKS(1000));
-      ESP_LOGW(TAG, "<%s> Connection service failed", esp_err_to_name(ret));
-    }
-  } while (ret != ESP_OK);
+static imgcache_entry_t s_otaImage;
 
-  total_size = esp_http_client_fetch_headers(client);
+esp_err_t
+app_ota_initiator_data_cb(size_t src_offset, void *dst, size_t size)
+{
+  return (VSCP_ERROR_SUCCESS == imgcache_read(&s_otaImage, src_offset, dst, size)) ? ESP_OK : ESP_FAIL;
+}
 
-  if (total_size <= 0) {
-    ESP_LOGW(TAG, "Please check the address of the server");
-    ret = esp_http_client_read(client, (char *) data, OTA_DATA_PAYLOAD_LEN);
-    ESP_GOTO_ON_ERROR(ret < 0, EXIT, TAG, "<%s> Read data from http stream", esp_err_to_name(ret));
+///////////////////////////////////////////////////////////////////////////////
+// app_ota_delta_data_cb
+//
+// Data for a delta transfer comes from RAM
+//
 
-    ESP_LOGW(TAG, "Recv data: %.*s", ret, data);
-    goto EXIT;
-  }
+static const uint8_t *s_pdelta = NULL;
+static size_t s_deltaSize      = 0;
 
-  /**
-   * @brief 2. Read firmware from the server and write it to the flash of the root node
-   */
-
-  const esp_partition_t *updata_partition = esp_ota_get_next_update_partition(NULL);
-  /**< Commence an OTA update writing to the specified partition. */
-  ret = esp_ota_begin(updata_partition, total_size, &ota_handle);
-  ESP_GOTO_ON_ERROR(ret != ESP_OK, EXIT, TAG, "<%s> esp_ota_begin failed, total_size", esp_err_to_name(ret));
-
-  for (ssize_t size = 0, recv_size = 0; recv_size < total_size; recv_size += size) {
-    size = esp_http_client_read(client, (char *) data, OTA_DATA_PAYLOAD_LEN);
-    ESP_GOTO_ON_ERROR(size < 0, EXIT, TAG, "<%s> Read data from http stream", esp_err_to_name(ret));
-
-    if (size > 0) {
-      /**< Write OTA update data to partition */
-      ret = esp_ota_write(ota_handle, data, OTA_DATA_PAYLOAD_LEN);
-      ESP_GOTO_ON_ERROR(ret != ESP_OK,
-                        EXIT,
-                        TAG,
-                        "<%s> Write firmware to flash, size: %d, data: %.*s",
-                        esp_err_to_name(ret),
-                        size,
-                        size,
-                        data);
-    }
-    else {
-      ESP_LOGW(TAG, "<%s> esp_http_client_read", esp_err_to_name((int) ret));
-      goto EXIT;
-    }
+static esp_err_t
+app_ota_delta_data_cb(size_t src_offset, void *dst, size_t size)
+{
+  if ((NULL == s_pdelta) || (src_offset > s_deltaSize) || (size > (s_deltaSize - src_offset))) {
+    return ESP_ERR_INVALID_ARG;
   }
 
-  ESP_LOGI(TAG,
-           "The service download firmware is complete, Spend time: %ds",
-           (int) ((xTaskGetTickCount() - start_time) * portTICK_PERIOD_MS / 1000));
-
-  ret = esp_ota_end(ota_handle);
-  ESP_GOTO_ON_ERROR(ret != ESP_OK, EXIT, TAG, "<%s> esp_ota_end", esp_err_to_name(ret));
-
-EXIT:
-  free(data);
-  esp_http_client_close(client);
-  esp_http_client_cleanup(client);
-
-  return total_size;
+  memcpy(dst, s_pdelta + src_offset, size);
+  return ESP_OK;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// ota_initiator_data_cb
+// app_ota_rescan
+//
+// Scan for nodes again after the delta pass. Nodes that applied the delta
+// have restarted and no longer listen. Nodes that listen but already run
+// the new image (pdesc) are left out. The address list is replaced and the
+// number of nodes that still need the full image returned. Nodes from the
+// successful delta list that show up again are taken off *psuccessed.
 //
 
-esp_err_t
-app_ota_initiator_data_cb(size_t src_offset, void *dst, size_t size)
+static size_t
+app_ota_rescan(espnow_addr_t **plist,
+               const esp_app_desc_t *pdesc,
+               const espnow_ota_result_t *pdeltaResult,
+               size_t *psuccessed)
 {
-  static const esp_partition_t *data_partition = NULL;
+  espnow_ota_responder_t *info_list = NULL;
+  size_t num                        = 0;
+  size_t cnt                        = 0;
 
-  if (!data_partition) {
-    data_partition = esp_ota_get_next_update_partition(NULL);
+  ESP_FREE(*plist);
+
+  espnow_ota_initiator_scan(&info_list, &num, pdMS_TO_TICKS(3000));
+  if (num) {
+    *plist = ESP_MALLOC(num * ESPNOW_ADDR_LEN);
   }
 
-  return esp_partition_read(data_partition, src_offset, dst, size);
+  for (size_t i = 0; (NULL != *plist) && (i < num); i++) {
+
+    if ((NULL != pdesc) &&
+        (0 == memcmp(info_list[i].app_desc.app_elf_sha256, pdesc->app_elf_sha256, sizeof(pdesc->app_elf_sha256)))) {
+      continue;
+    }
+
+    // Got the delta but did not end up with the new image
+    for (size_t j = 0; j < pdeltaResult->successed_num; j++) {
+      if (0 == memcmp(pdeltaResult->successed_addr[j], info_list[i].mac, ESPNOW_ADDR_LEN)) {
+        (*psuccessed)--;
+        break;
+      }
+    }
+
+    memcpy((*plist)[cnt++], info_list[i].mac, ESPNOW_ADDR_LEN);
+  }
+
+  espnow_ota_initiator_scan_result_free();
+
+  ESP_LOGI(TAG, "%u nodes listening after delta, %u need the full image", num, cnt);
+  return cnt;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -654,7 +641,7 @@ app_ota_initiator_data_cb(size_t src_offset, void *dst, size_t size)
 //
 
 void
-app_firmware_send(size_t firmware_size, uint8_t sha[ESPNOW_OTA_HASH_LEN])
+app_firmware_send(size_t firmware_size, uint8_t sha[ESPNOW_OTA_HASH_LEN], const uint8_t *pdelta, size_t deltaSize)
 {
   esp_err_t ret                         = ESP_OK;
   uint32_t start_time                   = xTaskGetTickCount();
@@ -662,6 +649,27 @@ app_firmware_send(size_t firmware_size, uint8_t sha[ESPNOW_OTA_HASH_LEN])
   espnow_ota_responder_t *info_list     = NULL;
   espnow_addr_t *dest_addr_list         = NULL;
   size_t num                            = 0;
+  size_t numDelta                       = 0;
+  size_t successed                      = 0;
+  const vscp_delta_hdr_t *phdr          = (const vscp_delta_hdr_t *) pdelta;
+
+  // The delta must be for the image we are sending
+  if ((NULL != pdelta) && ((VSCP_ERROR_SUCCESS != vscp_delta_check_header(phdr, deltaSize)) ||
+                           memcmp(phdr->dstDigest, sha, ESPNOW_OTA_HASH_LEN))) {
+    ESP_LOGW(TAG, "Delta is not for this firmware image, not used");
+    pdelta = NULL;
+  }
+
+  // Keep the image while it is sent
+  if (VSCP_ERROR_SUCCESS != imgcache_find_lock(sha, &s_otaImage)) {
+    ESP_LOGE(TAG, "Firmware to send is not in the image cache");
+    return;
+  }
+
+  if (firmware_size != s_otaImage.size) {
+    ESP_LOGW(TAG, "Firmware size %u differs from cached image, %lu used", firmware_size, (unsigned long) s_otaImage.size);
+    firmware_size = s_otaImage.size;
+  }
 
   espnow_ota_initiator_scan(&info_list, &num, pdMS_TO_TICKS(3000));
   ESP_LOGW(TAG, "espnow wait ota num: %u", num);
@@ -672,17 +680,113 @@ app_firmware_send(size_t firmware_size, uint8_t sha[ESPNOW_OTA_HASH_LEN])
 
   dest_addr_list = ESP_MALLOC(num * ESPNOW_ADDR_LEN);
 
+  // Nodes that run the source image of the delta go first in the list
   for (size_t i = 0; i < num; i++) {
-    memcpy(dest_addr_list[i], info_list[i].mac, ESPNOW_ADDR_LEN);
+    if ((NULL != pdelta) && vscp_delta_is_source(phdr, &info_list[i].app_desc)) {
+      memmove(dest_addr_list[numDelta + 1], dest_addr_list[numDelta], (i - numDelta) * ESPNOW_ADDR_LEN);
+      memcpy(dest_addr_list[numDelta++], info_list[i].mac, ESPNOW_ADDR_LEN);
+    }
+    else {
+      memcpy(dest_addr_list[i], info_list[i].mac, ESPNOW_ADDR_LEN);
+    }
   }
 
   espnow_ota_initiator_scan_result_free();
 
-  ret =
-    espnow_ota_initiator_send(dest_addr_list, num, sha, firmware_size, app_ota_initiator_data_cb, &espnow_ota_result);
-  ESP_ERROR_GOTO(ret != ESP_OK, EXIT, "<%s> espnow_ota_initiator_send", esp_err_to_name(ret));
+  if (numDelta) {
+
+    ESP_LOGI(TAG, "Sending %u byte delta to %u of %u nodes", (unsigned) deltaSize, numDelta, num);
+
+    // The target digest is used as id so nodes already running it report done
+    s_pdelta    = pdelta;
+    s_deltaSize = deltaSize;
+    ret = espnow_ota_initiator_send(dest_addr_list, numDelta, sha, deltaSize, app_ota_delta_data_cb, &espnow_ota_result);
+    s_pdelta = NULL;
+    ESP_ERROR_GOTO((ret != ESP_OK) && (ret != ESP_ERR_ESPNOW_OTA_FIRMWARE_INCOMPLETE),
+                   EXIT,
+                   "<%s> espnow_ota_initiator_send (delta)",
+                   esp_err_to_name(ret));
+
+    ESP_LOGI(TAG,
+             "Delta sent, successed_num: %u, unfinished_num: %u",
+             espnow_ota_result.successed_num,
+             espnow_ota_result.unfinished_num);
+    successed += espnow_ota_result.successed_num;
+
+    // Nodes rebuild the image and restart. Their responder is not started
+    // again, so sending the full image to them would only time out. The
+    // full image goes to the nodes that still listen and do not run it.
+    vTaskDelay(pdMS_TO_TICKS(OTA_DELTA_SETTLE_TIME * 1000));
+
+    esp_app_desc_t appDesc;
+    bool bAppDesc = (VSCP_ERROR_SUCCESS == imgcache_read(&s_otaImage,
+                                                         sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t),
+                                                         &appDesc,
+                                                         sizeof(appDesc))) &&
+                    (ESP_APP_DESC_MAGIC_WORD == appDesc.magic_word);
+
+    num = app_ota_rescan(&dest_addr_list, bAppDesc ? &appDesc : NULL, &espnow_ota_result, &successed);
+    espnow_ota_initiator_result_free(&espnow_ota_result);
+    memset(&espnow_ota_result, 0, sizeof(espnow_ota_result));
+  }
+
+#ifdef CONFIG_APP_OTA_FEC
+  // Many nodes share one broadcast of the image. Nodes that did not get it
+  // all are left to the ack driven transfer below.
+  if (num >= OTA_FEC_MIN_NODES) {
+
+    vscp_fota_result_t fotaResult = { 0 };
+    vscp_fota_config_t fotaConfig = {
+      .redundancy  = OTA_FEC_REDUNDANCY,
+      .rounds      = OTA_FEC_ROUNDS,
+      .prepareTime = OTA_FEC_PREPARE_TIME,
+    };
+
+    if (VSCP_ERROR_SUCCESS ==
+        vscp_fota_send(dest_addr_list, num, sha, firmware_size, app_ota_initiator_data_cb, &fotaConfig, &fotaResult)) {
+      ESP_LOGI(TAG,
+               "Broadcast update, %u nodes done, %u left, airtime %lu%% of one image",
+               fotaResult.successNum,
+               fotaResult.unfinishedNum,
+               (unsigned long) (((uint64_t) fotaResult.symbolsSent * VSCP_FOTA_SYMBOL_SIZE * 100) / firmware_size));
+      successed += fotaResult.successNum;
+      num = fotaResult.unfinishedNum;
+      memcpy(dest_addr_list, fotaResult.unfinishedAddr, num * ESPNOW_ADDR_LEN);
+    }
+    vscp_fota_result_free(&fotaResult);
+  }
+#endif
+
+  for (int round = 0; num; round++) {
+
+    ret =
+      espnow_ota_initiator_send(dest_addr_list, num, sha, firmware_size, app_ota_initiator_data_cb, &espnow_ota_result);
+    ESP_ERROR_GOTO((ret != ESP_OK) && (ret != ESP_ERR_ESPNOW_OTA_FIRMWARE_INCOMPLETE),
+                   EXIT,
+                   "<%s> espnow_ota_initiator_send",
+                   esp_err_to_name(ret));
+
+    successed += espnow_ota_result.successed_num;
+    if (!espnow_ota_result.unfinished_num || (round >= OTA_RESEND_ROUNDS)) {
+      break;
+    }
 
-  if (espnow_ota_result.successed_num == 0) {
+    // Nodes that restarted, changed channel or lost contact keep what they
+    // got. They are asked for their packet bitmap and only missing packets
+    // are sent.
+    ESP_LOGI(TAG,
+             "%u nodes unfinished, resume in %d s (%d/%d)",
+             espnow_ota_result.unfinished_num,
+             OTA_RESEND_DELAY,
+             round + 1,
+             OTA_RESEND_ROUNDS);
+    num = espnow_ota_result.unfinished_num;
+    memcpy(dest_addr_list, espnow_ota_result.unfinished_addr, num * ESPNOW_ADDR_LEN);
+    espnow_ota_initiator_result_free(&espnow_ota_result);
+    vTaskDelay(pdMS_TO_TICKS(OTA_RESEND_DELAY * 1000));
+  }
+
+  if (0 == successed) {
     ESP_LOGW(TAG, "Devices upgrade failed, unfinished_num: %u", espnow_ota_result.unfinished_num);
     goto EXIT;
   }
@@ -692,10 +796,11 @@ app_firmware_send(size_t firmware_size, uint8_t sha[ESPNOW_OTA_HASH_LEN])
            (xTaskGetTickCount() - start_time) * portTICK_PERIOD_MS / 1000);
   ESP_LOGI(TAG,
            "Devices upgrade completed, successed_num: %u, unfinished_num: %u",
-           espnow_ota_result.successed_num,
+           successed,
            espnow_ota_result.unfinished_num);
 
 EXIT:
+  imgcache_unlock(&s_otaImage);
   ESP_FREE(dest_addr_list);
   espnow_ota_initiator_result_free(&espnow_ota_result);
 }
@@ -707,19 +812,35 @@ EXIT:
 int
 app_initiate_firmware_upload(const char *url)
 {
-  const char *url_to_upload             = url;
-  uint8_t sha_256[32]                   = { 0 };
-  const esp_partition_t *data_partition = esp_ota_get_next_update_partition(NULL);
+  int rv;
+  const char *url_to_upload = url;
+  uint8_t *pdelta           = NULL;
+  size_t deltaSize          = 0;
+  imgcache_entry_t image;
 
   if (NULL == url) {
     url_to_upload = CONFIG_APP_OTA_URL;
   }
 
-  size_t firmware_size = app_firmware_download(url_to_upload);
-  esp_partition_get_sha256(data_partition, sha_256);
+  rv = app_firmware_download(url_to_upload, &image);
+  if (VSCP_ERROR_SUCCESS != rv) {
+    return rv;
+  }
+
+#ifdef CONFIG_APP_OTA_DELTA
+  // A delta is looked for next to the image (<url>.delta)
+  char *delta_url = ESP_MALLOC(strlen(url_to_upload) + 7);
+  if (NULL != delta_url) {
+    sprintf(delta_url, "%s.delta", url_to_upload);
+    ota_download_delta(delta_url, &pdelta, &deltaSize);
+    ESP_FREE(delta_url);
+  }
+#endif
 
   // Send new firmware to clients
-  app_firmware_send(firmware_size, sha_256);
+  app_firmware_send(image.size, image.sha, pdelta, deltaSize);
+
+  ESP_FREE(pdelta);
 
   return VSCP_ERROR_SUCCESS;
 }
@@ -847,9 +968,6 @@ app_factory_reset_press_cb(void *arg, void *usr_data)
   }
   nvs_commit(g_nvsHandle);
 
-  // set defaults
-  readPersistentConfigs();
-
   // Disconnect from wifi
   ret = esp_wifi_disconnect();
   if (ESP_OK != ret) {
@@ -884,6 +1002,44 @@ vscp_espnow_data_cb(uint8_t *src_addr, void *data, size_t size, wifi_pkt_rx_ctrl
            rx_ctrl->rssi);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// app_espnow_event_cb
+//
+// Events received from the esp-now cluster are published on the event bus
+//
+
+static void
+app_espnow_event_cb(const vscpEvent *pev, void *userdata)
+{
+  int rv;
+
+  nodes_received(pev, (const vscp_espnow_rx_info_t *) userdata);
+
+  // Keep track of sleeping nodes and deliver their mail when they wake up
+  mailbox_received(pev, (const vscp_espnow_rx_info_t *) userdata);
+
+  if (VSCP_ERROR_SUCCESS != (rv = eventbus_publish(pev, EVENTBUS_OBID(EVENTBUS_TRANSPORT_ESPNOW, 0)))) {
+    ESP_LOGW(TAG, "Failed to publish esp-now event. rv=%d", rv);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// app_eventbus_espnow_cb
+//
+// Events from the event bus are broadcast to the esp-now cluster. Events
+// addressed to a sleeping node are held until it wakes up.
+//
+
+static int
+app_eventbus_espnow_cb(const vscpEvent *pev, void *userdata)
+{
+  if (VSCP_ERROR_SUCCESS == mailbox_post(pev)) {
+    return VSCP_ERROR_SUCCESS;
+  }
+
+  return vscp_espnow_sendEvent(ESPNOW_ADDR_BROADCAST, pev, true, 1000);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // app_button_init
 //
@@ -916,21 +1072,17 @@ app_button_init(void)
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// readPersistentConfigs
+// app_update_boot_counter
+//
+// The boot counter is kept outside of the configuration blob as it
+// changes on every boot.
 //
 
-static esp_err_t
-readPersistentConfigs(void)
+static void
+app_update_boot_counter(void)
 {
   esp_err_t rv;
-  char buf[80];
-  size_t length = sizeof(buf);
-  uint8_t val;
-
-  // Set default primary key
-  vscp_fwhlp_hex2bin(g_persistent.vscpLinkKey, 16, VSCP_DEFAULT_KEY16);
 
-  // boot counter
   rv = nvs_get_u32(g_nvsHandle, "boot_counter", &g_persistent.bootCnt);
   switch (rv) {
 
@@ -954,479 +1106,10 @@ readPersistentConfigs(void)
     ESP_LOGE(TAG, "Failed to update boot counter");
   }
 
-  // Node name
-  rv = nvs_get_str(g_nvsHandle, "node_name", buf, &length);
-  switch (rv) {
-    case ESP_OK:
-      strncpy(g_persistent.nodeName, buf, sizeof(g_persistent.nodeName));
-      ESP_LOGI(TAG, "Node Name = %s", g_persistent.nodeName);
-      break;
-
-    case ESP_ERR_NVS_NOT_FOUND:
-      rv = nvs_set_str(g_nvsHandle, "node_name", g_persistent.nodeName);
-      if (rv != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to update node name");
-      }
-      break;
-
-    default:
-      ESP_LOGE(TAG, "Error (%s) reading 'node_name'!", esp_err_to_name(rv));
-      break;
-  }
-
-  // Start Delay (seconds)
-  rv = nvs_get_u8(g_nvsHandle, "start_delay", &g_persistent.startDelay);
-  switch (rv) {
-
-    case ESP_OK:
-      ESP_LOGI(TAG, "Start delay = %d", g_persistent.startDelay);
-      break;
-
-    case ESP_ERR_NVS_NOT_FOUND:
-      rv = nvs_set_u8(g_nvsHandle, "start_delay", 2);
-      if (rv != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to update start delay");
-      }
-      break;
-
-    default:
-      ESP_LOGE(TAG, "Error (%s) reading!", esp_err_to_name(rv));
-      break;
-  }
-
-  // pmk (Primary key)
-  length = 16;
-  rv     = nvs_get_blob(g_nvsHandle, "pmk", g_persistent.pmk, &length);
-  if (rv != ESP_OK) {
-    const char key[] = VSCP_DEFAULT_KEY16;
-    const char *pos  = key;
-    for (int i = 0; i < 16; i++) {
-      sscanf(pos, "%2hhx", &g_persistent.pmk[i]);
-      pos += 2;
-    }
-    rv = nvs_set_blob(g_nvsHandle, "pmk", g_persistent.pmk, 16);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to write node pmk to nvs. rv=%d", rv);
-    }
-  }
-
-  // espnow queueSize
-  rv = nvs_get_u8(g_nvsHandle, "queue_size", &g_persistent.queueSize);
-  if (ESP_OK != rv) {
-    rv = nvs_set_u8(g_nvsHandle, "queue_size", g_persistent.queueSize);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to update queue_size");
-    }
-  }
-
-  // Logging ------------------------------------------------------------------
-
-  // logwrite2Stdout
-  rv = nvs_get_u8(g_nvsHandle, "log_stdout", &g_persistent.logwrite2Stdout);
-  if (ESP_OK != rv) {
-    rv = nvs_set_u8(g_nvsHandle, "log_stdout", g_persistent.logwrite2Stdout);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to update log-stdout");
-    }
-  }
-
-  // logLevel
-  esp_log_level_set("*", ESP_LOG_INFO);
-  rv = nvs_get_u8(g_nvsHandle, "log_level", &g_persistent.logLevel);
-  if (ESP_OK != rv) {
-    rv = nvs_set_u8(g_nvsHandle, "log_level", g_persistent.logLevel);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to update log-level");
-    }
-  }
-
-  // logType
-  rv = nvs_get_u8(g_nvsHandle, "log_type", &g_persistent.logType);
-  if (ESP_OK != rv) {
-    rv = nvs_set_u8(g_nvsHandle, "log_type", g_persistent.logType);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to update log-type");
-    }
-  }
-
-  // logRetries
-  rv = nvs_get_u8(g_nvsHandle, "log_retries", &g_persistent.logRetries);
-  if (ESP_OK != rv) {
-    rv = nvs_set_u8(g_nvsHandle, "log:retries", g_persistent.logRetries);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to update log-retries");
-    }
-  }
-
-  // logUrl
-  length = sizeof(g_persistent.logUrl);
-  rv     = nvs_get_str(g_nvsHandle, "log_url", g_persistent.logUrl, &length);
-  if (rv != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to read 'log URL' will be set to default. ret=%d", rv);
-    rv = nvs_set_str(g_nvsHandle, "log_url", g_persistent.logUrl);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to save log URL");
-    }
-  }
-
-  // logPort
-  rv = nvs_get_u16(g_nvsHandle, "log_port", &g_persistent.logPort);
-  if (ESP_OK != rv) {
-    rv = nvs_set_u16(g_nvsHandle, "log_port", g_persistent.logPort);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to update log_port");
-    }
-  }
-
-  // logMqttTopic
-  length = sizeof(g_persistent.logMqttTopic);
-  rv     = nvs_get_str(g_nvsHandle, "log_mqtt_topic", g_persistent.logMqttTopic, &length);
-  if (rv != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to read 'log MQTT topic' will be set to default. ret=%d", rv);
-    rv = nvs_set_str(g_nvsHandle, "log_mqtt_topic", g_persistent.logMqttTopic);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to save log MQTT topic");
-    }
-  }
-
-  // VSCP Link ----------------------------------------------------------------
-
-  // VSCP Link enable
-  rv = nvs_get_u8(g_nvsHandle, "vscp_enable", &val);
-  if (rv != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to read 'VSCP link enable' will be set to default. ret=%d", rv);
-    val = (uint8_t) g_persistent.vscplinkEnable;
-    rv  = nvs_set_u8(g_nvsHandle, "vscp_enable", g_persistent.vscplinkEnable);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to save VSCP link enable");
-    }
-  }
-  else {
-    g_persistent.vscplinkEnable = (bool) val;
-  }
-
-  // VSCP Link host
-  length = sizeof(g_persistent.vscplinkUrl);
-  rv     = nvs_get_str(g_nvsHandle, "vscp_url", g_persistent.vscplinkUrl, &length);
-  if (rv != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to read 'VSCP link host' will be set to default. ret=%d", rv);
-    rv = nvs_set_str(g_nvsHandle, "vscp_url", CONFIG_APP_DEFAULT_USER);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to save VSCP link host");
-    }
-  }
-
-  // VSCP link port
-  rv = nvs_get_u16(g_nvsHandle, "vscp_port", &g_persistent.vscplinkPort);
-  if (ESP_OK != rv) {
-    rv = nvs_set_u16(g_nvsHandle, "vscp_port", g_persistent.vscplinkPort);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to update VSCP link port");
-    }
-  }
-
-  // VSCP Link key
-  length = sizeof(g_persistent.vscpLinkKey);
-  rv     = nvs_get_blob(g_nvsHandle, "vscp_key", (char *) g_persistent.vscpLinkKey, &length);
-  if (rv != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to read 'VSCP link_key' will be set to default. ret=%d", rv);
-    rv = nvs_set_blob(g_nvsHandle, "vscp_key", g_persistent.vscpLinkKey, sizeof(g_persistent.vscpLinkKey));
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to save VSCL link key");
-    }
-  }
-
-  // VSCP Link Username
-  length = sizeof(g_persistent.vscplinkUsername);
-  rv     = nvs_get_str(g_nvsHandle, "vscp_user", g_persistent.vscplinkUsername, &length);
-  if (rv != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to read 'VSCP Username' will be set to default. ret=%d", rv);
-    rv = nvs_set_str(g_nvsHandle, "vscp_user", CONFIG_APP_DEFAULT_USER);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to save VSCP username");
-    }
-  }
-
-  // VSCP Link password
-  length = sizeof(g_persistent.vscplinkPassword);
-  rv     = nvs_get_str(g_nvsHandle, "vscp_password", g_persistent.vscplinkPassword, &length);
-  if (rv != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to read 'VSCP password' will be set to default. ret=%d", rv);
-    nvs_set_str(g_nvsHandle, "vscp_password", CONFIG_APP_DEFAULT_PASSWORD);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to save VSCP password");
-    }
-  }
-  // ESP_LOGI(TAG, "VSCP Password: %s", buf);
-
-  // MQTT ----------------------------------------------------------------
-
-  // MQTT enable
-  rv = nvs_get_u8(g_nvsHandle, "mqtt_enable", &val);
-  if (rv != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to read 'mqtt enable' will be set to default. ret=%d", rv);
-    val = (uint8_t) g_persistent.mqttEnable;
-    rv  = nvs_set_u8(g_nvsHandle, "mqtt_enable", g_persistent.mqttEnable);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to save MQTT enable");
-    }
-  }
-  else {
-    g_persistent.mqttEnable = (bool) val;
-  }
-
-  // MQTT host
-  length = sizeof(g_persistent.mqttUrl);
-  rv     = nvs_get_str(g_nvsHandle, "mqtt_url", g_persistent.mqttUrl, &length);
-  if (rv != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to read 'MQTT host' will be set to default. ret=%d", rv);
-    rv = nvs_set_str(g_nvsHandle, "mqtt_url", g_persistent.mqttUrl);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to save MQTT host");
-    }
-  }
-
-  // MQTT port
-  rv = nvs_get_u16(g_nvsHandle, "mqtt_port", &g_persistent.mqttPort);
-  if (ESP_OK != rv) {
-    rv = nvs_set_u16(g_nvsHandle, "mqtt_port", g_persistent.mqttPort);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to update MQTT port");
-    }
-  }
-
-  // MQTT client
-  length = sizeof(g_persistent.mqttClientid);
-  rv     = nvs_get_str(g_nvsHandle, "mqtt_cid", g_persistent.mqttClientid, &length);
-  if (rv != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to read 'MQTT clientid' will be set to default. ret=%d", rv);
-    rv = nvs_set_str(g_nvsHandle, "mqtt_cid", g_persistent.mqttClientid);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to save MQTT clientid");
-    }
-  }
-
-  // MQTT Link Username
-  length = sizeof(g_persistent.mqttUsername);
-  rv     = nvs_get_str(g_nvsHandle, "mqtt_user", g_persistent.mqttUsername, &length);
-  if (rv != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to read 'MQTT user' will be set to default. ret=%d", rv);
-    rv = nvs_set_str(g_nvsHandle, "mqtt_user", CONFIG_APP_DEFAULT_USER);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to save MQTT username");
-    }
-  }
-
-  // MQTT password
-  length = sizeof(g_persistent.mqttPassword);
-  rv     = nvs_get_str(g_nvsHandle, "mqtt_password", g_persistent.mqttPassword, &length);
-  if (rv != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to read 'MQTT password' will be set to default. ret=%d", rv);
-    nvs_set_str(g_nvsHandle, "mqtt_password", CONFIG_APP_DEFAULT_PASSWORD);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to save MQTT password");
-    }
-  }
-
-  // MQTT subscribe
-  length = sizeof(g_persistent.mqttSub);
-  rv     = nvs_get_str(g_nvsHandle, "mqtt_sub", g_persistent.mqttSub, &length);
-  if (rv != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to read 'MQTT sub' will be set to default. ret=%d", rv);
-    rv = nvs_set_str(g_nvsHandle, "mqtt_sub", g_persistent.mqttSub);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to save MQTT sub");
-    }
-  }
-
-  // MQTT publish
-  length = sizeof(g_persistent.mqttPub);
-  rv     = nvs_get_str(g_nvsHandle, "mqtt_pub", g_persistent.mqttPub, &length);
-  if (rv != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to read 'MQTT pub' will be set to default. ret=%d", rv);
-    rv = nvs_set_str(g_nvsHandle, "mqtt_pub", g_persistent.mqttPub);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to save MQTT pub");
-    }
-  }
-
-  // MQTT publish log
-  length = sizeof(g_persistent.mqttPubLog);
-  rv     = nvs_get_str(g_nvsHandle, "mqtt_pub_log", g_persistent.mqttPubLog, &length);
-  if (rv != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to read 'MQTT pub log' will be set to default. ret=%d", rv);
-    rv = nvs_set_str(g_nvsHandle, "mqtt_pub_log", g_persistent.mqttPubLog);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to save MQTT pub log");
-    }
-  }
-
-  // WEB server ----------------------------------------------------------------
-
-  // WEB enable
-  rv = nvs_get_u8(g_nvsHandle, "web_enable", &val);
-  if (rv != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to read 'web enable' will be set to default. ret=%d", rv);
-    val = (uint8_t) g_persistent.webEnable;
-    rv  = nvs_set_u8(g_nvsHandle, "web_enable", g_persistent.webEnable);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to save web enable");
-    }
-  }
-  else {
-    g_persistent.webEnable = (bool) val;
-  }
-
-  // WEB port
-  rv = nvs_get_u16(g_nvsHandle, "web_port", &g_persistent.webPort);
-  if (ESP_OK != rv) {
-    rv = nvs_set_u16(g_nvsHandle, "web_port", g_persistent.webPort);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to update Web server port");
-    }
-  }
-
-  // WEB Username
-  length = sizeof(g_persistent.webUsername);
-  rv     = nvs_get_str(g_nvsHandle, "web_user", g_persistent.webUsername, &length);
-  if (rv != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to read 'Web server user' will be set to default. ret=%d", rv);
-    rv = nvs_set_str(g_nvsHandle, "web_user", CONFIG_APP_DEFAULT_USER);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to save Web Server username");
-    }
-  }
-
-  // WEB password
-  length = sizeof(g_persistent.webPassword);
-  rv     = nvs_get_str(g_nvsHandle, "web_password", g_persistent.webPassword, &length);
-  if (rv != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to read 'Web server password' will be set to default. ret=%d", rv);
-    nvs_set_str(g_nvsHandle, "web_password", CONFIG_APP_DEFAULT_PASSWORD);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to save Web server password");
-    }
-  }
-
-  // espnow ----------------------------------------------------------------
-
-  // VSCP Link enable
-  rv = nvs_get_u8(g_nvsHandle, "drop_enable", &val);
-  if (rv != ESP_OK) {
-    ESP_LOGE(TAG, "Failed to read 'espnow enable' will be set to default. ret=%d", rv);
-    val = (uint8_t) g_persistent.espnowEnable;
-    rv  = nvs_set_u8(g_nvsHandle, "drop_enable", g_persistent.espnowEnable);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to save VSCP link enable");
-    }
-  }
-  else {
-    g_persistent.espnowEnable = (bool) val;
-  }
-
-  // Long Range
-  rv = nvs_get_u8(g_nvsHandle, "drop_lr", &val);
-  if (ESP_OK != rv) {
-    val = (uint8_t) g_persistent.espnowLongRange;
-    rv  = nvs_set_u8(g_nvsHandle, "drop_lr", g_persistent.espnowLongRange);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to update espnow long range");
-    }
-  }
-  else {
-    g_persistent.espnowLongRange = (bool) val;
-  }
-
-  // Channel
-  rv = nvs_get_u8(g_nvsHandle, "drop_ch", &g_persistent.espnowChannel);
-  if (ESP_OK != rv) {
-    rv = nvs_set_u8(g_nvsHandle, "drop_ch", g_persistent.espnowChannel);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to update espnow channel");
-    }
-  }
-
-  // Default queue size
-  rv = nvs_get_u8(g_nvsHandle, "drop_qsize", &g_persistent.espnowSizeQueue);
-  if (ESP_OK != rv) {
-    rv = nvs_set_u8(g_nvsHandle, "drop_qsize", g_persistent.espnowSizeQueue);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to update espnow queue size");
-    }
-  }
-
-  // Default ttl
-  rv = nvs_get_u8(g_nvsHandle, "drop_ttl", &g_persistent.espnowTtl);
-  if (ESP_OK != rv) {
-    rv = nvs_set_u8(g_nvsHandle, "drop_ttl", g_persistent.espnowTtl);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to update espnow ttl");
-    }
-  }
-
-  // Forward
-  rv = nvs_get_u8(g_nvsHandle, "drop_fw", &val);
-  if (ESP_OK != rv) {
-    val = (uint8_t) g_persistent.espnowForwardEnable;
-    rv  = nvs_set_u8(g_nvsHandle, "drop_fw", g_persistent.espnowForwardEnable);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to update espnow forward");
-    }
-  }
-  else {
-    g_persistent.espnowForwardEnable = (bool) val;
-  }
-
-  // Encryption
-  rv = nvs_get_u8(g_nvsHandle, "drop_enc", &g_persistent.espnowEncryption);
-  if (ESP_OK != rv) {
-    rv = nvs_set_u8(g_nvsHandle, "drop_enc", g_persistent.espnowEncryption);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to update espnow encryption");
-    }
-  }
-
-  // Adj filter channel
-  rv = nvs_get_u8(g_nvsHandle, "drop_filt", &val);
-  if (ESP_OK != rv) {
-    val = (uint8_t) g_persistent.espnowFilterAdjacentChannel;
-    rv  = nvs_set_u8(g_nvsHandle, "drop_filt", g_persistent.espnowFilterAdjacentChannel);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to update espnow adj channel filter");
-    }
-  }
-  else {
-    g_persistent.espnowFilterAdjacentChannel = (bool) val;
-  }
-
-  // Allow switching channel on forward
-  rv = nvs_get_u8(g_nvsHandle, "drop_swchf", &val);
-  if (ESP_OK != rv) {
-    val = (uint8_t) g_persistent.espnowForwardSwitchChannel;
-    rv  = nvs_set_u8(g_nvsHandle, "drop_swchf", g_persistent.espnowForwardSwitchChannel);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to update espnow shitch channel on forward");
-    }
-  }
-  else {
-    g_persistent.espnowFilterAdjacentChannel = (bool) val;
-  }
-
-  // RSSI limit
-  rv = nvs_get_i8(g_nvsHandle, "drop_rssi", &g_persistent.espnowFilterWeakSignal);
-  if (ESP_OK != rv) {
-    rv = nvs_set_u8(g_nvsHandle, "drop_rssi", g_persistent.espnowFilterWeakSignal);
-    if (rv != ESP_OK) {
-      ESP_LOGE(TAG, "Failed to update espnow RSSI");
-    }
-  }
-
   rv = nvs_commit(g_nvsHandle);
   if (rv != ESP_OK) {
-    ESP_LOGI(TAG, "Failed to commit updates to nvs\n");
+    ESP_LOGE(TAG, "Failed to commit boot counter");
   }
-
-  return ESP_OK;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1728,10 +1411,12 @@ app_main()
     ESP_LOGE(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(ret));
   }
   else {
-    // Read (or set to defaults) persistent values
-    readPersistentConfigs();
+    // Read persistent values (defaults for values not stored)
+    cfgstore_load();
   }
 
+  esp_log_level_set("*", ESP_LOG_INFO);
+
   s_wifi_event_group = xEventGroupCreate();
 
   memcpy((uint8_t *) espnow_config.pmk, g_persistent.pmk, 16);
@@ -1744,6 +1429,13 @@ app_main()
 
   espnow_init(&espnow_config);
 
+  ESP_LOGI(TAG, "esp-now ready %lld ms after boot", esp_timer_get_time() / 1000);
+
+  // Not needed to bring up the radio so done after it is up
+  if (g_nvsHandle) {
+    app_update_boot_counter();
+  }
+
   // Init web file system
   app_init_spiffs();
 
@@ -1802,8 +1494,7 @@ app_main()
       break;
 
     case ALPHA_LOG_VSCP:
-      // ESP_ERROR_CHECK(mqtt_logging_init( CONFIG_LOG_MQTT_SERVER_URL, CONFIG_LOG_MQTT_PUB_TOPIC,
-      // g_persistent.logwrite2Stdout ));
+      ESP_ERROR_CHECK(vscp_logging_init(g_persistent.logwrite2Stdout));
       break;
 
     case ALPHA_LOG_STD:
@@ -1875,6 +1566,36 @@ app_main()
   // Start heartbeat task vscp_heartbeat_task
   // xTaskCreate(&vscp_espnow_heartbeat_task, "vscp_hb", 1024 * 3, NULL, 1, NULL);
 
+  // Event bus connecting esp-now, link clients, MQTT and web
+  if (VSCP_ERROR_SUCCESS != eventbus_init()) {
+    ESP_LOGE(TAG, "Failed to initialize event bus");
+  }
+
+  if (VSCP_ERROR_SUCCESS != eventbus_subscribe("espnowbus",
+                                               EVENTBUS_TRANSPORT_ESPNOW,
+                                               0,
+                                               CONFIG_APP_EVENTBUS_QUEUE_SIZE,
+                                               app_eventbus_espnow_cb,
+                                               NULL,
+                                               NULL)) {
+    ESP_LOGE(TAG, "Failed to subscribe esp-now to event bus");
+  }
+
+  if (VSCP_ERROR_SUCCESS != mailbox_init()) {
+    ESP_LOGE(TAG, "Failed to initialize mailboxes");
+  }
+
+  if (VSCP_ERROR_SUCCESS != nodes_init()) {
+    ESP_LOGE(TAG, "Failed to initialize node table");
+  }
+
+  // Firmware images for the nodes
+  if (VSCP_ERROR_SUCCESS != imgcache_init()) {
+    ESP_LOGE(TAG, "Failed to initialize image cache");
+  }
+
+  vscp_espnow_set_vscp_user_handler_cb(app_espnow_event_cb);
+
   vscp_espnow_config_t vscp_espnow_conf;
 
   // Initialize VSCP espnow
@@ -1994,7 +1715,8 @@ app_main()
         pev->pdata[7]   = (time_us / 1000) & 0xff;        // Milliseconds (LSB)
         pev->timestamp  = esp_timer_get_time();
 
-        vscp_espnow_sendEvent(ESPNOW_ADDR_BROADCAST, pev, true, pdMS_TO_TICKS(1000));
+        // Broadcast to the cluster and to all other transports
+        eventbus_publish(pev, EVENTBUS_OBID(EVENTBUS_TRANSPORT_INTERNAL, 0));
 
         if (NULL != pev) {
           vscp_fwhlp_deleteEvent(&pev);
@@ -51,6 +51,7 @@
 #include "vscp-projdefs.h"
 
 #include "vscp-espnow.h"
+#include "eventbus.h"
 #include "tcpsrv.h"
 #include "alpha.h"
 
@@ -94,7 +95,7 @@ vscp_link_callback_welcome(const void *pdata)
   vscpctx_t *pctx = (vscpctx_t *) pdata;
 
   sprintf(pbuf, TCPSRV_WELCOME_MSG, g_persistent.nodeName);
-  send(pctx->sock, pbuf, strlen(pbuf), 0);
+  tcpsrv_write(pctx, pbuf, strlen(pbuf));
 
   ESP_FREE(pbuf);
   return VSCP_ERROR_SUCCESS;
@@ -112,7 +113,7 @@ vscp_link_callback_write_client(const void *pdata, const char *msg)
   }
 
   vscpctx_t *pctx = (vscpctx_t *) pdata;
-  send(pctx->sock, (uint8_t *) msg, strlen(msg), 0);
+  tcpsrv_write(pctx, msg, strlen(msg));
   return VSCP_ERROR_SUCCESS;
 }
 
@@ -131,7 +132,8 @@ vscp_link_callback_quit(const void *pdata)
   vscpctx_t *pctx = (vscpctx_t *) pdata;
 
   // Confirm quit
-  send(pctx->sock, VSCP_LINK_MSG_GOODBY, strlen(VSCP_LINK_MSG_GOODBY), 0);
+  tcpsrv_write(pctx, VSCP_LINK_MSG_GOODBY, strlen(VSCP_LINK_MSG_GOODBY));
+  tcpsrv_flush(pctx);
 
   // Disconnect from client
   close(pctx->sock);
@@ -154,7 +156,7 @@ vscp_link_callback_help(const void *pdata, const char *arg)
   }
 
   vscpctx_t *pctx = (vscpctx_t *) pdata;
-  send(pctx->sock, VSCP_LINK_MSG_OK, strlen(VSCP_LINK_MSG_OK), 0);
+  tcpsrv_write(pctx, VSCP_LINK_MSG_OK, strlen(VSCP_LINK_MSG_OK));
   return VSCP_ERROR_SUCCESS;
 }
 
@@ -217,7 +219,7 @@ vscp_link_callback_check_user(const void *pdata, const char *arg)
 
   vscpctx_t *pctx = (vscpctx_t *) pdata;
   strncpy(pctx->user, (char *) p, VSCP_LINK_MAX_USER_NAME_LENGTH);
-  send(pctx->sock, VSCP_LINK_MSG_USENAME_OK, strlen(VSCP_LINK_MSG_USENAME_OK), 0);
+  tcpsrv_write(pctx, VSCP_LINK_MSG_USENAME_OK, strlen(VSCP_LINK_MSG_USENAME_OK));
   return VSCP_ERROR_SUCCESS;
 }
 
@@ -236,7 +238,7 @@ vscp_link_callback_check_password(const void *pdata, const char *arg)
 
   // Must have a username before a password
   if (*(pctx->user) == '\0') {
-    send(pctx->sock, VSCP_LINK_MSG_NEED_USERNAME, strlen(VSCP_LINK_MSG_NEED_USERNAME), 0);
+    tcpsrv_write(pctx, VSCP_LINK_MSG_NEED_USERNAME, strlen(VSCP_LINK_MSG_NEED_USERNAME));
     return VSCP_ERROR_SUCCESS;
   }
 
@@ -263,11 +265,11 @@ vscp_link_callback_check_password(const void *pdata, const char *arg)
     pctx->user[0]    = '\0';
     pctx->bValidated = false;
     pctx->privLevel  = 0;
-    send(pctx->sock, VSCP_LINK_MSG_PASSWORD_ERROR, strlen(VSCP_LINK_MSG_PASSWORD_ERROR), 0);
+    tcpsrv_write(pctx, VSCP_LINK_MSG_PASSWORD_ERROR, strlen(VSCP_LINK_MSG_PASSWORD_ERROR));
     return VSCP_ERROR_SUCCESS;
   }
 
-  send(pctx->sock, VSCP_LINK_MSG_PASSWORD_OK, strlen(VSCP_LINK_MSG_PASSWORD_OK), 0);
+  tcpsrv_write(pctx, VSCP_LINK_MSG_PASSWORD_OK, strlen(VSCP_LINK_MSG_PASSWORD_OK));
   return VSCP_ERROR_SUCCESS;
 }
 
@@ -304,7 +306,7 @@ vscp_link_callback_challenge(const void *pdata, const char *arg)
   }
 
   strcat((char *) buf, "\r\n");
-  send(pctx->sock, buf, strlen((const char *) buf), 0);
+  tcpsrv_write(pctx, buf, strlen((const char *) buf));
   return VSCP_ERROR_SUCCESS;
 }
 
@@ -361,7 +363,7 @@ vscp_link_callback_test(const void *pdata, const char *arg)
 
   vscpctx_t *pctx = (vscpctx_t *) pdata;
 
-  send(pctx->sock, VSCP_LINK_MSG_OK, strlen(VSCP_LINK_MSG_OK), 0);
+  tcpsrv_write(pctx, VSCP_LINK_MSG_OK, strlen(VSCP_LINK_MSG_OK));
   return 0;
 }
 
@@ -379,7 +381,7 @@ vscp_link_callback_send(const void *pdata, vscpEvent *pev)
   vscpctx_t *pctx = (vscpctx_t *) pdata;
 
   // Filter
-  if (!vscp_fwhlp_doLevel2Filter(pev, &pctx->filter)) {
+  if (!tcpsrv_isEventAccepted(pctx, pev)) {
     return VSCP_ERROR_SUCCESS; // Filter out == OK
   }
 
@@ -387,15 +389,15 @@ vscp_link_callback_send(const void *pdata, vscpEvent *pev)
   pctx->statistics.cntTransmitFrames++;
   pctx->statistics.cntTransmitData += pev->sizeData;
 
-  // if obid is not set set to channel id
-  if (!pev->obid) {
-    pev->obid = pctx->id;
+  // Publish on the event bus (esp-now, MQTT, other link clients, ...)
+  int rv = eventbus_publish(pev, EVENTBUS_OBID(EVENTBUS_TRANSPORT_TCPSRV, pctx->id));
+  if (VSCP_ERROR_TRM_FULL == rv) {
+    pctx->statistics.cntOverruns++;
+  }
+  else if (VSCP_ERROR_SUCCESS != rv) {
+    ESP_LOGE(TAG, "Failed to publish event. rv = %d", rv);
+    return rv;
   }
-
-  // if (ESP_OK != (ret = droplet_sendEvent(DROPLET_ADDR_BROADCAST, pev, NULL, 100))) {
-  //   ESP_LOGE(TAG, "Failed to send event. rv = %d", ret);
-  //   return VSCP_ERROR_ERROR;
-  // }
 
   return VSCP_ERROR_SUCCESS;
 }
@@ -430,14 +432,20 @@ vscp_link_callback_retr(const void *pdata, vscpEvent **pev)
   }
 
   vscpctx_t *pctx = (vscpctx_t *) pdata;
+  tcpsrv_qitem_t item;
 
   if (pdTRUE == xSemaphoreTake(pctx->mutexQueue, 10 / portTICK_PERIOD_MS)) {
-    if (pdTRUE != xQueueReceive(pctx->queueClient, pev, 0)) {
+    if (pdTRUE != xQueueReceive(pctx->queueClient, &item, 0)) {
       xSemaphoreGive(pctx->mutexQueue);
       return VSCP_ERROR_RCV_EMPTY; // Yes receive
     }
     xSemaphoreGive(pctx->mutexQueue);
   }
+  else {
+    return VSCP_ERROR_RCV_EMPTY;
+  }
+
+  *pev = item.pev;
 
   // Update receive statistics
   pctx->statistics.cntReceiveFrames++;
@@ -498,11 +506,11 @@ vscp_link_callback_clrAll(const void *pdata)
 
   vscpctx_t *pctx = (vscpctx_t *) pdata;
 
-  vscpEvent *pev;
+  tcpsrv_qitem_t item;
   if (pdTRUE == xSemaphoreTake(pctx->mutexQueue, 10 / portTICK_PERIOD_MS)) {
 
-    while (pdTRUE == xQueueReceive(pctx->queueClient, &(pev), 0)) {
-      vscp_fwhlp_deleteEvent(&pev);
+    while (pdTRUE == xQueueReceive(pctx->queueClient, &item, 0)) {
+      vscp_fwhlp_deleteEvent(&item.pev);
     }
     xSemaphoreGive(pctx->mutexQueue);
   }
@@ -601,7 +609,7 @@ vscp_link_callback_setFilter(const void *pdata, vscpEventFilter *pfilter)
   pctx->filter.filter_priority = pfilter->filter_priority;
   memcpy(pctx->filter.filter_GUID, pfilter->filter_GUID, 16);
 
-  return VSCP_ERROR_SUCCESS;
+  return tcpsrv_compileFilter(pctx);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -622,7 +630,7 @@ vscp_link_callback_setMask(const void *pdata, vscpEventFilter *pfilter)
   pctx->filter.mask_priority = pfilter->mask_priority;
   memcpy(pctx->filter.mask_GUID, pfilter->mask_GUID, 16);
 
-  return VSCP_ERROR_SUCCESS;
+  return tcpsrv_compileFilter(pctx);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -681,8 +689,9 @@ vscp_link_callback_rcvloop(const void *pdata, vscpEvent **pev)
     return VSCP_ERROR_TIMEOUT;
   }
 
+  tcpsrv_qitem_t item;
   if (pdTRUE == xSemaphoreTake(pctx->mutexQueue, 0)) {
-    if (pdTRUE != xQueueReceive(pctx->queueClient, pev, 0)) {
+    if (pdTRUE != xQueueReceive(pctx->queueClient, &item, 0)) {
       xSemaphoreGive(pctx->mutexQueue);
       return VSCP_ERROR_RCV_EMPTY;
     }
@@ -692,7 +701,7 @@ vscp_link_callback_rcvloop(const void *pdata, vscpEvent **pev)
     return VSCP_ERROR_TIMEOUT;
   }
 
-  xSemaphoreGive(pctx->mutexQueue);
+  *pev = item.pev;
 
   // Update receive statistics
   pctx->statistics.cntReceiveFrames++;
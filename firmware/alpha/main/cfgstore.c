@@ -0,0 +1,605 @@
+/*
+  File: cfgstore.c
+
+  VSCP alpha node persistent configuration store
+
+  This file is part of the VSCP (https://www.vscp.org)
+
+  The MIT License (MIT)
+  Copyright © 2022-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stddef.h>
+#include <string.h>
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_crc.h>
+#include <nvs_flash.h>
+
+#include <vscp.h>
+#include <vscp-firmware-helper.h>
+
+#include "alpha.h"
+#include "cfgstore.h"
+
+static const char *TAG = "cfgstore";
+
+extern nvs_handle_t g_nvsHandle;
+extern node_persistent_config_t g_persistent;
+
+// Value types
+typedef enum {
+  CFGSTORE_TYPE_UINT = 0, // Unsigned integer (and bool)
+  CFGSTORE_TYPE_INT,      // Signed integer
+  CFGSTORE_TYPE_STR,      // Zero terminated string
+  CFGSTORE_TYPE_BLOB      // Binary data (keys)
+} cfgstore_type_t;
+
+/*
+  Blob header. Followed by 'length' bytes of records
+  { id (1 byte), length (1 byte), data } that the CRC is
+  calculated over. Integers are stored little endian.
+*/
+typedef struct {
+  uint32_t magic;   // CFGSTORE_MAGIC
+  uint16_t version; // CFGSTORE_VERSION of the firmware that wrote it
+  uint16_t count;   // Number of records
+  uint32_t length;  // Length of records
+  uint32_t crc;     // CRC32 of records
+} cfgstore_header_t;
+
+// Description of a stored value
+typedef struct {
+  uint8_t id;            // Record id. Never reuse an id.
+  uint8_t type;          // cfgstore_type_t
+  uint16_t offset;       // Offset in node_persistent_config_t
+  uint16_t size;         // Size in node_persistent_config_t
+  const char *legacyKey; // NVS key used by older firmware (NULL if none)
+} cfgstore_field_t;
+
+#define CFGSTORE_FIELD(id, type, member, legacyKey)                                                                   \
+  { id,                                                                                                               \
+    type,                                                                                                             \
+    offsetof(node_persistent_config_t, member),                                                                       \
+    sizeof(((node_persistent_config_t *) 0)->member),                                                                 \
+    legacyKey }
+
+/*
+  bootCnt keeps its own key as it is written on every boot. Large values
+  (certificates) are stored with cfgstore_save_text() and only their
+  length is kept here.
+*/
+/* clang-format off */
+static const cfgstore_field_t s_fields[] = {
+
+  // Module
+  CFGSTORE_FIELD(1,  CFGSTORE_TYPE_STR,  nodeName,                    "node_name"),
+  CFGSTORE_FIELD(2,  CFGSTORE_TYPE_BLOB, pmk,                         "pmk"),
+  CFGSTORE_FIELD(3,  CFGSTORE_TYPE_BLOB, lmk,                         NULL),
+  CFGSTORE_FIELD(4,  CFGSTORE_TYPE_UINT, queueSize,                   "queue_size"),
+  CFGSTORE_FIELD(5,  CFGSTORE_TYPE_UINT, startDelay,                  "start_delay"),
+
+  // Logging
+  CFGSTORE_FIELD(10, CFGSTORE_TYPE_UINT, logwrite2Stdout,             "log_stdout"),
+  CFGSTORE_FIELD(11, CFGSTORE_TYPE_UINT, logLevel,                    "log_level"),
+  CFGSTORE_FIELD(12, CFGSTORE_TYPE_UINT, logType,                     "log_type"),
+  CFGSTORE_FIELD(13, CFGSTORE_TYPE_UINT, logRetries,                  "log_retries"),
+  CFGSTORE_FIELD(14, CFGSTORE_TYPE_STR,  logUrl,                      "log_url"),
+  CFGSTORE_FIELD(15, CFGSTORE_TYPE_UINT, logPort,                     "log_port"),
+  CFGSTORE_FIELD(16, CFGSTORE_TYPE_STR,  logMqttTopic,                "log_mqtt_topic"),
+
+  // VSCP Link
+  CFGSTORE_FIELD(20, CFGSTORE_TYPE_UINT, vscplinkEnable,              "vscp_enable"),
+  CFGSTORE_FIELD(21, CFGSTORE_TYPE_STR,  vscplinkUrl,                 "vscp_url"),
+  CFGSTORE_FIELD(22, CFGSTORE_TYPE_UINT, vscplinkPort,                "vscp_port"),
+  CFGSTORE_FIELD(23, CFGSTORE_TYPE_STR,  vscplinkUsername,            "vscp_user"),
+  CFGSTORE_FIELD(24, CFGSTORE_TYPE_STR,  vscplinkPassword,            "vscp_password"),
+  CFGSTORE_FIELD(25, CFGSTORE_TYPE_BLOB, vscpLinkKey,                 "vscp_key"),
+
+  // ESP-NOW
+  CFGSTORE_FIELD(30, CFGSTORE_TYPE_UINT, espnowEnable,                "drop_enable"),
+  CFGSTORE_FIELD(31, CFGSTORE_TYPE_UINT, espnowLongRange,             "drop_lr"),
+  CFGSTORE_FIELD(32, CFGSTORE_TYPE_UINT, espnowSizeQueue,             "drop_qsize"),
+  CFGSTORE_FIELD(33, CFGSTORE_TYPE_UINT, espnowChannel,               "drop_ch"),
+  CFGSTORE_FIELD(34, CFGSTORE_TYPE_UINT, espnowTtl,                   "drop_ttl"),
+  CFGSTORE_FIELD(35, CFGSTORE_TYPE_UINT, espnowForwardEnable,         "drop_fw"),
+  CFGSTORE_FIELD(36, CFGSTORE_TYPE_UINT, espnowEncryption,            "drop_enc"),
+  CFGSTORE_FIELD(37, CFGSTORE_TYPE_UINT, espnowFilterAdjacentChannel, "drop_filt"),
+  CFGSTORE_FIELD(38, CFGSTORE_TYPE_UINT, espnowForwardSwitchChannel,  "drop_swchf"),
+  CFGSTORE_FIELD(39, CFGSTORE_TYPE_INT,  espnowFilterWeakSignal,      "drop_rssi"),
+
+  // Web server
+  CFGSTORE_FIELD(40, CFGSTORE_TYPE_UINT, webEnable,                   "web_enable"),
+  CFGSTORE_FIELD(41, CFGSTORE_TYPE_UINT, webPort,                     "web_port"),
+  CFGSTORE_FIELD(42, CFGSTORE_TYPE_STR,  webUsername,                 "web_user"),
+  CFGSTORE_FIELD(43, CFGSTORE_TYPE_STR,  webPassword,                 "web_password"),
+
+  // MQTT
+  CFGSTORE_FIELD(50, CFGSTORE_TYPE_UINT, mqttEnable,                  "mqtt_enable"),
+  CFGSTORE_FIELD(51, CFGSTORE_TYPE_STR,  mqttUrl,                     "mqtt_url"),
+  CFGSTORE_FIELD(52, CFGSTORE_TYPE_UINT, mqttPort,                    "mqtt_port"),
+  CFGSTORE_FIELD(53, CFGSTORE_TYPE_STR,  mqttClientid,                "mqtt_cid"),
+  CFGSTORE_FIELD(54, CFGSTORE_TYPE_STR,  mqttUsername,                "mqtt_user"),
+  CFGSTORE_FIELD(55, CFGSTORE_TYPE_STR,  mqttPassword,                "mqtt_password"),
+  CFGSTORE_FIELD(56, CFGSTORE_TYPE_INT,  mqttQos,                     NULL),
+  CFGSTORE_FIELD(57, CFGSTORE_TYPE_INT,  mqttRetain,                  NULL),
+  CFGSTORE_FIELD(58, CFGSTORE_TYPE_STR,  mqttSub,                     "mqtt_sub"),
+  CFGSTORE_FIELD(59, CFGSTORE_TYPE_STR,  mqttPub,                     "mqtt_pub"),
+  CFGSTORE_FIELD(60, CFGSTORE_TYPE_UINT, mqttFormat,                  "mqtt_format"),
+  CFGSTORE_FIELD(61, CFGSTORE_TYPE_STR,  mqttPubLog,                  "mqtt_pub_log"),
+  CFGSTORE_FIELD(62, CFGSTORE_TYPE_STR,  mqttLwTopic,                 NULL),
+  CFGSTORE_FIELD(63, CFGSTORE_TYPE_STR,  mqttLwMessage,               NULL),
+  CFGSTORE_FIELD(64, CFGSTORE_TYPE_UINT, mqttLwQos,                   NULL),
+  CFGSTORE_FIELD(65, CFGSTORE_TYPE_UINT, mqttLwRetain,                NULL),
+  CFGSTORE_FIELD(66, CFGSTORE_TYPE_UINT, mqttVerificationLen,         NULL),
+};
+/* clang-format on */
+
+#define CFGSTORE_FIELD_COUNT (sizeof(s_fields) / sizeof(s_fields[0]))
+
+///////////////////////////////////////////////////////////////////////////////
+// cfgstore_findField
+//
+
+static const cfgstore_field_t *
+cfgstore_findField(uint8_t id)
+{
+  for (int i = 0; i < CFGSTORE_FIELD_COUNT; i++) {
+    if (s_fields[i].id == id) {
+      return &s_fields[i];
+    }
+  }
+
+  return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// cfgstore_maxSize
+//
+// Largest possible size of a blob written by this firmware
+//
+
+static size_t
+cfgstore_maxSize(void)
+{
+  size_t size = sizeof(cfgstore_header_t);
+
+  for (int i = 0; i < CFGSTORE_FIELD_COUNT; i++) {
+    size += 2 + ((s_fields[i].size > 255) ? 255 : s_fields[i].size);
+  }
+
+  return size;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// cfgstore_setInteger
+//
+// Store an integer in a field of any size. Values that does not fit are
+// clamped. This is what lets an integer grow or shrink between versions.
+//
+
+static void
+cfgstore_setInteger(const cfgstore_field_t *pfield, int64_t val)
+{
+  uint8_t *p   = (uint8_t *) &g_persistent + pfield->offset;
+  int bits     = 8 * ((pfield->size > 4) ? 4 : pfield->size);
+  int64_t vmax = (CFGSTORE_TYPE_INT == pfield->type) ? ((1LL << (bits - 1)) - 1) : ((1LL << bits) - 1);
+  int64_t vmin = (CFGSTORE_TYPE_INT == pfield->type) ? -(1LL << (bits - 1)) : 0;
+
+  if (val > vmax) {
+    val = vmax;
+  }
+  else if (val < vmin) {
+    val = vmin;
+  }
+
+  for (int i = 0; i < pfield->size; i++) {
+    p[i] = (uint8_t) (val >> (8 * i));
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// cfgstore_applyRecord
+//
+// Apply one stored record to g_persistent
+//
+
+static void
+cfgstore_applyRecord(const cfgstore_field_t *pfield, const uint8_t *pdata, uint8_t len)
+{
+  uint8_t *p = (uint8_t *) &g_persistent + pfield->offset;
+
+  switch (pfield->type) {
+
+    case CFGSTORE_TYPE_UINT:
+    case CFGSTORE_TYPE_INT: {
+      int64_t val = 0;
+      if (!len || (len > 8)) {
+        return;
+      }
+      for (int i = len - 1; i >= 0; i--) {
+        val = (val << 8) | pdata[i];
+      }
+      // Sign extend
+      if ((CFGSTORE_TYPE_INT == pfield->type) && (len < 8) && (pdata[len - 1] & 0x80)) {
+        val -= (1LL << (8 * len));
+      }
+      cfgstore_setInteger(pfield, val);
+    } break;
+
+    case CFGSTORE_TYPE_STR:
+      if (len >= pfield->size) {
+        len = pfield->size - 1;
+      }
+      memcpy(p, pdata, len);
+      p[len] = '\0';
+      break;
+
+    case CFGSTORE_TYPE_BLOB:
+      memset(p, 0, pfield->size);
+      memcpy(p, pdata, (len > pfield->size) ? pfield->size : len);
+      break;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// cfgstore_migrate
+//
+// Called when the blob was written by firmware with an older layout version.
+// Values are already applied by id so only changes in the meaning of a value
+// need to be handled here, one version step at a time.
+//
+
+static void
+cfgstore_migrate(uint16_t version)
+{
+  ESP_LOGI(TAG, "Migrating configuration from version %d to %d", version, CFGSTORE_VERSION);
+
+  switch (version) {
+    // case 1: Convert values from version 1 to version 2 here and fall through.
+    default:
+      break;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// cfgstore_importLegacy
+//
+// Import configuration stored by older firmware one key per value. Returns
+// the number of values found.
+//
+
+static int
+cfgstore_importLegacy(void)
+{
+  esp_err_t rv;
+  int cnt = 0;
+
+  for (int i = 0; i < CFGSTORE_FIELD_COUNT; i++) {
+
+    const cfgstore_field_t *pfield = &s_fields[i];
+    uint8_t *p                     = (uint8_t *) &g_persistent + pfield->offset;
+    size_t length                  = pfield->size;
+
+    if (NULL == pfield->legacyKey) {
+      continue;
+    }
+
+    switch (pfield->type) {
+
+      case CFGSTORE_TYPE_UINT:
+        if (sizeof(uint16_t) == pfield->size) {
+          uint16_t val16;
+          if (ESP_OK == (rv = nvs_get_u16(g_nvsHandle, pfield->legacyKey, &val16))) {
+            cfgstore_setInteger(pfield, val16);
+          }
+        }
+        else {
+          uint8_t val8;
+          if (ESP_OK == (rv = nvs_get_u8(g_nvsHandle, pfield->legacyKey, &val8))) {
+            cfgstore_setInteger(pfield, val8);
+          }
+        }
+        break;
+
+      case CFGSTORE_TYPE_INT: {
+        int8_t val8;
+        rv = nvs_get_i8(g_nvsHandle, pfield->legacyKey, &val8);
+        if (ESP_ERR_NVS_NOT_FOUND == rv) {
+          // Some older firmware wrote signed values as unsigned
+          rv = nvs_get_u8(g_nvsHandle, pfield->legacyKey, (uint8_t *) &val8);
+        }
+        if (ESP_OK == rv) {
+          cfgstore_setInteger(pfield, val8);
+        }
+      } break;
+
+      case CFGSTORE_TYPE_STR:
+        rv = nvs_get_str(g_nvsHandle, pfield->legacyKey, (char *) p, &length);
+        break;
+
+      case CFGSTORE_TYPE_BLOB:
+        rv = nvs_get_blob(g_nvsHandle, pfield->legacyKey, p, &length);
+        break;
+
+      default:
+        rv = ESP_ERR_INVALID_ARG;
+        break;
+    }
+
+    if (ESP_OK == rv) {
+      cnt++;
+    }
+  }
+
+  if (cnt) {
+    for (int i = 0; i < CFGSTORE_FIELD_COUNT; i++) {
+      if (NULL != s_fields[i].legacyKey) {
+        nvs_erase_key(g_nvsHandle, s_fields[i].legacyKey);
+      }
+    }
+    // Written by mistake by some older firmware
+    nvs_erase_key(g_nvsHandle, "log:retries");
+  }
+
+  return cnt;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// cfgstore_load
+//
+
+int
+cfgstore_load(void)
+{
+  esp_err_t ret;
+  int rv = VSCP_ERROR_SUCCESS;
+  uint8_t *pblob;
+  const uint8_t *p;
+  const uint8_t *pend;
+  cfgstore_header_t hdr;
+  size_t length;
+  int64_t start = esp_timer_get_time();
+
+  // Default keys
+  vscp_fwhlp_hex2bin(g_persistent.pmk, sizeof(g_persistent.pmk), VSCP_DEFAULT_KEY16);
+  vscp_fwhlp_hex2bin(g_persistent.vscpLinkKey, 16, VSCP_DEFAULT_KEY16);
+
+  length = cfgstore_maxSize();
+  pblob  = ESP_MALLOC(length);
+  if (NULL == pblob) {
+    return VSCP_ERROR_MEMORY;
+  }
+
+  ret = nvs_get_blob(g_nvsHandle, CFGSTORE_NVS_KEY, pblob, &length);
+  if (ESP_ERR_NVS_INVALID_LENGTH == ret) {
+    // Written by newer firmware with more values. length is now the size needed.
+    ESP_FREE(pblob);
+    if (NULL == (pblob = ESP_MALLOC(length))) {
+      return VSCP_ERROR_MEMORY;
+    }
+    ret = nvs_get_blob(g_nvsHandle, CFGSTORE_NVS_KEY, pblob, &length);
+  }
+
+  if (ESP_ERR_NVS_NOT_FOUND == ret) {
+    int cnt;
+    ESP_FREE(pblob);
+    cnt = cfgstore_importLegacy();
+    rv  = cfgstore_save();
+    ESP_LOGI(TAG,
+             "No configuration blob. %d value(s) imported from older firmware in %lld us.",
+             cnt,
+             esp_timer_get_time() - start);
+    return rv;
+  }
+
+  if (ESP_OK != ret) {
+    ESP_LOGE(TAG, "Failed to read configuration (%s). Using defaults.", esp_err_to_name(ret));
+    ESP_FREE(pblob);
+    return VSCP_ERROR_ERROR;
+  }
+
+  memcpy(&hdr, pblob, (length < sizeof(hdr)) ? length : sizeof(hdr));
+  if ((length < sizeof(hdr)) || (CFGSTORE_MAGIC != hdr.magic) || (hdr.length != (length - sizeof(hdr))) ||
+      (hdr.crc != esp_crc32_le(0, pblob + sizeof(hdr), hdr.length))) {
+    ESP_LOGE(TAG, "Configuration is corrupt. Using defaults.");
+    ESP_FREE(pblob);
+    return VSCP_ERROR_INVALID_FRAME;
+  }
+
+  p    = pblob + sizeof(hdr);
+  pend = p + hdr.length;
+  while ((p + 2) <= pend) {
+    const cfgstore_field_t *pfield;
+    uint8_t id  = p[0];
+    uint8_t len = p[1];
+    p += 2;
+    if ((p + len) > pend) {
+      break;
+    }
+    // Values unknown to this firmware are skipped
+    if (NULL != (pfield = cfgstore_findField(id))) {
+      cfgstore_applyRecord(pfield, p, len);
+    }
+    p += len;
+  }
+
+  ESP_FREE(pblob);
+
+  if (hdr.version < CFGSTORE_VERSION) {
+    cfgstore_migrate(hdr.version);
+    rv = cfgstore_save();
+  }
+
+  ESP_LOGI(TAG,
+           "Configuration version %d loaded (%d values, %d bytes) in %lld us",
+           hdr.version,
+           hdr.count,
+           (int) length,
+           esp_timer_get_time() - start);
+
+  return rv;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// cfgstore_save
+//
+
+int
+cfgstore_save(void)
+{
+  esp_err_t ret;
+  uint8_t *pblob;
+  uint8_t *p;
+  cfgstore_header_t hdr;
+
+  pblob = ESP_MALLOC(cfgstore_maxSize());
+  if (NULL == pblob) {
+    return VSCP_ERROR_MEMORY;
+  }
+
+  p = pblob + sizeof(hdr);
+  for (int i = 0; i < CFGSTORE_FIELD_COUNT; i++) {
+
+    const cfgstore_field_t *pfield = &s_fields[i];
+    const uint8_t *pval            = (const uint8_t *) &g_persistent + pfield->offset;
+    size_t len                     = pfield->size;
+
+    // Strings are stored without terminator and padding
+    if (CFGSTORE_TYPE_STR == pfield->type) {
+      len = strnlen((const char *) pval, pfield->size - 1);
+    }
+
+    if (len > 255) {
+      len = 255;
+    }
+
+    *p++ = pfield->id;
+    *p++ = (uint8_t) len;
+    memcpy(p, pval, len);
+    p += len;
+  }
+
+  hdr.magic   = CFGSTORE_MAGIC;
+  hdr.version = CFGSTORE_VERSION;
+  hdr.count   = CFGSTORE_FIELD_COUNT;
+  hdr.length  = (p - pblob) - sizeof(hdr);
+  hdr.crc     = esp_crc32_le(0, pblob + sizeof(hdr), hdr.length);
+  memcpy(pblob, &hdr, sizeof(hdr));
+
+  ret = nvs_set_blob(g_nvsHandle, CFGSTORE_NVS_KEY, pblob, p - pblob);
+  ESP_FREE(pblob);
+  if (ESP_OK != ret) {
+    ESP_LOGE(TAG, "Failed to write configuration (%s)", esp_err_to_name(ret));
+    return VSCP_ERROR_ERROR;
+  }
+
+  if (ESP_OK != (ret = nvs_commit(g_nvsHandle))) {
+    ESP_LOGE(TAG, "Failed to commit configuration (%s)", esp_err_to_name(ret));
+    return VSCP_ERROR_ERROR;
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// cfgstore_load_text
+//
+
+char *
+cfgstore_load_text(const char *key, size_t maxlen)
+{
+  esp_err_t ret;
+  char *ptext;
+  size_t length = 0;
+
+  // Check pointer
+  if (NULL == key) {
+    return NULL;
+  }
+
+  // Size only, nothing is read
+  ret = nvs_get_blob(g_nvsHandle, key, NULL, &length);
+  if ((ESP_OK != ret) || !length || (length > maxlen)) {
+    if ((ESP_OK == ret) && (length > maxlen)) {
+      ESP_LOGE(TAG, "Stored %s is too large (%d bytes)", key, (int) length);
+    }
+    return NULL;
+  }
+
+  ptext = ESP_MALLOC(length + 1);
+  if (NULL == ptext) {
+    return NULL;
+  }
+
+  ret = nvs_get_blob(g_nvsHandle, key, ptext, &length);
+  if (ESP_OK != ret) {
+    ESP_LOGE(TAG, "Failed to read %s (%s)", key, esp_err_to_name(ret));
+    ESP_FREE(ptext);
+    return NULL;
+  }
+
+  ptext[length] = '\0';
+  return ptext;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// cfgstore_save_text
+//
+
+int
+cfgstore_save_text(const char *key, const char *text, size_t maxlen)
+{
+  esp_err_t ret;
+  size_t length;
+
+  // Check pointer
+  if (NULL == key) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  length = (NULL == text) ? 0 : strlen(text);
+  if (length > maxlen) {
+    return VSCP_ERROR_BUFFER_TO_SMALL;
+  }
+
+  if (length) {
+    ret = nvs_set_blob(g_nvsHandle, key, text, length);
+  }
+  else {
+    ret = nvs_erase_key(g_nvsHandle, key);
+    if (ESP_ERR_NVS_NOT_FOUND == ret) {
+      ret = ESP_OK;
+    }
+  }
+
+  if (ESP_OK == ret) {
+    ret = nvs_commit(g_nvsHandle);
+  }
+
+  if (ESP_OK != ret) {
+    ESP_LOGE(TAG, "Failed to write %s (%s)", key, esp_err_to_name(ret));
+    return VSCP_ERROR_ERROR;
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
@@ -0,0 +1,110 @@
+/*
+  File: cfgstore.h
+
+  VSCP alpha node persistent configuration store
+
+  This file is part of the VSCP (https://www.vscp.org)
+
+  The MIT License (MIT)
+  Copyright © 2022-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  The persistent configuration (node_persistent_config_t) is stored in NVS
+  as one blob. The blob starts with a header holding a magic, the layout
+  version, the length and a CRC32 of the records that follows. Each value is
+  a record of id, length and data, so values can be added, removed, grown
+  or shrunk between firmware versions without losing the rest of the
+  configuration. Ids are never reused.
+
+  Large values such as certificates are not part of node_persistent_config_t.
+  They are stored under keys of their own and are only read into RAM when
+  they are needed. The configuration just holds their length.
+
+  Older firmware stored every value under a key of its own. These keys are
+  imported, and then erased, the first time a node boots without a blob.
+*/
+
+#ifndef __VSCP_ALPHA_CFGSTORE__
+#define __VSCP_ALPHA_CFGSTORE__
+
+#include <stddef.h>
+
+// NVS key for the configuration blob (in the "config" namespace)
+#define CFGSTORE_NVS_KEY "cfg"
+
+// Magic for the blob header ("ACFG")
+#define CFGSTORE_MAGIC 0x47464341
+
+// NVS key for the MQTT server certificate (PEM)
+#define CFGSTORE_KEY_MQTT_CA "mqtt_ca"
+
+// Current layout version. Bump when the meaning of a stored value changes.
+#define CFGSTORE_VERSION 1
+
+/**
+ * @brief Load the persistent configuration
+ *
+ * Reads the configuration blob in one go and applies all values found in
+ * it to g_persistent. Values not in the blob keep their defaults. A blob
+ * from an older layout version is migrated and written back. If there is
+ * no blob the configuration of older firmware is imported from the
+ * individual keys and stored as a blob.
+ *
+ * g_nvsHandle must be open when this is called.
+ *
+ * @return VSCP_ERROR_SUCCESS on success, VSCP_ERROR_INVALID_FRAME if the blob
+ *         was corrupt and defaults are used, error code otherwise.
+ */
+int
+cfgstore_load(void);
+
+/**
+ * @brief Save the persistent configuration
+ *
+ * Writes all values in g_persistent as one blob and commits it.
+ *
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+cfgstore_save(void);
+
+/**
+ * @brief Load a large text value from flash
+ *
+ * @param key NVS key the text is stored under (CFGSTORE_KEY_xxx)
+ * @param maxlen Max length of text accepted
+ * @return Pointer to zero terminated text that must be freed with ESP_FREE,
+ *         or NULL if there is no text stored or it could not be read.
+ */
+char *
+cfgstore_load_text(const char *key, size_t maxlen);
+
+/**
+ * @brief Store a large text value in flash
+ *
+ * @param key NVS key to store the text under (CFGSTORE_KEY_xxx)
+ * @param text Zero terminated text. NULL or empty removes the stored text.
+ * @param maxlen Max length of text accepted
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+cfgstore_save_text(const char *key, const char *text, size_t maxlen);
+
+#endif
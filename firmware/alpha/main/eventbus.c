@@ -0,0 +1,349 @@
+/*
+  File: eventbus.c
+
+  VSCP alpha node event bus
+
+  This file is part of the VSCP (https://www.vscp.org)
+
+  The MIT License (MIT)
+  Copyright © 2022-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <freertos/FreeRTOS.h>
+#include "freertos/semphr.h"
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include "esp_log.h"
+#include <esp_timer.h>
+
+#include <string.h>
+
+#include "alpha.h"
+#include <vscp.h>
+#include <vscp-firmware-helper.h>
+
+#include "eventbus.h"
+
+static const char *TAG = "eventbus";
+
+/*
+  An event on the bus. The event is copied once on publish and the copy
+  is shared between all queued subscribers. The last one to release it
+  frees it.
+*/
+typedef struct {
+  vscpEvent *pev;  // Shared event copy
+  uint32_t refcnt; // Number of holders
+} eventbus_msg_t;
+
+typedef struct {
+  const char *name;                // Subscriber name
+  eventbus_transport_t transport;  // Transport subscriber belongs to
+  uint8_t flags;                   // EVENTBUS_FLAG_xxx
+  QueueHandle_t queue;             // eventbus_msg_t pointers (NULL for direct delivery)
+  eventbus_deliver_cb_t cb;        // Delivery callback
+  void *userdata;                  // User data for callback
+  volatile int64_t tsHoldOff;      // No delivery until this time (us)
+  eventbus_stats_t stats;          // Statistics
+} eventbus_subscriber_t;
+
+static eventbus_subscriber_t s_subscribers[EVENTBUS_MAX_SUBSCRIBERS];
+static volatile int s_cntSubscribers       = 0;
+static SemaphoreHandle_t s_mutexSubscribe = NULL;
+
+///////////////////////////////////////////////////////////////////////////////
+// eventbus_release
+//
+// Drop one reference to a bus message and free it when the last
+// holder is done with it.
+//
+
+static void
+eventbus_release(eventbus_msg_t *pmsg)
+{
+  if (0 == __atomic_sub_fetch(&pmsg->refcnt, 1, __ATOMIC_ACQ_REL)) {
+    vscp_fwhlp_deleteEvent(&pmsg->pev);
+    ESP_FREE(pmsg);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// eventbus_worker_task
+//
+// Deliver queued events to one subscriber.
+//
+
+static void
+eventbus_worker_task(void *pvParameters)
+{
+  eventbus_subscriber_t *psub = (eventbus_subscriber_t *) pvParameters;
+  eventbus_msg_t *pmsg;
+
+  for (;;) {
+    if (pdTRUE != xQueueReceive(psub->queue, &pmsg, portMAX_DELAY)) {
+      continue;
+    }
+
+    if (VSCP_ERROR_SUCCESS == psub->cb(pmsg->pev, psub->userdata)) {
+      psub->stats.nDelivered++;
+    }
+    else {
+      psub->stats.nFailed++;
+    }
+
+    eventbus_release(pmsg);
+  }
+
+  vTaskDelete(NULL);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// eventbus_init
+//
+
+int
+eventbus_init(void)
+{
+  if (NULL != s_mutexSubscribe) {
+    return VSCP_ERROR_SUCCESS;
+  }
+
+  memset(s_subscribers, 0, sizeof(s_subscribers));
+  s_cntSubscribers = 0;
+
+  s_mutexSubscribe = xSemaphoreCreateMutex();
+  if (NULL == s_mutexSubscribe) {
+    ESP_LOGE(TAG, "Unable to create subscriber mutex");
+    return VSCP_ERROR_MEMORY;
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// eventbus_subscribe
+//
+
+int
+eventbus_subscribe(const char *name,
+                   eventbus_transport_t transport,
+                   uint8_t flags,
+                   uint16_t queueSize,
+                   eventbus_deliver_cb_t cb,
+                   void *userdata,
+                   int *phandle)
+{
+  int rv = VSCP_ERROR_SUCCESS;
+  eventbus_subscriber_t *psub;
+
+  // Check pointers
+  if ((NULL == name) || (NULL == cb)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if (transport >= EVENTBUS_TRANSPORT_COUNT) {
+    return VSCP_ERROR_PARAMETER;
+  }
+
+  if (NULL == s_mutexSubscribe) {
+    return VSCP_ERROR_INIT_MISSING;
+  }
+
+  xSemaphoreTake(s_mutexSubscribe, portMAX_DELAY);
+
+  if (s_cntSubscribers >= EVENTBUS_MAX_SUBSCRIBERS) {
+    ESP_LOGE(TAG, "No room for subscriber %s", name);
+    rv = VSCP_ERROR_BUFFER_FULL;
+    goto EXIT;
+  }
+
+  psub            = &s_subscribers[s_cntSubscribers];
+  psub->name      = name;
+  psub->transport = transport;
+  psub->flags     = flags;
+  psub->cb        = cb;
+  psub->userdata  = userdata;
+  psub->queue     = NULL;
+  psub->tsHoldOff = 0;
+  memset(&psub->stats, 0, sizeof(eventbus_stats_t));
+
+  if (queueSize) {
+    psub->queue = xQueueCreate(queueSize, sizeof(eventbus_msg_t *));
+    if (NULL == psub->queue) {
+      ESP_LOGE(TAG, "Unable to create queue for subscriber %s", name);
+      rv = VSCP_ERROR_MEMORY;
+      goto EXIT;
+    }
+
+    if (pdPASS != xTaskCreate(eventbus_worker_task, name, 4096, psub, 5, NULL)) {
+      ESP_LOGE(TAG, "Unable to create worker task for subscriber %s", name);
+      vQueueDelete(psub->queue);
+      psub->queue = NULL;
+      rv          = VSCP_ERROR_MEMORY;
+      goto EXIT;
+    }
+  }
+
+  if (NULL != phandle) {
+    *phandle = s_cntSubscribers;
+  }
+
+  // Make the subscriber visible to publishers only when it is complete
+  __atomic_store_n(&s_cntSubscribers, s_cntSubscribers + 1, __ATOMIC_RELEASE);
+
+  ESP_LOGI(TAG, "Subscriber %s added (transport=%d, queue=%d)", name, transport, queueSize);
+
+EXIT:
+  xSemaphoreGive(s_mutexSubscribe);
+  return rv;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// eventbus_publish
+//
+
+int
+eventbus_publish(const vscpEvent *pev, uint32_t obid)
+{
+  int rv = VSCP_ERROR_SUCCESS;
+  int cnt;
+  int64_t now;
+  eventbus_msg_t *pmsg;
+  eventbus_transport_t transport = EVENTBUS_OBID_TRANSPORT(obid);
+
+  // Check pointer
+  if (NULL == pev) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  cnt = __atomic_load_n(&s_cntSubscribers, __ATOMIC_ACQUIRE);
+  if (!cnt) {
+    return VSCP_ERROR_SUCCESS;
+  }
+
+  pmsg = ESP_MALLOC(sizeof(eventbus_msg_t));
+  if (NULL == pmsg) {
+    return VSCP_ERROR_MEMORY;
+  }
+
+  pmsg->pev = vscp_fwhlp_mkEventCopy(pev);
+  if (NULL == pmsg->pev) {
+    ESP_FREE(pmsg);
+    return VSCP_ERROR_MEMORY;
+  }
+
+  pmsg->pev->obid = obid;
+  pmsg->refcnt    = 1; // Held by us until all subscribers got it
+  now             = esp_timer_get_time();
+
+  for (int i = 0; i < cnt; i++) {
+
+    eventbus_subscriber_t *psub = &s_subscribers[i];
+
+    // Loop prevention: never send an event back where it came from
+    if ((psub->transport == transport) && !(psub->flags & EVENTBUS_FLAG_ECHO)) {
+      continue;
+    }
+
+    // Subscriber has asked for a break
+    if (psub->tsHoldOff > now) {
+      psub->stats.nDropped++;
+      rv = VSCP_ERROR_TRM_FULL;
+      continue;
+    }
+
+    // Direct delivery in the context of the publisher
+    if (NULL == psub->queue) {
+      if (VSCP_ERROR_SUCCESS == psub->cb(pmsg->pev, psub->userdata)) {
+        psub->stats.nDelivered++;
+      }
+      else {
+        psub->stats.nFailed++;
+      }
+      continue;
+    }
+
+    __atomic_add_fetch(&pmsg->refcnt, 1, __ATOMIC_RELAXED);
+    if (pdTRUE != xQueueSend(psub->queue, &pmsg, 0)) {
+      __atomic_sub_fetch(&pmsg->refcnt, 1, __ATOMIC_RELAXED);
+      psub->stats.nDropped++;
+      rv = VSCP_ERROR_TRM_FULL;
+      ESP_LOGD(TAG, "Subscriber %s queue full, event dropped", psub->name);
+    }
+  }
+
+  eventbus_release(pmsg);
+  return rv;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// eventbus_hold_off
+//
+
+int
+eventbus_hold_off(int handle, uint32_t ms)
+{
+  if ((handle < 0) || (handle >= eventbus_get_subscriber_count())) {
+    return VSCP_ERROR_INDEX_OOB;
+  }
+
+  s_subscribers[handle].tsHoldOff = ms ? (esp_timer_get_time() + (int64_t) ms * 1000) : 0;
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// eventbus_get_subscriber_count
+//
+
+int
+eventbus_get_subscriber_count(void)
+{
+  return __atomic_load_n(&s_cntSubscribers, __ATOMIC_ACQUIRE);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// eventbus_get_stats
+//
+
+int
+eventbus_get_stats(int handle, const char **pname, eventbus_stats_t *pstats)
+{
+  // Check pointer
+  if (NULL == pstats) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if ((handle < 0) || (handle >= eventbus_get_subscriber_count())) {
+    return VSCP_ERROR_INDEX_OOB;
+  }
+
+  if (NULL != pname) {
+    *pname = s_subscribers[handle].name;
+  }
+
+  memcpy(pstats, &s_subscribers[handle].stats, sizeof(eventbus_stats_t));
+  pstats->nQueued =
+    (NULL != s_subscribers[handle].queue) ? uxQueueMessagesWaiting(s_subscribers[handle].queue) : 0;
+
+  return VSCP_ERROR_SUCCESS;
+}
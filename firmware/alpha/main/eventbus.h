@@ -0,0 +1,171 @@
+/*
+  File: eventbus.h
+
+  VSCP alpha node event bus
+
+  This file is part of the VSCP (https://www.vscp.org)
+
+  The MIT License (MIT)
+  Copyright © 2022-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  The event bus connects the transports of the alpha node (esp-now, VSCP link
+  protocol clients, MQTT, websocket) with each other. A transport publish
+  events it receives on the bus and subscribe to get events from all other
+  transports. An event is copied once when published and is then shared by
+  all subscribers.
+*/
+
+#ifndef __VSCP_ALPHA_EVENTBUS__
+#define __VSCP_ALPHA_EVENTBUS__
+
+#include <vscp.h>
+
+/**
+ * Max number of subscribers on the bus
+ */
+#define EVENTBUS_MAX_SUBSCRIBERS 8
+
+/**
+ * Transports that can publish and subscribe to events.
+ */
+typedef enum {
+  EVENTBUS_TRANSPORT_INTERNAL = 0, // Events generated by the node itself
+  EVENTBUS_TRANSPORT_ESPNOW,       // esp-now cluster
+  EVENTBUS_TRANSPORT_TCPSRV,       // VSCP link protocol clients
+  EVENTBUS_TRANSPORT_MQTT,         // MQTT broker
+  EVENTBUS_TRANSPORT_WEBSOCKET,    // Websocket clients
+  EVENTBUS_TRANSPORT_COUNT
+} eventbus_transport_t;
+
+/*
+  The obid of an event on the bus tells where it came from. The upper byte
+  is the transport and the lower bytes the channel within the transport
+  (for example the VSCP link client id). A subscriber never get events
+  back from its own transport unless it asks for it with EVENTBUS_FLAG_ECHO.
+  It must then itself skip events from the originating channel.
+*/
+#define EVENTBUS_OBID(transport, channel) ((((uint32_t) (transport)) << 24) | ((uint32_t) (channel) & 0xffffff))
+#define EVENTBUS_OBID_TRANSPORT(obid)     (((uint32_t) (obid) >> 24) & 0xff)
+#define EVENTBUS_OBID_CHANNEL(obid)       ((uint32_t) (obid) & 0xffffff)
+
+// Subscriber flags
+#define EVENTBUS_FLAG_ECHO 0x01 // Also deliver events published by the same transport
+
+/**
+ * @brief Subscriber delivery callback
+ *
+ * @param pev Pointer to event. The event is shared with other subscribers and
+ *        must not be changed or freed.
+ * @param userdata User data set on subscribe
+ * @return VSCP_ERROR_SUCCESS if delivered, error code otherwise.
+ */
+typedef int (*eventbus_deliver_cb_t)(const vscpEvent *pev, void *userdata);
+
+/**
+ * @brief Per subscriber statistics
+ */
+typedef struct {
+  uint32_t nDelivered; // Events delivered to subscriber
+  uint32_t nDropped;   // Events dropped because the subscriber queue was full
+  uint32_t nFailed;    // Events the subscriber failed to deliver
+  uint32_t nQueued;    // Events currently waiting in subscriber queue
+} eventbus_stats_t;
+
+/**
+ * @brief Initialize the event bus
+ *
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+eventbus_init(void);
+
+/**
+ * @brief Subscribe to events on the bus
+ *
+ * @param name Name for subscriber. Also used as worker task name.
+ * @param transport Transport the subscriber belongs to.
+ * @param flags Subscriber flags (EVENTBUS_FLAG_xxx)
+ * @param queueSize Max number of events waiting for the subscriber. Events are
+ *        delivered from a worker task owned by the bus. If set to zero the
+ *        callback is called directly in the context of the publisher and must
+ *        not block.
+ * @param cb Delivery callback
+ * @param userdata User data for callback
+ * @param phandle Pointer to variable that get subscriber handle. Can be NULL.
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+eventbus_subscribe(const char *name,
+                   eventbus_transport_t transport,
+                   uint8_t flags,
+                   uint16_t queueSize,
+                   eventbus_deliver_cb_t cb,
+                   void *userdata,
+                   int *phandle);
+
+/**
+ * @brief Publish an event on the bus
+ *
+ * The event is copied and can be freed by the caller when the call returns.
+ *
+ * @param pev Pointer to event to publish
+ * @param obid Origin of the event. Set with EVENTBUS_OBID()
+ * @return VSCP_ERROR_SUCCESS if all subscribers got the event,
+ *         VSCP_ERROR_TRM_FULL if one or more subscriber queues was full, error code otherwise.
+ */
+int
+eventbus_publish(const vscpEvent *pev, uint32_t obid);
+
+/**
+ * @brief Hold off delivery to a subscriber
+ *
+ * Used by a subscriber that can't keep up (for example a slow link to a
+ * remote server) to signal backpressure. Events published during the hold
+ * off time are dropped for the subscriber without being copied or queued
+ * and the publisher get VSCP_ERROR_TRM_FULL.
+ *
+ * @param handle Subscriber handle
+ * @param ms Hold off time in milliseconds. Zero cancel a hold off.
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+eventbus_hold_off(int handle, uint32_t ms);
+
+/**
+ * @brief Get number of subscribers
+ *
+ * @return Number of subscribers
+ */
+int
+eventbus_get_subscriber_count(void);
+
+/**
+ * @brief Get statistics for a subscriber
+ *
+ * @param handle Subscriber handle (0 - eventbus_get_subscriber_count()-1)
+ * @param pname Pointer to pointer that get subscriber name. Can be NULL.
+ * @param pstats Pointer to statistics structure that will be filled in
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+eventbus_get_stats(int handle, const char **pname, eventbus_stats_t *pstats);
+
+#endif
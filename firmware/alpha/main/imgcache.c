@@ -0,0 +1,709 @@
+/*
+  File: imgcache.c
+
+  VSCP alpha node firmware image cache
+
+  This file is part of the VSCP (https://www.vscp.org)
+
+  The MIT License (MIT)
+  Copyright © 2022-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <string.h>
+#include <sys/param.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include <esp_app_desc.h>
+#include <esp_app_format.h>
+#include <esp_log.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <esp_timer.h>
+#include <nvs_flash.h>
+
+#include <espnow_utils.h>
+
+#include <vscp.h>
+
+#include "vscp-projdefs.h"
+
+#include "imgcache.h"
+
+static const char *TAG = "imgcache";
+
+// Flash is erased in blocks of this size ahead of the data written
+#define IMGCACHE_ERASE_SIZE 0x10000
+
+/*
+  Index as stored in NVS. Entries are only used if the layout (address and
+  slot size) is the same as when they were stored.
+*/
+typedef struct {
+  uint32_t address;                            // Address of first slot
+  uint32_t slotSize;                           // Slot size
+  imgcache_entry_t entry[IMGCACHE_MAX_SLOTS];  // One entry per slot
+} imgcache_index_t;
+
+static const esp_partition_t *s_part = NULL; // Cache partition or next OTA partition
+static bool s_bOtaPartition          = false;
+static int s_cntSlots                = 0;
+static uint32_t s_slotSize           = 0;
+static imgcache_index_t s_index;
+static int64_t s_tsFetched[IMGCACHE_MAX_SLOTS]; // Download time (esp_timer) or zero
+static uint8_t s_locked[IMGCACHE_MAX_SLOTS];    // Users of slot
+static bool s_bSelfUpdate = false;              // Slot 0 is locked by a self update
+static SemaphoreHandle_t s_mutex = NULL;
+static nvs_handle_t s_nvsHandle;
+
+///////////////////////////////////////////////////////////////////////////////
+// imgcache_url_hash
+//
+// FNV-1a, never zero
+//
+
+static uint32_t
+imgcache_url_hash(const char *url)
+{
+  uint32_t hash = 2166136261;
+
+  while (*url) {
+    hash ^= (uint8_t) *url++;
+    hash *= 16777619;
+  }
+
+  return hash ? hash : 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// imgcache_save
+//
+
+static void
+imgcache_save(void)
+{
+  if (ESP_OK != nvs_set_blob(s_nvsHandle, "index", &s_index, sizeof(s_index))) {
+    ESP_LOGE(TAG, "Failed to save cache index");
+    return;
+  }
+
+  nvs_commit(s_nvsHandle);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// imgcache_slot_partition
+//
+// A slot as an app partition, for image validation and digest
+//
+
+static void
+imgcache_slot_partition(int slot, esp_partition_t *ppart)
+{
+  memcpy(ppart, s_part, sizeof(esp_partition_t));
+  ppart->address += slot * s_slotSize;
+  ppart->size = s_slotSize;
+  ppart->type = ESP_PARTITION_TYPE_APP;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// imgcache_init
+//
+
+int
+imgcache_init(void)
+{
+  esp_err_t ret;
+  size_t len = sizeof(s_index);
+
+  if (NULL != s_mutex) {
+    return VSCP_ERROR_SUCCESS;
+  }
+
+  s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, IMGCACHE_PARTITION_LABEL);
+  if (NULL != s_part) {
+    s_cntSlots = CONFIG_APP_IMGCACHE_SLOTS;
+    s_slotSize = (s_part->size / s_cntSlots) & ~(IMGCACHE_ERASE_SIZE - 1);
+  }
+  else {
+    // No room for a cache, the image is kept where it was always downloaded to
+    s_part          = esp_ota_get_next_update_partition(NULL);
+    s_bOtaPartition = true;
+    s_cntSlots      = 1;
+    s_slotSize      = (NULL != s_part) ? s_part->size : 0;
+  }
+
+  if ((NULL == s_part) || !s_slotSize) {
+    ESP_LOGE(TAG, "No partition for image cache");
+    return VSCP_ERROR_INIT_MISSING;
+  }
+
+  ret = nvs_open("imgcache", NVS_READWRITE, &s_nvsHandle);
+  if (ESP_OK != ret) {
+    ESP_LOGE(TAG, "Error (%s) opening NVS handle!", esp_err_to_name(ret));
+    return VSCP_ERROR_INIT_MISSING;
+  }
+
+  s_mutex = xSemaphoreCreateMutex();
+  if (NULL == s_mutex) {
+    nvs_close(s_nvsHandle);
+    return VSCP_ERROR_MEMORY;
+  }
+
+  if ((ESP_OK != nvs_get_blob(s_nvsHandle, "index", &s_index, &len)) || (sizeof(s_index) != len) ||
+      (s_index.address != s_part->address) || (s_index.slotSize != s_slotSize)) {
+    memset(&s_index, 0, sizeof(s_index));
+    s_index.address  = s_part->address;
+    s_index.slotSize = s_slotSize;
+  }
+
+  for (int i = 0; i < IMGCACHE_MAX_SLOTS; i++) {
+    imgcache_entry_t *pentry = &s_index.entry[i];
+
+    if ((i >= s_cntSlots) || (pentry->slot != i) || (pentry->size > s_slotSize)) {
+      pentry->valid = 0;
+    }
+
+    // The alpha itself may have used its OTA partition since the image was stored
+    if (pentry->valid && s_bOtaPartition) {
+      uint8_t sha[32];
+      if ((ESP_OK != esp_partition_get_sha256(s_part, sha)) || memcmp(sha, pentry->sha, sizeof(sha))) {
+        ESP_LOGW(TAG, "Image in OTA partition has changed, dropped");
+        pentry->valid = 0;
+      }
+    }
+
+    if (pentry->valid) {
+      ESP_LOGI(TAG,
+               "Slot %d: %.32s %.32s, %lu bytes",
+               i,
+               pentry->projectName,
+               pentry->version,
+               (unsigned long) pentry->size);
+    }
+  }
+
+  ESP_LOGI(TAG,
+           "Image cache in %s, %d slot(s) of %lu KB",
+           s_part->label,
+           s_cntSlots,
+           (unsigned long) s_slotSize / 1024);
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// imgcache_get_slot_count
+//
+
+int
+imgcache_get_slot_count(void)
+{
+  return (NULL != s_mutex) ? s_cntSlots : 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// imgcache_get_slot_size
+//
+
+size_t
+imgcache_get_slot_size(void)
+{
+  return s_slotSize;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// imgcache_get
+//
+
+int
+imgcache_get(int slot, imgcache_entry_t *pentry)
+{
+  int rv = VSCP_ERROR_UNKNOWN_ITEM;
+
+  // Check pointer
+  if (NULL == pentry) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if ((slot < 0) || (slot >= imgcache_get_slot_count())) {
+    return VSCP_ERROR_INDEX_OOB;
+  }
+
+  xSemaphoreTake(s_mutex, portMAX_DELAY);
+  if (s_index.entry[slot].valid) {
+    memcpy(pentry, &s_index.entry[slot], sizeof(imgcache_entry_t));
+    rv = VSCP_ERROR_SUCCESS;
+  }
+  xSemaphoreGive(s_mutex);
+
+  return rv;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// imgcache_lookup
+//
+// Find an image by digest, or by project name if sha is NULL. If bLock is
+// set the image is locked under the same mutex hold, so it can not be
+// replaced between the lookup and the lock.
+//
+
+static int
+imgcache_lookup(const uint8_t *sha, const char *projectName, imgcache_entry_t *pentry, bool bLock)
+{
+  int rv = VSCP_ERROR_UNKNOWN_ITEM;
+
+  if (NULL == s_mutex) {
+    return VSCP_ERROR_INIT_MISSING;
+  }
+
+  xSemaphoreTake(s_mutex, portMAX_DELAY);
+  for (int i = 0; i < s_cntSlots; i++) {
+    if (!s_index.entry[i].valid) {
+      continue;
+    }
+    if ((NULL != sha) ? !memcmp(s_index.entry[i].sha, sha, 32)
+                      : !strncmp(s_index.entry[i].projectName, projectName, sizeof(s_index.entry[i].projectName))) {
+      if (NULL != pentry) {
+        memcpy(pentry, &s_index.entry[i], sizeof(imgcache_entry_t));
+      }
+      if (bLock) {
+        s_locked[i]++;
+      }
+      rv = VSCP_ERROR_SUCCESS;
+      break;
+    }
+  }
+  xSemaphoreGive(s_mutex);
+
+  return rv;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// imgcache_find
+//
+
+int
+imgcache_find(const uint8_t sha[32], imgcache_entry_t *pentry)
+{
+  // Check pointer
+  if (NULL == sha) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  return imgcache_lookup(sha, NULL, pentry, false);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// imgcache_find_lock
+//
+
+int
+imgcache_find_lock(const uint8_t sha[32], imgcache_entry_t *pentry)
+{
+  // Check pointers
+  if ((NULL == sha) || (NULL == pentry)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  return imgcache_lookup(sha, NULL, pentry, true);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// imgcache_find_project
+//
+
+int
+imgcache_find_project(const char *projectName, imgcache_entry_t *pentry)
+{
+  // Check pointer
+  if (NULL == projectName) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  return imgcache_lookup(NULL, projectName, pentry, false);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// imgcache_find_project_lock
+//
+
+int
+imgcache_find_project_lock(const char *projectName, imgcache_entry_t *pentry)
+{
+  // Check pointers
+  if ((NULL == projectName) || (NULL == pentry)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  return imgcache_lookup(NULL, projectName, pentry, true);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// imgcache_find_url
+//
+
+int
+imgcache_find_url(const char *url, imgcache_entry_t *pentry)
+{
+  int rv = VSCP_ERROR_UNKNOWN_ITEM;
+  uint32_t hash;
+  int64_t now = esp_timer_get_time();
+
+  // Check pointer
+  if (NULL == url) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if (NULL == s_mutex) {
+    return VSCP_ERROR_INIT_MISSING;
+  }
+
+  hash = imgcache_url_hash(url);
+
+  xSemaphoreTake(s_mutex, portMAX_DELAY);
+  for (int i = 0; i < s_cntSlots; i++) {
+    if (s_index.entry[i].valid && (hash == s_index.entry[i].urlHash) && s_tsFetched[i] &&
+        ((now - s_tsFetched[i]) < (CONFIG_APP_IMGCACHE_URL_TTL * 1000000LL))) {
+      if (NULL != pentry) {
+        memcpy(pentry, &s_index.entry[i], sizeof(imgcache_entry_t));
+      }
+      rv = VSCP_ERROR_SUCCESS;
+      break;
+    }
+  }
+  xSemaphoreGive(s_mutex);
+
+  return rv;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// imgcache_begin
+//
+
+int
+imgcache_begin(size_t size, imgcache_writer_t *pw)
+{
+  int slot = -1;
+
+  // Check pointer
+  if (NULL == pw) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if (NULL == s_mutex) {
+    return VSCP_ERROR_INIT_MISSING;
+  }
+
+  if (!size || (size > s_slotSize)) {
+    ESP_LOGE(TAG, "Image (%u bytes) does not fit in cache slot", (unsigned) size);
+    return VSCP_ERROR_BUFFER_TO_SMALL;
+  }
+
+  xSemaphoreTake(s_mutex, portMAX_DELAY);
+
+  // Empty slot or the oldest image
+  for (int i = 0; i < s_cntSlots; i++) {
+    if (s_locked[i]) {
+      continue;
+    }
+    if (!s_index.entry[i].valid) {
+      slot = i;
+      break;
+    }
+    if ((slot < 0) || (s_index.entry[i].seq < s_index.entry[slot].seq)) {
+      slot = i;
+    }
+  }
+
+  if (slot >= 0) {
+    if (s_index.entry[slot].valid) {
+      ESP_LOGI(TAG, "Replacing %.32s %.32s", s_index.entry[slot].projectName, s_index.entry[slot].version);
+    }
+    s_index.entry[slot].valid = 0;
+    s_tsFetched[slot]         = 0;
+    s_locked[slot]++;
+    imgcache_save();
+  }
+
+  xSemaphoreGive(s_mutex);
+
+  if (slot < 0) {
+    ESP_LOGE(TAG, "All cache slots are in use");
+    return VSCP_ERROR_BUFFER_FULL;
+  }
+
+  pw->slot   = slot;
+  pw->size   = size;
+  pw->offset = 0;
+  pw->erased = 0;
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// imgcache_write
+//
+
+int
+imgcache_write(imgcache_writer_t *pw, const void *data, size_t len)
+{
+  esp_err_t ret;
+  uint32_t base;
+
+  // Check pointers
+  if ((NULL == pw) || (NULL == data)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if (len > (pw->size - pw->offset)) {
+    return VSCP_ERROR_BUFFER_TO_SMALL;
+  }
+
+  base = pw->slot * s_slotSize;
+
+  // Erase ahead of the data
+  while (pw->erased < (pw->offset + len)) {
+    uint32_t erase = MIN(IMGCACHE_ERASE_SIZE, s_slotSize - pw->erased);
+    ret            = esp_partition_erase_range(s_part, base + pw->erased, erase);
+    if (ESP_OK != ret) {
+      ESP_LOGE(TAG, "<%s> Erase at %lu", esp_err_to_name(ret), (unsigned long) pw->erased);
+      return VSCP_ERROR_WRITE_ERROR;
+    }
+    pw->erased += erase;
+  }
+
+  ret = esp_partition_write(s_part, base + pw->offset, data, len);
+  if (ESP_OK != ret) {
+    ESP_LOGE(TAG, "<%s> Write at %lu", esp_err_to_name(ret), (unsigned long) pw->offset);
+    return VSCP_ERROR_WRITE_ERROR;
+  }
+
+  pw->offset += len;
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// imgcache_end
+//
+
+int
+imgcache_end(imgcache_writer_t *pw, const char *url, imgcache_entry_t *pentry)
+{
+  esp_err_t ret;
+  imgcache_entry_t entry;
+  esp_app_desc_t desc;
+  esp_partition_t part;
+  uint32_t seq = 0;
+
+  // Check pointer
+  if (NULL == pw) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if (pw->offset != pw->size) {
+    ESP_LOGE(TAG, "Image incomplete, %lu of %lu bytes", (unsigned long) pw->offset, (unsigned long) pw->size);
+    imgcache_abort(pw);
+    return VSCP_ERROR_ERROR;
+  }
+
+  memset(&entry, 0, sizeof(entry));
+
+  // Validates the image and gives the same digest as on the nodes
+  imgcache_slot_partition(pw->slot, &part);
+  ret = esp_partition_get_sha256(s_bOtaPartition ? s_part : &part, entry.sha);
+  if (ESP_OK != ret) {
+    ESP_LOGE(TAG, "<%s> Image is not valid", esp_err_to_name(ret));
+    imgcache_abort(pw);
+    return VSCP_ERROR_INVALID_FRAME;
+  }
+
+  ret = esp_partition_read(s_part,
+                           pw->slot * s_slotSize + sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t),
+                           &desc,
+                           sizeof(desc));
+  if ((ESP_OK != ret) || (ESP_APP_DESC_MAGIC_WORD != desc.magic_word)) {
+    ESP_LOGE(TAG, "Image has no application description");
+    imgcache_abort(pw);
+    return VSCP_ERROR_INVALID_FRAME;
+  }
+
+  entry.size    = pw->size;
+  entry.urlHash = (NULL != url) ? imgcache_url_hash(url) : 0;
+  entry.slot    = pw->slot;
+  entry.valid   = 1;
+  strncpy(entry.projectName, desc.project_name, sizeof(entry.projectName));
+  strncpy(entry.version, desc.version, sizeof(entry.version));
+
+  xSemaphoreTake(s_mutex, portMAX_DELAY);
+
+  for (int i = 0; i < s_cntSlots; i++) {
+
+    if (!s_index.entry[i].valid) {
+      continue;
+    }
+
+    seq = MAX(seq, s_index.entry[i].seq);
+
+    // One image per target type. A copy of this image is dropped as well.
+    if (!strncmp(s_index.entry[i].projectName, entry.projectName, sizeof(entry.projectName)) ||
+        !memcmp(s_index.entry[i].sha, entry.sha, sizeof(entry.sha))) {
+      ESP_LOGI(TAG, "Dropping %.32s %.32s", s_index.entry[i].projectName, s_index.entry[i].version);
+      s_index.entry[i].valid = 0;
+    }
+  }
+
+  entry.seq = seq + 1;
+  memcpy(&s_index.entry[pw->slot], &entry, sizeof(entry));
+  s_tsFetched[pw->slot] = (NULL != url) ? esp_timer_get_time() : 0;
+  s_locked[pw->slot]--;
+  imgcache_save();
+
+  xSemaphoreGive(s_mutex);
+
+  ESP_LOGI(TAG,
+           "Cached %.32s %.32s, %lu bytes in slot %d",
+           entry.projectName,
+           entry.version,
+           (unsigned long) entry.size,
+           entry.slot);
+
+  if (NULL != pentry) {
+    memcpy(pentry, &entry, sizeof(entry));
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// imgcache_abort
+//
+
+void
+imgcache_abort(imgcache_writer_t *pw)
+{
+  if ((NULL == pw) || (NULL == s_mutex)) {
+    return;
+  }
+
+  xSemaphoreTake(s_mutex, portMAX_DELAY);
+  if (s_locked[pw->slot]) {
+    s_locked[pw->slot]--;
+  }
+  xSemaphoreGive(s_mutex);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// imgcache_read
+//
+
+int
+imgcache_read(const imgcache_entry_t *pentry, size_t offset, void *dst, size_t size)
+{
+  // Check pointers
+  if ((NULL == pentry) || (NULL == dst)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if ((pentry->slot >= s_cntSlots) || (offset > pentry->size) || (size > (pentry->size - offset))) {
+    return VSCP_ERROR_INDEX_OOB;
+  }
+
+  if (ESP_OK != esp_partition_read(s_part, pentry->slot * s_slotSize + offset, dst, size)) {
+    return VSCP_ERROR_ERROR;
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// imgcache_unlock
+//
+
+void
+imgcache_unlock(const imgcache_entry_t *pentry)
+{
+  if ((NULL == pentry) || (NULL == s_mutex) || (pentry->slot >= s_cntSlots)) {
+    return;
+  }
+
+  xSemaphoreTake(s_mutex, portMAX_DELAY);
+  if (s_locked[pentry->slot]) {
+    s_locked[pentry->slot]--;
+  }
+  xSemaphoreGive(s_mutex);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// imgcache_self_update
+//
+
+int
+imgcache_self_update(void)
+{
+  int rv = VSCP_ERROR_SUCCESS;
+
+  if ((NULL == s_mutex) || !s_bOtaPartition) {
+    return VSCP_ERROR_SUCCESS;
+  }
+
+  xSemaphoreTake(s_mutex, portMAX_DELAY);
+  if (s_locked[0]) {
+    // Being written, read by a transfer to the nodes or another self update
+    ESP_LOGW(TAG, "OTA partition is in use by the image cache");
+    rv = VSCP_ERROR_BUFFER_FULL;
+  }
+  else {
+    if (s_index.entry[0].valid) {
+      ESP_LOGI(TAG, "OTA partition needed by alpha node, cached image dropped");
+      s_index.entry[0].valid = 0;
+      s_tsFetched[0]         = 0;
+      imgcache_save();
+    }
+    // No image is written to the slot while the alpha node updates itself.
+    // A successful update restarts the node, which releases it.
+    s_locked[0]++;
+    s_bSelfUpdate = true;
+  }
+  xSemaphoreGive(s_mutex);
+
+  return rv;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// imgcache_self_update_failed
+//
+
+void
+imgcache_self_update_failed(void)
+{
+  if (NULL == s_mutex) {
+    return;
+  }
+
+  xSemaphoreTake(s_mutex, portMAX_DELAY);
+  if (s_bSelfUpdate) {
+    s_bSelfUpdate = false;
+    s_locked[0]--;
+  }
+  xSemaphoreGive(s_mutex);
+}
@@ -0,0 +1,266 @@
+/*
+  File: imgcache.h
+
+  VSCP alpha node firmware image cache
+
+  This file is part of the VSCP (https://www.vscp.org)
+
+  The MIT License (MIT)
+  Copyright © 2022-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  Firmware images for the nodes are downloaded (or uploaded) once and kept
+  in a cache on the alpha node. Both the esp-now OTA and sibling HTTP
+  requests (/api/v1/image) are served from the cache. Images are keyed by
+  their SHA-256 digest (same digest as esp_partition_get_sha256 gives on a
+  node) and there is one image per target type (project name in the image).
+
+  The cache lives in a partition labelled "imgcache" (see partitions_8MB.csv)
+  split in CONFIG_APP_IMGCACHE_SLOTS slots. Without that partition the next
+  OTA partition of the alpha is used as a cache with a single slot. The index
+  is kept in NVS.
+*/
+
+#ifndef __VSCP_ALPHA_IMGCACHE__
+#define __VSCP_ALPHA_IMGCACHE__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <esp_partition.h>
+
+#include <vscp.h>
+
+#define IMGCACHE_PARTITION_LABEL "imgcache"
+#define IMGCACHE_MAX_SLOTS       4
+
+/**
+ * @brief A cached image
+ */
+typedef struct {
+  uint8_t sha[32];      // Image digest
+  uint32_t size;        // Image size
+  uint32_t urlHash;     // Hash of the URL the image was downloaded from, zero for uploads
+  uint32_t seq;         // Store sequence, higher is newer
+  char projectName[32]; // Target type (project name of image)
+  char version[32];     // Firmware version of image
+  uint8_t slot;         // Cache slot
+  uint8_t valid;        // Non zero if the slot holds an image
+} imgcache_entry_t;
+
+/**
+ * @brief An image being written to the cache
+ */
+typedef struct {
+  uint8_t slot;    // Slot written to
+  uint32_t size;   // Expected size
+  uint32_t offset; // Bytes written
+  uint32_t erased; // Bytes erased
+} imgcache_writer_t;
+
+/**
+ * @brief Initialize the image cache
+ *
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+imgcache_init(void);
+
+/**
+ * @brief Get number of cache slots
+ *
+ * @return Number of slots, zero if the cache is not initialized.
+ */
+int
+imgcache_get_slot_count(void);
+
+/**
+ * @brief Get max size of an image in the cache
+ *
+ * @return Slot size in bytes
+ */
+size_t
+imgcache_get_slot_size(void);
+
+/**
+ * @brief Get the entry of a slot
+ *
+ * @param slot Slot (0 - imgcache_get_slot_count()-1)
+ * @param pentry Pointer to entry that will be filled in
+ * @return VSCP_ERROR_SUCCESS if the slot holds an image, VSCP_ERROR_UNKNOWN_ITEM
+ *         if it is empty, error code otherwise.
+ */
+int
+imgcache_get(int slot, imgcache_entry_t *pentry);
+
+/**
+ * @brief Find an image by digest
+ *
+ * @param sha Image digest
+ * @param pentry Pointer to entry that will be filled in. Can be NULL.
+ * @return VSCP_ERROR_SUCCESS if found, VSCP_ERROR_UNKNOWN_ITEM if not.
+ */
+int
+imgcache_find(const uint8_t sha[32], imgcache_entry_t *pentry);
+
+/**
+ * @brief Find an image by digest and keep it from being replaced
+ *
+ * The lookup and the lock are done in one step. Release the image with
+ * imgcache_unlock when done with it.
+ *
+ * @param sha Image digest
+ * @param pentry Pointer to entry that will be filled in
+ * @return VSCP_ERROR_SUCCESS if found and locked, VSCP_ERROR_UNKNOWN_ITEM if not.
+ */
+int
+imgcache_find_lock(const uint8_t sha[32], imgcache_entry_t *pentry);
+
+/**
+ * @brief Find the image for a target type
+ *
+ * @param projectName Project name of image
+ * @param pentry Pointer to entry that will be filled in. Can be NULL.
+ * @return VSCP_ERROR_SUCCESS if found, VSCP_ERROR_UNKNOWN_ITEM if not.
+ */
+int
+imgcache_find_project(const char *projectName, imgcache_entry_t *pentry);
+
+/**
+ * @brief Find the image for a target type and keep it from being replaced
+ *
+ * The lookup and the lock are done in one step. Release the image with
+ * imgcache_unlock when done with it.
+ *
+ * @param projectName Project name of image
+ * @param pentry Pointer to entry that will be filled in
+ * @return VSCP_ERROR_SUCCESS if found and locked, VSCP_ERROR_UNKNOWN_ITEM if not.
+ */
+int
+imgcache_find_project_lock(const char *projectName, imgcache_entry_t *pentry);
+
+/**
+ * @brief Find an image downloaded from a URL
+ *
+ * Only images downloaded since boot and less than CONFIG_APP_IMGCACHE_URL_TTL
+ * seconds ago are found. Nothing is found with the default TTL of zero. The
+ * match is on the URL alone and is not checked with the server, so a file
+ * replaced under the same URL within the TTL is not seen.
+ *
+ * @param url URL image was downloaded from
+ * @param pentry Pointer to entry that will be filled in. Can be NULL.
+ * @return VSCP_ERROR_SUCCESS if found, VSCP_ERROR_UNKNOWN_ITEM if not.
+ */
+int
+imgcache_find_url(const char *url, imgcache_entry_t *pentry);
+
+/**
+ * @brief Start writing an image to the cache
+ *
+ * The oldest slot not in use is taken. Its image is dropped.
+ *
+ * @param size Image size
+ * @param pw Pointer to writer
+ * @return VSCP_ERROR_SUCCESS on success, VSCP_ERROR_BUFFER_TO_SMALL if the image
+ *         does not fit in a slot, VSCP_ERROR_BUFFER_FULL if all slots are in
+ *         use, error code otherwise.
+ */
+int
+imgcache_begin(size_t size, imgcache_writer_t *pw);
+
+/**
+ * @brief Write image data. Data is written in order.
+ *
+ * @param pw Pointer to writer
+ * @param data Pointer to data
+ * @param len Number of bytes
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+imgcache_write(imgcache_writer_t *pw, const void *data, size_t len);
+
+/**
+ * @brief Finish an image
+ *
+ * The image is validated and its digest calculated. An older image for the
+ * same target type is dropped.
+ *
+ * @param pw Pointer to writer
+ * @param url URL image was downloaded from. NULL for uploads.
+ * @param pentry Pointer to entry that will be filled in. Can be NULL.
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+imgcache_end(imgcache_writer_t *pw, const char *url, imgcache_entry_t *pentry);
+
+/**
+ * @brief Abort writing an image. The slot is left empty.
+ *
+ * @param pw Pointer to writer
+ */
+void
+imgcache_abort(imgcache_writer_t *pw);
+
+/**
+ * @brief Read image data
+ *
+ * @param pentry Pointer to entry of image
+ * @param offset Offset in image
+ * @param dst Pointer to buffer
+ * @param size Number of bytes to read
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+imgcache_read(const imgcache_entry_t *pentry, size_t offset, void *dst, size_t size);
+
+/**
+ * @brief Allow an image locked by imgcache_find_lock or
+ *        imgcache_find_project_lock to be replaced again
+ *
+ * @param pentry Pointer to entry of image
+ */
+void
+imgcache_unlock(const imgcache_entry_t *pentry);
+
+/**
+ * @brief The alpha node is about to update itself
+ *
+ * Drops the cached image if the cache uses the next OTA partition and keeps
+ * the slot locked, so no image is written to the partition during the
+ * update. The update must not start if the image there is in use. Call
+ * imgcache_self_update_failed if the update fails. A successful update
+ * restarts the node.
+ *
+ * @return VSCP_ERROR_SUCCESS if the OTA partition is free to use,
+ *         VSCP_ERROR_BUFFER_FULL if the cached image in it is being written
+ *         or sent.
+ */
+int
+imgcache_self_update(void);
+
+/**
+ * @brief The update of the alpha node failed
+ *
+ * Releases the slot locked by imgcache_self_update.
+ */
+void
+imgcache_self_update_failed(void);
+
+#endif
@@ -0,0 +1,304 @@
+/*
+  File: jsonwr.c
+
+  VSCP alpha node streaming JSON writer
+
+  This file is part of the VSCP (https://www.vscp.org)
+
+  The MIT License (MIT)
+  Copyright © 2022-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <string.h>
+
+#include <esp_http_server.h>
+
+#include "jsonwr.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// jsonwr_flush
+//
+
+static void
+jsonwr_flush(jsonwr_t *pw)
+{
+  if (pw->len && (ESP_OK == pw->err)) {
+    pw->err = httpd_resp_send_chunk(pw->req, pw->buf, pw->len);
+  }
+  pw->len = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// jsonwr_putc
+//
+
+static void
+jsonwr_putc(jsonwr_t *pw, char c)
+{
+  if (pw->len >= sizeof(pw->buf)) {
+    jsonwr_flush(pw);
+  }
+  pw->buf[pw->len++] = c;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// jsonwr_puts
+//
+
+static void
+jsonwr_puts(jsonwr_t *pw, const char *str)
+{
+  while (*str) {
+    jsonwr_putc(pw, *str++);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// jsonwr_putUint
+//
+
+static void
+jsonwr_putUint(jsonwr_t *pw, uint64_t value)
+{
+  char buf[21];
+  char *p = buf + sizeof(buf) - 1;
+
+  *p = '\0';
+  do {
+    *--p = '0' + (value % 10);
+    value /= 10;
+  } while (value);
+
+  jsonwr_puts(pw, p);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// jsonwr_putEscaped
+//
+// Write a quoted and escaped string
+//
+
+static void
+jsonwr_putEscaped(jsonwr_t *pw, const char *str)
+{
+  static const char hex[] = "0123456789abcdef";
+
+  jsonwr_putc(pw, '"');
+
+  for (; *str; str++) {
+    uint8_t c = (uint8_t) *str;
+    if (('"' == c) || ('\\' == c)) {
+      jsonwr_putc(pw, '\\');
+      jsonwr_putc(pw, c);
+    }
+    else if (c < 0x20) {
+      jsonwr_puts(pw, "\\u00");
+      jsonwr_putc(pw, hex[c >> 4]);
+      jsonwr_putc(pw, hex[c & 0x0f]);
+    }
+    else {
+      jsonwr_putc(pw, c);
+    }
+  }
+
+  jsonwr_putc(pw, '"');
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// jsonwr_member
+//
+// Separator and key before a value
+//
+
+static void
+jsonwr_member(jsonwr_t *pw, const char *key)
+{
+  if (!pw->bFirst[pw->depth]) {
+    jsonwr_putc(pw, ',');
+  }
+  pw->bFirst[pw->depth] = false;
+
+  if (NULL != key) {
+    jsonwr_putEscaped(pw, key);
+    jsonwr_putc(pw, ':');
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// jsonwr_begin
+//
+
+static void
+jsonwr_begin(jsonwr_t *pw, const char *key, char c)
+{
+  jsonwr_member(pw, key);
+  jsonwr_putc(pw, c);
+
+  if (pw->depth < (JSONWR_MAX_DEPTH - 1)) {
+    pw->depth++;
+  }
+  pw->bFirst[pw->depth] = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// jsonwr_end
+//
+
+static void
+jsonwr_end(jsonwr_t *pw, char c)
+{
+  jsonwr_putc(pw, c);
+
+  if (pw->depth) {
+    pw->depth--;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// jsonwr_init
+//
+
+void
+jsonwr_init(jsonwr_t *pw, httpd_req_t *req)
+{
+  memset(pw->bFirst, 0, sizeof(pw->bFirst));
+  pw->req       = req;
+  pw->err       = ESP_OK;
+  pw->depth     = 0;
+  pw->len       = 0;
+  pw->bFirst[0] = true;
+
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// jsonwr_begin_object
+//
+
+void
+jsonwr_begin_object(jsonwr_t *pw, const char *key)
+{
+  jsonwr_begin(pw, key, '{');
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// jsonwr_end_object
+//
+
+void
+jsonwr_end_object(jsonwr_t *pw)
+{
+  jsonwr_end(pw, '}');
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// jsonwr_begin_array
+//
+
+void
+jsonwr_begin_array(jsonwr_t *pw, const char *key)
+{
+  jsonwr_begin(pw, key, '[');
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// jsonwr_end_array
+//
+
+void
+jsonwr_end_array(jsonwr_t *pw)
+{
+  jsonwr_end(pw, ']');
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// jsonwr_string
+//
+
+void
+jsonwr_string(jsonwr_t *pw, const char *key, const char *value)
+{
+  jsonwr_member(pw, key);
+
+  if (NULL == value) {
+    jsonwr_puts(pw, "null");
+    return;
+  }
+
+  jsonwr_putEscaped(pw, value);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// jsonwr_uint
+//
+
+void
+jsonwr_uint(jsonwr_t *pw, const char *key, uint64_t value)
+{
+  jsonwr_member(pw, key);
+  jsonwr_putUint(pw, value);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// jsonwr_int
+//
+
+void
+jsonwr_int(jsonwr_t *pw, const char *key, int64_t value)
+{
+  jsonwr_member(pw, key);
+
+  if (value < 0) {
+    jsonwr_putc(pw, '-');
+    jsonwr_putUint(pw, (uint64_t) (-(value + 1)) + 1);
+  }
+  else {
+    jsonwr_putUint(pw, (uint64_t) value);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// jsonwr_bool
+//
+
+void
+jsonwr_bool(jsonwr_t *pw, const char *key, bool value)
+{
+  jsonwr_member(pw, key);
+  jsonwr_puts(pw, value ? "true" : "false");
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// jsonwr_finish
+//
+
+esp_err_t
+jsonwr_finish(jsonwr_t *pw)
+{
+  jsonwr_flush(pw);
+
+  if (ESP_OK != pw->err) {
+    return pw->err;
+  }
+
+  return httpd_resp_send_chunk(pw->req, NULL, 0);
+}
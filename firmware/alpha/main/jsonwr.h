@@ -0,0 +1,151 @@
+/*
+  File: jsonwr.h
+
+  VSCP alpha node streaming JSON writer
+
+  This file is part of the VSCP (https://www.vscp.org)
+
+  The MIT License (MIT)
+  Copyright © 2022-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  JSON documents are written into a small buffer that is sent as a HTTP
+  chunk each time it fills up. A document of any size can be sent without
+  building it in memory.
+*/
+
+#ifndef __VSCP_ALPHA_JSONWR__
+#define __VSCP_ALPHA_JSONWR__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <esp_http_server.h>
+
+#define JSONWR_BUF_SIZE  512 // Size of send buffer
+#define JSONWR_MAX_DEPTH 8   // Max nesting of objects and arrays
+
+/**
+ * @brief Writer state
+ */
+typedef struct {
+  httpd_req_t *req;              // Request the document is sent on
+  esp_err_t err;                 // First send error
+  uint8_t depth;                 // Current nesting level
+  bool bFirst[JSONWR_MAX_DEPTH]; // No member written yet on level
+  size_t len;                    // Bytes in buffer
+  char buf[JSONWR_BUF_SIZE];     // Send buffer
+} jsonwr_t;
+
+/**
+ * @brief Start a JSON response
+ *
+ * Sets content type and cache headers for the response.
+ *
+ * @param pw Pointer to writer
+ * @param req Request to send document on
+ */
+void
+jsonwr_init(jsonwr_t *pw, httpd_req_t *req);
+
+/**
+ * @brief Start an object
+ *
+ * @param pw Pointer to writer
+ * @param key Member name or NULL for the root object or an array element
+ */
+void
+jsonwr_begin_object(jsonwr_t *pw, const char *key);
+
+/**
+ * @brief End current object
+ *
+ * @param pw Pointer to writer
+ */
+void
+jsonwr_end_object(jsonwr_t *pw);
+
+/**
+ * @brief Start an array
+ *
+ * @param pw Pointer to writer
+ * @param key Member name or NULL for the root or an array element
+ */
+void
+jsonwr_begin_array(jsonwr_t *pw, const char *key);
+
+/**
+ * @brief End current array
+ *
+ * @param pw Pointer to writer
+ */
+void
+jsonwr_end_array(jsonwr_t *pw);
+
+/**
+ * @brief Write a string value
+ *
+ * @param pw Pointer to writer
+ * @param key Member name or NULL for an array element
+ * @param value String to write. Escaped as needed. NULL is written as null.
+ */
+void
+jsonwr_string(jsonwr_t *pw, const char *key, const char *value);
+
+/**
+ * @brief Write a signed integer value
+ *
+ * @param pw Pointer to writer
+ * @param key Member name or NULL for an array element
+ * @param value Value to write
+ */
+void
+jsonwr_int(jsonwr_t *pw, const char *key, int64_t value);
+
+/**
+ * @brief Write an unsigned integer value
+ *
+ * @param pw Pointer to writer
+ * @param key Member name or NULL for an array element
+ * @param value Value to write
+ */
+void
+jsonwr_uint(jsonwr_t *pw, const char *key, uint64_t value);
+
+/**
+ * @brief Write a boolean value
+ *
+ * @param pw Pointer to writer
+ * @param key Member name or NULL for an array element
+ * @param value Value to write
+ */
+void
+jsonwr_bool(jsonwr_t *pw, const char *key, bool value);
+
+/**
+ * @brief Send what is left in the buffer and end the response
+ *
+ * @param pw Pointer to writer
+ * @return ESP_OK if the whole document was sent, error code otherwise.
+ */
+esp_err_t
+jsonwr_finish(jsonwr_t *pw);
+
+#endif
@@ -0,0 +1,380 @@
+/*
+  File: mailbox.c
+
+  VSCP alpha node store-and-forward mailboxes for sleeping nodes
+
+  This file is part of the VSCP (https://www.vscp.org)
+
+  The MIT License (MIT)
+  Copyright © 2022-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <freertos/FreeRTOS.h>
+#include "freertos/semphr.h"
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include "esp_log.h"
+#include <esp_timer.h>
+
+#include <string.h>
+
+#include "alpha.h"
+#include <vscp.h>
+#include <vscp-class.h>
+#include <vscp-type.h>
+#include <vscp-firmware-helper.h>
+#include <vscp-espnow.h>
+
+#include "mailbox.h"
+
+static const char *TAG = "mailbox";
+
+// Mailbox for one gamma node
+typedef struct {
+  bool bUsed;                                 // Slot is in use
+  uint8_t mac[ESP_NOW_ETH_ALEN];              // MAC address of node
+  uint16_t nickname;                          // Nickname of node
+  int64_t tsWake;                             // Time for last wake up (us)
+  uint8_t head;                               // Index for oldest event
+  uint8_t count;                              // Number of events in mailbox
+  vscpEvent *events[CONFIG_APP_MAILBOX_SIZE]; // Events waiting for node
+} mailbox_node_t;
+
+static mailbox_node_t s_nodes[CONFIG_APP_MAILBOX_MAX_NODES];
+static SemaphoreHandle_t s_mutexMailbox = NULL;
+static QueueHandle_t s_queueWake        = NULL; // Index of nodes with mail to deliver
+static mailbox_stats_t s_stats          = { 0 };
+
+///////////////////////////////////////////////////////////////////////////////
+// mailbox_findMac
+//
+// Must be called with the mailbox mutex held
+//
+
+static int
+mailbox_findMac(const uint8_t *mac)
+{
+  for (int i = 0; i < CONFIG_APP_MAILBOX_MAX_NODES; i++) {
+    if (s_nodes[i].bUsed && !memcmp(s_nodes[i].mac, mac, ESP_NOW_ETH_ALEN)) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mailbox_findNickname
+//
+// Must be called with the mailbox mutex held
+//
+
+static int
+mailbox_findNickname(uint16_t nickname)
+{
+  for (int i = 0; i < CONFIG_APP_MAILBOX_MAX_NODES; i++) {
+    if (s_nodes[i].bUsed && (s_nodes[i].nickname == nickname)) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mailbox_newNode
+//
+// Get a free slot. If all are used the slot for the node that has been
+// silent for the longest time with an empty mailbox is reused.
+// Must be called with the mailbox mutex held
+//
+
+static int
+mailbox_newNode(const uint8_t *mac)
+{
+  int idx = -1;
+
+  for (int i = 0; i < CONFIG_APP_MAILBOX_MAX_NODES; i++) {
+    if (!s_nodes[i].bUsed) {
+      idx = i;
+      break;
+    }
+    if (!s_nodes[i].count && ((-1 == idx) || (s_nodes[i].tsWake < s_nodes[idx].tsWake))) {
+      idx = i;
+    }
+  }
+
+  if (-1 == idx) {
+    return -1;
+  }
+
+  memset(&s_nodes[idx], 0, sizeof(mailbox_node_t));
+  s_nodes[idx].bUsed = true;
+  memcpy(s_nodes[idx].mac, mac, ESP_NOW_ETH_ALEN);
+
+  return idx;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mailbox_getTarget
+//
+// Find the mailbox for the node an event is addressed to.
+// Must be called with the mailbox mutex held
+//
+
+static int
+mailbox_getTarget(const vscpEvent *pev)
+{
+  if (VSCP_CLASS1_PROTOCOL == pev->vscp_class) {
+
+    // Addressed Level I protocol events have the nickname of the target node in the first data byte
+    switch (pev->vscp_type) {
+      case VSCP_TYPE_PROTOCOL_SET_NICKNAME:
+      case VSCP_TYPE_PROTOCOL_DROP_NICKNAME:
+      case VSCP_TYPE_PROTOCOL_READ_REGISTER:
+      case VSCP_TYPE_PROTOCOL_WRITE_REGISTER:
+      case VSCP_TYPE_PROTOCOL_RESET_DEVICE:
+      case VSCP_TYPE_PROTOCOL_PAGE_READ:
+      case VSCP_TYPE_PROTOCOL_PAGE_WRITE:
+      case VSCP_TYPE_PROTOCOL_INCREMENT_REGISTER:
+      case VSCP_TYPE_PROTOCOL_DECREMENT_REGISTER:
+      case VSCP_TYPE_PROTOCOL_WHO_IS_THERE:
+      case VSCP_TYPE_PROTOCOL_GET_MATRIX_INFO:
+      case VSCP_TYPE_PROTOCOL_GET_EMBEDDED_MDF:
+      case VSCP_TYPE_PROTOCOL_EXTENDED_PAGE_READ:
+      case VSCP_TYPE_PROTOCOL_EXTENDED_PAGE_WRITE:
+      case VSCP_TYPE_PROTOCOL_GET_EVENT_INTEREST:
+        if ((pev->sizeData < 1) || (NULL == pev->pdata) || (0xff == pev->pdata[0])) {
+          return -1;
+        }
+        return mailbox_findNickname(pev->pdata[0]);
+
+      default:
+        return -1;
+    }
+  }
+
+  // Level II protocol events have the GUID of the target node first in data
+  if (VSCP_CLASS2_LEVEL1_PROTOCOL == pev->vscp_class) {
+    if ((pev->sizeData < 16) || (NULL == pev->pdata)) {
+      return -1;
+    }
+    return mailbox_findMac(pev->pdata + 8);
+  }
+
+  return -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mailbox_task
+//
+// Deliver the content of a mailbox in one burst when the node is awake
+//
+
+static void
+mailbox_task(void *pvParameters)
+{
+  int idx;
+  int cnt;
+  uint8_t mac[ESP_NOW_ETH_ALEN];
+  vscpEvent *events[CONFIG_APP_MAILBOX_SIZE];
+
+  for (;;) {
+
+    if (pdTRUE != xQueueReceive(s_queueWake, &idx, portMAX_DELAY)) {
+      continue;
+    }
+
+    // Take all events out of the mailbox so new ones can be stored while we send
+    xSemaphoreTake(s_mutexMailbox, portMAX_DELAY);
+    mailbox_node_t *pnode = &s_nodes[idx];
+    memcpy(mac, pnode->mac, ESP_NOW_ETH_ALEN);
+    for (cnt = 0; cnt < pnode->count; cnt++) {
+      events[cnt] = pnode->events[(pnode->head + cnt) % CONFIG_APP_MAILBOX_SIZE];
+    }
+    pnode->head  = 0;
+    pnode->count = 0;
+    xSemaphoreGive(s_mutexMailbox);
+
+    if (cnt) {
+      ESP_LOGI(TAG, "Delivering %d event(s) to " MACSTR, cnt, MAC2STR(mac));
+    }
+
+    for (int i = 0; i < cnt; i++) {
+      if (VSCP_ERROR_SUCCESS == vscp_espnow_sendEvent(mac, events[i], true, CONFIG_APP_MAILBOX_SEND_TIMEOUT)) {
+        s_stats.nDelivered++;
+      }
+      else {
+        s_stats.nFailed++;
+      }
+      vscp_fwhlp_deleteEvent(&events[i]);
+    }
+  }
+
+  vTaskDelete(NULL);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mailbox_init
+//
+
+int
+mailbox_init(void)
+{
+  memset(s_nodes, 0, sizeof(s_nodes));
+
+  s_mutexMailbox = xSemaphoreCreateMutex();
+  if (NULL == s_mutexMailbox) {
+    ESP_LOGE(TAG, "Unable to create mailbox mutex");
+    return VSCP_ERROR_MEMORY;
+  }
+
+  s_queueWake = xQueueCreate(CONFIG_APP_MAILBOX_MAX_NODES, sizeof(int));
+  if (NULL == s_queueWake) {
+    ESP_LOGE(TAG, "Unable to create mailbox wake queue");
+    return VSCP_ERROR_MEMORY;
+  }
+
+  if (pdPASS != xTaskCreate(mailbox_task, "mailbox", 3072, NULL, 5, NULL)) {
+    ESP_LOGE(TAG, "Unable to create mailbox task");
+    return VSCP_ERROR_MEMORY;
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mailbox_received
+//
+
+int
+mailbox_received(const vscpEvent *pev, const vscp_espnow_rx_info_t *pinfo)
+{
+  int idx;
+
+  // Check pointers
+  if ((NULL == pev) || (NULL == pinfo)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if ((NULL == s_mutexMailbox) || (VSCP_DROPLET_GAMMA != pinfo->node_type)) {
+    return VSCP_ERROR_SUCCESS;
+  }
+
+  xSemaphoreTake(s_mutexMailbox, portMAX_DELAY);
+
+  if (-1 == (idx = mailbox_findMac(pinfo->src_addr))) {
+    if (-1 == (idx = mailbox_newNode(pinfo->src_addr))) {
+      xSemaphoreGive(s_mutexMailbox);
+      ESP_LOGW(TAG, "No free mailbox for " MACSTR, MAC2STR(pinfo->src_addr));
+      return VSCP_ERROR_BUFFER_FULL;
+    }
+    ESP_LOGI(TAG, "Mailbox created for " MACSTR, MAC2STR(pinfo->src_addr));
+  }
+
+  s_nodes[idx].nickname = ((uint16_t) pev->GUID[14] << 8) + pev->GUID[15];
+
+  // Node is awake. Deliver what is waiting for it.
+  if ((VSCP_CLASS1_PROTOCOL == pev->vscp_class) && (VSCP_TYPE_PROTOCOL_NEW_NODE_ONLINE == pev->vscp_type)) {
+    s_nodes[idx].tsWake = esp_timer_get_time();
+    s_stats.nWakeups++;
+    if (s_nodes[idx].count) {
+      xQueueSend(s_queueWake, &idx, 0);
+    }
+  }
+
+  xSemaphoreGive(s_mutexMailbox);
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mailbox_post
+//
+
+int
+mailbox_post(const vscpEvent *pev)
+{
+  int idx;
+  vscpEvent *pcopy;
+
+  // Check pointer
+  if (NULL == pev) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if (NULL == s_mutexMailbox) {
+    return VSCP_ERROR_UNKNOWN_ITEM;
+  }
+
+  xSemaphoreTake(s_mutexMailbox, portMAX_DELAY);
+
+  if (-1 == (idx = mailbox_getTarget(pev))) {
+    xSemaphoreGive(s_mutexMailbox);
+    return VSCP_ERROR_UNKNOWN_ITEM;
+  }
+
+  if (NULL == (pcopy = vscp_fwhlp_mkEventCopy(pev))) {
+    xSemaphoreGive(s_mutexMailbox);
+    return VSCP_ERROR_MEMORY;
+  }
+
+  mailbox_node_t *pnode = &s_nodes[idx];
+
+  // Full mailbox: the oldest event is dropped to make room for the new one
+  if (CONFIG_APP_MAILBOX_SIZE == pnode->count) {
+    vscp_fwhlp_deleteEvent(&pnode->events[pnode->head]);
+    pnode->head = (pnode->head + 1) % CONFIG_APP_MAILBOX_SIZE;
+    pnode->count--;
+    s_stats.nDropped++;
+  }
+
+  pnode->events[(pnode->head + pnode->count) % CONFIG_APP_MAILBOX_SIZE] = pcopy;
+  pnode->count++;
+  s_stats.nStored++;
+
+  // Node is still in its listen window after wake up. Send right away.
+  if ((esp_timer_get_time() - pnode->tsWake) < (CONFIG_APP_MAILBOX_AWAKE_TIME * 1000LL)) {
+    xQueueSend(s_queueWake, &idx, 0);
+  }
+
+  xSemaphoreGive(s_mutexMailbox);
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mailbox_get_stats
+//
+
+int
+mailbox_get_stats(mailbox_stats_t *pstats)
+{
+  // Check pointer
+  if (NULL == pstats) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  memcpy(pstats, &s_stats, sizeof(mailbox_stats_t));
+
+  return VSCP_ERROR_SUCCESS;
+}
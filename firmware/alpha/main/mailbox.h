@@ -0,0 +1,92 @@
+/*
+  File: mailbox.h
+
+  VSCP alpha node store-and-forward mailboxes for sleeping nodes
+
+  This file is part of the VSCP (https://www.vscp.org)
+
+  The MIT License (MIT)
+  Copyright © 2022-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  Gamma nodes sleep most of the time and only listen for a short while after
+  they have sent VSCP_TYPE_PROTOCOL_NEW_NODE_ONLINE on wake up. Events addressed
+  to a gamma node are held in a mailbox for the node on the alpha and are sent
+  to it in one burst when it wakes up.
+*/
+
+#ifndef __VSCP_ALPHA_MAILBOX__
+#define __VSCP_ALPHA_MAILBOX__
+
+#include <vscp.h>
+#include <vscp-espnow.h>
+
+/**
+ * @brief Mailbox statistics
+ */
+typedef struct {
+  uint32_t nStored;    // Events stored in a mailbox
+  uint32_t nDelivered; // Events delivered to a node after wake up
+  uint32_t nDropped;   // Events dropped because a mailbox was full
+  uint32_t nFailed;    // Events that could not be sent to a woken node
+  uint32_t nWakeups;   // Number of wake ups seen from gamma nodes
+} mailbox_stats_t;
+
+/**
+ * @brief Initialize mailboxes
+ *
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+mailbox_init(void);
+
+/**
+ * @brief Handle an event received from a node
+ *
+ * Learns the address and nickname of gamma nodes and starts delivery of the
+ * mailbox of a node when it report that it is awake.
+ *
+ * @param pev Pointer to received event
+ * @param pinfo Pointer to information about the frame the event came in
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+mailbox_received(const vscpEvent *pev, const vscp_espnow_rx_info_t *pinfo);
+
+/**
+ * @brief Store an event in the mailbox of the node it is addressed to
+ *
+ * @param pev Pointer to event. The event is copied.
+ * @return VSCP_ERROR_SUCCESS if the event was stored, VSCP_ERROR_UNKNOWN_ITEM
+ *         if the event is not addressed to a known gamma node, error code otherwise.
+ */
+int
+mailbox_post(const vscpEvent *pev);
+
+/**
+ * @brief Get mailbox statistics
+ *
+ * @param pstats Pointer to statistics structure that will be filled in
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+mailbox_get_stats(mailbox_stats_t *pstats);
+
+#endif
@@ -33,8 +33,12 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
 #include <esp_system.h>
 #include <esp_partition.h>
 #include <spi_flash_mmap.h>
@@ -46,12 +50,15 @@
 #include <esp_tls.h>
 #include <esp_ota_ops.h>
 #include <esp_mac.h> // esp_base_mac_addr_get
+#include <esp_timer.h>
 #include <sys/param.h>
 
 #include <vscp.h>
 #include <vscp-firmware-helper.h>
 
 #include <alpha.h>
+#include "cfgstore.h"
+#include "eventbus.h"
 #include "mqtt.h"
 
 // Global stuff
@@ -67,6 +74,107 @@ static bool s_mqtt_connected = false; // true when connected
 
 static mqtt_stats_t s_mqtt_statistics = { 0 };
 
+static bool s_mqtt_eventbus = false; // true when subscribed to event bus
+static int s_mqtt_busHandle = -1;    // Event bus subscriber handle
+
+// Precompiled topics
+
+#define MQTT_TOPIC_MAX_LEN    256 // Max length for a rendered topic
+#define MQTT_TOPIC_MAX_TOKENS 32  // Max number of parts in a topic template
+
+typedef enum {
+  MQTT_TOKEN_LITERAL = 0, // Literal text (node constants already substituted)
+  MQTT_TOKEN_EVGUID,
+  MQTT_TOKEN_CLASS,
+  MQTT_TOKEN_TYPE,
+  MQTT_TOKEN_EVNICKNAME,
+  MQTT_TOKEN_SINDEX,
+  MQTT_TOKEN_TIMESTAMP,
+  MQTT_TOKEN_INDEX, // Index, zone and subzone must be in data byte order
+  MQTT_TOKEN_ZONE,
+  MQTT_TOKEN_SUBZONE,
+  MQTT_TOKEN_DATA,
+  MQTT_TOKEN_YEAR,
+  MQTT_TOKEN_FYEAR,
+  MQTT_TOKEN_MONTH,
+  MQTT_TOKEN_DAY,
+  MQTT_TOKEN_HOUR,
+  MQTT_TOKEN_MINUTE,
+  MQTT_TOKEN_SECOND,
+} mqtt_token_id_t;
+
+typedef struct {
+  uint8_t id;     // mqtt_token_id_t
+  uint8_t arg;    // Data byte for {{d[n]}}
+  uint8_t offset; // Offset for literal in text
+  uint8_t len;    // Length of literal
+} mqtt_token_t;
+
+typedef struct {
+  char text[MQTT_TOPIC_MAX_LEN]; // Literal parts of topic
+  uint8_t cntTokens;             // Number of tokens
+  mqtt_token_t tokens[MQTT_TOPIC_MAX_TOKENS];
+} mqtt_topic_t;
+
+static mqtt_topic_t s_topicPub;               // Compiled g_persistent.mqttPub
+static mqtt_topic_t s_topicPubLog;            // Compiled g_persistent.mqttPubLog
+static mqtt_topic_t s_topicSub;               // Compiled g_persistent.mqttSub
+static SemaphoreHandle_t s_mutexTopic = NULL; // Protects compiled topics
+
+/*
+  Payload encoding. Large enough for a JSON encoded event with max
+  data size. Binary and CBOR payloads are much smaller.
+*/
+#define MQTT_PAYLOAD_MAX_LEN 2048
+
+static uint8_t s_payload[MQTT_PAYLOAD_MAX_LEN];
+static SemaphoreHandle_t s_mutexPayload = NULL; // Protects payload buffer and batch
+
+/*
+  Batching. Events for the same topic are collected in the payload buffer
+  and published as one message when the batch size is reached, the topic
+  changes or the batch time has passed. JSON events are sent as an array,
+  binary frames and CBOR items are concatenated. With batching disabled
+  every event is published as soon as it is encoded.
+*/
+#ifdef CONFIG_APP_MQTT_BATCH
+#define MQTT_BATCH_SIZE CONFIG_APP_MQTT_BATCH_SIZE
+#define MQTT_BATCH_TIME CONFIG_APP_MQTT_BATCH_TIME
+#else
+#define MQTT_BATCH_SIZE 0
+#define MQTT_BATCH_TIME 0
+#endif
+
+// Time the event bus holds off events when the outbox is full
+#define MQTT_HOLD_OFF_TIME 100
+
+static char s_batchTopic[MQTT_TOPIC_MAX_LEN]; // Topic for batch
+static uint8_t s_batchFormat;                 // Payload format for batch
+static size_t s_batchLen;                     // Bytes in batch
+static uint16_t s_batchCnt;                   // Events in batch
+static esp_timer_handle_t s_batchTimer = NULL;
+
+// Server certificate. Read from flash each time the client is started and
+// kept for as long as that client may (re)connect, as the client only
+// holds a pointer to it.
+static char *s_serverCert = NULL;
+
+// VSCP binary frame (same layout as the VSCP UDP frame)
+#define MQTT_FRAME_POS_PKTTYPE   0  // Packet type (0 = unencrypted)
+#define MQTT_FRAME_POS_HEAD      1  // VSCP head (2 bytes)
+#define MQTT_FRAME_POS_TIMESTAMP 3  // Timestamp (4 bytes)
+#define MQTT_FRAME_POS_YEAR      7  // Year (2 bytes)
+#define MQTT_FRAME_POS_MONTH     9  // Month
+#define MQTT_FRAME_POS_DAY       10 // Day
+#define MQTT_FRAME_POS_HOUR      11 // Hour
+#define MQTT_FRAME_POS_MINUTE    12 // Minute
+#define MQTT_FRAME_POS_SECOND    13 // Second
+#define MQTT_FRAME_POS_CLASS     14 // VSCP class (2 bytes)
+#define MQTT_FRAME_POS_TYPE      16 // VSCP type (2 bytes)
+#define MQTT_FRAME_POS_GUID      18 // GUID (16 bytes)
+#define MQTT_FRAME_POS_SIZE      34 // Data size (2 bytes)
+#define MQTT_FRAME_POS_DATA      36 // Data followed by two byte CRC
+
 // #if CONFIG_BROKER_CERTIFICATE_OVERRIDDEN == 1
 // static const uint8_t mqtt_eclipseprojects_io_pem_start[] =
 //   "-----BEGIN CERTIFICATE-----\n" CONFIG_BROKER_CERTIFICATE_OVERRIDE "\n-----END CERTIFICATE-----";
@@ -97,320 +205,1318 @@ extern const uint8_t mqtt_eclipse_io_pem_end[] asm("_binary_mqtt_eclipse_io_pem_
 // }
 
 ///////////////////////////////////////////////////////////////////////////////
-// mqtt_topic_subst
+// mqtt_topic_compile
+//
+// Parse a topic template into a list of literal parts and event tokens.
+// Tokens that only depend on the node are substituted here once so
+// rendering a topic for an event is a single pass over the token list.
+//
+
+static int
+mqtt_topic_compile(mqtt_topic_t *ptopic, const char *tmpl)
+{
+  char workbuf[48];
+  uint8_t GUID[16];
+  size_t pos = 0;
+
+  /*
+    {{node}}        - Node name
+    {{guid}}        - Node GUID
+    {{evguid}}      - Event GUID
+    {{class}}       - Event class
+    {{type}}        - Event type
+    {{nickname}}    - Node nickname (16-bit)
+    {{evnickname}}  - Node nickname (16-bit) for node sending event
+    {{sindex}}      - Sensor index (if any)
+    {{timestamp}}   - Timestamep for event
+    {{index}}       - Index (data byte 0) (if any)
+    {{zone}}        - Zone (data byte 1) (if any)
+    {{subzone}}     - Sub Zone (data byte 2) (if any)
+    {{d[n]}}        - Data byte n (if any)
+    {{year}}        - Two digit year of event (Time always in GMT).
+    {{fyear}}       - Four digit year of event (Time always in GMT).
+    {{month}}       - Two digit month of event (Time always in GMT).
+    {{day}}         - Two digit day of event (Time always in GMT).
+    {{hour}}        - Two digit hour of event (Time always in GMT).
+    {{minute}}      - Two digit minute of event (Time always in GMT).
+    {{second}}      - Two digit second of event (Time always in GMT).
+
+    Typical topic
+    vscp/FF:FF:FF:FF:FF:FF:FF:F5:01:00:00:00:00:00:00:02/20/9/2
+    vscp/{{guid}}/{{class}}/{{type}}/{{index}}
+  */
+
+  static const struct {
+    const char *name;
+    uint8_t id;
+  } tokens[] = {
+    { "evguid", MQTT_TOKEN_EVGUID },   { "class", MQTT_TOKEN_CLASS },
+    { "type", MQTT_TOKEN_TYPE },       { "evnickname", MQTT_TOKEN_EVNICKNAME },
+    { "sindex", MQTT_TOKEN_SINDEX },   { "timestamp", MQTT_TOKEN_TIMESTAMP },
+    { "index", MQTT_TOKEN_INDEX },     { "zone", MQTT_TOKEN_ZONE },
+    { "subzone", MQTT_TOKEN_SUBZONE }, { "year", MQTT_TOKEN_YEAR },
+    { "fyear", MQTT_TOKEN_FYEAR },     { "month", MQTT_TOKEN_MONTH },
+    { "day", MQTT_TOKEN_DAY },         { "hour", MQTT_TOKEN_HOUR },
+    { "minute", MQTT_TOKEN_MINUTE },   { "second", MQTT_TOKEN_SECOND },
+  };
+
+  // Check pointers
+  if ((NULL == ptopic) || (NULL == tmpl)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  memset(ptopic, 0, sizeof(mqtt_topic_t));
+  vscp_espnow_get_node_guid(GUID);
+
+  while (*tmpl) {
+
+    const char *pstart = strstr(tmpl, "{{");
+    const char *pend   = (NULL != pstart) ? strstr(pstart + 2, "}}") : NULL;
+    size_t litlen      = (NULL != pend) ? (size_t) (pstart - tmpl) : strlen(tmpl);
+    const char *pconst = NULL;
+    uint8_t id         = MQTT_TOKEN_LITERAL;
+    uint8_t arg        = 0;
+
+    // Literal part up to the token (or rest of template)
+    if (litlen) {
+      if ((pos + litlen >= sizeof(ptopic->text)) || (ptopic->cntTokens >= MQTT_TOPIC_MAX_TOKENS)) {
+        return VSCP_ERROR_BUFFER_TO_SMALL;
+      }
+      memcpy(ptopic->text + pos, tmpl, litlen);
+      ptopic->tokens[ptopic->cntTokens].id     = MQTT_TOKEN_LITERAL;
+      ptopic->tokens[ptopic->cntTokens].offset = pos;
+      ptopic->tokens[ptopic->cntTokens].len    = litlen;
+      ptopic->cntTokens++;
+      pos += litlen;
+      tmpl += litlen;
+    }
+
+    if (NULL == pend) {
+      break;
+    }
+
+    const char *pname = pstart + 2;
+    size_t namelen    = pend - pname;
+    tmpl              = pend + 2;
+
+    // Node constants are resolved now
+    if ((4 == namelen) && !memcmp(pname, "node", 4)) {
+      pconst = g_persistent.nodeName;
+    }
+    else if ((4 == namelen) && !memcmp(pname, "guid", 4)) {
+      vscp_fwhlp_writeGuidToString(workbuf, GUID);
+      pconst = workbuf;
+    }
+    else if ((8 == namelen) && !memcmp(pname, "nickname", 8)) {
+      sprintf(workbuf, "%d", ((GUID[14] << 8) + (GUID[15])));
+      pconst = workbuf;
+    }
+    else if ((namelen > 3) && !memcmp(pname, "d[", 2) && (']' == pname[namelen - 1])) {
+      id  = MQTT_TOKEN_DATA;
+      arg = atoi(pname + 2);
+    }
+    else {
+      for (int i = 0; i < sizeof(tokens) / sizeof(tokens[0]); i++) {
+        if ((strlen(tokens[i].name) == namelen) && !memcmp(pname, tokens[i].name, namelen)) {
+          id = tokens[i].id;
+          break;
+        }
+      }
+    }
+
+    if (ptopic->cntTokens >= MQTT_TOPIC_MAX_TOKENS) {
+      return VSCP_ERROR_BUFFER_TO_SMALL;
+    }
+
+    // Unknown tokens are kept as they are
+    if ((NULL == pconst) && (MQTT_TOKEN_LITERAL == id)) {
+      pconst = pstart;
+      namelen += 4;
+    }
+    else if (NULL != pconst) {
+      namelen = strlen(pconst);
+    }
+
+    if (NULL != pconst) {
+      if (pos + namelen >= sizeof(ptopic->text)) {
+        return VSCP_ERROR_BUFFER_TO_SMALL;
+      }
+      memcpy(ptopic->text + pos, pconst, namelen);
+      ptopic->tokens[ptopic->cntTokens].id     = MQTT_TOKEN_LITERAL;
+      ptopic->tokens[ptopic->cntTokens].offset = pos;
+      ptopic->tokens[ptopic->cntTokens].len    = namelen;
+      pos += namelen;
+    }
+    else {
+      ptopic->tokens[ptopic->cntTokens].id  = id;
+      ptopic->tokens[ptopic->cntTokens].arg = arg;
+    }
+    ptopic->cntTokens++;
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_putUint
+//
+// Write an unsigned number with at least 'width' digits
+//
+
+static char *
+mqtt_putUint(char *p, const char *pend, uint32_t val, int width)
+{
+  char digits[10];
+  int n = 0;
+
+  do {
+    digits[n++] = '0' + (val % 10);
+    val /= 10;
+  } while (val && (n < sizeof(digits)));
+
+  while (n < width) {
+    digits[n++] = '0';
+  }
+
+  while (n && (p < pend)) {
+    *p++ = digits[--n];
+  }
+
+  return p;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_topic_render
+//
+// Render a compiled topic for an event. pev can be NULL in which case event
+// tokens are left empty.
+//
+
+static int
+mqtt_topic_render(char *buf, size_t len, const mqtt_topic_t *ptopic, const vscpEvent *pev)
+{
+  char *p          = buf;
+  const char *pend = buf + len - 1; // Room for terminating zero
+  char workbuf[48];
+
+  for (int i = 0; i < ptopic->cntTokens; i++) {
+
+    const mqtt_token_t *ptoken = &ptopic->tokens[i];
+
+    if (MQTT_TOKEN_LITERAL == ptoken->id) {
+      if (p + ptoken->len > pend) {
+        return VSCP_ERROR_BUFFER_TO_SMALL;
+      }
+      memcpy(p, ptopic->text + ptoken->offset, ptoken->len);
+      p += ptoken->len;
+      continue;
+    }
+
+    // Skip event related escapes if no event set
+    if (NULL == pev) {
+      continue;
+    }
+
+    switch (ptoken->id) {
+
+      case MQTT_TOKEN_EVGUID: {
+        vscp_fwhlp_writeGuidToString(workbuf, pev->GUID);
+        size_t n = strlen(workbuf);
+        if (p + n > pend) {
+          return VSCP_ERROR_BUFFER_TO_SMALL;
+        }
+        memcpy(p, workbuf, n);
+        p += n;
+      } break;
+
+      case MQTT_TOKEN_CLASS:
+        p = mqtt_putUint(p, pend, pev->vscp_class, 1);
+        break;
+
+      case MQTT_TOKEN_TYPE:
+        p = mqtt_putUint(p, pend, pev->vscp_type, 1);
+        break;
+
+      case MQTT_TOKEN_EVNICKNAME:
+        p = mqtt_putUint(p, pend, (pev->GUID[14] << 8) + pev->GUID[15], 1);
+        break;
+
+      case MQTT_TOKEN_SINDEX:
+        if (VSCP_ERROR_SUCCESS == vscp_fwhlp_isMeasurement(pev)) {
+          p = mqtt_putUint(p, pend, vscp_fwhlp_getMeasurementSensorIndex(pev), 1);
+        }
+        break;
+
+      case MQTT_TOKEN_TIMESTAMP:
+        p = mqtt_putUint(p, pend, pev->timestamp, 1);
+        break;
+
+      case MQTT_TOKEN_INDEX:
+      case MQTT_TOKEN_ZONE:
+      case MQTT_TOKEN_SUBZONE:
+        if ((NULL != pev->pdata) && (pev->sizeData > (ptoken->id - MQTT_TOKEN_INDEX))) {
+          p = mqtt_putUint(p, pend, pev->pdata[ptoken->id - MQTT_TOKEN_INDEX], 1);
+        }
+        break;
+
+      case MQTT_TOKEN_DATA:
+        if ((NULL != pev->pdata) && (pev->sizeData > ptoken->arg)) {
+          p = mqtt_putUint(p, pend, pev->pdata[ptoken->arg], 1);
+        }
+        break;
+
+      case MQTT_TOKEN_YEAR:
+        p = mqtt_putUint(p, pend, pev->year % 100, 2);
+        break;
+
+      case MQTT_TOKEN_FYEAR:
+        p = mqtt_putUint(p, pend, pev->year, 4);
+        break;
+
+      case MQTT_TOKEN_MONTH:
+        p = mqtt_putUint(p, pend, pev->month, 2);
+        break;
+
+      case MQTT_TOKEN_DAY:
+        p = mqtt_putUint(p, pend, pev->day, 2);
+        break;
+
+      case MQTT_TOKEN_HOUR:
+        p = mqtt_putUint(p, pend, pev->hour, 2);
+        break;
+
+      case MQTT_TOKEN_MINUTE:
+        p = mqtt_putUint(p, pend, pev->minute, 2);
+        break;
+
+      case MQTT_TOKEN_SECOND:
+        p = mqtt_putUint(p, pend, pev->second, 2);
+        break;
+    }
+
+    if (p >= pend) {
+      return VSCP_ERROR_BUFFER_TO_SMALL;
+    }
+  }
+
+  *p = '\0';
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_compile_topics
+//
+
+int
+mqtt_compile_topics(void)
+{
+  int rv = VSCP_ERROR_SUCCESS;
+  int ret;
+  static mqtt_topic_t topic; // Too large for the stack of some callers
+
+  if (NULL == s_mutexTopic) {
+    s_mutexTopic = xSemaphoreCreateMutex();
+    if (NULL == s_mutexTopic) {
+      return VSCP_ERROR_MEMORY;
+    }
+  }
+
+  xSemaphoreTake(s_mutexTopic, portMAX_DELAY);
+
+  if (VSCP_ERROR_SUCCESS != (ret = mqtt_topic_compile(&topic, g_persistent.mqttPub))) {
+    ESP_LOGE(TAG, "Failed to compile publish topic '%s' rv=%d", g_persistent.mqttPub, ret);
+    rv = ret;
+  }
+  memcpy(&s_topicPub, &topic, sizeof(mqtt_topic_t));
+
+  if (VSCP_ERROR_SUCCESS != (ret = mqtt_topic_compile(&topic, g_persistent.mqttPubLog))) {
+    ESP_LOGE(TAG, "Failed to compile log topic '%s' rv=%d", g_persistent.mqttPubLog, ret);
+    rv = ret;
+  }
+  memcpy(&s_topicPubLog, &topic, sizeof(mqtt_topic_t));
+
+  if (VSCP_ERROR_SUCCESS != (ret = mqtt_topic_compile(&topic, g_persistent.mqttSub))) {
+    ESP_LOGE(TAG, "Failed to compile subscribe topic '%s' rv=%d", g_persistent.mqttSub, ret);
+    rv = ret;
+  }
+  memcpy(&s_topicSub, &topic, sizeof(mqtt_topic_t));
+
+  xSemaphoreGive(s_mutexTopic);
+
+  return rv;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_render_topic
+//
+// Render configured topic or a custom topic for an event
+//
+
+static int
+mqtt_render_topic(char *buf, size_t len, const mqtt_topic_t *pcompiled, const char *tmpl, const vscpEvent *pev)
+{
+  int rv;
+
+  // Custom topic. Compiled for this call only.
+  if (NULL != tmpl) {
+    mqtt_topic_t *ptopic = ESP_MALLOC(sizeof(mqtt_topic_t));
+    if (NULL == ptopic) {
+      return VSCP_ERROR_MEMORY;
+    }
+    if (VSCP_ERROR_SUCCESS == (rv = mqtt_topic_compile(ptopic, tmpl))) {
+      rv = mqtt_topic_render(buf, len, ptopic, pev);
+    }
+    ESP_FREE(ptopic);
+    return rv;
+  }
+
+  if (NULL == s_mutexTopic) {
+    return VSCP_ERROR_INIT_MISSING;
+  }
+
+  xSemaphoreTake(s_mutexTopic, portMAX_DELAY);
+  rv = mqtt_topic_render(buf, len, pcompiled, pev);
+  xSemaphoreGive(s_mutexTopic);
+
+  return rv;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_crc16
+//
+// CRC-CCITT (polynomial 0x1021, initial value 0xffff) as used by VSCP frames
+//
+
+static uint16_t
+mqtt_crc16(const uint8_t *buf, size_t len)
+{
+  uint16_t crc = 0xffff;
+
+  while (len--) {
+    crc ^= (uint16_t) *buf++ << 8;
+    for (int i = 0; i < 8; i++) {
+      crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+    }
+  }
+
+  return crc;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_encode_binary
+//
+// Write event as a VSCP binary frame. Same layout as the unencrypted VSCP
+// UDP frame (packet type 0) with a CRC over head to end of data.
+//
+
+static int
+mqtt_encode_binary(uint8_t *buf, size_t size, const vscpEvent *pev, size_t *plen)
+{
+  size_t len = MQTT_FRAME_POS_DATA + pev->sizeData + 2;
+
+  if (len > size) {
+    return VSCP_ERROR_BUFFER_TO_SMALL;
+  }
+
+  buf[MQTT_FRAME_POS_PKTTYPE]       = 0; // Unencrypted
+  buf[MQTT_FRAME_POS_HEAD]          = (pev->head >> 8) & 0xff;
+  buf[MQTT_FRAME_POS_HEAD + 1]      = pev->head & 0xff;
+  buf[MQTT_FRAME_POS_TIMESTAMP]     = (pev->timestamp >> 24) & 0xff;
+  buf[MQTT_FRAME_POS_TIMESTAMP + 1] = (pev->timestamp >> 16) & 0xff;
+  buf[MQTT_FRAME_POS_TIMESTAMP + 2] = (pev->timestamp >> 8) & 0xff;
+  buf[MQTT_FRAME_POS_TIMESTAMP + 3] = pev->timestamp & 0xff;
+  buf[MQTT_FRAME_POS_YEAR]          = (pev->year >> 8) & 0xff;
+  buf[MQTT_FRAME_POS_YEAR + 1]      = pev->year & 0xff;
+  buf[MQTT_FRAME_POS_MONTH]         = pev->month;
+  buf[MQTT_FRAME_POS_DAY]           = pev->day;
+  buf[MQTT_FRAME_POS_HOUR]          = pev->hour;
+  buf[MQTT_FRAME_POS_MINUTE]        = pev->minute;
+  buf[MQTT_FRAME_POS_SECOND]        = pev->second;
+  buf[MQTT_FRAME_POS_CLASS]         = (pev->vscp_class >> 8) & 0xff;
+  buf[MQTT_FRAME_POS_CLASS + 1]     = pev->vscp_class & 0xff;
+  buf[MQTT_FRAME_POS_TYPE]          = (pev->vscp_type >> 8) & 0xff;
+  buf[MQTT_FRAME_POS_TYPE + 1]      = pev->vscp_type & 0xff;
+  memcpy(buf + MQTT_FRAME_POS_GUID, pev->GUID, 16);
+  buf[MQTT_FRAME_POS_SIZE]     = (pev->sizeData >> 8) & 0xff;
+  buf[MQTT_FRAME_POS_SIZE + 1] = pev->sizeData & 0xff;
+  if (pev->sizeData && (NULL != pev->pdata)) {
+    memcpy(buf + MQTT_FRAME_POS_DATA, pev->pdata, pev->sizeData);
+  }
+
+  uint16_t crc = mqtt_crc16(buf + MQTT_FRAME_POS_HEAD, MQTT_FRAME_POS_DATA - MQTT_FRAME_POS_HEAD + pev->sizeData);
+  buf[len - 2] = (crc >> 8) & 0xff;
+  buf[len - 1] = crc & 0xff;
+
+  *plen = len;
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_cborHead
+//
+// Write CBOR item head (major type + argument)
+//
+
+static uint8_t *
+mqtt_cborHead(uint8_t *p, const uint8_t *pend, uint8_t major, uint32_t val)
+{
+  major <<= 5;
+
+  if (val < 24) {
+    if (p + 1 > pend) {
+      return NULL;
+    }
+    *p++ = major | val;
+  }
+  else if (val <= 0xff) {
+    if (p + 2 > pend) {
+      return NULL;
+    }
+    *p++ = major | 24;
+    *p++ = val;
+  }
+  else if (val <= 0xffff) {
+    if (p + 3 > pend) {
+      return NULL;
+    }
+    *p++ = major | 25;
+    *p++ = (val >> 8) & 0xff;
+    *p++ = val & 0xff;
+  }
+  else {
+    if (p + 5 > pend) {
+      return NULL;
+    }
+    *p++ = major | 26;
+    *p++ = (val >> 24) & 0xff;
+    *p++ = (val >> 16) & 0xff;
+    *p++ = (val >> 8) & 0xff;
+    *p++ = val & 0xff;
+  }
+
+  return p;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_cborBytes
+//
+// Write CBOR byte (major type 2) or text (major type 3) string
+//
+
+static uint8_t *
+mqtt_cborBytes(uint8_t *p, const uint8_t *pend, uint8_t major, const void *pdata, size_t len)
+{
+  if ((NULL == p) || (NULL == (p = mqtt_cborHead(p, pend, major, len))) || (p + len > pend)) {
+    return NULL;
+  }
+
+  if (len) {
+    memcpy(p, pdata, len);
+  }
+
+  return p + len;
+}
+
+#define CBOR_UINT  0
+#define CBOR_BYTES 2
+#define CBOR_TEXT  3
+#define CBOR_MAP   5
+
+// CBOR key as text string
+#define CBOR_KEY(p, pend, key) mqtt_cborBytes((p), (pend), CBOR_TEXT, (key), sizeof(key) - 1)
+
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_encode_cbor
+//
+// Write event as a CBOR map with the same keys as the VSCP JSON format.
+// GUID and data are byte strings and the date is an ISO 8601 text string.
+//
+
+static int
+mqtt_encode_cbor(uint8_t *buf, size_t size, const vscpEvent *pev, size_t *plen)
+{
+  uint8_t *p          = buf;
+  const uint8_t *pend = buf + size;
+  char dt[20];
+
+  // YYYY-MM-DDTHH:MM:SS
+  dt[0]  = '0' + (pev->year / 1000) % 10;
+  dt[1]  = '0' + (pev->year / 100) % 10;
+  dt[2]  = '0' + (pev->year / 10) % 10;
+  dt[3]  = '0' + pev->year % 10;
+  dt[4]  = '-';
+  dt[5]  = '0' + (pev->month / 10) % 10;
+  dt[6]  = '0' + pev->month % 10;
+  dt[7]  = '-';
+  dt[8]  = '0' + (pev->day / 10) % 10;
+  dt[9]  = '0' + pev->day % 10;
+  dt[10] = 'T';
+  dt[11] = '0' + (pev->hour / 10) % 10;
+  dt[12] = '0' + pev->hour % 10;
+  dt[13] = ':';
+  dt[14] = '0' + (pev->minute / 10) % 10;
+  dt[15] = '0' + pev->minute % 10;
+  dt[16] = ':';
+  dt[17] = '0' + (pev->second / 10) % 10;
+  dt[18] = '0' + pev->second % 10;
+
+  p = mqtt_cborHead(p, pend, CBOR_MAP, 8);
+  p = CBOR_KEY(p, pend, "vscpHead");
+  p = (NULL != p) ? mqtt_cborHead(p, pend, CBOR_UINT, pev->head) : NULL;
+  p = CBOR_KEY(p, pend, "vscpObId");
+  p = (NULL != p) ? mqtt_cborHead(p, pend, CBOR_UINT, pev->obid) : NULL;
+  p = CBOR_KEY(p, pend, "vscpDateTime");
+  p = mqtt_cborBytes(p, pend, CBOR_TEXT, dt, 19);
+  p = CBOR_KEY(p, pend, "vscpTimeStamp");
+  p = (NULL != p) ? mqtt_cborHead(p, pend, CBOR_UINT, pev->timestamp) : NULL;
+  p = CBOR_KEY(p, pend, "vscpClass");
+  p = (NULL != p) ? mqtt_cborHead(p, pend, CBOR_UINT, pev->vscp_class) : NULL;
+  p = CBOR_KEY(p, pend, "vscpType");
+  p = (NULL != p) ? mqtt_cborHead(p, pend, CBOR_UINT, pev->vscp_type) : NULL;
+  p = CBOR_KEY(p, pend, "vscpGuid");
+  p = mqtt_cborBytes(p, pend, CBOR_BYTES, pev->GUID, 16);
+  p = CBOR_KEY(p, pend, "vscpData");
+  p = mqtt_cborBytes(p, pend, CBOR_BYTES, pev->pdata, (NULL != pev->pdata) ? pev->sizeData : 0);
+
+  if (NULL == p) {
+    return VSCP_ERROR_BUFFER_TO_SMALL;
+  }
+
+  *plen = p - buf;
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_encode_payload
+//
+// Encode event in the selected payload format into a caller supplied buffer
+//
+
+int
+mqtt_encode_payload(uint8_t *buf, size_t size, uint8_t format, const vscpEvent *pev, size_t *plen)
+{
+  int rv;
+
+  switch (format) {
+
+    case MQTT_FORMAT_BINARY:
+      return mqtt_encode_binary(buf, size, pev, plen);
+
+    case MQTT_FORMAT_CBOR:
+      return mqtt_encode_cbor(buf, size, pev, plen);
+
+    case MQTT_FORMAT_JSON:
+    default:
+      if (VSCP_ERROR_SUCCESS != (rv = vscp_fwhlp_create_json((char *) buf, size, pev))) {
+        return rv;
+      }
+      *plen = strlen((char *) buf);
+      return VSCP_ERROR_SUCCESS;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_batch_flush
+//
+// Put collected events in the client outbox. Must be called with the
+// payload mutex held.
+//
+
+static int
+mqtt_batch_flush(void)
+{
+  int rv = VSCP_ERROR_SUCCESS;
+
+  if (NULL != s_batchTimer) {
+    esp_timer_stop(s_batchTimer);
+  }
+
+  if (!s_batchCnt) {
+    return VSCP_ERROR_SUCCESS;
+  }
+
+  if (MQTT_BATCH_SIZE && (MQTT_FORMAT_JSON == s_batchFormat)) {
+    s_payload[s_batchLen++] = ']';
+  }
+
+  // Enqueue never block on the network. The MQTT task sends from the outbox.
+  int msgid = esp_mqtt_client_enqueue(g_mqtt_client,
+                                      s_batchTopic,
+                                      (const char *) s_payload,
+                                      s_batchLen,
+                                      g_persistent.mqttQos,
+                                      g_persistent.mqttRetain,
+                                      true);
+  if (msgid >= 0) {
+    s_mqtt_statistics.nPub += s_batchCnt;
+    s_mqtt_statistics.nPubBatch++;
+  }
+  else {
+    s_mqtt_statistics.nPubFailures += s_batchCnt;
+    ESP_LOGE(TAG,
+             "Failed to publish MQTT message. id=%d Topic=%s outbox-size = %d",
+             msgid,
+             s_batchTopic,
+             esp_mqtt_client_get_outbox_size(g_mqtt_client));
+    rv = VSCP_ERROR_ERROR;
+  }
+
+  s_batchLen = 0;
+  s_batchCnt = 0;
+
+  return rv;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_batch_timer_cb
+//
+// Batch time has passed. Send what we have.
+//
+
+static void
+mqtt_batch_timer_cb(void *arg)
+{
+  xSemaphoreTake(s_mutexPayload, portMAX_DELAY);
+  mqtt_batch_flush();
+  xSemaphoreGive(s_mutexPayload);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_send_vscp_event
+//
+
+int
+mqtt_send_vscp_event(const char *topic, const vscpEvent *pev)
+{
+  int rv;
+  size_t len;
+  char newTopic[MQTT_TOPIC_MAX_LEN];
+
+  // Check event pointer
+  if (NULL == pev) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  // If not connected there is no meaning to send event
+  if (!s_mqtt_connected) {
+    s_mqtt_statistics.nPubFailures++;
+    return VSCP_ERROR_SUCCESS;
+  }
+
+  // If no topic set. Use configured topic
+  if (VSCP_ERROR_SUCCESS != (rv = mqtt_render_topic(newTopic, sizeof(newTopic), &s_topicPub, topic, pev))) {
+    s_mqtt_statistics.nPubFailures++;
+    ESP_LOGE(TAG, "Failed to render topic rv = %d", rv);
+    return rv;
+  }
+
+  if (NULL == s_mutexPayload) {
+    return VSCP_ERROR_INIT_MISSING;
+  }
+
+  // Backpressure: don't let a slow broker link eat the heap
+  if (esp_mqtt_client_get_outbox_size(g_mqtt_client) > CONFIG_APP_MQTT_OUTBOX_MAX) {
+    s_mqtt_statistics.nPubDropped++;
+    if (s_mqtt_busHandle >= 0) {
+      eventbus_hold_off(s_mqtt_busHandle, MQTT_HOLD_OFF_TIME);
+    }
+    return VSCP_ERROR_TRM_FULL;
+  }
+
+  // Payload is encoded into a shared static buffer
+  xSemaphoreTake(s_mutexPayload, portMAX_DELAY);
+
+  // A batch holds events for one topic and format only
+  if (s_batchCnt && ((s_batchFormat != g_persistent.mqttFormat) || strcmp(s_batchTopic, newTopic))) {
+    mqtt_batch_flush();
+  }
+
+  // JSON events in a batch are sent as an array ('[' or ',' before and ']' after)
+  size_t extra = (MQTT_BATCH_SIZE && (MQTT_FORMAT_JSON == g_persistent.mqttFormat)) ? 1 : 0;
+
+  rv = mqtt_encode_payload(s_payload + s_batchLen + extra,
+                           sizeof(s_payload) - s_batchLen - 2 * extra,
+                           g_persistent.mqttFormat,
+                           pev,
+                           &len);
+  if ((VSCP_ERROR_BUFFER_TO_SMALL == rv) && s_batchCnt) {
+    mqtt_batch_flush();
+    rv = mqtt_encode_payload(s_payload + extra, sizeof(s_payload) - 2 * extra, g_persistent.mqttFormat, pev, &len);
+  }
+
+  if (VSCP_ERROR_SUCCESS != rv) {
+    xSemaphoreGive(s_mutexPayload);
+    s_mqtt_statistics.nPubFailures++;
+    ESP_LOGE(TAG, "Failed to encode event rv = %d", rv);
+    return rv;
+  }
+
+  if (extra) {
+    s_payload[s_batchLen] = s_batchCnt ? ',' : '[';
+  }
+
+  if (!s_batchCnt) {
+    strcpy(s_batchTopic, newTopic);
+    s_batchFormat = g_persistent.mqttFormat;
+  }
+
+  s_batchLen += extra + len;
+  s_batchCnt++;
+
+  if (s_batchLen >= MQTT_BATCH_SIZE) {
+    mqtt_batch_flush();
+  }
+  else if ((1 == s_batchCnt) && (NULL != s_batchTimer)) {
+    esp_timer_start_once(s_batchTimer, MQTT_BATCH_TIME * 1000);
+  }
+
+  xSemaphoreGive(s_mutexPayload);
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_is_connected
+//
+
+bool
+mqtt_is_connected(void)
+{
+  return s_mqtt_connected;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_get_stats
+//
+
+int
+mqtt_get_stats(mqtt_stats_t *pstats)
+{
+  // Check pointer
+  if (NULL == pstats) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  memcpy(pstats, &s_mqtt_statistics, sizeof(mqtt_stats_t));
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_log
+//
+
+int
+mqtt_log(const char *msg)
+{
+  ESP_PARAM_CHECK(msg);
+
+  // Noting to do if no message
+  if (!strlen(msg)) {
+    return VSCP_ERROR_SUCCESS;
+  }
+
+  if (strlen(g_persistent.mqttPubLog)) {
+
+    char newTopic[MQTT_TOPIC_MAX_LEN];
+    if (VSCP_ERROR_SUCCESS != mqtt_render_topic(newTopic, sizeof(newTopic), &s_topicPubLog, NULL, NULL)) {
+      s_mqtt_statistics.nPubLogFailures++;
+      return VSCP_ERROR_PARAMETER;
+    }
+
+    int msgid = esp_mqtt_client_publish(g_mqtt_client, newTopic, msg, strlen(msg), 0, 0);
+    if (-1 != msgid) {
+      s_mqtt_statistics.nPubLog++;
+    }
+    else {
+      s_mqtt_statistics.nPubLogFailures++;
+      ESP_LOGE(TAG,
+               "Failed to publish MQTT log message. id=%d Topic=%s outbox-size = %d",
+               msgid,
+               g_persistent.mqttPubLog,
+               esp_mqtt_client_get_outbox_size(g_mqtt_client));
+    }
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+// ----------------------------------------------------------------------------
+//                              MQTT ingress
+// ----------------------------------------------------------------------------
+
+/*
+  Events received on the subscribe topic are parsed in place from the MQTT
+  receive buffer (no allocation) and published on the event bus where the
+  esp-now subscriber sends them to the cluster. JSON (single event or array)
+  and binary frames (one or more concatenated) are accepted.
+*/
+
+#define MQTT_RATE_SLOTS 8 // Number of topics rate limited at the same time
+
+typedef struct {
+  uint32_t hash;  // Topic hash (zero is unused)
+  int32_t tokens; // Available tokens (1000 per event)
+  int64_t tsLast; // Last refill (us)
+} mqtt_rate_t;
+
+static mqtt_rate_t s_rate[MQTT_RATE_SLOTS];
+
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_rateAllow
 //
-// Substitute mustache tags to real value in string.
-// pev Pointer to event can be NULL.
+// Token bucket per topic. Returns true if one more event is allowed.
 //
 
-static int
-mqtt_topic_subst(char *newTopic, size_t len, const char *pTopic, const vscpEvent *pev)
+static bool
+mqtt_rateAllow(const char *topic, int len)
 {
-  int rv;
-  char workbuf[48];
+  uint32_t hash      = 2166136261u; // FNV-1a
+  int64_t now        = esp_timer_get_time();
+  mqtt_rate_t *pslot = NULL;
 
-  ESP_PARAM_CHECK(newTopic);
-  ESP_PARAM_CHECK(pTopic);
-
-  /*
-    {{node}}        - Node name
-    {{guid}}        - Node GUID
-    {{evguid}}      - Event GUID
-    {{class}}       - Event class
-    {{type}}        - Event type
-    {{nickname}}    - Node nickname (16-bit)
-    {{ecnickname}}  - Node nickname (16-bit) for node sending event
-    {{sindex}}      - Sensor index (if any)
-    --------------------------------------------
-    {{timestamp}}   - Timestamep for event
-    {{index}}       - Index (data byte 0) (if any)
-    {{zone}}        - Zone (data byte 1) (if any)
-    {{subzone}}     - Sub Zone (data byte 2) (if any)
-    {{d[n]}}        - Data byte n (if any)
-    {{year}}        - Two digit year of event (Time always in GMT).
-    {{fyear}}       - Four digit year of event (Time always in GMT).
-    {{month}}       - Two digit month of event (Time always in GMT).
-    {{day}}         - Two digit day of event (Time always in GMT).
-    {{hour}}        - Two digit hour of event (Time always in GMT).
-    {{minute}}      - Two digit minute of event (Time always in GMT).
-    {{second}}      - Two digit second of event (Time always in GMT).
+  for (int i = 0; i < len; i++) {
+    hash = (hash ^ (uint8_t) topic[i]) * 16777619u;
+  }
+  hash |= 1;
 
-    Typical topic
-    vscp/FF:FF:FF:FF:FF:FF:FF:F5:01:00:00:00:00:00:00:02/20/9/2
-    vscp/{{guid}}/{{class}}/{{type}}/{{index}}
-  */
+  for (int i = 0; i < MQTT_RATE_SLOTS; i++) {
+    if (s_rate[i].hash == hash) {
+      pslot = &s_rate[i];
+      break;
+    }
+    // Reuse the slot that has been idle for the longest time
+    if ((NULL == pslot) || (s_rate[i].tsLast < pslot->tsLast)) {
+      pslot = &s_rate[i];
+    }
+  }
 
-  strncpy(newTopic, pTopic, MIN(len,strlen(pTopic)));
+  if (pslot->hash != hash) {
+    pslot->hash   = hash;
+    pslot->tokens = CONFIG_APP_MQTT_SUB_BURST * 1000;
+    pslot->tsLast = now;
+  }
 
-  //printf("newtopic=%s\n", newTopic);
-  //fflush(stdout);
+  // Refill
+  int64_t refill = ((now - pslot->tsLast) * CONFIG_APP_MQTT_SUB_RATE) / 1000;
+  pslot->tsLast  = now;
+  pslot->tokens  = MIN(pslot->tokens + refill, CONFIG_APP_MQTT_SUB_BURST * 1000);
 
-  char *saveTopic = (char *)ESP_CALLOC(1,len);
-  if (NULL == saveTopic) {
-    return VSCP_ERROR_MEMORY;
+  if (pslot->tokens < 1000) {
+    return false;
   }
 
-  // Node name
-  vscp_fwhlp_strsubst(newTopic, len, pTopic, "{{node}}", g_persistent.nodeName);
-  strncpy(saveTopic, newTopic, MIN(strlen(newTopic), len));
-
-  // GUID
-  uint8_t GUID[16];
-  vscp_espnow_get_node_guid(GUID);
-  vscp_fwhlp_writeGuidToString(workbuf, GUID);
-  vscp_fwhlp_strsubst(newTopic, len, saveTopic, "{{guid}}", workbuf);
-  strcpy(saveTopic, newTopic);
+  pslot->tokens -= 1000;
+  return true;
+}
 
-  // Skip event related escapes if no event set
-  if (NULL != pev) {
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_hexNibble
+//
 
-    // Event GUID
-    vscp_fwhlp_writeGuidToString(workbuf, pev->GUID);
-    vscp_fwhlp_strsubst(newTopic, len, saveTopic, "{{evguid}}", workbuf);
-    strcpy(saveTopic, newTopic);
+static int
+mqtt_hexNibble(char c)
+{
+  if ((c >= '0') && (c <= '9')) {
+    return c - '0';
+  }
+  if ((c >= 'a') && (c <= 'f')) {
+    return c - 'a' + 10;
+  }
+  if ((c >= 'A') && (c <= 'F')) {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
 
-    // Class
-    sprintf(workbuf, "%d", pev->vscp_class);
-    vscp_fwhlp_strsubst(newTopic, len, saveTopic, "{{class}}", workbuf);
-    strcpy(saveTopic, newTopic);
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_jsonSkipWs
+//
 
-    // Type
-    sprintf(workbuf, "%d", pev->vscp_type);
-    vscp_fwhlp_strsubst(newTopic, len, saveTopic, "{{type}}", workbuf);
-    strcpy(saveTopic, newTopic);
+static const char *
+mqtt_jsonSkipWs(const char *p, const char *pend)
+{
+  while ((p < pend) && ((' ' == *p) || ('\t' == *p) || ('\r' == *p) || ('\n' == *p))) {
+    p++;
+  }
+  return p;
+}
 
-    // nickname
-    sprintf(workbuf, "%d", ((GUID[14] << 8) + (GUID[15])));
-    vscp_fwhlp_strsubst(newTopic, len, saveTopic, "{{nickname}}", workbuf);
-    strcpy(saveTopic, newTopic);
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_jsonString
+//
+// Parse a string. Returns pointer after string or NULL. The content is not
+// unescaped.
+//
 
-    // event nickname
-    sprintf(workbuf, "%d", ((pev->GUID[14] << 8) + (pev->GUID[15])));
-    vscp_fwhlp_strsubst(newTopic, len, saveTopic, "{{evnickname}}", workbuf);
-    strcpy(saveTopic, newTopic);
+static const char *
+mqtt_jsonString(const char *p, const char *pend, const char **pstr, size_t *plen)
+{
+  if ((p >= pend) || ('"' != *p)) {
+    return NULL;
+  }
 
-    // sensor index
-    if (VSCP_ERROR_SUCCESS == vscp_fwhlp_isMeasurement(pev)) {
-      sprintf(workbuf, "%d", vscp_fwhlp_getMeasurementSensorIndex(pev));
+  *pstr = ++p;
+  while (p < pend) {
+    if ('\\' == *p) {
+      p += 2;
+      continue;
     }
-    else {
-      memset(workbuf, 0, sizeof(workbuf));
+    if ('"' == *p) {
+      *plen = p - *pstr;
+      return p + 1;
     }
-    vscp_fwhlp_strsubst(newTopic, len, saveTopic, "{{sindex}}", workbuf);
-    // strcpy(saveTopic, newTopic);
+    p++;
   }
 
-  ESP_FREE(saveTopic);
-
-  return VSCP_ERROR_SUCCESS;
+  return NULL;
 }
 
-#define MQTT_SUBST_BUF_LEN 2048
-
 ///////////////////////////////////////////////////////////////////////////////
-// mqtt_send_vscp_event
+// mqtt_jsonNumber
+//
+// Parse an integer (fractions are ignored).
 //
 
-int
-mqtt_send_vscp_event(const char *topic, const vscpEvent *pev)
+static const char *
+mqtt_jsonNumber(const char *p, const char *pend, int64_t *pval)
 {
-  int rv;
-  const char *pTopic = topic;
+  bool bNeg   = false;
+  int64_t val = 0;
 
-  // Check event pointer
-  if (NULL == pev) {
-    return VSCP_ERROR_INVALID_POINTER;
+  if ((p < pend) && ('-' == *p)) {
+    bNeg = true;
+    p++;
   }
 
-  // If no topic set. Use configured topic
-  if (NULL == topic) {
-    pTopic = g_persistent.mqttPub;
+  if ((p >= pend) || (*p < '0') || (*p > '9')) {
+    return NULL;
   }
 
-  // If not connected there is no meaning to send event
-  if (!s_mqtt_connected) {
-    s_mqtt_statistics.nPubFailures++;
-    return VSCP_ERROR_SUCCESS;
+  while ((p < pend) && (*p >= '0') && (*p <= '9')) {
+    val = val * 10 + (*p++ - '0');
   }
 
-  // We publish VSCP event on JSON form
-  char *pbuf = ESP_MALLOC(MQTT_SUBST_BUF_LEN);
-  if (NULL == pbuf) {
-    ESP_LOGE(TAG, "Unable to allocate JSON buffer for conversion");
-    return VSCP_ERROR_MEMORY;
+  // Skip fraction and exponent
+  while ((p < pend) && (('.' == *p) || ('e' == *p) || ('E' == *p) || ('+' == *p) || ('-' == *p) ||
+                        ((*p >= '0') && (*p <= '9')))) {
+    p++;
   }
 
-  if (VSCP_ERROR_SUCCESS != (rv = vscp_fwhlp_create_json(pbuf, 2048, pev))) {
-    ESP_FREE(pbuf);
-    ESP_LOGE(TAG, "Failed to convert event to JSON rv = %d", rv);
-    return rv;
+  *pval = bNeg ? -val : val;
+  return p;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_jsonSkipValue
+//
+// Skip any value including nested objects and arrays
+//
+
+static const char *
+mqtt_jsonSkipValue(const char *p, const char *pend)
+{
+  int depth = 0;
+  const char *pstr;
+  size_t len;
+
+  do {
+    p = mqtt_jsonSkipWs(p, pend);
+    if (p >= pend) {
+      return NULL;
+    }
+
+    switch (*p) {
+      case '"':
+        if (NULL == (p = mqtt_jsonString(p, pend, &pstr, &len))) {
+          return NULL;
+        }
+        break;
+
+      case '{':
+      case '[':
+        depth++;
+        p++;
+        break;
+
+      case '}':
+      case ']':
+        if (!depth) {
+          return NULL;
+        }
+        depth--;
+        p++;
+        break;
+
+      default:
+        // Number, literal, ',' or ':'
+        p++;
+        while ((p < pend) && (NULL == strchr(",:{}[]\" \t\r\n", *p))) {
+          p++;
+        }
+        break;
+    }
+  } while (depth);
+
+  return p;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_jsonEvent
+//
+// Parse one JSON event object into pev (pdata must point to a buffer of
+// VSCP_MAX_DATA bytes). Returns pointer after object or NULL.
+//
+
+static const char *
+mqtt_jsonEvent(const char *p, const char *pend, vscpEvent *pev)
+{
+  const char *pkey;
+  const char *pstr;
+  size_t keylen;
+  size_t len;
+  int64_t val;
+
+  p = mqtt_jsonSkipWs(p, pend);
+  if ((p >= pend) || ('{' != *p++)) {
+    return NULL;
   }
 
-  ESP_LOGV(TAG, "converted");
+  for (;;) {
 
-  /*
-    {{node}}        - Node name
-    {{guid}}        - Node GUID
-    {{evguid}}      - Event GUID
-    {{class}}       - Event class
-    {{type}}        - Event type
-    {{nickname}}    - Node nickname (16-bit)
-    {{ecnickname}}  - Node nickname (16-bit) for node sending event
-    {{sindex}}      - Sensor index (if any)
-    --------------------------------------------
-    {{timestamp}}   - Timestamep for event
-    {{index}}       - Index (data byte 0) (if any)
-    {{zone}}        - Zone (data byte 1) (if any)
-    {{subzone}}     - Sub Zone (data byte 2) (if any)
-    {{d[n]}}        - Data byte n (if any)
-    {{year}}        - Two digit year of event (Time always in GMT).
-    {{fyear}}       - Four digit year of event (Time always in GMT).
-    {{month}}       - Two digit month of event (Time always in GMT).
-    {{day}}         - Two digit day of event (Time always in GMT).
-    {{hour}}        - Two digit hour of event (Time always in GMT).
-    {{minute}}      - Two digit minute of event (Time always in GMT).
-    {{second}}      - Two digit second of event (Time always in GMT).
+    p = mqtt_jsonSkipWs(p, pend);
+    if ((p < pend) && ('}' == *p)) {
+      return p + 1;
+    }
 
-    Typical topic
-    vscp/FF:FF:FF:FF:FF:FF:FF:F5:01:00:00:00:00:00:00:02/20/9/2
-    vscp/{{guid}}/{{class}}/{{type}}/{{index}}
-  */
+    if (NULL == (p = mqtt_jsonString(p, pend, &pkey, &keylen))) {
+      return NULL;
+    }
 
-  // char newTopic[128], saveTopic[128], workbuf[48];
-  // cccc
-  //   // Node name
-  //   vscp_fwhlp_strsubst(newTopic, sizeof(newTopic), pTopic, "{{node}}", g_persistent.nodeName);
-  // strcpy(saveTopic, newTopic);
-
-  // // GUID
-  // uint8_t GUID[16];
-  // vscp_espnow_get_node_guid(GUID);
-  // vscp_fwhlp_writeGuidToString(workbuf, GUID);
-  // vscp_fwhlp_strsubst(newTopic, sizeof(newTopic), saveTopic, "{{guid}}", workbuf);
-  // strcpy(saveTopic, newTopic);
-
-  // // Event GUID
-  // vscp_fwhlp_writeGuidToString(workbuf, pev->GUID);
-  // vscp_fwhlp_strsubst(newTopic, sizeof(newTopic), saveTopic, "{{evguid}}", workbuf);
-  // strcpy(saveTopic, newTopic);
-
-  // // Class
-  // sprintf(workbuf, "%d", pev->vscp_class);
-  // vscp_fwhlp_strsubst(newTopic, sizeof(newTopic), saveTopic, "{{class}}", workbuf);
-  // strcpy(saveTopic, newTopic);
-
-  // // Type
-  // sprintf(workbuf, "%d", pev->vscp_type);
-  // vscp_fwhlp_strsubst(newTopic, sizeof(newTopic), saveTopic, "{{type}}", workbuf);
-  // strcpy(saveTopic, newTopic);
-
-  // // nickname
-  // sprintf(workbuf, "%d", ((GUID[14] << 8) + (GUID[15])));
-  // vscp_fwhlp_strsubst(newTopic, sizeof(newTopic), saveTopic, "{{nickname}}", workbuf);
-  // strcpy(saveTopic, newTopic);
-
-  // // event nickname
-  // sprintf(workbuf, "%d", ((pev->GUID[14] << 8) + (pev->GUID[15])));
-  // vscp_fwhlp_strsubst(newTopic, sizeof(newTopic), saveTopic, "{{evnickname}}", workbuf);
-  // strcpy(saveTopic, newTopic);
-
-  // // sensor index
-  // if (VSCP_ERROR_SUCCESS == vscp_fwhlp_isMeasurement(pev)) {
-  //   sprintf(workbuf, "%d", vscp_fwhlp_getMeasurementSensorIndex(pev));
-  // }
-  // else {
-  //   memset(workbuf, 0, sizeof(workbuf));
-  // }
-  // vscp_fwhlp_strsubst(newTopic, sizeof(newTopic), saveTopic, "{{sindex}}", workbuf);
-  // strcpy(saveTopic, newTopic);
-
-  char *newTopic = ESP_CALLOC(1,MQTT_SUBST_BUF_LEN);
-  if (NULL == newTopic) {
-    ESP_LOGE(TAG, "Unable to allocate memory.");
-    ESP_FREE(pbuf);
-    return VSCP_ERROR_MEMORY;
-  }
-
-  mqtt_topic_subst(newTopic, MQTT_SUBST_BUF_LEN, pTopic, pev);
-
-  printf("%s\n", newTopic);
-  // strcpy(newTopic, "xxx/");
-
-  int msgid = esp_mqtt_client_publish(g_mqtt_client,
-                                      newTopic,
-                                      pbuf,
-                                      strlen(pbuf),
-                                      0,
-                                      0 /*g_persistent.mqttQos, g_persistent.mqttRetain*/);
-
-  // int msgid =
-  // esp_mqtt_client_enqueue(g_mqtt_client, newTopic, pbuf, strlen(pbuf), 0,0/*g_persistent.mqttQos,
-  // g_persistent.mqttRetain*/, false);
-  if (-1 != msgid) {
-    // ESP_LOGI(TAG, "Published MQTT message. id=%d topic=%s outbox-size = %d", msgid, newTopic,
-    // esp_mqtt_client_get_outbox_size(g_mqtt_client));
-    s_mqtt_statistics.nPub++;
+    p = mqtt_jsonSkipWs(p, pend);
+    if ((p >= pend) || (':' != *p++)) {
+      return NULL;
+    }
+    p = mqtt_jsonSkipWs(p, pend);
+
+#define KEY_IS(k) ((sizeof(k) - 1 == keylen) && !memcmp(pkey, k, keylen))
+
+    if (KEY_IS("vscpHead") || KEY_IS("vscpTimeStamp") || KEY_IS("vscpClass") || KEY_IS("vscpType") ||
+        KEY_IS("vscpObId")) {
+      if (NULL == (p = mqtt_jsonNumber(p, pend, &val))) {
+        return NULL;
+      }
+      if (KEY_IS("vscpHead")) {
+        pev->head = val;
+      }
+      else if (KEY_IS("vscpTimeStamp")) {
+        pev->timestamp = val;
+      }
+      else if (KEY_IS("vscpClass")) {
+        pev->vscp_class = val;
+      }
+      else if (KEY_IS("vscpType")) {
+        pev->vscp_type = val;
+      }
+    }
+    else if (KEY_IS("vscpGuid")) {
+      // FF:FF:FF:FF:FF:FF:FF:FE:B8:27:EB:CF:3A:15:00:01 or '-' for all zero
+      if (NULL == (p = mqtt_jsonString(p, pend, &pstr, &len))) {
+        return NULL;
+      }
+      memset(pev->GUID, 0, 16);
+      for (int i = 0, pos = 0; (i < 16) && ((size_t) pos + 1 < len); i++, pos += 3) {
+        int hi = mqtt_hexNibble(pstr[pos]);
+        int lo = mqtt_hexNibble(pstr[pos + 1]);
+        if ((hi < 0) || (lo < 0)) {
+          return NULL;
+        }
+        pev->GUID[i] = (hi << 4) + lo;
+      }
+    }
+    else if (KEY_IS("vscpDateTime")) {
+      // YYYY-MM-DDTHH:MM:SS
+      if (NULL == (p = mqtt_jsonString(p, pend, &pstr, &len))) {
+        return NULL;
+      }
+      if (len >= 19) {
+        pev->year   = (pstr[0] - '0') * 1000 + (pstr[1] - '0') * 100 + (pstr[2] - '0') * 10 + (pstr[3] - '0');
+        pev->month  = (pstr[5] - '0') * 10 + (pstr[6] - '0');
+        pev->day    = (pstr[8] - '0') * 10 + (pstr[9] - '0');
+        pev->hour   = (pstr[11] - '0') * 10 + (pstr[12] - '0');
+        pev->minute = (pstr[14] - '0') * 10 + (pstr[15] - '0');
+        pev->second = (pstr[17] - '0') * 10 + (pstr[18] - '0');
+      }
+    }
+    else if (KEY_IS("vscpData")) {
+      if ((p >= pend) || ('[' != *p++)) {
+        return NULL;
+      }
+      pev->sizeData = 0;
+      for (;;) {
+        p = mqtt_jsonSkipWs(p, pend);
+        if ((p < pend) && (']' == *p)) {
+          p++;
+          break;
+        }
+        if ((pev->sizeData >= VSCP_MAX_DATA) || (NULL == (p = mqtt_jsonNumber(p, pend, &val))) || (val < 0) ||
+            (val > 255)) {
+          return NULL;
+        }
+        pev->pdata[pev->sizeData++] = val;
+        p = mqtt_jsonSkipWs(p, pend);
+        if ((p < pend) && (',' == *p)) {
+          p++;
+        }
+      }
+    }
+    else {
+      if (NULL == (p = mqtt_jsonSkipValue(p, pend))) {
+        return NULL;
+      }
+    }
+
+#undef KEY_IS
+
+    p = mqtt_jsonSkipWs(p, pend);
+    if ((p < pend) && (',' == *p)) {
+      p++;
+    }
   }
-  else {
-    s_mqtt_statistics.nPubFailures++;
-    ESP_LOGE(TAG,
-             "Failed to publish MQTT message. id=%d Topic=%s outbox-size = %d",
-             msgid,
-             newTopic,
-             esp_mqtt_client_get_outbox_size(g_mqtt_client));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_binaryEvent
+//
+// Parse one VSCP binary frame into pev (pdata must point to a buffer of
+// VSCP_MAX_DATA bytes). Returns number of bytes used or -1 on error.
+//
+
+static int
+mqtt_binaryEvent(const uint8_t *buf, size_t len, vscpEvent *pev)
+{
+  if ((len < MQTT_FRAME_POS_DATA + 2) || (0 != buf[MQTT_FRAME_POS_PKTTYPE])) {
+    return -1;
   }
 
-  ESP_FREE(newTopic);
-  ESP_FREE(pbuf);
+  uint16_t sizeData = (buf[MQTT_FRAME_POS_SIZE] << 8) + buf[MQTT_FRAME_POS_SIZE + 1];
+  size_t frameLen   = MQTT_FRAME_POS_DATA + sizeData + 2;
+  if ((sizeData > VSCP_MAX_DATA) || (frameLen > len)) {
+    return -1;
+  }
 
-  return VSCP_ERROR_SUCCESS;
+  uint16_t crc = (buf[frameLen - 2] << 8) + buf[frameLen - 1];
+  if (crc != mqtt_crc16(buf + MQTT_FRAME_POS_HEAD, MQTT_FRAME_POS_DATA - MQTT_FRAME_POS_HEAD + sizeData)) {
+    return -1;
+  }
+
+  pev->head       = (buf[MQTT_FRAME_POS_HEAD] << 8) + buf[MQTT_FRAME_POS_HEAD + 1];
+  pev->timestamp  = ((uint32_t) buf[MQTT_FRAME_POS_TIMESTAMP] << 24) + ((uint32_t) buf[MQTT_FRAME_POS_TIMESTAMP + 1] << 16) +
+                   ((uint32_t) buf[MQTT_FRAME_POS_TIMESTAMP + 2] << 8) + buf[MQTT_FRAME_POS_TIMESTAMP + 3];
+  pev->year       = (buf[MQTT_FRAME_POS_YEAR] << 8) + buf[MQTT_FRAME_POS_YEAR + 1];
+  pev->month      = buf[MQTT_FRAME_POS_MONTH];
+  pev->day        = buf[MQTT_FRAME_POS_DAY];
+  pev->hour       = buf[MQTT_FRAME_POS_HOUR];
+  pev->minute     = buf[MQTT_FRAME_POS_MINUTE];
+  pev->second     = buf[MQTT_FRAME_POS_SECOND];
+  pev->vscp_class = (buf[MQTT_FRAME_POS_CLASS] << 8) + buf[MQTT_FRAME_POS_CLASS + 1];
+  pev->vscp_type  = (buf[MQTT_FRAME_POS_TYPE] << 8) + buf[MQTT_FRAME_POS_TYPE + 1];
+  memcpy(pev->GUID, buf + MQTT_FRAME_POS_GUID, 16);
+  pev->sizeData = sizeData;
+  memcpy(pev->pdata, buf + MQTT_FRAME_POS_DATA, sizeData);
+
+  return frameLen;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// mqtt_log
+// mqtt_inject
+//
+// Rate limit and publish a parsed event on the event bus
 //
 
-int
-mqtt_log(const char *msg)
+static void
+mqtt_inject(const char *topic, int topicLen, vscpEvent *pev)
 {
-  char *pbuf = msg;
-  ESP_PARAM_CHECK(msg);
-
-  // Noting to do if no message
-  if (!strlen(msg)) {
-    return VSCP_ERROR_SUCCESS;
+  if (!mqtt_rateAllow(topic, topicLen)) {
+    s_mqtt_statistics.nSubDropped++;
+    return;
   }
 
-  if (strlen(g_persistent.mqttPubLog)) {
+  s_mqtt_statistics.nSub++;
+  eventbus_publish(pev, EVENTBUS_OBID(EVENTBUS_TRANSPORT_MQTT, 0));
+}
 
-    char *newTopic = ESP_CALLOC(1,MQTT_SUBST_BUF_LEN);
-    if (NULL == newTopic) {
-      ESP_LOGE(TAG, "Unable to allocate memory.");
-      ESP_FREE(pbuf);
-      return VSCP_ERROR_MEMORY;
-    }
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_handle_data
+//
+// Handle a message received on the subscribe topic
+//
 
-    const char *pTopic = g_persistent.mqttPubLog;
-    mqtt_topic_subst(newTopic, MQTT_SUBST_BUF_LEN, pTopic, NULL);
+static void
+mqtt_handle_data(esp_mqtt_event_handle_t event)
+{
+  vscpEvent ev;
+  uint8_t data[VSCP_MAX_DATA];
+  const char *p    = event->data;
+  const char *pend = event->data + event->data_len;
+
+  // Fast rejection: fragmented, empty or oversized messages are not events
+  if ((event->data_len <= 0) || (event->current_data_offset != 0) || (event->data_len != event->total_data_len) ||
+      (event->data_len > MQTT_PAYLOAD_MAX_LEN)) {
+    s_mqtt_statistics.nSubRejected++;
+    return;
+  }
 
-    int msgid = esp_mqtt_client_publish(g_mqtt_client, newTopic, pbuf, strlen(pbuf), 0, 0);
-    if (-1 != msgid) {
-      s_mqtt_statistics.nPubLog++;
+  memset(&ev, 0, sizeof(vscpEvent));
+  ev.pdata = data;
+
+  p = mqtt_jsonSkipWs(p, pend);
+
+  // JSON event
+  if ((p < pend) && ('{' == *p)) {
+    if (NULL == mqtt_jsonEvent(p, pend, &ev)) {
+      s_mqtt_statistics.nSubRejected++;
+      return;
     }
-    else {
-      s_mqtt_statistics.nPubLogFailures++;
-      ESP_LOGE(TAG,
-               "Failed to publish MQTT log message. id=%d Topic=%s outbox-size = %d",
-               msgid,
-               g_persistent.mqttPubLog,
-               esp_mqtt_client_get_outbox_size(g_mqtt_client));
+    mqtt_inject(event->topic, event->topic_len, &ev);
+  }
+  // JSON array of events
+  else if ((p < pend) && ('[' == *p)) {
+    p++;
+    for (;;) {
+      p = mqtt_jsonSkipWs(p, pend);
+      if ((p < pend) && (']' == *p)) {
+        break;
+      }
+      memset(&ev, 0, sizeof(vscpEvent));
+      ev.pdata = data;
+      if (NULL == (p = mqtt_jsonEvent(p, pend, &ev))) {
+        s_mqtt_statistics.nSubRejected++;
+        return;
+      }
+      mqtt_inject(event->topic, event->topic_len, &ev);
+      p = mqtt_jsonSkipWs(p, pend);
+      if ((p < pend) && (',' == *p)) {
+        p++;
+      }
+    }
+  }
+  // Binary frame(s)
+  else {
+    const uint8_t *pbuf = (const uint8_t *) event->data;
+    size_t remaining    = event->data_len;
+    while (remaining) {
+      int len = mqtt_binaryEvent(pbuf, remaining, &ev);
+      if (len < 0) {
+        s_mqtt_statistics.nSubRejected++;
+        return;
+      }
+      mqtt_inject(event->topic, event->topic_len, &ev);
+      pbuf += len;
+      remaining -= len;
     }
-
-    ESP_FREE(newTopic);
   }
-
-  
-  return VSCP_ERROR_SUCCESS;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -433,6 +1539,7 @@ mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id,
   esp_mqtt_event_handle_t event   = event_data;
   esp_mqtt_client_handle_t client = event->client;
   int msg_id;
+  char subTopic[MQTT_TOPIC_MAX_LEN];
   switch ((esp_mqtt_event_id_t) event_id) {
 
     case MQTT_EVENT_BEFORE_CONNECT:
@@ -443,17 +1550,13 @@ mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id,
       s_mqtt_connected = true;
       s_mqtt_statistics.nConnect++;
       ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
-      msg_id =
-        esp_mqtt_client_subscribe(client,
-                                  /*"/topic/qos0"*/ "vscp/FF:FF:FF:FF:FF:FF:FF:FE:B8:27:EB:CF:3A:15:00:01/10/6/1/0",
-                                  0);
-      ESP_LOGI(TAG, "sent subscribe successful, msg_id=%d", msg_id);
-
-      // msg_id = esp_mqtt_client_subscribe(client, "/topic/qos1", 1);
-      // ESP_LOGI(TAG, "sent subscribe successful, msg_id=%d", msg_id);
-
-      // msg_id = esp_mqtt_client_unsubscribe(client, "/topic/qos1");
-      // ESP_LOGI(TAG, "sent unsubscribe successful, msg_id=%d", msg_id);
+      if (VSCP_ERROR_SUCCESS == mqtt_render_topic(subTopic, sizeof(subTopic), &s_topicSub, NULL, NULL)) {
+        msg_id = esp_mqtt_client_subscribe(client, subTopic, g_persistent.mqttQos);
+        ESP_LOGI(TAG, "Subscribe to %s, msg_id=%d", subTopic, msg_id);
+      }
+      else {
+        ESP_LOGE(TAG, "Failed to render subscribe topic");
+      }
       break;
 
     case MQTT_EVENT_DISCONNECTED:
@@ -479,10 +1582,8 @@ mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id,
       break;
 
     case MQTT_EVENT_DATA:
-      ESP_LOGI(TAG, "MQTT_EVENT_DATA");
-      printf("TOPIC=%.*s\r\n", event->topic_len, event->topic);
-      printf("DATA=%.*s\r\n", event->data_len, event->data);
-      fflush(stdout);
+      ESP_LOGD(TAG, "MQTT_EVENT_DATA topic=%.*s len=%d", event->topic_len, event->topic, event->data_len);
+      mqtt_handle_data(event);
       break;
 
     case MQTT_EVENT_ERROR:
@@ -510,6 +1611,18 @@ mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id,
   }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_eventbus_cb
+//
+// Events from the event bus are published on the configured topic
+//
+
+static int
+mqtt_eventbus_cb(const vscpEvent *pev, void *userdata)
+{
+  return mqtt_send_vscp_event(NULL, pev);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // mqtt_start
 //
@@ -519,6 +1632,8 @@ mqtt_start(void)
 {
   ESP_LOGI(TAG, "Starting MQTT client");
 
+  mqtt_compile_topics();
+
   // Set client id from mac
   uint8_t mac[8];
   ESP_ERROR_CHECK(esp_base_mac_addr_get(mac));
@@ -543,8 +1658,36 @@ mqtt_start(void)
   vscp_fwhlp_writeGuidToString(workbuf, GUID);
   vscp_fwhlp_strsubst(clientid, sizeof(clientid), save, "{{guid}}", workbuf);
 
+  // A previous client still points at the old certificate
+  if (NULL != g_mqtt_client) {
+    esp_mqtt_client_destroy(g_mqtt_client);
+    g_mqtt_client = NULL;
+  }
+
+  // The stored certificate may have been replaced or removed since it was
+  // last read. It is only read into RAM if TLS is used.
+  if (NULL != s_serverCert) {
+    ESP_FREE(s_serverCert);
+  }
+
+  if (g_persistent.mqttVerificationLen) {
+    s_serverCert = cfgstore_load_text(CFGSTORE_KEY_MQTT_CA, CONFIG_APP_MQTT_CA_MAX_SIZE);
+    if ((NULL == s_serverCert) || (strlen(s_serverCert) != g_persistent.mqttVerificationLen)) {
+      // Never fall back to a plain connection that would expose the credentials
+      ESP_LOGE(TAG, "Failed to load server certificate. MQTT client not started.");
+      if (NULL != s_serverCert) {
+        ESP_FREE(s_serverCert);
+      }
+      return;
+    }
+  }
+
   char uri[64];
-  sprintf(uri, "mqtt://%s:%d", g_persistent.mqttUrl, g_persistent.mqttPort);
+  sprintf(uri,
+          "%s://%s:%d",
+          (NULL != s_serverCert) ? "mqtts" : "mqtt",
+          g_persistent.mqttUrl,
+          g_persistent.mqttPort);
 
   // clang-format off
 #if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
@@ -552,7 +1695,7 @@ mqtt_start(void)
     .broker = { 
                 .address.uri = uri,                     // "mqtt://192.168.1.7:1883", 
                 .address.port = g_persistent.mqttPort,  // 1883,
-                /*.verification.certificate = (const char *) mqtt_eclipse_io_pem_start*/ 
+                .verification.certificate = s_serverCert, // NULL for no TLS
               },    
     .session.disable_clean_session = true,
     .session.keepalive = 60,          
@@ -584,6 +1727,55 @@ mqtt_start(void)
   }
 
   ESP_LOGI(TAG, "Outbox-size = %d", esp_mqtt_client_get_outbox_size(g_mqtt_client));
+
+  if (NULL == s_mutexPayload) {
+    s_mutexPayload = xSemaphoreCreateMutex();
+  }
+
+  if (MQTT_BATCH_SIZE && (NULL == s_batchTimer)) {
+    const esp_timer_create_args_t timerArgs = {
+      .callback = mqtt_batch_timer_cb,
+      .name     = "mqttbatch",
+    };
+    if (ESP_OK != esp_timer_create(&timerArgs, &s_batchTimer)) {
+      ESP_LOGE(TAG, "Failed to create batch timer");
+    }
+  }
+
+  // Publish events from all other transports to the broker
+  if (!s_mqtt_eventbus) {
+    if (VSCP_ERROR_SUCCESS == eventbus_subscribe("mqttbus",
+                                                 EVENTBUS_TRANSPORT_MQTT,
+                                                 0,
+                                                 CONFIG_APP_EVENTBUS_QUEUE_SIZE,
+                                                 mqtt_eventbus_cb,
+                                                 NULL,
+                                                 &s_mqtt_busHandle)) {
+      s_mqtt_eventbus = true;
+    }
+    else {
+      ESP_LOGE(TAG, "Failed to subscribe to event bus");
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mqtt_set_server_cert
+//
+
+int
+mqtt_set_server_cert(const char *pem)
+{
+  int rv;
+
+  if (VSCP_ERROR_SUCCESS != (rv = cfgstore_save_text(CFGSTORE_KEY_MQTT_CA, pem, CONFIG_APP_MQTT_CA_MAX_SIZE))) {
+    return rv;
+  }
+
+  // The running client keeps using the certificate it was started with.
+  // mqtt_start is only called at boot so a reboot is required.
+  g_persistent.mqttVerificationLen = (NULL == pem) ? 0 : strlen(pem);
+  return cfgstore_save();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
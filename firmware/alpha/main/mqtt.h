@@ -30,6 +30,9 @@
 #ifndef __DROPLET_MQTT__
 #define __DROPLET_MQTT__
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #include <vscp.h>
 
 #define DROPLET_MQTT_STATISTIC_PUBLISH_INTERVAL 60000
@@ -38,6 +41,16 @@
 #define DROPLET_MQTT_TOPIC_STATS_RECV_CNT "droplet/alpha/statistics/rcvcnt"
 #define DROPLET_MQTT_TOPIC_STATS_TX_CNT   "droplet/alpha/statistics/txcnt"
 
+/**
+ * @brief Payload formats for published events
+ *
+ */
+typedef enum {
+  MQTT_FORMAT_JSON = 0, // VSCP JSON event
+  MQTT_FORMAT_BINARY,   // VSCP binary frame (UDP frame layout)
+  MQTT_FORMAT_CBOR,     // CBOR map with VSCP JSON keys
+} mqtt_format_t;
+
 /**
  * @brief Send and receive statistics
  *
@@ -49,10 +62,14 @@ typedef struct {
   uint32_t nPub;            // # published frames
   uint32_t nPubFailures;    // Number of publish failures
   uint32_t nPubConfirm;     // # of OK publish
+  uint32_t nPubBatch;       // # published messages (a message can hold several events)
+  uint32_t nPubDropped;     // # events dropped because the outbox was full
   uint32_t nPubLog;         // # published logframes
   uint32_t nPubLogFailures; // Number of publish log failures
   uint32_t nPubLogConfirm;  // # of OK log publish
   uint32_t nSub;            // # received events
+  uint32_t nSubRejected;    // # received messages rejected as malformed
+  uint32_t nSubDropped;     // # received events dropped by rate limit
 } mqtt_stats_t;
 
 /**
@@ -73,6 +90,39 @@ mqtt_start(void);
 void
 mqtt_stop(void);
 
+/**
+ * @fn mqtt_compile_topics
+ * @brief Compile configured publish topics
+ *
+ * Must be called when the topic templates or the node name has been changed.
+ *
+ * @return int VSCP_ERROR_SUCCESS if OK, else error code.
+ */
+
+int
+mqtt_compile_topics(void);
+
+/**
+ * @fn mqtt_is_connected
+ * @brief Check if the client is connected to the broker
+ *
+ * @return true if connected, false otherwise.
+ */
+
+bool
+mqtt_is_connected(void);
+
+/**
+ * @fn mqtt_get_stats
+ * @brief Get MQTT statistics
+ *
+ * @param pstats Pointer to statistics structure that will be filled in
+ * @return int VSCP_ERROR_SUCCESS if OK, else error code.
+ */
+
+int
+mqtt_get_stats(mqtt_stats_t *pstats);
+
 /**
  * @fn mqtt_send_vscp_event
  * @brief Send VSCP event on configured topic
@@ -85,6 +135,24 @@ mqtt_stop(void);
 int
 mqtt_send_vscp_event(const char *topic, const vscpEvent *pev);
 
+/**
+ * @fn mqtt_encode_payload
+ * @brief Encode an event in one of the MQTT payload formats
+ *
+ * Also used by other transports that offer the same formats.
+ *
+ * @param buf Buffer that get encoded event
+ * @param size Size of buffer
+ * @param format Payload format (mqtt_format_t)
+ * @param pev Pointer to event to encode
+ * @param plen Pointer to variable that get number of bytes written
+ * @return int VSCP_ERROR_SUCCESS if OK, VSCP_ERROR_BUFFER_TO_SMALL if the
+ *         event does not fit, else error code.
+ */
+
+int
+mqtt_encode_payload(uint8_t *buf, size_t size, uint8_t format, const vscpEvent *pev, size_t *plen);
+
 /**
  * @fn mqtt_log
  * @brief Log message to MQTT
@@ -100,4 +168,18 @@ mqtt_send_vscp_event(const char *topic, const vscpEvent *pev);
 int
 mqtt_log(const char *msg);
 
+/**
+ * @brief Set the server certificate used to verify the broker
+ *
+ * The certificate is stored in flash and is read into RAM when the
+ * client is started. The client connects with TLS (mqtts) when a
+ * certificate is set. The running client is not restarted, a reboot
+ * is required before the new certificate is used.
+ *
+ * @param pem Zero terminated PEM certificate. NULL or empty removes it.
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+mqtt_set_server_cert(const char *pem);
+
 #endif
\ No newline at end of file
@@ -136,27 +136,28 @@ mqtt_pub(void *pvParameters)
 */
 
   // Send ready to receive notify
-  char buffer[LOG_MSG_ITEM_SIZE];
+  char buffer[LOG_BATCH_SIZE];
   xTaskNotifyGive(param.taskHandle);
 
   while (1) {
-    size_t size = xMessageBufferReceive(xMessageBufferTrans, buffer, sizeof(buffer), portMAX_DELAY);
+    // Lines are sent in one message
+    size_t size = net_logging_receive_batch(buffer, sizeof(buffer));
     // printf("xMessageBufferReceive received=%d\n", received);
     if (size > 0) {
       // printf("xMessageBufferReceive buffer=[%.*s]\n",received, buffer);
-      EventBits_t EventBits = xEventGroupGetBits(mqtt_status_event_group);
-      // printf("EventBits=%x\n", EventBits);
-      if (EventBits & MQTT_CONNECTED_BIT) {
+      // Log is published by the main MQTT client (the client above is not used)
+      if (mqtt_is_connected()) {
 
         if (g_persistent.mqttEnable) {
 
-          const char *buf    = NULL;
+          char *buf          = NULL;
           size_t size_buffer = 50 + size;
 
-          buf = ESP_CALLOC(1,size_buffer);
+          buf = ESP_CALLOC(1, size_buffer);
           if (NULL == buf) {
             ESP_LOGE(TAG, "Unable to allocate buffer for log message.");
-            return; // ESP_ERR_NO_MEM
+            net_logging_batch_sent(false);
+            continue;
           }
 
           uint8_t src_addr[6];
@@ -166,9 +167,9 @@ mqtt_pub(void *pvParameters)
           wifi_second_chan_t secondary;
           esp_wifi_get_channel(&primary, &secondary);
 
-          snprintf(buf, size_buffer, "[" MACSTR "][%d][%d]: %.*s", MAC2STR(src_addr), size, primary, 0, buffer);
+          snprintf(buf, size_buffer, "[" MACSTR "][%d]: %.*s", MAC2STR(src_addr), primary, (int) size, buffer);
 
-          mqtt_log(buf);
+          net_logging_batch_sent(VSCP_ERROR_SUCCESS == mqtt_log(buf));
           ESP_FREE(buf);
         }
         // esp_mqtt_client_publish(g_mqtt_client, param.topic, buffer, received, 1, 0);
@@ -176,6 +177,7 @@ mqtt_pub(void *pvParameters)
       }
       else {
         ESP_LOGW(TAG, "Disconnect to MQTT Broker. Skip to send");
+        net_logging_batch_sent(false);
       }
     }
     else {
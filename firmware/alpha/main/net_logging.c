@@ -27,6 +27,14 @@ vprintf_like_t g_stdLogFunc;
 MessageBufferHandle_t xMessageBufferTrans;
 bool writeToStdout;
 
+// Task that ships log lines. Its own log output is not shipped.
+static TaskHandle_t s_logTask = NULL;
+
+// Serialize writers. A message buffer only allows one writer at a time.
+static portMUX_TYPE s_logMux = portMUX_INITIALIZER_UNLOCKED;
+
+static net_logging_stats_t s_logStats;
+
 ///////////////////////////////////////////////////////////////////////////////
 // logging_vprintf
 //
@@ -34,18 +42,30 @@ bool writeToStdout;
 int
 logging_vprintf(const char *fmt, va_list l)
 {
-  // Convert according to format
-  char buffer[LOG_MSG_ITEM_SIZE];
-  int buffer_len = vsnprintf(buffer, LOG_MSG_ITEM_SIZE, fmt, l);
-  //printf("logging_vprintf buffer_len=%d\n",buffer_len);
-  //printf("logging_vprintf buffer=[%.*s]\n", buffer_len, buffer);
-  if (buffer_len > 0) {
-    // Send MessageBuffer
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    size_t nsent = xMessageBufferSendFromISR(xMessageBufferTrans, &buffer, buffer_len, &xHigherPriorityTaskWoken);
-    //printf("logging_vprintf sent=%d\n",nsent);
-    if (nsent != buffer_len) {
-      //ESP_LOGE(TAG, "Unable to send full buffer");
+  // Log output from the log task itself would feed back into the log
+  if ((NULL != xMessageBufferTrans) && (xTaskGetCurrentTaskHandle() != s_logTask)) {
+
+    // Convert according to format
+    char buffer[LOG_MSG_ITEM_SIZE];
+    va_list copy;
+    va_copy(copy, l);
+    int buffer_len = vsnprintf(buffer, LOG_MSG_ITEM_SIZE, fmt, copy);
+    va_end(copy);
+
+    if (buffer_len > 0) {
+
+      // Truncated
+      if (buffer_len >= LOG_MSG_ITEM_SIZE) {
+        buffer_len = LOG_MSG_ITEM_SIZE - 1;
+      }
+
+      // Never block the logging task. Lines that don't fit are dropped.
+      portENTER_CRITICAL_SAFE(&s_logMux);
+      s_logStats.nLines++;
+      if (buffer_len != xMessageBufferSendFromISR(xMessageBufferTrans, buffer, buffer_len, NULL)) {
+        s_logStats.nDropped++;
+      }
+      portEXIT_CRITICAL_SAFE(&s_logMux);
     }
   }
 
@@ -58,6 +78,75 @@ logging_vprintf(const char *fmt, va_list l)
   }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// net_logging_receive_batch
+//
+// Wait for log lines and collect them in buf until the batch is full or
+// the first line has waited LOG_BATCH_TIME ms. Returns number of bytes in
+// buf. size must be at least LOG_MSG_ITEM_SIZE.
+//
+
+size_t
+net_logging_receive_batch(char *buf, size_t size)
+{
+  size_t len;
+  size_t received;
+  TickType_t start;
+  TickType_t elapsed;
+
+  len = xMessageBufferReceive(xMessageBufferTrans, buf, size, portMAX_DELAY);
+  if (!len) {
+    return 0;
+  }
+
+  start = xTaskGetTickCount();
+  while ((len + LOG_MSG_ITEM_SIZE) <= size) {
+    elapsed = xTaskGetTickCount() - start;
+    if (elapsed >= pdMS_TO_TICKS(LOG_BATCH_TIME)) {
+      break;
+    }
+    // Zero on timeout
+    received = xMessageBufferReceive(xMessageBufferTrans, buf + len, size - len, pdMS_TO_TICKS(LOG_BATCH_TIME) - elapsed);
+    if (!received) {
+      break;
+    }
+    len += received;
+  }
+
+  return len;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// net_logging_batch_sent
+//
+
+void
+net_logging_batch_sent(bool bSuccess)
+{
+  if (bSuccess) {
+    s_logStats.nBatches++;
+  }
+  else {
+    s_logStats.nFailed++;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// net_logging_get_stats
+//
+
+void
+net_logging_get_stats(net_logging_stats_t *pstats)
+{
+  if (NULL == pstats) {
+    return;
+  }
+
+  portENTER_CRITICAL(&s_logMux);
+  memcpy(pstats, &s_logStats, sizeof(net_logging_stats_t));
+  portEXIT_CRITICAL(&s_logMux);
+}
+
 void
 udp_client(void *pvParameters);
 
@@ -79,7 +168,7 @@ udp_logging_init(char *ipaddr, unsigned long port, int16_t enableStdout)
   param.port = port;
   strcpy(param.ipv4, ipaddr);
   param.taskHandle = xTaskGetCurrentTaskHandle();
-  xTaskCreate(udp_client, "UDP", 1024 * 6, (void *) &param, 2, NULL);
+  xTaskCreate(udp_client, "UDP", 1024 * 6, (void *) &param, 2, &s_logTask);
 
   // Wait for ready to receive notify
   ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
@@ -112,7 +201,7 @@ tcp_logging_init(char *ipaddr, unsigned long port, int16_t enableStdout)
   param.port = port;
   strcpy(param.ipv4, ipaddr);
   param.taskHandle = xTaskGetCurrentTaskHandle();
-  xTaskCreate(tcp_client, "TCP", 1024 * 6, (void *) &param, 2, NULL);
+  xTaskCreate(tcp_client, "TCP", 1024 * 6, (void *) &param, 2, &s_logTask);
 
   // Wait for ready to receive notify
   ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
@@ -145,7 +234,7 @@ mqtt_logging_init(char *url, char *topic, int16_t enableStdout)
   strcpy(param.url, url);
   strcpy(param.topic, topic);
   param.taskHandle = xTaskGetCurrentTaskHandle();
-  xTaskCreate(mqtt_pub, "MQTT", 1024 * 6, (void *) &param, 2, NULL);
+  xTaskCreate(mqtt_pub, "MQTT", 1024 * 6, (void *) &param, 2, &s_logTask);
 
   // Wait for ready to receive notify
   ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
@@ -177,7 +266,7 @@ http_logging_init(char *url, int16_t enableStdout)
   PARAMETER_t param;
   strcpy(param.url, url);
   param.taskHandle = xTaskGetCurrentTaskHandle();
-  xTaskCreate(http_client, "HTTP", 1024 * 4, (void *) &param, 2, NULL);
+  xTaskCreate(http_client, "HTTP", 1024 * 6, (void *) &param, 2, &s_logTask);
 
   // Wait for ready to receive notify
   ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
@@ -188,3 +277,33 @@ http_logging_init(char *url, int16_t enableStdout)
   g_stdLogFunc = esp_log_set_vprintf(logging_vprintf);
   return ESP_OK;
 }
+
+void
+vscp_log_client(void *pvParameters);
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_logging_init
+//
+
+esp_err_t
+vscp_logging_init(int16_t enableStdout)
+{
+  printf("start vscp logging\n");
+
+  // Create MessageBuffer
+  xMessageBufferTrans = xMessageBufferCreate(LOG_MSG_BUF_SIZE);
+  configASSERT(xMessageBufferTrans);
+
+  // Start VSCP task
+  PARAMETER_t param;
+  param.taskHandle = xTaskGetCurrentTaskHandle();
+  xTaskCreate(vscp_log_client, "VSCPLOG", 1024 * 4, (void *) &param, 2, &s_logTask);
+
+  // Wait for ready to receive notify
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+  // Set function used to output log entries.
+  writeToStdout = enableStdout;
+  g_stdLogFunc = esp_log_set_vprintf(logging_vprintf);
+  return ESP_OK;
+}
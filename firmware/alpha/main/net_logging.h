@@ -28,16 +28,41 @@ typedef struct {
 } PARAMETER_t;
 
 // The total number of bytes (not messages) the message buffer will be able to hold at any one time.
-#define LOG_MSG_BUF_SIZE 1024
+#define LOG_MSG_BUF_SIZE CONFIG_APP_LOG_BUFFER_SIZE
 // The size, in bytes, required to hold each item in the message,
 #define LOG_MSG_ITEM_SIZE 512
 
+// Lines are sent in batches of at most this size
+#define LOG_BATCH_SIZE CONFIG_APP_LOG_BATCH_SIZE
+// Max time (ms) a line waits for a batch to fill up
+#define LOG_BATCH_TIME CONFIG_APP_LOG_BATCH_TIME
+
+// VSCP log sink. Average and burst events per second and max text per line
+#define LOG_VSCP_RATE     CONFIG_APP_LOG_VSCP_RATE
+#define LOG_VSCP_BURST    CONFIG_APP_LOG_VSCP_BURST
+#define LOG_VSCP_MAX_TEXT CONFIG_APP_LOG_VSCP_MAX_TEXT
+// Text in one Level I log frame and frames needed for the longest line
+#define LOG_VSCP_FRAME_TEXT 5
+#define LOG_VSCP_MAX_FRAMES (LOG_VSCP_MAX_TEXT / LOG_VSCP_FRAME_TEXT + 1)
+// The bucket always holds the longest line, even with a small burst
+#define LOG_VSCP_BUCKET MAX(LOG_VSCP_BURST, LOG_VSCP_MAX_FRAMES)
+
+typedef struct {
+	uint32_t nLines;   // Lines logged
+	uint32_t nDropped; // Lines dropped because the log buffer was full
+	uint32_t nBatches; // Batches sent
+	uint32_t nFailed;  // Batches that could not be sent
+} net_logging_stats_t;
 
 int logging_vprintf( const char *fmt, va_list l );
+size_t net_logging_receive_batch(char *buf, size_t size);
+void net_logging_batch_sent(bool bSuccess);
+void net_logging_get_stats(net_logging_stats_t *pstats);
 esp_err_t udp_logging_init(char *ipaddr, unsigned long port, int16_t enableStdout);
 esp_err_t tcp_logging_init(char *ipaddr, unsigned long port, int16_t enableStdout);
 esp_err_t mqtt_logging_init(char *url, char *topic, int16_t enableStdout);
 esp_err_t http_logging_init(char *url, int16_t enableStdout);
+esp_err_t vscp_logging_init(int16_t enableStdout);
 
 #ifdef __cplusplus
 }
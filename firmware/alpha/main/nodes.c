@@ -0,0 +1,169 @@
+/*
+  File: nodes.c
+
+  VSCP alpha node table of nodes in the esp-now cluster
+
+  This file is part of the VSCP (https://www.vscp.org)
+
+  The MIT License (MIT)
+  Copyright © 2022-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <freertos/FreeRTOS.h>
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include <esp_timer.h>
+
+#include <string.h>
+
+#include "alpha.h"
+#include <vscp.h>
+#include <vscp-espnow.h>
+
+#include "nodes.h"
+
+static const char *TAG = "nodes";
+
+static nodes_info_t s_nodes[CONFIG_APP_NODES_MAX];
+static int s_cntNodes                 = 0;
+static SemaphoreHandle_t s_mutexNodes = NULL;
+
+///////////////////////////////////////////////////////////////////////////////
+// nodes_init
+//
+
+int
+nodes_init(void)
+{
+  if (NULL != s_mutexNodes) {
+    return VSCP_ERROR_SUCCESS;
+  }
+
+  memset(s_nodes, 0, sizeof(s_nodes));
+  s_cntNodes = 0;
+
+  s_mutexNodes = xSemaphoreCreateMutex();
+  if (NULL == s_mutexNodes) {
+    ESP_LOGE(TAG, "Unable to create node table mutex");
+    return VSCP_ERROR_MEMORY;
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// nodes_received
+//
+
+int
+nodes_received(const vscpEvent *pev, const vscp_espnow_rx_info_t *pinfo)
+{
+  int idx = -1;
+
+  // Check pointers
+  if ((NULL == pev) || (NULL == pinfo)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if (NULL == s_mutexNodes) {
+    return VSCP_ERROR_INIT_MISSING;
+  }
+
+  xSemaphoreTake(s_mutexNodes, portMAX_DELAY);
+
+  for (int i = 0; i < s_cntNodes; i++) {
+    if (!memcmp(s_nodes[i].mac, pinfo->src_addr, ESP_NOW_ETH_ALEN)) {
+      idx = i;
+      break;
+    }
+  }
+
+  if (-1 == idx) {
+    if (s_cntNodes < CONFIG_APP_NODES_MAX) {
+      idx = s_cntNodes++;
+    }
+    else {
+      // Reuse the entry for the node that has been silent for the longest time
+      idx = 0;
+      for (int i = 1; i < s_cntNodes; i++) {
+        if (s_nodes[i].tsLastSeen < s_nodes[idx].tsLastSeen) {
+          idx = i;
+        }
+      }
+    }
+    memset(&s_nodes[idx], 0, sizeof(nodes_info_t));
+    memcpy(s_nodes[idx].mac, pinfo->src_addr, ESP_NOW_ETH_ALEN);
+    ESP_LOGI(TAG, "New node " MACSTR, MAC2STR(pinfo->src_addr));
+  }
+
+  s_nodes[idx].nodeType   = pinfo->node_type;
+  s_nodes[idx].nickname   = (pev->GUID[14] << 8) + pev->GUID[15];
+  s_nodes[idx].rssi       = pinfo->rssi;
+  s_nodes[idx].tsLastSeen = esp_timer_get_time();
+  s_nodes[idx].nEvents++;
+
+  xSemaphoreGive(s_mutexNodes);
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// nodes_get_count
+//
+
+int
+nodes_get_count(void)
+{
+  return s_cntNodes;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// nodes_get
+//
+
+int
+nodes_get(int idx, nodes_info_t *pinfo)
+{
+  int rv = VSCP_ERROR_SUCCESS;
+
+  // Check pointer
+  if (NULL == pinfo) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if (NULL == s_mutexNodes) {
+    return VSCP_ERROR_INIT_MISSING;
+  }
+
+  xSemaphoreTake(s_mutexNodes, portMAX_DELAY);
+
+  if ((idx < 0) || (idx >= s_cntNodes)) {
+    rv = VSCP_ERROR_INDEX_OOB;
+  }
+  else {
+    memcpy(pinfo, &s_nodes[idx], sizeof(nodes_info_t));
+  }
+
+  xSemaphoreGive(s_mutexNodes);
+
+  return rv;
+}
@@ -0,0 +1,88 @@
+/*
+  File: nodes.h
+
+  VSCP alpha node table of nodes in the esp-now cluster
+
+  This file is part of the VSCP (https://www.vscp.org)
+
+  The MIT License (MIT)
+  Copyright © 2022-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  Every node the alpha hears from on esp-now is recorded with the last time
+  it was heard from and the signal strength. The table is used to report the
+  state of the cluster.
+*/
+
+#ifndef __VSCP_ALPHA_NODES__
+#define __VSCP_ALPHA_NODES__
+
+#include <vscp.h>
+#include <vscp-espnow.h>
+
+/**
+ * @brief Information about a node
+ */
+typedef struct {
+  uint8_t mac[ESP_NOW_ETH_ALEN]; // MAC address of node
+  uint8_t nodeType;              // VSCP_DROPLET_ALPHA / VSCP_DROPLET_BETA / VSCP_DROPLET_GAMMA
+  uint16_t nickname;             // Nickname of node
+  int8_t rssi;                   // Signal strength of last frame
+  int64_t tsLastSeen;            // Time node was last heard from (us)
+  uint32_t nEvents;              // Number of events received from node
+} nodes_info_t;
+
+/**
+ * @brief Initialize node table
+ *
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+nodes_init(void);
+
+/**
+ * @brief Record an event received from a node
+ *
+ * @param pev Pointer to received event
+ * @param pinfo Pointer to information about the frame the event came in
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+nodes_received(const vscpEvent *pev, const vscp_espnow_rx_info_t *pinfo);
+
+/**
+ * @brief Get number of nodes in table
+ *
+ * @return Number of nodes
+ */
+int
+nodes_get_count(void);
+
+/**
+ * @brief Get information about a node
+ *
+ * @param idx Index of node (0 - nodes_get_count()-1)
+ * @param pinfo Pointer to structure that will be filled in
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+nodes_get(int idx, nodes_info_t *pinfo);
+
+#endif
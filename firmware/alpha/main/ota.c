@@ -0,0 +1,492 @@
+/*
+  File: ota.c
+
+  VSCP alpha node firmware download
+
+  This file is part of the VSCP (https://www.vscp.org)
+
+  The MIT License (MIT)
+  Copyright © 2022-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <string.h>
+#include <sys/param.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include <esp_log.h>
+#include <esp_netif.h>
+#include <esp_timer.h>
+#include <esp_http_client.h>
+#include <esp_crt_bundle.h>
+
+#include <vscp.h>
+
+#include "vscp-compiler.h"
+#include "vscp-projdefs.h"
+
+#include "vscp-delta.h"
+
+#include "imgcache.h"
+#include "ota.h"
+
+static const char *TAG = "ota";
+
+// Number of download buffers
+#define OTA_BUFFERS 2
+
+/*
+  A chunk of the image on its way from the network to flash. A chunk
+  with zero length ends the stream.
+*/
+typedef struct {
+  uint8_t *data; // Buffer (OTA_CHUNK_SIZE)
+  size_t len;    // Bytes in buffer
+} ota_chunk_t;
+
+typedef struct {
+  imgcache_writer_t writer; // Image cache writer
+  QueueHandle_t freeq;      // Empty buffers
+  QueueHandle_t fullq;      // Buffers waiting to be written
+  TaskHandle_t owner;       // Task notified when the writer is done
+  volatile esp_err_t err;   // First flash write error
+} ota_pipe_t;
+
+static ota_stats_t s_otaStats;
+
+///////////////////////////////////////////////////////////////////////////////
+// ota_writer_task
+//
+// Write chunks to flash until a zero length chunk arrives. Buffers are
+// handed back even after an error so the network side never blocks.
+//
+
+static void
+ota_writer_task(void *pvParameters)
+{
+  ota_pipe_t *ppipe = (ota_pipe_t *) pvParameters;
+  ota_chunk_t chunk;
+
+  for (;;) {
+    xQueueReceive(ppipe->fullq, &chunk, portMAX_DELAY);
+    if (!chunk.len) {
+      break;
+    }
+
+    if (ESP_OK == ppipe->err) {
+      if (VSCP_ERROR_SUCCESS != imgcache_write(&ppipe->writer, chunk.data, chunk.len)) {
+        ESP_LOGE(TAG, "Write firmware to flash failed, size: %u", (unsigned) chunk.len);
+        ppipe->err = ESP_FAIL;
+      }
+    }
+
+    xQueueSend(ppipe->freeq, &chunk, portMAX_DELAY);
+  }
+
+  xTaskNotifyGive(ppipe->owner);
+  vTaskDelete(NULL);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ota_connect
+//
+// Open connection and fetch headers. Failed attempts are retried
+// 'retries' times with doubling delay. A client error (4xx) from the
+// server is not retried. Returns content length or a negative value
+// on failure.
+//
+
+static int64_t
+ota_connect(esp_http_client_handle_t client, int retries)
+{
+  esp_err_t ret;
+  int status;
+  int64_t length;
+  uint32_t delay = OTA_RETRY_DELAY;
+
+  for (int i = 0;; i++) {
+
+    ret = esp_http_client_open(client, 0);
+    if (ESP_OK == ret) {
+      length = esp_http_client_fetch_headers(client);
+      status = esp_http_client_get_status_code(client);
+      if ((200 == status) && (length > 0)) {
+        return length;
+      }
+      esp_http_client_close(client);
+      if ((status >= 400) && (status < 500)) {
+        ESP_LOGW(TAG, "Server responded with status %d", status);
+        return -1;
+      }
+      ESP_LOGW(TAG, "No content length (status %d)", status);
+    }
+    else {
+      ESP_LOGW(TAG, "<%s> Connection to server failed", esp_err_to_name(ret));
+    }
+
+    if (i >= retries) {
+      return -1;
+    }
+
+    s_otaStats.retries++;
+    ESP_LOGI(TAG, "Retry %d/%d in %lu ms", i + 1, retries, (unsigned long) delay);
+    vTaskDelay(pdMS_TO_TICKS(delay));
+    delay = MIN(2 * delay, OTA_RETRY_DELAY_MAX);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ota_read_chunk
+//
+// Fill a chunk with up to 'want' bytes. Short reads are normal, the
+// network hand over what it has. Returns ESP_OK or error.
+//
+
+static esp_err_t
+ota_read_chunk(esp_http_client_handle_t client, ota_chunk_t *pchunk, size_t want)
+{
+  pchunk->len = 0;
+
+  while (pchunk->len < want) {
+    int size = esp_http_client_read(client, (char *) pchunk->data + pchunk->len, want - pchunk->len);
+#ifdef ESP_ERR_HTTP_EAGAIN
+    if (-ESP_ERR_HTTP_EAGAIN == size) {
+      continue;
+    }
+#endif
+    if (size <= 0) {
+      ESP_LOGE(TAG, "Read data from http stream failed (%d)", size);
+      return ESP_FAIL;
+    }
+    pchunk->len += size;
+  }
+
+  return ESP_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ota_bind_if
+//
+
+int
+ota_bind_if(esp_http_client_config_t *pconfig, struct ifreq *pifr)
+{
+  // Check pointers
+  if ((NULL == pconfig) || (NULL == pifr)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+#ifdef CONFIG_APP_OTA_BIND_IF
+  esp_netif_t *netif = esp_netif_get_handle_from_ifkey(CONFIG_APP_OTA_BIND_IF_KEY);
+  if (NULL == netif) {
+    ESP_LOGE(TAG, "Can't find interface %s", CONFIG_APP_OTA_BIND_IF_KEY);
+    return VSCP_ERROR_UNKNOWN_ITEM;
+  }
+
+  if (ESP_OK != esp_netif_get_netif_impl_name(netif, pifr->ifr_name)) {
+    ESP_LOGE(TAG, "Can't get name of interface %s", CONFIG_APP_OTA_BIND_IF_KEY);
+    return VSCP_ERROR_ERROR;
+  }
+
+  ESP_LOGI(TAG, "Bind interface name is %s", pifr->ifr_name);
+  pconfig->if_name = pifr;
+#endif
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ota_download
+//
+
+int
+ota_download(const char *url, imgcache_entry_t *pentry)
+{
+  int rv = VSCP_ERROR_SUCCESS;
+  esp_err_t ret;
+  int64_t length;
+  int64_t tsStart;
+  int64_t tsWait;
+  int64_t flashWait = 0;
+  uint32_t received = 0;
+  int reported      = 0;
+  uint8_t *pbuf     = NULL;
+  ota_chunk_t chunk;
+  ota_pipe_t pipe;
+  struct ifreq ifr;
+
+  if (NULL == url) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  memset(&s_otaStats, 0, sizeof(s_otaStats));
+  memset(&pipe, 0, sizeof(pipe));
+
+  esp_http_client_config_t config = {
+    .url               = url,
+    .crt_bundle_attach = esp_crt_bundle_attach,
+    .keep_alive_enable = true,
+    .buffer_size       = OTA_CHUNK_SIZE,
+  };
+
+#ifdef CONFIG_APP_OTA_SKIP_COMMON_NAME_CHECK
+  config.skip_cert_common_name_check = true;
+#endif
+
+  if (VSCP_ERROR_SUCCESS != (rv = ota_bind_if(&config, &ifr))) {
+    return rv;
+  }
+
+  esp_http_client_handle_t client = esp_http_client_init(&config);
+  if (NULL == client) {
+    ESP_LOGE(TAG, "Failed to initialise HTTP connection");
+    return VSCP_ERROR_MEMORY;
+  }
+
+  ESP_LOGI(TAG, "Download firmware from %s", url);
+  tsStart = esp_timer_get_time();
+
+  length = ota_connect(client, OTA_RETRIES);
+  if (length <= 0) {
+    ESP_LOGE(TAG, "Giving up connecting to %s", url);
+    rv = VSCP_ERROR_CONNECTION;
+    goto EXIT;
+  }
+
+  s_otaStats.size = (uint32_t) length;
+
+  // Flash is erased as it is written so the writer does not stall the start
+  rv = imgcache_begin(length, &pipe.writer);
+  if (VSCP_ERROR_SUCCESS != rv) {
+    goto EXIT;
+  }
+
+  pbuf       = ESP_MALLOC(OTA_BUFFERS * OTA_CHUNK_SIZE);
+  pipe.freeq = xQueueCreate(OTA_BUFFERS, sizeof(ota_chunk_t));
+  pipe.fullq = xQueueCreate(OTA_BUFFERS + 1, sizeof(ota_chunk_t)); // + end marker
+  pipe.owner = xTaskGetCurrentTaskHandle();
+  pipe.err   = ESP_OK;
+  if ((NULL == pbuf) || (NULL == pipe.freeq) || (NULL == pipe.fullq)) {
+    ESP_LOGE(TAG, "Unable to allocate download buffers");
+    imgcache_abort(&pipe.writer);
+    rv = VSCP_ERROR_MEMORY;
+    goto EXIT;
+  }
+
+  for (int i = 0; i < OTA_BUFFERS; i++) {
+    chunk.data = pbuf + i * OTA_CHUNK_SIZE;
+    chunk.len  = 0;
+    xQueueSend(pipe.freeq, &chunk, 0);
+  }
+
+  if (pdPASS != xTaskCreate(ota_writer_task, "otawr", 4096, &pipe, 5, NULL)) {
+    ESP_LOGE(TAG, "Unable to create flash writer task");
+    imgcache_abort(&pipe.writer);
+    rv = VSCP_ERROR_MEMORY;
+    goto EXIT;
+  }
+
+  while ((received < length) && (ESP_OK == pipe.err)) {
+
+    // Time spent here is time the network waited for flash
+    tsWait = esp_timer_get_time();
+    xQueueReceive(pipe.freeq, &chunk, portMAX_DELAY);
+    flashWait += esp_timer_get_time() - tsWait;
+
+    ret = ota_read_chunk(client, &chunk, MIN(OTA_CHUNK_SIZE, length - received));
+    if (chunk.len) {
+      xQueueSend(pipe.fullq, &chunk, portMAX_DELAY);
+      received += chunk.len;
+    }
+    else {
+      xQueueSend(pipe.freeq, &chunk, 0);
+    }
+
+    if (ESP_OK != ret) {
+      rv = VSCP_ERROR_COMMUNICATION;
+      break;
+    }
+
+    // Progress every ten percent
+    if ((received * 10 / length) > reported) {
+      int64_t elapsed = esp_timer_get_time() - tsStart;
+      reported        = received * 10 / length;
+      ESP_LOGI(TAG,
+               "%d%% %lu/%lld bytes, %llu KB/s",
+               reported * 10,
+               (unsigned long) received,
+               length,
+               elapsed ? ((uint64_t) received * 1000000 / elapsed) / 1024 : 0);
+    }
+  }
+
+  // End of stream, wait for the writer to finish
+  chunk.data = NULL;
+  chunk.len  = 0;
+  xQueueSend(pipe.fullq, &chunk, portMAX_DELAY);
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+  if (ESP_OK != pipe.err) {
+    rv = VSCP_ERROR_WRITE_ERROR;
+  }
+
+  if (VSCP_ERROR_SUCCESS != rv) {
+    imgcache_abort(&pipe.writer);
+    goto EXIT;
+  }
+
+  // Validates the image
+  rv = imgcache_end(&pipe.writer, url, pentry);
+
+EXIT:
+  s_otaStats.received    = received;
+  s_otaStats.timeMs      = (esp_timer_get_time() - tsStart) / 1000;
+  s_otaStats.rate        = s_otaStats.timeMs ? (uint32_t) ((uint64_t) received * 1000 / s_otaStats.timeMs) : 0;
+  s_otaStats.flashWaitMs = flashWait / 1000;
+  s_otaStats.result      = rv;
+
+  ESP_LOGI(TAG,
+           "Download %s: %lu bytes in %lu ms (%lu KB/s), waited %lu ms for flash, %lu retries",
+           (VSCP_ERROR_SUCCESS == rv) ? "done" : "failed",
+           (unsigned long) s_otaStats.received,
+           (unsigned long) s_otaStats.timeMs,
+           (unsigned long) s_otaStats.rate / 1024,
+           (unsigned long) s_otaStats.flashWaitMs,
+           (unsigned long) s_otaStats.retries);
+
+  if (NULL != pipe.freeq) {
+    vQueueDelete(pipe.freeq);
+  }
+  if (NULL != pipe.fullq) {
+    vQueueDelete(pipe.fullq);
+  }
+  ESP_FREE(pbuf);
+  esp_http_client_close(client);
+  esp_http_client_cleanup(client);
+
+  return rv;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ota_download_delta
+//
+
+int
+ota_download_delta(const char *url, uint8_t **pbuf, size_t *psize)
+{
+  int rv = VSCP_ERROR_SUCCESS;
+  int64_t length;
+  uint8_t *pdelta = NULL;
+  ota_chunk_t chunk;
+  struct ifreq ifr;
+
+  // Check pointers
+  if ((NULL == url) || (NULL == pbuf) || (NULL == psize)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  *pbuf  = NULL;
+  *psize = 0;
+
+  esp_http_client_config_t config = {
+    .url               = url,
+    .crt_bundle_attach = esp_crt_bundle_attach,
+    .buffer_size       = OTA_CHUNK_SIZE,
+  };
+
+#ifdef CONFIG_APP_OTA_SKIP_COMMON_NAME_CHECK
+  config.skip_cert_common_name_check = true;
+#endif
+
+  if (VSCP_ERROR_SUCCESS != (rv = ota_bind_if(&config, &ifr))) {
+    return rv;
+  }
+
+  esp_http_client_handle_t client = esp_http_client_init(&config);
+  if (NULL == client) {
+    ESP_LOGE(TAG, "Failed to initialise HTTP connection");
+    return VSCP_ERROR_MEMORY;
+  }
+
+  // A missing delta is normal, don't retry
+  length = ota_connect(client, 0);
+  if (length <= 0) {
+    ESP_LOGI(TAG, "No delta at %s", url);
+    rv = VSCP_ERROR_CONNECTION;
+    goto EXIT;
+  }
+
+  if ((length < sizeof(vscp_delta_hdr_t)) || (length > OTA_DELTA_MAX_SIZE)) {
+    ESP_LOGW(TAG, "Delta size %lld is outside limits (max %d)", length, OTA_DELTA_MAX_SIZE);
+    rv = VSCP_ERROR_BUFFER_TO_SMALL;
+    goto EXIT;
+  }
+
+  pdelta = ESP_MALLOC(length);
+  if (NULL == pdelta) {
+    rv = VSCP_ERROR_MEMORY;
+    goto EXIT;
+  }
+
+  chunk.data = pdelta;
+  if (ESP_OK != ota_read_chunk(client, &chunk, length)) {
+    rv = VSCP_ERROR_COMMUNICATION;
+    goto EXIT;
+  }
+
+  if (VSCP_ERROR_SUCCESS != vscp_delta_check_header((vscp_delta_hdr_t *) pdelta, length)) {
+    ESP_LOGW(TAG, "Invalid delta at %s", url);
+    rv = VSCP_ERROR_INVALID_FRAME;
+    goto EXIT;
+  }
+
+  ESP_LOGI(TAG, "Delta downloaded, %lld bytes", length);
+
+  *pbuf  = pdelta;
+  *psize = length;
+  pdelta = NULL;
+
+EXIT:
+  ESP_FREE(pdelta);
+  esp_http_client_close(client);
+  esp_http_client_cleanup(client);
+
+  return rv;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ota_get_stats
+//
+
+int
+ota_get_stats(ota_stats_t *pstats)
+{
+  // Check pointer
+  if (NULL == pstats) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  memcpy(pstats, &s_otaStats, sizeof(ota_stats_t));
+
+  return VSCP_ERROR_SUCCESS;
+}
@@ -0,0 +1,135 @@
+/*
+  File: ota.h
+
+  VSCP alpha node firmware download
+
+  This file is part of the VSCP (https://www.vscp.org)
+
+  The MIT License (MIT)
+  Copyright © 2022-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  Firmware for the alpha and the nodes of its cluster is downloaded over
+  HTTP(S) into the next OTA partition. The download is a pipeline with two
+  buffers. The calling task fill one from the network while a writer task
+  erase and write the other to flash, so network and flash work in parallel.
+
+  A delta against the firmware the nodes run can be fetched as well. It is
+  sent to the nodes that run its source image instead of the full image.
+*/
+
+#ifndef __VSCP_ALPHA_OTA__
+#define __VSCP_ALPHA_OTA__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <net/if.h>
+
+#include <esp_http_client.h>
+
+#include "imgcache.h"
+
+// Size of each of the two download buffers
+#define OTA_CHUNK_SIZE CONFIG_APP_OTA_CHUNK_SIZE
+
+// Connection retries and first retry delay (ms). The delay doubles up to OTA_RETRY_DELAY_MAX
+#define OTA_RETRIES         CONFIG_APP_OTA_RETRIES
+#define OTA_RETRY_DELAY     CONFIG_APP_OTA_RETRY_DELAY
+#define OTA_RETRY_DELAY_MAX 10000
+
+// Max size of a firmware delta. It is held in RAM while it is sent.
+#define OTA_DELTA_MAX_SIZE CONFIG_APP_OTA_DELTA_MAX_SIZE
+
+// Time (s) given to nodes to rebuild and restart after a delta before the full image is sent
+#define OTA_DELTA_SETTLE_TIME CONFIG_APP_OTA_DELTA_SETTLE_TIME
+
+// Rounds and delay (s) between rounds for nodes that did not get the whole image
+#define OTA_RESEND_ROUNDS CONFIG_APP_OTA_RESEND_ROUNDS
+#define OTA_RESEND_DELAY  CONFIG_APP_OTA_RESEND_DELAY
+
+// Broadcast (FEC) update. Min nodes, repair share (percent) and feedback rounds
+#define OTA_FEC_MIN_NODES    CONFIG_APP_OTA_FEC_MIN_NODES
+#define OTA_FEC_REDUNDANCY   CONFIG_APP_OTA_FEC_REDUNDANCY
+#define OTA_FEC_ROUNDS       CONFIG_APP_OTA_FEC_ROUNDS
+#define OTA_FEC_PREPARE_TIME 20000 // Max time (ms) for nodes to erase the update partition
+
+/**
+ * @brief Statistics for the last download
+ */
+typedef struct {
+  uint32_t size;        // Image size
+  uint32_t received;    // Bytes received
+  uint32_t timeMs;      // Time from connect to image written
+  uint32_t rate;        // Average rate (bytes/s)
+  uint32_t flashWaitMs; // Time the network side waited for flash
+  uint32_t retries;     // Connection retries
+  int result;           // VSCP error code
+} ota_stats_t;
+
+/**
+ * @brief Bind HTTP client to the OTA interface
+ *
+ * Does nothing unless CONFIG_APP_OTA_BIND_IF is set.
+ *
+ * @param pconfig Pointer to HTTP client configuration to update.
+ * @param pifr Pointer to interface request that get the interface name. Must
+ *        be valid as long as the client is used.
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+ota_bind_if(esp_http_client_config_t *pconfig, struct ifreq *pifr);
+
+/**
+ * @brief Download firmware to the image cache
+ *
+ * The boot partition is not changed.
+ *
+ * @param url URL to firmware image
+ * @param pentry Pointer to entry that get the cached image. Can be NULL.
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+ota_download(const char *url, imgcache_entry_t *pentry);
+
+/**
+ * @brief Download a firmware delta to RAM
+ *
+ * Deltas are made with tools/vscp-delta. Only the header is checked, nodes
+ * verify the rest before they use it.
+ *
+ * @param url URL to delta
+ * @param pbuf Pointer to variable that get a pointer to the delta. Free
+ *        with ESP_FREE.
+ * @param psize Pointer to variable that get delta size.
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+ota_download_delta(const char *url, uint8_t **pbuf, size_t *psize);
+
+/**
+ * @brief Get statistics for the last download
+ *
+ * @param pstats Pointer to statistics structure that will be filled in
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+ota_get_stats(ota_stats_t *pstats);
+
+#endif
@@ -0,0 +1,578 @@
+/*
+  File: restapi.c
+
+  VSCP alpha node JSON REST API
+
+  This file is part of the VSCP (https://www.vscp.org)
+
+  The MIT License (MIT)
+  Copyright © 2022-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <string.h>
+#include <strings.h>
+#include <sys/param.h>
+
+#include <esp_system.h>
+#include <esp_chip_info.h>
+#include <esp_app_desc.h>
+#include <esp_wifi.h>
+#include <esp_netif.h>
+#include <esp_mac.h>
+#include <esp_timer.h>
+#include <esp_log.h>
+#include <esp_http_server.h>
+
+#include <vscp.h>
+#include <vscp-firmware-helper.h>
+#include <vscp-espnow.h>
+#include <vscp-espnow-trace.h>
+
+#include "alpha.h"
+#include "eventbus.h"
+#include "imgcache.h"
+#include "mailbox.h"
+#include "mqtt.h"
+#include "net_logging.h"
+#include "ota.h"
+#include "nodes.h"
+#include "tcpsrv.h"
+#include "websrv.h"
+#include "jsonwr.h"
+#include "restapi.h"
+
+static const char *TAG = "restapi";
+
+extern node_persistent_config_t g_persistent;
+
+///////////////////////////////////////////////////////////////////////////////
+// restapi_chipModel
+//
+
+static const char *
+restapi_chipModel(esp_chip_model_t model)
+{
+  switch (model) {
+    case CHIP_ESP32:
+      return "ESP32";
+    case CHIP_ESP32S2:
+      return "ESP32-S2";
+    case CHIP_ESP32S3:
+      return "ESP32-S3";
+    case CHIP_ESP32C3:
+      return "ESP32-C3";
+    case CHIP_ESP32H2:
+      return "ESP32-H2";
+    case CHIP_ESP32C2:
+      return "ESP32-C2";
+    default:
+      return "unknown";
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// restapi_resetReason
+//
+
+static const char *
+restapi_resetReason(esp_reset_reason_t reason)
+{
+  switch (reason) {
+    case ESP_RST_POWERON:
+      return "poweron";
+    case ESP_RST_EXT:
+      return "external";
+    case ESP_RST_SW:
+      return "software";
+    case ESP_RST_PANIC:
+      return "panic";
+    case ESP_RST_INT_WDT:
+      return "int_wdt";
+    case ESP_RST_TASK_WDT:
+      return "task_wdt";
+    case ESP_RST_WDT:
+      return "wdt";
+    case ESP_RST_DEEPSLEEP:
+      return "deepsleep";
+    case ESP_RST_BROWNOUT:
+      return "brownout";
+    case ESP_RST_SDIO:
+      return "sdio";
+    default:
+      return "unknown";
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// restapi_nodeType
+//
+
+static const char *
+restapi_nodeType(uint8_t type)
+{
+  switch (type) {
+    case VSCP_DROPLET_ALPHA:
+      return "alpha";
+    case VSCP_DROPLET_BETA:
+      return "beta";
+    case VSCP_DROPLET_GAMMA:
+      return "gamma";
+    default:
+      return "unknown";
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// restapi_status
+//
+
+static esp_err_t
+restapi_status(httpd_req_t *req)
+{
+  jsonwr_t w;
+  char str[50];
+  uint8_t GUID[16];
+  esp_chip_info_t chip_info;
+  wifi_ap_record_t ap_info;
+  const esp_app_desc_t *appDescr = esp_app_get_description();
+
+  esp_chip_info(&chip_info);
+
+  jsonwr_init(&w, req);
+  jsonwr_begin_object(&w, NULL);
+
+  jsonwr_string(&w, "name", g_persistent.nodeName);
+  vscp_espnow_get_node_guid(GUID);
+  vscp_fwhlp_writeGuidToString(str, GUID);
+  jsonwr_string(&w, "guid", str);
+  jsonwr_string(&w, "version", appDescr->version);
+  jsonwr_string(&w, "idf", esp_get_idf_version());
+  jsonwr_string(&w, "chip", restapi_chipModel(chip_info.model));
+  jsonwr_uint(&w, "cores", chip_info.cores);
+  jsonwr_uint(&w, "revision", chip_info.revision);
+  jsonwr_uint(&w, "uptime", esp_timer_get_time() / 1000000);
+  jsonwr_uint(&w, "bootCnt", g_persistent.bootCnt);
+  jsonwr_string(&w, "resetReason", restapi_resetReason(esp_reset_reason()));
+
+  jsonwr_begin_object(&w, "heap");
+  jsonwr_uint(&w, "free", esp_get_free_heap_size());
+  jsonwr_uint(&w, "minFree", esp_get_minimum_free_heap_size());
+  jsonwr_end_object(&w);
+
+  jsonwr_begin_object(&w, "wifi");
+  if (ESP_OK == esp_wifi_sta_get_ap_info(&ap_info)) {
+    jsonwr_bool(&w, "connected", true);
+    jsonwr_string(&w, "ssid", (const char *) ap_info.ssid);
+    sprintf(str, MACSTR, MAC2STR(ap_info.bssid));
+    jsonwr_string(&w, "bssid", str);
+    jsonwr_uint(&w, "channel", ap_info.primary);
+    jsonwr_int(&w, "rssi", ap_info.rssi);
+  }
+  else {
+    jsonwr_bool(&w, "connected", false);
+  }
+
+  esp_netif_t *netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+  esp_netif_ip_info_t ifinfo;
+  if ((NULL != netif) && (ESP_OK == esp_netif_get_ip_info(netif, &ifinfo))) {
+    sprintf(str, IPSTR, IP2STR(&ifinfo.ip));
+    jsonwr_string(&w, "ip", str);
+    sprintf(str, IPSTR, IP2STR(&ifinfo.netmask));
+    jsonwr_string(&w, "netmask", str);
+    sprintf(str, IPSTR, IP2STR(&ifinfo.gw));
+    jsonwr_string(&w, "gateway", str);
+  }
+  jsonwr_end_object(&w);
+
+  jsonwr_begin_object(&w, "mqtt");
+  jsonwr_bool(&w, "enabled", g_persistent.mqttEnable);
+  jsonwr_bool(&w, "connected", mqtt_is_connected());
+  jsonwr_end_object(&w);
+
+  jsonwr_end_object(&w);
+
+  return jsonwr_finish(&w);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// restapi_stats
+//
+
+static esp_err_t
+restapi_stats(httpd_req_t *req)
+{
+  jsonwr_t w;
+  mqtt_stats_t mqttStats;
+  mailbox_stats_t mailboxStats;
+  eventbus_stats_t busStats;
+  tcpsrv_latency_t latency;
+  websrv_ws_stats_t wsStats;
+  net_logging_stats_t logStats;
+  ota_stats_t otaStats;
+  const char *name;
+
+  jsonwr_init(&w, req);
+  jsonwr_begin_object(&w, NULL);
+
+  if (VSCP_ERROR_SUCCESS == mqtt_get_stats(&mqttStats)) {
+    jsonwr_begin_object(&w, "mqtt");
+    jsonwr_uint(&w, "connect", mqttStats.nConnect);
+    jsonwr_uint(&w, "disconnect", mqttStats.nDisconnect);
+    jsonwr_uint(&w, "errors", mqttStats.nErrors);
+    jsonwr_uint(&w, "pub", mqttStats.nPub);
+    jsonwr_uint(&w, "pubFailures", mqttStats.nPubFailures);
+    jsonwr_uint(&w, "pubConfirm", mqttStats.nPubConfirm);
+    jsonwr_uint(&w, "pubBatch", mqttStats.nPubBatch);
+    jsonwr_uint(&w, "pubDropped", mqttStats.nPubDropped);
+    jsonwr_uint(&w, "pubLog", mqttStats.nPubLog);
+    jsonwr_uint(&w, "pubLogFailures", mqttStats.nPubLogFailures);
+    jsonwr_uint(&w, "pubLogConfirm", mqttStats.nPubLogConfirm);
+    jsonwr_uint(&w, "sub", mqttStats.nSub);
+    jsonwr_uint(&w, "subRejected", mqttStats.nSubRejected);
+    jsonwr_uint(&w, "subDropped", mqttStats.nSubDropped);
+    jsonwr_end_object(&w);
+  }
+
+  jsonwr_begin_array(&w, "eventbus");
+  for (int i = 0; i < eventbus_get_subscriber_count(); i++) {
+    if (VSCP_ERROR_SUCCESS != eventbus_get_stats(i, &name, &busStats)) {
+      continue;
+    }
+    jsonwr_begin_object(&w, NULL);
+    jsonwr_string(&w, "name", name);
+    jsonwr_uint(&w, "delivered", busStats.nDelivered);
+    jsonwr_uint(&w, "dropped", busStats.nDropped);
+    jsonwr_uint(&w, "failed", busStats.nFailed);
+    jsonwr_uint(&w, "queued", busStats.nQueued);
+    jsonwr_end_object(&w);
+  }
+  jsonwr_end_array(&w);
+
+  if (VSCP_ERROR_SUCCESS == mailbox_get_stats(&mailboxStats)) {
+    jsonwr_begin_object(&w, "mailbox");
+    jsonwr_uint(&w, "stored", mailboxStats.nStored);
+    jsonwr_uint(&w, "delivered", mailboxStats.nDelivered);
+    jsonwr_uint(&w, "dropped", mailboxStats.nDropped);
+    jsonwr_uint(&w, "failed", mailboxStats.nFailed);
+    jsonwr_uint(&w, "wakeups", mailboxStats.nWakeups);
+    jsonwr_end_object(&w);
+  }
+
+  if (VSCP_ERROR_SUCCESS == tcpsrv_getLatency(&latency)) {
+    jsonwr_begin_object(&w, "vscplink");
+    jsonwr_uint(&w, "latencyCnt", latency.cnt);
+    jsonwr_uint(&w, "latencyP50", latency.p50);
+    jsonwr_uint(&w, "latencyP99", latency.p99);
+    jsonwr_uint(&w, "latencyMax", latency.max);
+    jsonwr_end_object(&w);
+  }
+
+  net_logging_get_stats(&logStats);
+  jsonwr_begin_object(&w, "log");
+  jsonwr_uint(&w, "lines", logStats.nLines);
+  jsonwr_uint(&w, "dropped", logStats.nDropped);
+  jsonwr_uint(&w, "batches", logStats.nBatches);
+  jsonwr_uint(&w, "failed", logStats.nFailed);
+  jsonwr_end_object(&w);
+
+  ota_get_stats(&otaStats);
+  jsonwr_begin_object(&w, "ota");
+  jsonwr_uint(&w, "size", otaStats.size);
+  jsonwr_uint(&w, "received", otaStats.received);
+  jsonwr_uint(&w, "time", otaStats.timeMs);
+  jsonwr_uint(&w, "rate", otaStats.rate);
+  jsonwr_uint(&w, "flashWait", otaStats.flashWaitMs);
+  jsonwr_uint(&w, "retries", otaStats.retries);
+  jsonwr_int(&w, "result", otaStats.result);
+  jsonwr_end_object(&w);
+
+  jsonwr_begin_array(&w, "websocket");
+  for (int i = 0; i < CONFIG_APP_WS_MAX_CLIENTS; i++) {
+    if (VSCP_ERROR_SUCCESS != websrv_get_ws_stats(i, &wsStats)) {
+      continue;
+    }
+    jsonwr_begin_object(&w, NULL);
+    jsonwr_uint(&w, "sent", wsStats.nSent);
+    jsonwr_uint(&w, "frames", wsStats.nFrames);
+    jsonwr_uint(&w, "dropped", wsStats.nDropped);
+    jsonwr_uint(&w, "queued", wsStats.nQueued);
+    jsonwr_end_object(&w);
+  }
+  jsonwr_end_array(&w);
+
+  jsonwr_end_object(&w);
+
+  return jsonwr_finish(&w);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// restapi_nodes
+//
+
+static esp_err_t
+restapi_nodes(httpd_req_t *req)
+{
+  jsonwr_t w;
+  nodes_info_t node;
+  char str[20];
+  int64_t now = esp_timer_get_time();
+
+  jsonwr_init(&w, req);
+  jsonwr_begin_array(&w, NULL);
+
+  for (int i = 0; i < nodes_get_count(); i++) {
+    if (VSCP_ERROR_SUCCESS != nodes_get(i, &node)) {
+      continue;
+    }
+    jsonwr_begin_object(&w, NULL);
+    sprintf(str, MACSTR, MAC2STR(node.mac));
+    jsonwr_string(&w, "mac", str);
+    jsonwr_string(&w, "type", restapi_nodeType(node.nodeType));
+    jsonwr_uint(&w, "nickname", node.nickname);
+    jsonwr_int(&w, "rssi", node.rssi);
+    jsonwr_uint(&w, "lastSeen", (now - node.tsLastSeen) / 1000); // ms ago
+    jsonwr_uint(&w, "events", node.nEvents);
+    jsonwr_end_object(&w);
+  }
+
+  jsonwr_end_array(&w);
+
+  return jsonwr_finish(&w);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// restapi_trace
+//
+// Binary dump of the esp-now trace ring. Decode with tools/vscp-espnow-trace
+//
+
+static esp_err_t
+restapi_trace(httpd_req_t *req)
+{
+#ifdef CONFIG_APP_ESPNOW_TRACE
+  esp_err_t rv;
+  size_t size  = vscp_espnow_trace_dump_size();
+  uint8_t *buf = ESP_MALLOC(size);
+  if (NULL == buf) {
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    return ESP_FAIL;
+  }
+
+  size = vscp_espnow_trace_dump(buf, size);
+
+  httpd_resp_set_type(req, "application/octet-stream");
+  httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"espnow.trace\"");
+  rv = httpd_resp_send(req, (const char *) buf, size);
+
+  ESP_FREE(buf);
+  return rv;
+#else
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_status(req, HTTPD_404);
+  return httpd_resp_sendstr(req, "{\"error\":\"trace disabled\"}");
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// restapi_hex
+//
+
+static void
+restapi_hex(char *str, const uint8_t *data, size_t len)
+{
+  for (size_t i = 0; i < len; i++) {
+    sprintf(str + 2 * i, "%02x", data[i]);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// restapi_images
+//
+// Images in the image cache
+//
+
+static esp_err_t
+restapi_images(httpd_req_t *req)
+{
+  jsonwr_t w;
+  imgcache_entry_t entry;
+  char str[65];
+
+  jsonwr_init(&w, req);
+  jsonwr_begin_array(&w, NULL);
+
+  for (int i = 0; i < imgcache_get_slot_count(); i++) {
+    if (VSCP_ERROR_SUCCESS != imgcache_get(i, &entry)) {
+      continue;
+    }
+    jsonwr_begin_object(&w, NULL);
+    restapi_hex(str, entry.sha, sizeof(entry.sha));
+    jsonwr_string(&w, "sha256", str);
+    snprintf(str, sizeof(str), "%.32s", entry.projectName);
+    jsonwr_string(&w, "project", str);
+    snprintf(str, sizeof(str), "%.32s", entry.version);
+    jsonwr_string(&w, "version", str);
+    jsonwr_uint(&w, "size", entry.size);
+    jsonwr_uint(&w, "slot", entry.slot);
+    jsonwr_end_object(&w);
+  }
+
+  jsonwr_end_array(&w);
+
+  return jsonwr_finish(&w);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// restapi_send_all
+//
+// Raw send on the socket of a request
+//
+
+static esp_err_t
+restapi_send_all(httpd_req_t *req, const char *buf, size_t len)
+{
+  while (len) {
+    int sent = httpd_send(req, buf, len);
+    if (sent <= 0) {
+      return ESP_FAIL;
+    }
+    buf += sent;
+    len -= sent;
+  }
+
+  return ESP_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// restapi_image
+//
+// A cached firmware image, selected with sha256=<hex digest> or
+// project=<project name>. Lets sibling alpha nodes update from this node
+// instead of the server.
+//
+
+static esp_err_t
+restapi_image(httpd_req_t *req)
+{
+  esp_err_t rv = ESP_OK;
+  int found    = VSCP_ERROR_UNKNOWN_ITEM;
+  char query[100];
+  char param[65];
+  char str[65];
+  char hdr[200];
+  uint8_t sha[32];
+  imgcache_entry_t entry;
+
+  // The image is locked when found so it is not replaced while it is sent
+  if (ESP_OK == httpd_req_get_url_query_str(req, query, sizeof(query))) {
+    if (ESP_OK == httpd_query_key_value(query, "sha256", param, sizeof(param))) {
+      if ((2 * sizeof(sha) == strlen(param)) && (2 * sizeof(sha) == strspn(param, "0123456789abcdefABCDEF"))) {
+        vscp_fwhlp_hex2bin(sha, sizeof(sha), param);
+        found = imgcache_find_lock(sha, &entry);
+      }
+    }
+    else if (ESP_OK == httpd_query_key_value(query, "project", param, sizeof(param))) {
+      found = imgcache_find_project_lock(param, &entry);
+    }
+  }
+
+  if (VSCP_ERROR_SUCCESS != found) {
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_status(req, HTTPD_404);
+    return httpd_resp_sendstr(req, "{\"error\":\"image not found\"}");
+  }
+
+  uint8_t *buf = ESP_MALLOC(CONFIG_APP_OTA_CHUNK_SIZE);
+  if (NULL == buf) {
+    imgcache_unlock(&entry);
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    return ESP_FAIL;
+  }
+
+  /*
+    The response is written on the socket as is. The OTA download of a
+    sibling wants a content length and httpd_resp_send_chunk only do
+    chunked transfers.
+  */
+  restapi_hex(str, entry.sha, sizeof(entry.sha));
+  size_t len = snprintf(hdr,
+                        sizeof(hdr),
+                        "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\n"
+                        "Content-Length: %lu\r\nETag: \"%s\"\r\n\r\n",
+                        (unsigned long) entry.size,
+                        str);
+  rv = restapi_send_all(req, hdr, len);
+
+  for (size_t offset = 0; (ESP_OK == rv) && (offset < entry.size); offset += len) {
+    len = MIN(CONFIG_APP_OTA_CHUNK_SIZE, entry.size - offset);
+    if ((VSCP_ERROR_SUCCESS != imgcache_read(&entry, offset, buf, len)) ||
+        (ESP_OK != restapi_send_all(req, (const char *) buf, len))) {
+      ESP_LOGE(TAG, "Sending image failed at %u", (unsigned) offset);
+      rv = ESP_FAIL;
+    }
+  }
+
+  imgcache_unlock(&entry);
+  ESP_FREE(buf);
+
+  return rv;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// restapi_get_handler
+//
+
+esp_err_t
+restapi_get_handler(httpd_req_t *req)
+{
+  const char *resource = req->uri + strlen(RESTAPI_URI_PREFIX);
+  size_t len           = strcspn(resource, "?#");
+
+  ESP_LOGD(TAG, "API request %s", req->uri);
+
+  if ((6 == len) && (0 == strncmp(resource, "status", len))) {
+    return restapi_status(req);
+  }
+
+  if ((5 == len) && (0 == strncmp(resource, "stats", len))) {
+    return restapi_stats(req);
+  }
+
+  if ((5 == len) && (0 == strncmp(resource, "nodes", len))) {
+    return restapi_nodes(req);
+  }
+
+  if ((5 == len) && (0 == strncmp(resource, "trace", len))) {
+    return restapi_trace(req);
+  }
+
+  if ((6 == len) && (0 == strncmp(resource, "images", len))) {
+    return restapi_images(req);
+  }
+
+  if ((5 == len) && (0 == strncmp(resource, "image", len))) {
+    return restapi_image(req);
+  }
+
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_status(req, HTTPD_404);
+  return httpd_resp_sendstr(req, "{\"error\":\"unknown resource\"}");
+}
@@ -0,0 +1,55 @@
+/*
+  File: restapi.h
+
+  VSCP alpha node JSON REST API
+
+  This file is part of the VSCP (https://www.vscp.org)
+
+  The MIT License (MIT)
+  Copyright © 2022-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  Read only API for monitoring and for sibling firmware updates
+
+    /api/v1/status - Node, firmware, heap and connection status
+    /api/v1/stats  - Counters for MQTT, event bus, mailboxes, VSCP link, logging and OTA
+    /api/v1/nodes  - Nodes heard from on esp-now
+    /api/v1/trace  - Binary dump of the esp-now trace ring (tools/vscp-espnow-trace)
+    /api/v1/images - Firmware images in the image cache
+    /api/v1/image  - A cached firmware image (?sha256=<digest> or ?project=<name>)
+*/
+
+#ifndef __VSCP_ALPHA_RESTAPI__
+#define __VSCP_ALPHA_RESTAPI__
+
+#include <esp_http_server.h>
+
+#define RESTAPI_URI_PREFIX "/api/v1/"
+
+/**
+ * @brief Handle a GET request for an API resource
+ *
+ * @param req Request. The URI must start with RESTAPI_URI_PREFIX
+ * @return ESP_OK on success, error code otherwise.
+ */
+esp_err_t
+restapi_get_handler(httpd_req_t *req);
+
+#endif
@@ -80,16 +80,17 @@ tcp_client(void *pvParameters)
   }
 
   // Send ready to receive notify
-  char buffer[LOG_MSG_ITEM_SIZE];
+  char buffer[LOG_BATCH_SIZE];
   xTaskNotifyGive(param.taskHandle);
 
   while (1) {
-    size_t received = xMessageBufferReceive(xMessageBufferTrans, buffer, sizeof(buffer), portMAX_DELAY);
+    // Lines are sent in one write
+    size_t received = net_logging_receive_batch(buffer, sizeof(buffer));
     // printf("xMessageBufferReceive received=%d\n", received);
     if (received > 0) {
       // printf("xMessageBufferReceive buffer=[%.*s]\n",received, buffer);
       int ret = send(sock, buffer, received, 0);
-      LWIP_ASSERT("ret == received", ret == received);
+      net_logging_batch_sent(ret == (int) received);
 
 #if 0
 			int len = recv(sock, rx_buffer, sizeof(rx_buffer) - 1, 0);
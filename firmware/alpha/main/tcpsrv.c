@@ -49,6 +49,7 @@
 #include "esp_system.h"
 #include "esp_wifi.h"
 #include <esp_timer.h>
+#include <esp_vfs_eventfd.h>
 
 #include <nvs_flash.h>
 
@@ -59,10 +60,12 @@
 
 #include <string.h>
 #include <sys/param.h>
+#include <unistd.h>
 
 #include "alpha.h"
 #include <vscp.h>
 
+#include "eventbus.h"
 #include "tcpsrv.h"
 
 #define KEEPALIVE_IDLE                                                                                                 \
@@ -95,6 +98,25 @@ static uint8_t cntClients = 0; // Holds current number of clients
 */
 static vscpctx_t g_ctx[CONFIG_APP_VSCP_LINK_MAX_TCP_CONNECTIONS]; // Socket context
 
+/*
+  Routing index. For every indexed class, type and priority there is a
+  set of clients whose filter accept that value. Routing an event is an
+  AND of three table lookups instead of running the full filter for
+  each client. Clients in s_routeGuid also need a GUID check.
+*/
+static tcpsrv_client_set_t s_routeClass[TCPSRV_ROUTE_CLASS_COUNT];
+static tcpsrv_client_set_t s_routeType[TCPSRV_ROUTE_TYPE_COUNT];
+static tcpsrv_client_set_t s_routePriority[8];
+static tcpsrv_client_set_t s_routeGuid;
+
+// Protect the routing index
+static SemaphoreHandle_t s_mutexRoute = NULL;
+
+// Event-to-socket latency histogram (log2 buckets in microseconds)
+static uint32_t s_latencyHist[TCPSRV_LATENCY_BUCKETS];
+static uint32_t s_latencyMax = 0;
+static portMUX_TYPE s_latencyMux = portMUX_INITIALIZER_UNLOCKED;
+
 ///////////////////////////////////////////////////////////////////////////////
 // tcpsrv_setContextDefaults
 //
@@ -107,6 +129,10 @@ tcpsrv_setContextDefaults(vscpctx_t *pctx)
   pctx->privLevel         = 0;
   pctx->bRcvLoop          = 0;
   pctx->size              = 0;
+  pctx->head              = 0;
+  pctx->scan              = 0;
+  pctx->outlen            = 0;
+  pctx->cntPending        = 0;
   pctx->last_rcvloop_time = esp_timer_get_time();
   memset(pctx->buf, 0, TCPIP_BUF_MAX_SIZE);
   memset(pctx->user, 0, VSCP_LINK_MAX_USER_NAME_LENGTH);
@@ -114,45 +140,520 @@ tcpsrv_setContextDefaults(vscpctx_t *pctx)
   memset(&pctx->filter, 0, sizeof(vscpEventFilter));
   memset(&pctx->statistics, 0, sizeof(VSCPStatistics));
   memset(&pctx->status, 0, sizeof(VSCPStatus));
+  tcpsrv_compileFilter(pctx);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// tcpsrv_sendEventExToAllClients
+// tcpsrv_compileFilter
 //
 
 int
-tcpsrv_sendEventExToAllClients(const vscpEvent *pev)
+tcpsrv_compileFilter(vscpctx_t *pctx)
 {
-  for (int i = 0; i < CONFIG_APP_VSCP_LINK_MAX_TCP_CONNECTIONS; i++) {
-    if (g_ctx[i].sock && (NULL != g_ctx[i].queueClient)) {
-      vscpEvent *pnew = vscp_fwhlp_mkEventCopy(pev);
-      if (NULL == pnew) {
-        vscp_fwhlp_deleteEvent(&pnew);
-        ESP_LOGE(TAG, "Unable to allocate memory for event for client %d", i);
-        return VSCP_ERROR_MEMORY;
+  int i;
+  tcpsrv_cfilter_t cfilter;
+  const vscpEventFilter *pfilter;
+
+  if (NULL == pctx) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  pfilter = &pctx->filter;
+  memset(&cfilter, 0, sizeof(tcpsrv_cfilter_t));
+
+  // GUID: find the prefix length and check if the mask is a pure prefix
+  cfilter.bGuidPrefix = 1;
+  for (i = 0; i < 16; i++) {
+    cfilter.guid[i] = pfilter->filter_GUID[i] & pfilter->mask_GUID[i];
+    if (pfilter->mask_GUID[i]) {
+      cfilter.bGuid = 1;
+      if ((0xff != pfilter->mask_GUID[i]) || (cfilter.guidPrefixLen != i)) {
+        cfilter.bGuidPrefix = 0;
       }
       else {
-        if (pdTRUE == xSemaphoreTake(g_ctx[i].mutexQueue, 10 / portTICK_PERIOD_MS)) {
-          if (pdTRUE != xQueueSend(g_ctx[i].queueClient, &(pev), 0)) {
-            xSemaphoreGive(g_ctx[i].mutexQueue);
-            vscp_fwhlp_deleteEvent(&pnew);
-            g_ctx[i].statistics.cntOverruns++;
-            ESP_LOGI(TAG, "Queue is full for client %d", i);
-            return VSCP_ERROR_TRM_FULL; // yes, receive queue, but transmit for sender
-          }
-          xSemaphoreGive(g_ctx[i].mutexQueue);
-        }
-        else {
-          ESP_LOGI(TAG, "Mutex timeout for client %d", i);
-          return VSCP_ERROR_TIMEOUT;
-        }
+        cfilter.guidPrefixLen = i + 1;
       }
     }
   }
 
+  tcpsrv_client_set_t bit = (tcpsrv_client_set_t) 1 << pctx->id;
+
+  // Index is updated as a whole so routing never sees half a filter
+  if ((NULL != s_mutexRoute) && (pdTRUE != xSemaphoreTake(s_mutexRoute, 100 / portTICK_PERIOD_MS))) {
+    ESP_LOGE(TAG, "Mutex timeout when compiling filter for client %d", pctx->id);
+    return VSCP_ERROR_TIMEOUT;
+  }
+
+  memcpy(&pctx->cfilter, &cfilter, sizeof(tcpsrv_cfilter_t));
+
+  for (i = 0; i < TCPSRV_ROUTE_CLASS_COUNT; i++) {
+    if ((pfilter->filter_class ^ i) & pfilter->mask_class) {
+      s_routeClass[i] &= ~bit;
+    }
+    else {
+      s_routeClass[i] |= bit;
+    }
+  }
+
+  for (i = 0; i < TCPSRV_ROUTE_TYPE_COUNT; i++) {
+    if ((pfilter->filter_type ^ i) & pfilter->mask_type) {
+      s_routeType[i] &= ~bit;
+    }
+    else {
+      s_routeType[i] |= bit;
+    }
+  }
+
+  for (i = 0; i < 8; i++) {
+    if ((pfilter->filter_priority ^ i) & pfilter->mask_priority) {
+      s_routePriority[i] &= ~bit;
+    }
+    else {
+      s_routePriority[i] |= bit;
+    }
+  }
+
+  if (cfilter.bGuid) {
+    s_routeGuid |= bit;
+  }
+  else {
+    s_routeGuid &= ~bit;
+  }
+
+  if (NULL != s_mutexRoute) {
+    xSemaphoreGive(s_mutexRoute);
+  }
+
   return VSCP_ERROR_SUCCESS;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// tcpsrv_matchGuid
+//
+
+static bool
+tcpsrv_matchGuid(const vscpctx_t *pctx, const vscpEvent *pev)
+{
+  if (!pctx->cfilter.bGuid) {
+    return true;
+  }
+
+  if (pctx->cfilter.bGuidPrefix) {
+    return (0 == memcmp(pev->GUID, pctx->cfilter.guid, pctx->cfilter.guidPrefixLen));
+  }
+
+  for (int i = 0; i < 16; i++) {
+    if ((pev->GUID[i] & pctx->filter.mask_GUID[i]) != pctx->cfilter.guid[i]) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// tcpsrv_isEventAccepted
+//
+
+bool
+tcpsrv_isEventAccepted(const vscpctx_t *pctx, const vscpEvent *pev)
+{
+  if ((NULL == pctx) || (NULL == pev)) {
+    return false;
+  }
+
+  const vscpEventFilter *pfilter = &pctx->filter;
+
+  if ((pfilter->filter_class ^ pev->vscp_class) & pfilter->mask_class) {
+    return false;
+  }
+
+  if ((pfilter->filter_type ^ pev->vscp_type) & pfilter->mask_type) {
+    return false;
+  }
+
+  if ((pfilter->filter_priority ^ ((pev->head >> 5) & 0x07)) & pfilter->mask_priority) {
+    return false;
+  }
+
+  return tcpsrv_matchGuid(pctx, pev);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// tcpsrv_routeEvent
+//
+
+tcpsrv_client_set_t
+tcpsrv_routeEvent(const vscpEvent *pev)
+{
+  tcpsrv_client_set_t set;
+  tcpsrv_client_set_t check;
+
+  if (NULL == pev) {
+    return 0;
+  }
+
+  if ((NULL == s_mutexRoute) || (pdTRUE != xSemaphoreTake(s_mutexRoute, 10 / portTICK_PERIOD_MS))) {
+    return 0;
+  }
+
+  set = s_routePriority[(pev->head >> 5) & 0x07];
+
+  if (pev->vscp_class < TCPSRV_ROUTE_CLASS_COUNT) {
+    set &= s_routeClass[pev->vscp_class];
+  }
+
+  if (pev->vscp_type < TCPSRV_ROUTE_TYPE_COUNT) {
+    set &= s_routeType[pev->vscp_type];
+  }
+
+  // Clients that need more than the index can tell
+  check = set & s_routeGuid;
+  if ((pev->vscp_class >= TCPSRV_ROUTE_CLASS_COUNT) || (pev->vscp_type >= TCPSRV_ROUTE_TYPE_COUNT)) {
+    check = set;
+  }
+
+  while (check) {
+    int i = __builtin_ctz(check);
+    check &= check - 1;
+    if (!tcpsrv_isEventAccepted(&g_ctx[i], pev)) {
+      set &= ~((tcpsrv_client_set_t) 1 << i);
+    }
+  }
+
+  xSemaphoreGive(s_mutexRoute);
+
+  return set;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// tcpsrv_sendEventExToAllClients
+//
+
+int
+tcpsrv_sendEventExToAllClients(const vscpEvent *pev)
+{
+  int rv = VSCP_ERROR_SUCCESS;
+  tcpsrv_client_set_t clients;
+
+  if (NULL == pev) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  // Only clients with a filter that accept the event
+  clients = tcpsrv_routeEvent(pev);
+
+  // Never echo an event back to the link client that sent it
+  if ((EVENTBUS_TRANSPORT_TCPSRV == EVENTBUS_OBID_TRANSPORT(pev->obid)) &&
+      (EVENTBUS_OBID_CHANNEL(pev->obid) < CONFIG_APP_VSCP_LINK_MAX_TCP_CONNECTIONS)) {
+    clients &= ~((tcpsrv_client_set_t) 1 << EVENTBUS_OBID_CHANNEL(pev->obid));
+  }
+
+  while (clients) {
+
+    int i = __builtin_ctz(clients);
+    clients &= clients - 1;
+
+    if (!g_ctx[i].sock || (NULL == g_ctx[i].queueClient)) {
+      continue;
+    }
+
+    tcpsrv_qitem_t item;
+    item.pev = vscp_fwhlp_mkEventCopy(pev);
+    if (NULL == item.pev) {
+      ESP_LOGE(TAG, "Unable to allocate memory for event for client %d", i);
+      return VSCP_ERROR_MEMORY;
+    }
+
+    if (pdTRUE == xSemaphoreTake(g_ctx[i].mutexQueue, 10 / portTICK_PERIOD_MS)) {
+      item.tsQueued = esp_timer_get_time();
+      if (pdTRUE != xQueueSend(g_ctx[i].queueClient, &item, 0)) {
+        xSemaphoreGive(g_ctx[i].mutexQueue);
+        vscp_fwhlp_deleteEvent(&item.pev);
+        g_ctx[i].statistics.cntOverruns++;
+        ESP_LOGI(TAG, "Queue is full for client %d", i);
+        rv = VSCP_ERROR_TRM_FULL; // yes, receive queue, but transmit for sender
+        continue;
+      }
+      xSemaphoreGive(g_ctx[i].mutexQueue);
+    }
+    else {
+      vscp_fwhlp_deleteEvent(&item.pev);
+      ESP_LOGI(TAG, "Mutex timeout for client %d", i);
+      rv = VSCP_ERROR_TIMEOUT;
+      continue;
+    }
+
+    // Wake client task if it is waiting in rcvloop
+    if (g_ctx[i].bRcvLoop && (g_ctx[i].wakefd >= 0)) {
+      uint64_t val = 1;
+      write(g_ctx[i].wakefd, &val, sizeof(val));
+    }
+  }
+
+  return rv;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// tcpsrv_addLatency
+//
+
+static void
+tcpsrv_addLatency(int64_t latency)
+{
+  int bucket = 0;
+
+  if (latency < 0) {
+    latency = 0;
+  }
+
+  while ((latency >> (bucket + 1)) && (bucket < (TCPSRV_LATENCY_BUCKETS - 1))) {
+    bucket++;
+  }
+
+  taskENTER_CRITICAL(&s_latencyMux);
+  s_latencyHist[bucket]++;
+  if (latency > s_latencyMax) {
+    s_latencyMax = (uint32_t) MIN(latency, UINT32_MAX);
+  }
+  taskEXIT_CRITICAL(&s_latencyMux);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// tcpsrv_getLatency
+//
+
+int
+tcpsrv_getLatency(tcpsrv_latency_t *platency)
+{
+  uint32_t hist[TCPSRV_LATENCY_BUCKETS];
+  uint32_t sum = 0;
+
+  if (NULL == platency) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  memset(platency, 0, sizeof(tcpsrv_latency_t));
+
+  taskENTER_CRITICAL(&s_latencyMux);
+  memcpy(hist, s_latencyHist, sizeof(hist));
+  platency->max = s_latencyMax;
+  taskEXIT_CRITICAL(&s_latencyMux);
+
+  for (int i = 0; i < TCPSRV_LATENCY_BUCKETS; i++) {
+    platency->cnt += hist[i];
+  }
+
+  // Report the upper bound of the bucket holding the percentile
+  for (int i = 0; i < TCPSRV_LATENCY_BUCKETS; i++) {
+    sum += hist[i];
+    if (!platency->p50 && hist[i] && ((uint64_t) sum * 100 >= (uint64_t) platency->cnt * 50)) {
+      platency->p50 = MIN((1UL << (i + 1)) - 1, platency->max);
+    }
+    if (!platency->p99 && hist[i] && ((uint64_t) sum * 100 >= (uint64_t) platency->cnt * 99)) {
+      platency->p99 = MIN((1UL << (i + 1)) - 1, platency->max);
+    }
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// tcpsrv_flush
+//
+
+int
+tcpsrv_flush(vscpctx_t *pctx)
+{
+  if (NULL == pctx) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if (!pctx->outlen) {
+    return VSCP_ERROR_SUCCESS;
+  }
+
+  size_t len   = pctx->outlen;
+  pctx->outlen = 0;
+
+  if (!pctx->sock || (send(pctx->sock, pctx->outbuf, len, 0) < 0)) {
+    ESP_LOGE(TAG, "Failed to send to client %d errno=%d", pctx->id, errno);
+    pctx->cntPending = 0;
+    return VSCP_ERROR_ERROR;
+  }
+
+  // Events waiting in the buffer is now on their way
+  int64_t now = esp_timer_get_time();
+  for (int i = 0; i < pctx->cntPending; i++) {
+    tcpsrv_addLatency(now - pctx->tsPending[i]);
+  }
+  pctx->cntPending = 0;
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// tcpsrv_write
+//
+
+int
+tcpsrv_write(vscpctx_t *pctx, const void *pbuf, size_t len)
+{
+  int rv;
+
+  if ((NULL == pctx) || (NULL == pbuf)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if ((pctx->outlen + len) > TCPSRV_OUTBUF_SIZE) {
+    if (VSCP_ERROR_SUCCESS != (rv = tcpsrv_flush(pctx))) {
+      return rv;
+    }
+  }
+
+  // Too large for the buffer, send it as it is
+  if (len > TCPSRV_OUTBUF_SIZE) {
+    if (send(pctx->sock, pbuf, len, 0) < 0) {
+      ESP_LOGE(TAG, "Failed to send to client %d errno=%d", pctx->id, errno);
+      return VSCP_ERROR_ERROR;
+    }
+    return VSCP_ERROR_SUCCESS;
+  }
+
+  if (!pctx->outlen) {
+    pctx->outTime = esp_timer_get_time();
+  }
+
+  memcpy(pctx->outbuf + pctx->outlen, pbuf, len);
+  pctx->outlen += len;
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// tcpsrv_rcvloopWorker
+//
+// Move all events waiting in the client queue to the output buffer. The
+// buffer is flushed when it is full. Also emit '+OK' once a second when
+// there is nothing to send to tell the client we are still alive.
+//
+
+static void
+tcpsrv_rcvloopWorker(vscpctx_t *pctx)
+{
+  tcpsrv_qitem_t item;
+
+  if (!pctx->bRcvLoop || !pctx->sock) {
+    return;
+  }
+
+  while (1) {
+
+    bool bGot = false;
+    if (pdTRUE == xSemaphoreTake(pctx->mutexQueue, 10 / portTICK_PERIOD_MS)) {
+      bGot = (pdTRUE == xQueuePeek(pctx->queueClient, &item, 0));
+      xSemaphoreGive(pctx->mutexQueue);
+    }
+
+    if (!bGot) {
+      break;
+    }
+
+    // Make room for the event if needed
+    if ((pctx->cntPending >= TCPSRV_RCVLOOP_BATCH_MAX) ||
+        ((pctx->outlen + 110 + item.pev->sizeData * 5) > TCPSRV_OUTBUF_SIZE)) {
+      if (VSCP_ERROR_SUCCESS != tcpsrv_flush(pctx)) {
+        return;
+      }
+    }
+
+    if (pdTRUE == xSemaphoreTake(pctx->mutexQueue, 10 / portTICK_PERIOD_MS)) {
+      bGot = (pdTRUE == xQueueReceive(pctx->queueClient, &item, 0));
+      xSemaphoreGive(pctx->mutexQueue);
+    }
+    else {
+      break;
+    }
+
+    if (!bGot) {
+      break;
+    }
+
+    char *p = pctx->outbuf + pctx->outlen;
+    if (VSCP_ERROR_SUCCESS == vscp_fwhlp_eventToString(p, TCPSRV_OUTBUF_SIZE - pctx->outlen - 2, item.pev)) {
+      if (!pctx->outlen) {
+        pctx->outTime = esp_timer_get_time();
+      }
+      pctx->outlen += strlen(p);
+      pctx->outbuf[pctx->outlen++]        = '\r';
+      pctx->outbuf[pctx->outlen++]        = '\n';
+      pctx->tsPending[pctx->cntPending++] = item.tsQueued;
+
+      // Update receive statistics
+      pctx->statistics.cntReceiveFrames++;
+      pctx->statistics.cntReceiveData += item.pev->sizeData;
+
+      pctx->last_rcvloop_time = esp_timer_get_time();
+    }
+    vscp_fwhlp_deleteEvent(&item.pev);
+  }
+
+  // Every second output '+OK\r\n' in rcvloop mode
+  if ((esp_timer_get_time() - pctx->last_rcvloop_time) > 1000000l) {
+    pctx->last_rcvloop_time = esp_timer_get_time();
+    tcpsrv_write(pctx, VSCP_LINK_MSG_OK, strlen(VSCP_LINK_MSG_OK));
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// tcpsrv_parseLines
+//
+// Parse all complete command lines in the client buffer. Lines are parsed
+// where they are in the buffer. Received data is never moved except for
+// an incomplete last line when the end of the buffer is reached.
+//
+
+static void
+tcpsrv_parseLines(vscpctx_t *pctx)
+{
+  while (pctx->scan < pctx->size) {
+
+    char *peol = memchr(pctx->buf + pctx->scan, '\n', pctx->size - pctx->scan);
+    if (NULL == peol) {
+      // No line end yet, continue from here when more data arrives
+      pctx->scan = pctx->size;
+      break;
+    }
+
+    // Terminate the line temporarily after the line end. There is always
+    // room for this as the last byte of the buffer is never received into.
+    size_t eol     = (peol - pctx->buf) + 1;
+    char save      = pctx->buf[eol];
+    pctx->buf[eol] = '\0';
+
+    char *pnext = NULL;
+    if (VSCP_ERROR_SUCCESS != vscp_link_parser(pctx, pctx->buf + pctx->head, &pnext)) {
+      ESP_LOGW(TAG, "Failed to parse command line from client %d", pctx->id);
+    }
+
+    // If socket gets closed ("quit" command) context is reset
+    if (!pctx->sock) {
+      return;
+    }
+
+    pctx->buf[eol] = save;
+    pctx->head     = eol;
+    pctx->scan     = eol;
+  }
+
+  // Everything parsed, start over from the beginning of the buffer
+  if (pctx->head >= pctx->size) {
+    pctx->head = 0;
+    pctx->scan = 0;
+    pctx->size = 0;
+  }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // do_retransmit
 //
@@ -198,9 +699,8 @@ client_task(void *pvParameters)
 {
   int rv;
   size_t len;
-  fd_set readset;  // Socket read set
-  fd_set writeset; // Socket write set
-  fd_set errset;   // Socket error set
+  fd_set readset; // Socket read set
+  fd_set errset;  // Socket error set
   struct timeval tv;
   vscpctx_t *pctx = (vscpctx_t *) pvParameters;
 
@@ -212,6 +712,7 @@ client_task(void *pvParameters)
   // Greet client
   // send(pctx->sock, TCPSRV_WELCOME_MSG, sizeof(TCPSRV_WELCOME_MSG), 0);
   vscp_link_callback_welcome(pctx);
+  tcpsrv_flush(pctx);
 
   // Another client
   cntClients++;
@@ -219,27 +720,68 @@ client_task(void *pvParameters)
   do {
     FD_ZERO(&readset);
     FD_SET(pctx->sock, &readset);
-    FD_ZERO(&writeset);
-    FD_SET(pctx->sock, &writeset);
+    if (pctx->wakefd >= 0) {
+      FD_SET(pctx->wakefd, &readset);
+    }
     FD_ZERO(&errset);
     FD_SET(pctx->sock, &errset);
+
+    // Timeout is only needed for the rcvloop '+OK' keep alive and
+    // to flush the output buffer. New events wake us up through the
+    // wakefd.
     tv.tv_sec  = 1;
     tv.tv_usec = 0;
-    int ret    = select(pctx->sock + 1, &readset, &writeset, &errset, &tv);
-    if (FD_ISSET(pctx->sock, &writeset)) {
+    if (pctx->outlen) {
+      int64_t wait = (pctx->outTime + CONFIG_APP_VSCP_LINK_FLUSH_DELAY * 1000) - esp_timer_get_time();
+      tv.tv_sec    = 0;
+      tv.tv_usec   = MAX(wait, 0);
+    }
+    int ret    = select(MAX(pctx->sock, pctx->wakefd) + 1, &readset, NULL, &errset, &tv);
+    if (ret < 0) {
+      ESP_LOGE(TAG, "Error occurred during select: errno=%d", errno);
+      close(pctx->sock);
+      pctx->sock = 0;
+      break;
+    }
+
+    if (FD_ISSET(pctx->sock, &errset)) {
+      ESP_LOGE(TAG, "Socket error for client %d", pctx->id);
+      close(pctx->sock);
+      pctx->sock = 0;
+      break;
+    }
+
+    // Clear wakeup
+    if ((pctx->wakefd >= 0) && FD_ISSET(pctx->wakefd, &readset)) {
+      uint64_t val;
+      read(pctx->wakefd, &val, sizeof(val));
+    }
+
+    if (FD_ISSET(pctx->sock, &readset)) {
+
+      // Make room at the end of the buffer. Only an incomplete command
+      // line can be left here.
+      if (pctx->size >= (sizeof(pctx->buf) - 1)) {
+        if (pctx->head) {
+          memmove(pctx->buf, pctx->buf + pctx->head, pctx->size - pctx->head);
+          pctx->size -= pctx->head;
+          pctx->scan -= pctx->head;
+          pctx->head = 0;
+        }
+        else {
+          ESP_LOGW(TAG, "Full buffer without crlf for client %d. Discarded.", pctx->id);
+          pctx->head = 0;
+          pctx->scan = 0;
+          pctx->size = 0;
+        }
+      }
 
       len = (rv = recv(pctx->sock, pctx->buf + pctx->size, (sizeof(pctx->buf) - pctx->size) - 1, 0 /*MSG_DONTWAIT*/));
       if ((rv < 0)) {
-        // If nothing to read do idle work
         if (errno == EAGAIN) {
-          // Handle rcvloop etc
-          vscp_link_idle_worker(pctx);
-          // vTaskDelay(1 / portTICK_PERIOD_MS);
           continue;
         }
         ESP_LOGE(TAG, "Error occurred during receiving: rv=%d, errno=%d", rv, errno);
-        memset(pctx->buf, 0, sizeof(pctx->buf));
-        pctx->size = 0;
         close(pctx->sock);
         pctx->sock = 0;
         break;
@@ -253,29 +795,9 @@ client_task(void *pvParameters)
       else {
 
         pctx->size += len;
-        pctx->buf[pctx->size + 1] = 0;
-
-        // Parse VSCP command
-        char *pnext = NULL;
-        if (VSCP_ERROR_SUCCESS == vscp_link_parser(pctx, pctx->buf, &pnext)) {
-
-          if ((NULL != pnext) && *pnext) {
-            // printf("Copy [%s]\n", pnext);
-            strncpy(pctx->buf, pnext, sizeof(pctx->buf));
-            pctx->size = strlen(pctx->buf);
-          }
-          else {
-            memset(pctx->buf, 0, sizeof(pctx->buf));
-            pctx->size = 0;
-          }
-        }
-        else if (1 <= (sizeof(pctx->buf) - pctx->size)) {
-          // printf("Full buffer without crlf\n");
-          *pctx->buf = 0;
-          pctx->size = 0;
-        }
 
-        // printf("post len %d\n", pctx->size);
+        // Parse all complete VSCP commands
+        tcpsrv_parseLines(pctx);
 
         // If socket gets closed ("quit" command)
         // pctx->sock is zero
@@ -283,44 +805,30 @@ client_task(void *pvParameters)
           break;
         }
 
-        // Get event from out fifo to feed to
-        // protocol handler etc
-        // vscpEvent *pev = NULL;
-        // if (pdTRUE == xSemaphoreTake(pctx->mutexQueue, (TickType_t) 10/ portTICK_PERIOD_MS)) {
-        //   if (pdTRUE != xQueueReceive(pctx->queueClient, &pev, 0)) {
-        //     pev = NULL;
-        //   }
-        //   xSemaphoreGive(pctx->mutexQueue);
-        // }
-        // else {
-        //   ESP_LOGW(TAG, "Unable to get mutex for client queue for client %d", pctx->id);
-        // }
-
-        // pev is NULL if no event is available here
-        // The worker is still called.
-        // if pev != NULL the worker is responsible for
-        // freeing the event
-
-        // Do protocol work here
-        // if (NULL != pev) {
-        //  vscp2_do_work(pev);
-        //}
-
-        // Handle rcvloop etc
-        vscp_link_idle_worker(pctx);
-        // vTaskDelay(1 / portTICK_PERIOD_MS);
+        // End of command batch, send all responses
+        tcpsrv_flush(pctx);
       }
     }
+
+    // Deliver everything that is queued for the client in rcvloop mode
+    tcpsrv_rcvloopWorker(pctx);
+
+    // Send rcvloop events when the flush delay has expired
+    if (pctx->outlen &&
+        ((esp_timer_get_time() - pctx->outTime) >= (CONFIG_APP_VSCP_LINK_FLUSH_DELAY * 1000))) {
+      tcpsrv_flush(pctx);
+    }
+
   } while (pctx->sock);
 
   // Mark transport channel as closed
   // g_tr_tcpsrv[pctx->id].open = false;
 
-  vscpEvent *pev;
+  tcpsrv_qitem_t item;
   if (pdTRUE == xSemaphoreTake(pctx->mutexQueue, 5000 / portTICK_PERIOD_MS)) {
 
-    while (pdTRUE == xQueueReceive(pctx->queueClient, &(pev), 0)) {
-      vscp_fwhlp_deleteEvent(&pev);
+    while (pdTRUE == xQueueReceive(pctx->queueClient, &item, 0)) {
+      vscp_fwhlp_deleteEvent(&item.pev);
     }
     xSemaphoreGive(pctx->mutexQueue);
   }
@@ -346,6 +854,18 @@ client_task(void *pvParameters)
   vTaskDelete(NULL);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// tcpsrv_eventbus_cb
+//
+// Events from the event bus. Called in the context of the publisher.
+//
+
+static int
+tcpsrv_eventbus_cb(const vscpEvent *pev, void *userdata)
+{
+  return tcpsrv_sendEventExToAllClients(pev);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // tcpsrv_task
 //
@@ -360,11 +880,26 @@ tcpsrv_task(void *pvParameters)
   int keepIdle     = KEEPALIVE_IDLE;
   int keepInterval = KEEPALIVE_INTERVAL;
   int keepCount    = KEEPALIVE_COUNT;
+#ifdef CONFIG_APP_VSCP_LINK_TCP_NODELAY
+  int noDelay = 1;
+#endif
   struct sockaddr_storage dest_addr;
-  vscpEvent *pev;
 
   ESP_LOGI(TAG, "VSCP tcp/ip Link server started.");
 
+  // eventfd's are used to wake up client tasks when events are queued
+  esp_vfs_eventfd_config_t eventfdConfig = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+  eventfdConfig.max_fds                  = CONFIG_APP_VSCP_LINK_MAX_TCP_CONNECTIONS;
+  esp_err_t ret                          = esp_vfs_eventfd_register(&eventfdConfig);
+  if ((ESP_OK != ret) && (ESP_ERR_INVALID_STATE != ret)) {
+    ESP_LOGE(TAG, "Failed to register eventfd. rv=%d", ret);
+  }
+
+  s_mutexRoute = xSemaphoreCreateMutex();
+  if (NULL == s_mutexRoute) {
+    ESP_LOGE(TAG, "Failed to create mutex for routing index");
+  }
+
   for (int i = 0; i < CONFIG_APP_VSCP_LINK_MAX_TCP_CONNECTIONS; i++) {
     // g_tr_tcpsrv[i].msg_queue = xQueueCreate(10, VSCP_ESPNOW_MAX_FRAME); // tcp/ip link channel i
     g_ctx[i].id         = i;
@@ -373,13 +908,27 @@ tcpsrv_task(void *pvParameters)
     if (NULL == g_ctx[i].mutexQueue) {
       ESP_LOGE(TAG, "Failed to create mutex for client queue for client %d", i);
     }
-    g_ctx[i].queueClient = xQueueCreate(CLIENT_QUEUE_SIZE, sizeof(pev));
+    g_ctx[i].queueClient = xQueueCreate(CLIENT_QUEUE_SIZE, sizeof(tcpsrv_qitem_t));
     if (NULL == g_ctx[i].queueClient) {
       ESP_LOGE(TAG, "Failed to create client queue for client %d", i);
     }
+    g_ctx[i].wakefd = eventfd(0, 0);
+    if (g_ctx[i].wakefd < 0) {
+      ESP_LOGE(TAG, "Failed to create wakeup eventfd for client %d", i);
+    }
     tcpsrv_setContextDefaults(&g_ctx[i]);
   }
 
+  /*
+    Link clients get events from all other transports and from other link
+    clients. Queuing to a client never block so events are delivered
+    directly from the publisher.
+  */
+  if (VSCP_ERROR_SUCCESS !=
+      eventbus_subscribe("tcpsrv", EVENTBUS_TRANSPORT_TCPSRV, EVENTBUS_FLAG_ECHO, 0, tcpsrv_eventbus_cb, NULL, NULL)) {
+    ESP_LOGE(TAG, "Failed to subscribe to event bus");
+  }
+
   if (addr_family == AF_INET) {
     struct sockaddr_in *dest_addr_ip4 = (struct sockaddr_in *) &dest_addr;
     dest_addr_ip4->sin_addr.s_addr    = htonl(INADDR_ANY);
@@ -441,6 +990,11 @@ tcpsrv_task(void *pvParameters)
     setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &keepInterval, sizeof(int));
     setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &keepCount, sizeof(int));
 
+#ifdef CONFIG_APP_VSCP_LINK_TCP_NODELAY
+    // Output is coalesced in the client output buffer so Nagle is not needed
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(int));
+#endif
+
     // Convert ip address to string
     if (source_addr.ss_family == PF_INET) {
       inet_ntoa_r(((struct sockaddr_in *) &source_addr)->sin_addr, addr_str, sizeof(addr_str) - 1);
@@ -61,25 +61,113 @@
  */
 #define CLIENT_QUEUE_SIZE 4
 
+/**
+ * Max number of rcvloop events that can wait in the output
+ * buffer of a client before it is flushed.
+ */
+#define TCPSRV_RCVLOOP_BATCH_MAX 16
+
+/**
+ * Size of the per client output buffer. Responses and rcvloop
+ * events are collected here and sent with one send() when the
+ * buffer is full, a batch of commands/events is done or the
+ * flush delay has expired. Should be able to hold at least one
+ * event in string form.
+ */
+#define TCPSRV_OUTBUF_SIZE (2 * 1460)
+
+/**
+ * Number of log2 buckets for the event-to-socket latency histogram.
+ * Bucket n holds latencies in the range 2^n - 2^(n+1)-1 microseconds.
+ */
+#define TCPSRV_LATENCY_BUCKETS 24
+
+/**
+ * Number of VSCP classes covered by the routing index. Events with
+ * a class at or above this value (Level II) are matched against the
+ * raw class filter/mask instead.
+ */
+#define TCPSRV_ROUTE_CLASS_COUNT 512
+
+/**
+ * Number of VSCP types covered by the routing index. Events with
+ * a type at or above this value are matched against the raw type
+ * filter/mask instead.
+ */
+#define TCPSRV_ROUTE_TYPE_COUNT 256
+
+/*
+  One bit per client in the routing index. Bit n is client
+  context n (g_ctx[n]).
+*/
+typedef uint32_t tcpsrv_client_set_t;
+
+#if (CONFIG_APP_VSCP_LINK_MAX_TCP_CONNECTIONS > 32)
+#error "The routing index supports at most 32 VSCP link tcp/ip connections"
+#endif
+
+/*
+  Compiled receive filter for a client. The class, type and priority
+  part of the filter lives in the routing index (one client bit per
+  class/type/priority). The GUID part is kept here as a prefix match
+  when the GUID mask is a run of 0xff bytes followed by zeros which
+  is the normal case. Any other GUID mask falls back to a full
+  masked compare.
+*/
+typedef struct _tcpsrv_cfilter {
+  uint8_t bGuid;         // Non zero if GUID must be checked
+  uint8_t bGuidPrefix;   // GUID mask is a prefix mask
+  uint8_t guidPrefixLen; // Number of GUID bytes that must match (prefix mask)
+  uint8_t guid[16];      // Filter GUID with mask applied
+} tcpsrv_cfilter_t;
+
+/*
+  Item in a client queue. The time the event was queued is kept
+  so that the event-to-socket latency can be measured.
+*/
+typedef struct _tcpsrv_qitem {
+  vscpEvent *pev;   // Event, owned by the queue
+  int64_t tsQueued; // Time (esp_timer) when event was queued
+} tcpsrv_qitem_t;
+
+/*
+  Event-to-socket latency for events delivered in rcvloop mode
+*/
+typedef struct _tcpsrv_latency {
+  uint32_t cnt; // Number of events measured
+  uint32_t p50; // Median latency in microseconds
+  uint32_t p99; // 99th percentile latency in microseconds
+  uint32_t max; // Max latency in microseconds
+} tcpsrv_latency_t;
+
 /*
   Socket context
   This is the context for each open socket/channel.
 */
 typedef struct _vscpctx {
   int id;
-  int sock;                                  // Socket
-  size_t size;                               // Number of characters in buffer
-  char buf[TCPIP_BUF_MAX_SIZE];              // Command Buffer
-  char user[VSCP_LINK_MAX_USER_NAME_LENGTH]; // Username storage
-  SemaphoreHandle_t mutexQueue;              // Protect the queue
-  QueueHandle_t queueClient;                 // VSCP events to VSCP link client
-  int bValidated;                            // User is validated
-  uint8_t privLevel;                         // User privilege level 0-15
-  int bRcvLoop;                              // Receive loop is enabled if non zero
-  vscpEventFilter filter;                    // Filter for events
-  VSCPStatistics statistics;                 // VSCP Statistics
-  VSCPStatus status;                         // VSCP status
-  uint32_t last_rcvloop_time;                // Time of last received event
+  int sock;                                    // Socket
+  int wakefd;                                  // eventfd used to wake client task on new events
+  size_t size;                                 // End of received data in buffer
+  size_t head;                                 // Start of first unparsed command in buffer
+  size_t scan;                                 // Position where search for next line end continues
+  char buf[TCPIP_BUF_MAX_SIZE];                // Command Buffer
+  char user[VSCP_LINK_MAX_USER_NAME_LENGTH];   // Username storage
+  size_t outlen;                               // Number of characters in output buffer
+  int64_t outTime;                             // Time when first character was put in output buffer
+  int cntPending;                              // Number of rcvloop events in output buffer
+  int64_t tsPending[TCPSRV_RCVLOOP_BATCH_MAX]; // Queue time for rcvloop events in output buffer
+  char outbuf[TCPSRV_OUTBUF_SIZE];             // Output buffer
+  SemaphoreHandle_t mutexQueue;                // Protect the queue
+  QueueHandle_t queueClient;                   // VSCP events to VSCP link client (tcpsrv_qitem_t)
+  int bValidated;                              // User is validated
+  uint8_t privLevel;                           // User privilege level 0-15
+  int bRcvLoop;                                // Receive loop is enabled if non zero
+  vscpEventFilter filter;                      // Filter for events
+  tcpsrv_cfilter_t cfilter;                    // Compiled version of filter
+  VSCPStatistics statistics;                   // VSCP Statistics
+  VSCPStatus status;                           // VSCP status
+  int64_t last_rcvloop_time;                   // Time of last received event
 } vscpctx_t;
 
 #define MSG_MAX_CLIENTS "Max number of clients reached. Disconnecting.\r\n"
@@ -92,15 +180,78 @@ typedef struct _vscpctx {
 void
 tcpsrv_setContextDefaults(vscpctx_t *pctx);
 
+/**
+ * @brief Write data to a client
+ *
+ * Data is collected in the output buffer of the client and is sent
+ * when the buffer is full or on the next flush.
+ *
+ * @param pctx Pointer to context
+ * @param pbuf Pointer to data to write
+ * @param len Number of bytes to write
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+tcpsrv_write(vscpctx_t *pctx, const void *pbuf, size_t len);
+
+/**
+ * @brief Send everything in the output buffer of a client
+ *
+ * @param pctx Pointer to context
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+tcpsrv_flush(vscpctx_t *pctx);
+
+/**
+ * @brief Compile the filter of a client and update the routing index
+ *
+ * Must be called each time the filter or mask of a client is changed.
+ *
+ * @param pctx Pointer to context
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+tcpsrv_compileFilter(vscpctx_t *pctx);
+
+/**
+ * @brief Check if an event is accepted by the compiled filter of a client
+ *
+ * @param pctx Pointer to context
+ * @param pev Pointer to event to check
+ * @return True if the event is accepted by the client filter.
+ */
+bool
+tcpsrv_isEventAccepted(const vscpctx_t *pctx, const vscpEvent *pev);
+
+/**
+ * @brief Get the set of clients whose filter accepts an event
+ *
+ * @param pev Pointer to event to route
+ * @return Client set, one bit per client context. Zero if no client
+ *        is interested in the event.
+ */
+tcpsrv_client_set_t
+tcpsrv_routeEvent(const vscpEvent *pev);
+
 /**
  * @fn tcpsrv_sendEventExToAllClients
- * @brief Send event ex to all active clients
+ * @brief Send event to all active clients that has a filter that accept it
  * @param pev Pointer to event to send
  * @return VSCP_EVENT_SUCCESS if all web OK. Error code otherwise.
  */
 int
 tcpsrv_sendEventExToAllClients(const vscpEvent *pev);
 
+/**
+ * @brief Get event-to-socket latency for rcvloop delivery
+ *
+ * @param platency Pointer to structure that will get latency figures
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+tcpsrv_getLatency(tcpsrv_latency_t *platency);
+
 /*!
   VSCP tcp/ip link protocol task
   @param pvParameters Task parameters
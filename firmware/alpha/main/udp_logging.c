@@ -67,11 +67,12 @@ udp_client(void *pvParameters)
   LWIP_ASSERT("fd >= 0", fd >= 0);
 
   // Send ready to receive notify
-  char buffer[LOG_MSG_ITEM_SIZE];
+  char buffer[LOG_BATCH_SIZE];
   xTaskNotifyGive(param.taskHandle);
 
   while (1) {
-    size_t received = xMessageBufferReceive(xMessageBufferTrans, buffer, sizeof(buffer), portMAX_DELAY);
+    // Lines are sent in one datagram
+    size_t received = net_logging_receive_batch(buffer, sizeof(buffer));
     // printf("xMessageBufferReceive received=%d\n", received);
     if (received > 0) {
       // printf("xMessageBufferReceive buffer=[%.*s]\n",received, buffer);
@@ -114,7 +115,7 @@ udp_client(void *pvParameters)
       */
 
       ret = lwip_sendto(fd, buffer, received, 0, (struct sockaddr *) &addr, sizeof(addr));
-      //LWIP_ASSERT("ret == received", ret == received);
+      net_logging_batch_sent(ret == (int) received);
     }
     else {
       printf("xMessageBufferReceive fail\n");
@@ -0,0 +1,255 @@
+/*
+  File: vscp_logging.c
+
+  VSCP alpha node log sink that send log lines as VSCP log events
+
+  This file is part of the VSCP (https://www.vscp.org)
+
+  The MIT License (MIT)
+  Copyright © 2022-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <string.h>
+#include <sys/param.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/message_buffer.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <vscp.h>
+#include <vscp-firmware-helper.h>
+#include <vscp-espnow.h>
+
+#include "alpha.h"
+#include "eventbus.h"
+#include "net_logging.h"
+
+// External globals
+extern node_persistent_config_t g_persistent;
+extern MessageBufferHandle_t xMessageBufferTrans;
+
+static const char *TAG = "vscp_log";
+
+// Tags of code on the path from the event bus to the transports. A line
+// logged there while a log event is sent would become a new log event and
+// could keep the sink busy at the full rate of the token bucket.
+static const char *s_skipTags[] = {
+  "eventbus", "vscpnow", "espnow", "MQTT", "mqtt_client", "tcpsrv", "ws_sendFrame", NULL,
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_log_parse
+//
+// Find level and text of a formatted esp_log line
+//
+//     "\033[0;32mI (1234) tag: text\033[0m\n"
+//
+// Colors, level letter, time and line end are removed. The time is not
+// needed as the event has its own timestamp. Returns length of text.
+//
+
+static size_t
+vscp_log_parse(char *line, size_t len, uint8_t *plevel, char **ptext)
+{
+  char *p   = line;
+  char *end = line + len;
+
+  // Color
+  if ((p < end) && ('\033' == *p)) {
+    while ((p < end) && ('m' != *p)) {
+      p++;
+    }
+    if (p < end) {
+      p++;
+    }
+  }
+
+  *plevel = ESP_LOG_INFO;
+  if (((end - p) > 2) && (' ' == p[1]) && ('(' == p[2])) {
+    switch (p[0]) {
+      case 'E':
+        *plevel = ESP_LOG_ERROR;
+        break;
+      case 'W':
+        *plevel = ESP_LOG_WARN;
+        break;
+      case 'D':
+        *plevel = ESP_LOG_DEBUG;
+        break;
+      case 'V':
+        *plevel = ESP_LOG_VERBOSE;
+        break;
+    }
+
+    // Time
+    char *q = memchr(p, ')', end - p);
+    if (NULL != q) {
+      p = q + 1;
+      if ((p < end) && (' ' == *p)) {
+        p++;
+      }
+    }
+  }
+
+  // Line end and color reset
+  while ((end > p) && (('\n' == end[-1]) || ('\r' == end[-1]))) {
+    end--;
+  }
+  if (((end - p) >= 4) && (0 == memcmp(end - 4, "\033[0m", 4))) {
+    end -= 4;
+  }
+
+  *ptext = p;
+  return end - p;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_log_is_skipped
+//
+// Check if the text ("tag: message") of a line is from one of the tags on
+// the publish path
+//
+
+static bool
+vscp_log_is_skipped(const char *text, size_t len)
+{
+  for (int i = 0; NULL != s_skipTags[i]; i++) {
+    size_t n = strlen(s_skipTags[i]);
+    if ((len > n) && (':' == text[n]) && (0 == memcmp(text, s_skipTags[i], n))) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_log_client
+//
+// Log lines are sent as CLASS1.LOG, Type=1 (log message) on the event bus.
+// The bus forwards them to the esp-now cluster, VSCP link clients, MQTT and
+// websocket clients. Level I events carry at most eight bytes so a line is
+// split over several indexed frames
+//
+//   byte 0    - Log id (always zero)
+//   byte 1    - Level (esp_log_level_t: 1=error ... 5=verbose)
+//   byte 2    - Frame index, zero for the first frame of a line
+//   byte 3..7 - Up to five bytes of text ("tag: message"), not zero terminated
+//
+// A frame with less than five bytes of text ends the line. A line that is a
+// multiple of five bytes long ends with a frame without text.
+//
+// Lines with a level above the configured log level, or from code on the
+// publish path (s_skipTags), are not sent. A token bucket keep the average
+// rate below CONFIG_APP_LOG_VSCP_RATE events per second. Lines that need
+// more frames than there are tokens are dropped as a whole. Every sent line
+// counts as a batch in the log statistics.
+//
+
+void
+vscp_log_client(void *pvParameters)
+{
+  PARAMETER_t *task_parameter = pvParameters;
+  char line[LOG_MSG_ITEM_SIZE];
+  int64_t tsLast = esp_timer_get_time();
+  int64_t tokens = (int64_t) LOG_VSCP_BUCKET * 1000000; // Events * us
+
+  // Send ready to receive notify
+  xTaskNotifyGive(task_parameter->taskHandle);
+
+  while (1) {
+
+    size_t len = xMessageBufferReceive(xMessageBufferTrans, line, sizeof(line), portMAX_DELAY);
+    if (!len) {
+      continue;
+    }
+
+    uint8_t level;
+    char *text;
+    size_t size = vscp_log_parse(line, len, &level, &text);
+    if (!size || (level > g_persistent.logLevel) || vscp_log_is_skipped(text, size)) {
+      continue;
+    }
+
+    if (size > LOG_VSCP_MAX_TEXT) {
+      size = LOG_VSCP_MAX_TEXT;
+    }
+
+    int nFrames = size / LOG_VSCP_FRAME_TEXT + 1;
+
+    // Refill bucket with one event per 1/rate seconds
+    int64_t now = esp_timer_get_time();
+    tokens += (now - tsLast) * LOG_VSCP_RATE;
+    tsLast = now;
+    if (tokens > (int64_t) LOG_VSCP_BUCKET * 1000000) {
+      tokens = (int64_t) LOG_VSCP_BUCKET * 1000000;
+    }
+
+    if (tokens < (int64_t) nFrames * 1000000) {
+      net_logging_batch_sent(false);
+      continue;
+    }
+    tokens -= (int64_t) nFrames * 1000000;
+
+    vscpEvent *pev = vscp_fwhlp_newEvent();
+    if (NULL == pev) {
+      net_logging_batch_sent(false);
+      continue;
+    }
+
+    pev->pdata = ESP_MALLOC(3 + LOG_VSCP_FRAME_TEXT);
+    if (NULL == pev->pdata) {
+      vscp_fwhlp_deleteEvent(&pev);
+      net_logging_batch_sent(false);
+      continue;
+    }
+
+    vscp_espnow_get_node_guid(pev->GUID);
+    pev->head       = VSCP_PRIORITY_LOW;
+    pev->vscp_class = VSCP_CLASS1_LOG;
+    pev->vscp_type  = VSCP_TYPE_LOG_MESSAGE;
+    pev->timestamp  = now;
+    pev->pdata[0]   = 0;     // Log id
+    pev->pdata[1]   = level; // Level
+
+    // Subscribers that are full drop the event but it still reached the others
+    bool bSent = true;
+    for (int idx = 0; idx < nFrames; idx++) {
+      size_t n = MIN(size - idx * LOG_VSCP_FRAME_TEXT, LOG_VSCP_FRAME_TEXT);
+      pev->sizeData = 3 + n;
+      pev->pdata[2] = idx; // Frame index
+      memcpy(pev->pdata + 3, text + idx * LOG_VSCP_FRAME_TEXT, n);
+
+      int rv = eventbus_publish(pev, EVENTBUS_OBID(EVENTBUS_TRANSPORT_INTERNAL, 0));
+      if ((VSCP_ERROR_SUCCESS != rv) && (VSCP_ERROR_TRM_FULL != rv)) {
+        bSent = false;
+        break;
+      }
+    }
+    net_logging_batch_sent(bSent);
+
+    vscp_fwhlp_deleteEvent(&pev);
+  }
+
+  vTaskDelete(NULL);
+}
@@ -0,0 +1,721 @@
+/*
+  File: webcfg.c
+
+  VSCP alpha node schema driven configuration pages
+
+  This file is part of the VSCP (https://www.vscp.org)
+
+  The MIT License (MIT)
+  Copyright © 2022-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <esp_app_desc.h>
+#include <esp_log.h>
+#include <esp_http_server.h>
+
+#include <espnow.h>
+#include <espnow_security.h>
+
+#include <vscp.h>
+#include <vscp-firmware-helper.h>
+
+#include "alpha.h"
+#include "cfgstore.h"
+#include "mqtt.h"
+#include "websrv.h"
+#include "webcfg.h"
+
+static const char *TAG = "webcfg";
+
+extern node_persistent_config_t g_persistent;
+
+// Size of buffer used to render one field
+#define WEBCFG_BUF_SIZE 1024
+
+static esp_err_t
+webcfg_setEspnowKey(const char *value);
+
+static void
+webcfg_applyMqtt(void);
+
+static void
+webcfg_applyWeb(void);
+
+// ----------------------------------------------------------------------------
+//                                  Schema
+// ----------------------------------------------------------------------------
+
+static const webcfg_option_t s_optMqttFormat[] = {
+  { MQTT_FORMAT_JSON, "JSON" },
+  { MQTT_FORMAT_BINARY, "Binary" },
+  { MQTT_FORMAT_CBOR, "CBOR" },
+  { 0, NULL },
+};
+
+static const webcfg_option_t s_optLogType[] = {
+  { ALPHA_LOG_NONE, "none" }, { ALPHA_LOG_STD, "stdout" }, { ALPHA_LOG_UDP, "UDP" },   { ALPHA_LOG_TCP, "TCP" },
+  { ALPHA_LOG_HTTP, "HTTP" }, { ALPHA_LOG_MQTT, "MQTT" },  { ALPHA_LOG_VSCP, "VSCP" }, { 0, NULL },
+};
+
+static const webcfg_option_t s_optLogLevel[] = {
+  { ESP_LOG_ERROR, "error" }, { ESP_LOG_WARN, "warning" },    { ESP_LOG_INFO, "info" },
+  { ESP_LOG_DEBUG, "debug" }, { ESP_LOG_VERBOSE, "verbose" }, { 0, NULL },
+};
+
+static const webcfg_field_t s_fieldsModule[] = {
+  WEBCFG_TEXT("node_name", "Module name", WEBCFG_TYPE_STR, nodeName),
+  WEBCFG_ACTION("key", "Primary key (32 bytes hex)", 2 * APP_KEY_LEN, webcfg_setEspnowKey),
+  WEBCFG_NUM("strtdly", "Startup delay", WEBCFG_TYPE_U8, startDelay, 0, 99),
+};
+
+static const webcfg_field_t s_fieldsEspnow[] = {
+  WEBCFG_BOOL("enable", "Enable", espnowEnable),
+  WEBCFG_BOOL("lr", "Enable Long Range", espnowLongRange),
+  WEBCFG_BOOL("fw", "Enable Frame Forward", espnowForwardEnable),
+  WEBCFG_BOOL("adjf", "Filter Adj. Channel", espnowFilterAdjacentChannel),
+  WEBCFG_BOOL("swchf", "Forward Switch Channel", espnowForwardSwitchChannel),
+  WEBCFG_NUM("qsize", "Queue size (32)", WEBCFG_TYPE_U8, espnowSizeQueue, 1, 255),
+  WEBCFG_NUM("channel", "Use channel (0 is current)", WEBCFG_TYPE_U8, espnowChannel, 0, 14),
+  WEBCFG_NUM("ttl", "Time to live (32)", WEBCFG_TYPE_U8, espnowTtl, 0, 255),
+  { "rssi",
+    "Filter on RSSI (-67)",
+    WEBCFG_TYPE_I8,
+    WEBCFG_FLAG_NEGATIVE,
+    WEBCFG_MEMBER(espnowFilterWeakSignal),
+    -127,
+    0,
+    NULL,
+    NULL },
+};
+
+static const webcfg_field_t s_fieldsVscplink[] = {
+  WEBCFG_BOOL("enable", "Enable", vscplinkEnable),
+  WEBCFG_TEXT("url", "Host", WEBCFG_TYPE_STR, vscplinkUrl),
+  WEBCFG_NUM("port", "Port", WEBCFG_TYPE_U16, vscplinkPort, 1, 65535),
+  WEBCFG_TEXT("user", "Username", WEBCFG_TYPE_STR, vscplinkUsername),
+  WEBCFG_TEXT("password", "Password", WEBCFG_TYPE_PASSWORD, vscplinkPassword),
+  WEBCFG_TEXT("key", "Security key (32 bytes hex)", WEBCFG_TYPE_HEX, vscpLinkKey),
+};
+
+static const webcfg_field_t s_fieldsMqtt[] = {
+  WEBCFG_BOOL("enable", "Enable", mqttEnable),
+  WEBCFG_TEXT("url", "Host", WEBCFG_TYPE_STR, mqttUrl),
+  WEBCFG_NUM("port", "Port", WEBCFG_TYPE_U16, mqttPort, 1, 65535),
+  WEBCFG_TEXT("client", "Client id", WEBCFG_TYPE_STR, mqttClientid),
+  WEBCFG_TEXT("user", "Username", WEBCFG_TYPE_STR, mqttUsername),
+  WEBCFG_TEXT("password", "Password", WEBCFG_TYPE_PASSWORD, mqttPassword),
+  WEBCFG_TEXT("sub", "Subscribe", WEBCFG_TYPE_STR, mqttSub),
+  WEBCFG_TEXT("pub", "Publish", WEBCFG_TYPE_STR, mqttPub),
+  WEBCFG_SELECT("format", "Publish format", mqttFormat, s_optMqttFormat),
+};
+
+static const webcfg_field_t s_fieldsWeb[] = {
+  WEBCFG_BOOL("enable", "Enable", webEnable),
+  WEBCFG_NUM("port", "Port", WEBCFG_TYPE_U16, webPort, 1, 65535),
+  WEBCFG_TEXT("user", "Username", WEBCFG_TYPE_STR, webUsername),
+  WEBCFG_TEXT("password", "Password", WEBCFG_TYPE_PASSWORD, webPassword),
+};
+
+static const webcfg_field_t s_fieldsLog[] = {
+  WEBCFG_BOOL("stdout", "Log to stdout", logwrite2Stdout),
+  WEBCFG_SELECT("type", "Log to", logType, s_optLogType),
+  WEBCFG_SELECT("level", "Log level", logLevel, s_optLogLevel),
+  WEBCFG_NUM("retries", "Max retries", WEBCFG_TYPE_U8, logRetries, 0, 255),
+  WEBCFG_TEXT("url", "Destination (IP Addr)", WEBCFG_TYPE_STR, logUrl),
+  WEBCFG_NUM("port", "Port", WEBCFG_TYPE_U16, logPort, 0, 65535),
+  WEBCFG_TEXT("topic", "MQTT log Topic", WEBCFG_TYPE_STR, logMqttTopic),
+};
+
+#define WEBCFG_PAGE(name, title, fields, pfnApply) { name, title, fields, sizeof(fields) / sizeof(fields[0]), pfnApply }
+
+static const webcfg_page_t s_pages[] = {
+  WEBCFG_PAGE("module", "Module Configuration", s_fieldsModule, webcfg_applyMqtt),
+  WEBCFG_PAGE("espnow", "ESPNOW Configuration", s_fieldsEspnow, NULL),
+  WEBCFG_PAGE("vscplink", "VSCP Link Configuration", s_fieldsVscplink, NULL),
+  WEBCFG_PAGE("mqtt", "MQTT Configuration", s_fieldsMqtt, webcfg_applyMqtt),
+  WEBCFG_PAGE("web", "Web server Configuration", s_fieldsWeb, webcfg_applyWeb),
+  WEBCFG_PAGE("log", "Logging Configuration", s_fieldsLog, NULL),
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// webcfg_setEspnowKey
+//
+// The esp-now security key is kept by the esp-now component
+//
+
+static esp_err_t
+webcfg_setEspnowKey(const char *value)
+{
+  uint8_t key[APP_KEY_LEN];
+
+  memset(key, 0, sizeof(key));
+  vscp_fwhlp_hex2bin(key, sizeof(key), value);
+
+  return espnow_set_key(key);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// webcfg_applyMqtt
+//
+// Node name and topic templates are part of the compiled MQTT topics
+//
+
+static void
+webcfg_applyMqtt(void)
+{
+  mqtt_compile_topics();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// webcfg_applyWeb
+//
+
+static void
+webcfg_applyWeb(void)
+{
+  websrv_update_credentials();
+}
+
+// ----------------------------------------------------------------------------
+//                                  Helpers
+// ----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+// webcfg_urlDecode
+//
+// Decode a form value in place
+//
+
+static void
+webcfg_urlDecode(char *str)
+{
+  char *out = str;
+
+  while (*str) {
+    if (('%' == *str) && isxdigit((unsigned char) str[1]) && isxdigit((unsigned char) str[2])) {
+      char hex[3] = { str[1], str[2], 0 };
+      *out++      = (char) strtoul(hex, NULL, 16);
+      str += 3;
+    }
+    else if ('+' == *str) {
+      *out++ = ' ';
+      str++;
+    }
+    else {
+      *out++ = *str++;
+    }
+  }
+
+  *out = '\0';
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// webcfg_isHex
+//
+
+static bool
+webcfg_isHex(const char *str, size_t maxlen)
+{
+  size_t len = strlen(str);
+
+  if ((len > maxlen) || (len & 1)) {
+    return false;
+  }
+
+  while (*str) {
+    if (!isxdigit((unsigned char) *str++)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// webcfg_escape
+//
+// Copy a string escaped for use in an HTML attribute. Returns number of
+// characters written (not counting the terminating zero).
+//
+
+static size_t
+webcfg_escape(char *buf, size_t size, const char *str)
+{
+  size_t pos = 0;
+
+  while (*str && (pos + 7 < size)) {
+    switch (*str) {
+      case '"':
+        pos += sprintf(buf + pos, "&quot;");
+        break;
+      case '&':
+        pos += sprintf(buf + pos, "&amp;");
+        break;
+      case '<':
+        pos += sprintf(buf + pos, "&lt;");
+        break;
+      case '>':
+        pos += sprintf(buf + pos, "&gt;");
+        break;
+      default:
+        buf[pos++] = *str;
+        break;
+    }
+    str++;
+  }
+
+  buf[pos] = '\0';
+  return pos;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// webcfg_getNumber
+//
+// Read a number field from a config image
+//
+
+static int32_t
+webcfg_getNumber(const webcfg_field_t *pfield, const uint8_t *pcfg)
+{
+  switch (pfield->type) {
+    case WEBCFG_TYPE_U16:
+      return *(const uint16_t *) (pcfg + pfield->offset);
+    case WEBCFG_TYPE_I8:
+      return *(const int8_t *) (pcfg + pfield->offset);
+    default:
+      return *(const uint8_t *) (pcfg + pfield->offset);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// webcfg_renderField
+//
+
+static void
+webcfg_renderField(httpd_req_t *req, char *buf, const webcfg_field_t *pfield)
+{
+  size_t pos;
+  const uint8_t *pcfg = (const uint8_t *) &g_persistent;
+  const char *pval    = (const char *) (pcfg + pfield->offset);
+
+  switch (pfield->type) {
+
+    case WEBCFG_TYPE_BOOL:
+      sprintf(buf,
+              "<input type=\"checkbox\" id=\"%s\" name=\"%s\" value=\"true\" %s><label for=\"%s\"> %s</label><br>",
+              pfield->name,
+              pfield->name,
+              *pval ? "checked" : "",
+              pfield->name,
+              pfield->label);
+      break;
+
+    case WEBCFG_TYPE_U8:
+    case WEBCFG_TYPE_U16:
+    case WEBCFG_TYPE_I8:
+      sprintf(buf,
+              "%s:<input type=\"text\" name=\"%s\" value=\"%ld\" >",
+              pfield->label,
+              pfield->name,
+              (long) webcfg_getNumber(pfield, pcfg));
+      break;
+
+    case WEBCFG_TYPE_SELECT:
+      pos = sprintf(buf, "%s:<select name=\"%s\" >", pfield->label, pfield->name);
+      for (const webcfg_option_t *popt = pfield->options; NULL != popt->label; popt++) {
+        pos += sprintf(buf + pos,
+                       "<option value=\"%d\" %s>%s</option>",
+                       popt->value,
+                       (popt->value == *(const uint8_t *) pval) ? "selected" : "",
+                       popt->label);
+      }
+      sprintf(buf + pos, "</select>");
+      break;
+
+    case WEBCFG_TYPE_STR:
+    case WEBCFG_TYPE_PASSWORD:
+      pos = sprintf(buf,
+                    "%s:<input type=\"%s\" name=\"%s\" maxlength=\"%d\" value=\"",
+                    pfield->label,
+                    (WEBCFG_TYPE_PASSWORD == pfield->type) ? "password" : "text",
+                    pfield->name,
+                    pfield->size - 1);
+      pos += webcfg_escape(buf + pos, WEBCFG_BUF_SIZE - pos - 4, pval);
+      sprintf(buf + pos, "\" >");
+      break;
+
+    case WEBCFG_TYPE_HEX:
+      pos = sprintf(buf,
+                    "%s:<input type=\"password\" name=\"%s\" maxlength=\"%d\" value=\"",
+                    pfield->label,
+                    pfield->name,
+                    2 * pfield->size);
+      for (int i = 0; i < pfield->size; i++) {
+        pos += sprintf(buf + pos, "%02X", (uint8_t) pval[i]);
+      }
+      sprintf(buf + pos, "\" >");
+      break;
+
+    case WEBCFG_TYPE_ACTION:
+      // Write only. Left empty to keep the current value.
+      sprintf(buf,
+              "%s:<input type=\"password\" name=\"%s\" maxlength=\"%ld\" value=\"\" placeholder=\"unchanged\" >",
+              pfield->label,
+              pfield->name,
+              (long) pfield->max);
+      break;
+
+    default:
+      return;
+  }
+
+  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// webcfg_parseValue
+//
+// Check a posted value and store it in the page staging area
+//
+
+static int
+webcfg_parseValue(const webcfg_field_t *pfield, const char *value, uint8_t *pdst)
+{
+  char *pend;
+  long val;
+
+  switch (pfield->type) {
+
+    case WEBCFG_TYPE_BOOL:
+      *pdst = (NULL != strstr(value, "true")) ? 1 : 0;
+      return VSCP_ERROR_SUCCESS;
+
+    case WEBCFG_TYPE_U8:
+    case WEBCFG_TYPE_U16:
+    case WEBCFG_TYPE_I8:
+    case WEBCFG_TYPE_SELECT:
+      val = strtol(value, &pend, 0);
+      if ((pend == value) || ('\0' != *pend)) {
+        return VSCP_ERROR_PARAMETER;
+      }
+      if ((pfield->flags & WEBCFG_FLAG_NEGATIVE) && (val > 0)) {
+        val = -val;
+      }
+      if ((val < pfield->min) || (val > pfield->max)) {
+        return VSCP_ERROR_PARAMETER;
+      }
+      if (WEBCFG_TYPE_SELECT == pfield->type) {
+        const webcfg_option_t *popt = pfield->options;
+        while ((NULL != popt->label) && (popt->value != val)) {
+          popt++;
+        }
+        if (NULL == popt->label) {
+          return VSCP_ERROR_PARAMETER;
+        }
+      }
+      if (WEBCFG_TYPE_U16 == pfield->type) {
+        uint16_t val16 = (uint16_t) val;
+        memcpy(pdst, &val16, sizeof(uint16_t));
+      }
+      else {
+        *pdst = (uint8_t) val;
+      }
+      return VSCP_ERROR_SUCCESS;
+
+    case WEBCFG_TYPE_STR:
+    case WEBCFG_TYPE_PASSWORD:
+      if (strlen(value) >= pfield->size) {
+        return VSCP_ERROR_PARAMETER;
+      }
+      memset(pdst, 0, pfield->size);
+      strcpy((char *) pdst, value);
+      return VSCP_ERROR_SUCCESS;
+
+    case WEBCFG_TYPE_HEX:
+      if (!webcfg_isHex(value, 2 * pfield->size)) {
+        return VSCP_ERROR_PARAMETER;
+      }
+      memset(pdst, 0, pfield->size);
+      vscp_fwhlp_hex2bin(pdst, pfield->size, value);
+      return VSCP_ERROR_SUCCESS;
+
+    case WEBCFG_TYPE_ACTION:
+      return webcfg_isHex(value, pfield->max) ? VSCP_ERROR_SUCCESS : VSCP_ERROR_PARAMETER;
+
+    default:
+      return VSCP_ERROR_PARAMETER;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// webcfg_sendResult
+//
+
+static esp_err_t
+webcfg_sendResult(httpd_req_t *req, const webcfg_page_t *ppage, const char *msg)
+{
+  char *buf = ESP_MALLOC(WEBCFG_BUF_SIZE);
+  if (NULL == buf) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  snprintf(buf,
+           WEBCFG_BUF_SIZE,
+           "<html><head><meta charset='utf-8'><meta http-equiv=\"refresh\" content=\"%d;url=cfg%s\" "
+           "/><link rel=\"stylesheet\" href=\"/style.css\" /></head><body><h2 class=\"name\">%s</h2></body></html>",
+           (NULL == msg) ? 1 : 3,
+           ppage->name,
+           (NULL == msg) ? "saving data..." : msg);
+
+  esp_err_t rv = httpd_resp_send(req, buf, HTTPD_RESP_USE_STRLEN);
+  ESP_FREE(buf);
+
+  return rv;
+}
+
+// ----------------------------------------------------------------------------
+//                                  Pages
+// ----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+// webcfg_find_page
+//
+
+const webcfg_page_t *
+webcfg_find_page(const char *uri, bool *pbSave)
+{
+  size_t len;
+
+  // Check pointers
+  if ((NULL == uri) || (NULL == pbSave)) {
+    return NULL;
+  }
+
+  if (0 == strncmp(uri, "/docfg", 6)) {
+    *pbSave = true;
+    uri += 6;
+  }
+  else if (0 == strncmp(uri, "/cfg", 4)) {
+    *pbSave = false;
+    uri += 4;
+  }
+  else {
+    return NULL;
+  }
+
+  len = strcspn(uri, "?");
+
+  for (int i = 0; i < sizeof(s_pages) / sizeof(s_pages[0]); i++) {
+    if ((strlen(s_pages[i].name) == len) && (0 == strncmp(s_pages[i].name, uri, len))) {
+      return &s_pages[i];
+    }
+  }
+
+  return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// webcfg_page_get_handler
+//
+
+esp_err_t
+webcfg_page_get_handler(httpd_req_t *req, const webcfg_page_t *ppage)
+{
+  char *buf;
+
+  // Check pointer
+  if (NULL == ppage) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  buf = ESP_MALLOC(WEBCFG_BUF_SIZE);
+  if (NULL == buf) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  // Get application info data
+  const esp_app_desc_t *appDescr = esp_app_get_description();
+
+  snprintf(buf, WEBCFG_BUF_SIZE, WEBPAGE_START_TEMPLATE, g_persistent.nodeName, ppage->title);
+  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+
+  sprintf(buf, "<div><form id=but3 class=\"button\" action='/docfg%s' method='get'><fieldset>", ppage->name);
+  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+
+  for (int i = 0; i < ppage->nFields; i++) {
+    webcfg_renderField(req, buf, &ppage->fields[i]);
+  }
+
+  sprintf(buf, "<button class=\"bgrn bgrn:hover\">Save</button></fieldset></form></div>");
+  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+
+  snprintf(buf, WEBCFG_BUF_SIZE, WEBPAGE_END_TEMPLATE, appDescr->version, g_persistent.nodeName);
+  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+
+  httpd_resp_send_chunk(req, NULL, 0);
+
+  ESP_FREE(buf);
+
+  return ESP_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// webcfg_save_get_handler
+//
+
+esp_err_t
+webcfg_save_get_handler(httpd_req_t *req, const webcfg_page_t *ppage)
+{
+  esp_err_t rv;
+  char *query;
+  uint8_t *pstage;
+  size_t stageSize = 0;
+  int nChanged     = 0;
+  uint16_t stageOffset[WEBCFG_MAX_FIELDS];
+  const char *actionValue[WEBCFG_MAX_FIELDS];
+  const webcfg_field_t *pbad = NULL;
+  uint8_t *pcfg              = (uint8_t *) &g_persistent;
+
+  // Check pointer
+  if ((NULL == ppage) || (ppage->nFields > WEBCFG_MAX_FIELDS)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  // Staging area starts out as a copy of the current values.
+  // Checkboxes are only posted when checked so they start out as false.
+  for (int i = 0; i < ppage->nFields; i++) {
+    stageOffset[i] = stageSize;
+    actionValue[i] = NULL;
+    stageSize += ppage->fields[i].size;
+  }
+
+  pstage = ESP_MALLOC(stageSize + 1);
+  if (NULL == pstage) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  for (int i = 0; i < ppage->nFields; i++) {
+    const webcfg_field_t *pfield = &ppage->fields[i];
+    memcpy(pstage + stageOffset[i], pcfg + pfield->offset, pfield->size);
+    if (WEBCFG_TYPE_BOOL == pfield->type) {
+      pstage[stageOffset[i]] = 0;
+    }
+  }
+
+  // Parse the query in one pass. Values are decoded in place.
+  size_t len = httpd_req_get_url_query_len(req) + 1;
+  query      = ESP_MALLOC(len);
+  if (NULL == query) {
+    ESP_FREE(pstage);
+    return ESP_ERR_NO_MEM;
+  }
+
+  if ((len > 1) && (ESP_OK == httpd_req_get_url_query_str(req, query, len))) {
+
+    char *next = query;
+    while ((NULL != next) && ('\0' != *next) && (NULL == pbad)) {
+
+      char *key   = next;
+      char *value = "";
+
+      if (NULL != (next = strchr(key, '&'))) {
+        *next++ = '\0';
+      }
+
+      char *p = strchr(key, '=');
+      if (NULL != p) {
+        *p    = '\0';
+        value = p + 1;
+      }
+
+      webcfg_urlDecode(value);
+
+      for (int i = 0; i < ppage->nFields; i++) {
+        const webcfg_field_t *pfield = &ppage->fields[i];
+        if (0 != strcmp(pfield->name, key)) {
+          continue;
+        }
+        if (WEBCFG_TYPE_ACTION == pfield->type) {
+          if ('\0' == *value) {
+            break;
+          }
+          actionValue[i] = value;
+        }
+        if (VSCP_ERROR_SUCCESS != webcfg_parseValue(pfield, value, pstage + stageOffset[i])) {
+          pbad = pfield;
+        }
+        break;
+      }
+    }
+  }
+
+  if (NULL != pbad) {
+    char msg[80];
+    ESP_LOGE(TAG, "Bad value for %s on page %s. Nothing saved.", pbad->name, ppage->name);
+    snprintf(msg, sizeof(msg), "Invalid value for %s. Nothing saved.", pbad->label);
+    rv = webcfg_sendResult(req, ppage, msg);
+    ESP_FREE(query);
+    ESP_FREE(pstage);
+    return rv;
+  }
+
+  // Write changed values and commit them all at once
+  for (int i = 0; i < ppage->nFields; i++) {
+
+    const webcfg_field_t *pfield = &ppage->fields[i];
+
+    if (!pfield->size || !memcmp(pcfg + pfield->offset, pstage + stageOffset[i], pfield->size)) {
+      continue;
+    }
+
+    memcpy(pcfg + pfield->offset, pstage + stageOffset[i], pfield->size);
+    nChanged++;
+  }
+
+  if (nChanged) {
+    if (VSCP_ERROR_SUCCESS != (rv = cfgstore_save())) {
+      ESP_LOGE(TAG, "Failed to save configuration rv=%d", rv);
+    }
+    if (NULL != ppage->pfnApply) {
+      ppage->pfnApply();
+    }
+  }
+
+  for (int i = 0; i < ppage->nFields; i++) {
+    if (NULL != actionValue[i]) {
+      if (ESP_OK != (rv = ppage->fields[i].pfnSet(actionValue[i]))) {
+        ESP_LOGE(TAG, "Failed to set %s rv=%d", ppage->fields[i].name, rv);
+      }
+    }
+  }
+
+  ESP_LOGI(TAG, "Page %s saved, %d value(s) changed", ppage->name, nChanged);
+
+  ESP_FREE(query);
+  ESP_FREE(pstage);
+
+  return webcfg_sendResult(req, ppage, NULL);
+}
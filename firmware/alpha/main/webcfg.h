@@ -0,0 +1,162 @@
+/*
+  File: webcfg.h
+
+  VSCP alpha node schema driven configuration pages
+
+  This file is part of the VSCP (https://www.vscp.org)
+
+  The MIT License (MIT)
+  Copyright © 2022-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  Each configuration page is described by a table of fields. The table
+  tells where a value lives in node_persistent_config_t, how it is shown
+  on the form and its limits. Form rendering and query parsing are
+  generated from the table. Changed values are saved with cfgstore_save().
+
+    /cfg<name>   - Show the form for a page
+    /docfg<name> - Save the values posted from the form
+*/
+
+#ifndef __VSCP_ALPHA_WEBCFG__
+#define __VSCP_ALPHA_WEBCFG__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <esp_http_server.h>
+
+#include "alpha.h"
+
+// Max number of fields on one page
+#define WEBCFG_MAX_FIELDS 16
+
+/**
+ * Field types. The type also decides the NVS type a value is stored as.
+ */
+typedef enum {
+  WEBCFG_TYPE_BOOL = 0, // Checkbox (u8). Unchecked boxes are not posted and mean false.
+  WEBCFG_TYPE_U8,       // Unsigned 8-bit number
+  WEBCFG_TYPE_U16,      // Unsigned 16-bit number
+  WEBCFG_TYPE_I8,       // Signed 8-bit number
+  WEBCFG_TYPE_SELECT,   // Drop down list with options (u8)
+  WEBCFG_TYPE_STR,      // Text
+  WEBCFG_TYPE_PASSWORD, // Text shown as password
+  WEBCFG_TYPE_HEX,      // Binary value entered as hex (blob)
+  WEBCFG_TYPE_ACTION,   // Write only hex value not in the persistent config. Handed to a callback.
+} webcfg_type_t;
+
+// Field flags
+#define WEBCFG_FLAG_NEGATIVE 0x01 // Positive numbers are negated (RSSI)
+
+/**
+ * Option for a WEBCFG_TYPE_SELECT field. Lists end with a NULL label.
+ */
+typedef struct {
+  uint8_t value;
+  const char *label;
+} webcfg_option_t;
+
+/**
+ * @brief Set callback for WEBCFG_TYPE_ACTION fields
+ *
+ * @param value Value posted from the form. Never empty.
+ * @return ESP_OK on success, error code otherwise.
+ */
+typedef esp_err_t (*webcfg_set_cb_t)(const char *value);
+
+/**
+ * @brief Description of a configuration value
+ */
+typedef struct {
+  const char *name;                // Form and query parameter name
+  const char *label;               // Label shown on the form
+  uint8_t type;                    // webcfg_type_t
+  uint8_t flags;                   // WEBCFG_FLAG_xxx
+  uint16_t offset;                 // Offset in node_persistent_config_t
+  uint16_t size;                   // Size in node_persistent_config_t (zero for actions)
+  int32_t min;                     // Min value for numbers
+  int32_t max;                     // Max value for numbers (max length for actions)
+  const webcfg_option_t *options;  // Options for WEBCFG_TYPE_SELECT
+  webcfg_set_cb_t pfnSet;          // Callback for WEBCFG_TYPE_ACTION
+} webcfg_field_t;
+
+/**
+ * @brief Description of a configuration page
+ */
+typedef struct {
+  const char *name;              // Page name. Forms are at /cfg<name>, saved at /docfg<name>
+  const char *title;             // Section header on the page
+  const webcfg_field_t *fields;  // Fields on the page
+  uint8_t nFields;               // Number of fields
+  void (*pfnApply)(void);        // Called after changed values have been saved. Can be NULL.
+} webcfg_page_t;
+
+/*
+  Helpers for the field tables
+*/
+#define WEBCFG_MEMBER(member) offsetof(node_persistent_config_t, member), sizeof(((node_persistent_config_t *) 0)->member)
+
+#define WEBCFG_BOOL(name, label, member)                                                                              \
+  { name, label, WEBCFG_TYPE_BOOL, 0, WEBCFG_MEMBER(member), 0, 1, NULL, NULL }
+#define WEBCFG_NUM(name, label, type, member, min, max)                                                               \
+  { name, label, type, 0, WEBCFG_MEMBER(member), min, max, NULL, NULL }
+#define WEBCFG_SELECT(name, label, member, options)                                                                   \
+  { name, label, WEBCFG_TYPE_SELECT, 0, WEBCFG_MEMBER(member), 0, 255, options, NULL }
+#define WEBCFG_TEXT(name, label, type, member)                                                                        \
+  { name, label, type, 0, WEBCFG_MEMBER(member), 0, 0, NULL, NULL }
+#define WEBCFG_ACTION(name, label, maxlen, pfnSet)                                                                    \
+  { name, label, WEBCFG_TYPE_ACTION, 0, 0, 0, 0, maxlen, NULL, pfnSet }
+
+/**
+ * @brief Find the configuration page for a URI
+ *
+ * @param uri Request URI (/cfg<name> or /docfg<name>, query is ignored)
+ * @param pbSave Pointer to variable that is set to true if the URI is for
+ *        saving the page.
+ * @return Pointer to page or NULL if the URI is not a configuration page.
+ */
+const webcfg_page_t *
+webcfg_find_page(const char *uri, bool *pbSave);
+
+/**
+ * @brief Send the form for a configuration page
+ *
+ * @param req Request
+ * @param ppage Page to show
+ * @return ESP_OK on success, error code otherwise.
+ */
+esp_err_t
+webcfg_page_get_handler(httpd_req_t *req, const webcfg_page_t *ppage);
+
+/**
+ * @brief Save values posted from a configuration page
+ *
+ * The query is parsed in one pass and all values are checked before
+ * anything is changed. Changed values are then written to NVS and
+ * committed at once. If a value is bad nothing is saved.
+ *
+ * @param req Request
+ * @param ppage Page the values belong to
+ * @return ESP_OK on success, error code otherwise.
+ */
+esp_err_t
+webcfg_save_get_handler(httpd_req_t *req, const webcfg_page_t *ppage);
+
+#endif
@@ -27,6 +27,11 @@
   SOFTWARE.
 */
 
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
 #include <stdio.h>
 #include <string.h>
 #include <sys/param.h>
@@ -42,6 +47,7 @@
 #include <esp_mac.h>
 #include <esp_ota_ops.h>
 #include <esp_timer.h>
+#include <esp_random.h>
 #include <esp_err.h>
 #include <esp_log.h>
 #include <nvs_flash.h>
@@ -61,6 +67,13 @@
 #include "urldecode.h"
 
 #include "alpha.h"
+#include "eventbus.h"
+#include "imgcache.h"
+#include "mqtt.h"
+#include "restapi.h"
+#include "tcpsrv.h"
+#include "webcfg.h"
+#include "cfgstore.h"
 #include "websrv.h"
 
 #ifdef CONFIG_EXAMPLE_PROV_TRANSPORT_BLE
@@ -81,7 +94,6 @@ int
 app_initiate_firmware_upload(const char *url);
 
 // External from main
-extern nvs_handle_t g_nvsHandle;
 extern node_persistent_config_t g_persistent;
 extern vprintf_like_t g_stdLogFunc;
 #define TAG __func__
@@ -92,47 +104,184 @@ extern vprintf_like_t g_stdLogFunc;
 // Chunk buffer size
 #define CHUNK_BUFSIZE 8192
 
-#define IS_FILE_EXT(filename, ext) (strcasecmp(&filename[strlen(filename) - sizeof(ext) + 1], ext) == 0)
+#define IS_FILE_EXT(filename, ext)                                                                     \
+  ((strlen(filename) >= sizeof(ext) - 1) && (strcasecmp(&filename[strlen(filename) - sizeof(ext) + 1], ext) == 0))
 
 //-----------------------------------------------------------------------------
 //                               Start Basic Auth
 //-----------------------------------------------------------------------------
 
+/*
+  The expected Authorization header value is computed once when the web
+  credentials change, so checking a request needs no allocation or base64
+  work. With sessions enabled a client that has passed basic auth also gets
+  a session cookie. Later requests with a valid cookie skip the credential
+  check. All of this runs in the httpd task only and needs no locking.
+*/
+
+// "Basic " + base64 of "user:password"
+#define AUTH_DIGEST_SIZE (6 + 4 * ((sizeof(g_persistent.webUsername) + sizeof(g_persistent.webPassword) + 2) / 3) + 1)
+
+static char s_authDigest[AUTH_DIGEST_SIZE];
+
+#ifdef CONFIG_APP_WEB_SESSION
+
+#define SESSION_COOKIE    "alpha_session"
+#define SESSION_TOKEN_LEN 16
+
+typedef struct {
+  uint8_t token[SESSION_TOKEN_LEN]; // Random session token
+  int64_t tsExpire;                 // Session is valid until this time (us). Zero for free slot.
+  bool bUsed;                       // The cookie has come back, the client keeps it
+} session_t;
+
+static session_t s_sessions[CONFIG_APP_WEB_SESSION_COUNT];
+
+// Set-Cookie header value. Must live until the response is sent.
+static char s_setCookie[sizeof(SESSION_COOKIE) + 2 * SESSION_TOKEN_LEN + 64];
+
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////
-// http_auth_basic
+// websrv_update_credentials
 //
 
-static char *
-http_auth_basic(const char *username, const char *password)
+void
+websrv_update_credentials(void)
 {
-  int out;
-  char *user_info = NULL;
-  char *digest    = NULL;
-  size_t n        = 0;
-  asprintf(&user_info, "%s:%s", username, password);
-  if (!user_info) {
-    ESP_LOGE(TAG, "No enough memory for user information");
-    return NULL;
+  size_t n;
+  char user_info[sizeof(g_persistent.webUsername) + sizeof(g_persistent.webPassword) + 1];
+
+  snprintf(user_info, sizeof(user_info), "%s:%s", g_persistent.webUsername, g_persistent.webPassword);
+
+  memset(s_authDigest, 0, sizeof(s_authDigest));
+  strcpy(s_authDigest, "Basic ");
+  if (0 != esp_crypto_base64_encode((unsigned char *) s_authDigest + 6,
+                                    sizeof(s_authDigest) - 6,
+                                    &n,
+                                    (const unsigned char *) user_info,
+                                    strlen(user_info))) {
+    ESP_LOGE(TAG, "Failed to encode web credentials");
+    s_authDigest[0] = '\0'; // Nothing will match
+  }
+
+  memset(user_info, 0, sizeof(user_info));
+
+#ifdef CONFIG_APP_WEB_SESSION
+  // Old sessions were opened with the old credentials
+  memset(s_sessions, 0, sizeof(s_sessions));
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// auth_equal
+//
+// Compare in constant time so the time taken tells nothing about how much
+// of a secret matched
+//
+
+static bool
+auth_equal(const uint8_t *a, const uint8_t *b, size_t len)
+{
+  uint8_t diff = 0;
+
+  for (size_t i = 0; i < len; i++) {
+    diff |= a[i] ^ b[i];
+  }
+
+  return (0 == diff);
+}
+
+#ifdef CONFIG_APP_WEB_SESSION
+
+///////////////////////////////////////////////////////////////////////////////
+// session_check
+//
+// Check the session cookie of a request. A valid session has its expiry
+// time extended.
+//
+
+static bool
+session_check(httpd_req_t *req)
+{
+  char val[2 * SESSION_TOKEN_LEN + 1];
+  size_t len = sizeof(val);
+  uint8_t token[SESSION_TOKEN_LEN];
+  int64_t now = esp_timer_get_time();
+
+  if (ESP_OK != httpd_req_get_cookie_val(req, SESSION_COOKIE, val, &len)) {
+    return false;
+  }
+
+  if (2 * SESSION_TOKEN_LEN != strlen(val)) {
+    return false;
+  }
+
+  memset(token, 0, sizeof(token));
+  vscp_fwhlp_hex2bin(token, sizeof(token), val);
+
+  for (int i = 0; i < CONFIG_APP_WEB_SESSION_COUNT; i++) {
+    if ((s_sessions[i].tsExpire > now) && auth_equal(s_sessions[i].token, token, SESSION_TOKEN_LEN)) {
+      s_sessions[i].tsExpire = now + (int64_t) CONFIG_APP_WEB_SESSION_TIMEOUT * 1000000;
+      s_sessions[i].bUsed    = true;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// session_open
+//
+// Start a new session for a request that passed basic auth without a
+// valid session cookie. API requests get none, their clients send the
+// Authorization header every time.
+//
+// If the table is full an expired session is replaced first, then the
+// oldest session whose cookie never came back and last the oldest one.
+// Clients that ignore cookies then only push out each other and not the
+// sessions of browsers.
+//
+
+static void
+session_open(httpd_req_t *req)
+{
+  int pos;
+  int64_t now         = esp_timer_get_time();
+  session_t *psession = NULL;
+
+  if (0 == strncmp(req->uri, RESTAPI_URI_PREFIX, strlen(RESTAPI_URI_PREFIX))) {
+    return;
+  }
+
+  for (int i = 0; i < CONFIG_APP_WEB_SESSION_COUNT; i++) {
+    session_t *p = &s_sessions[i];
+    if (p->tsExpire <= now) {
+      psession = p;
+      break;
+    }
+    if ((NULL == psession) || (psession->bUsed && !p->bUsed) ||
+        ((psession->bUsed == p->bUsed) && (p->tsExpire < psession->tsExpire))) {
+      psession = p;
+    }
+  }
+
+  esp_fill_random(psession->token, SESSION_TOKEN_LEN);
+  psession->tsExpire = now + (int64_t) CONFIG_APP_WEB_SESSION_TIMEOUT * 1000000;
+  psession->bUsed    = false;
+
+  pos = sprintf(s_setCookie, SESSION_COOKIE "=");
+  for (int i = 0; i < SESSION_TOKEN_LEN; i++) {
+    pos += sprintf(s_setCookie + pos, "%02X", psession->token[i]);
   }
-  esp_crypto_base64_encode(NULL, 0, &n, (const unsigned char *) user_info, strlen(user_info));
-
-  /* 6: The length of the "Basic " string
-   * n: Number of bytes for a base64 encode format
-   * 1: Number of bytes for a reserved which be used to fill zero
-   */
-  digest = calloc(1, 6 + n + 1);
-  if (digest) {
-    strcpy(digest, "Basic ");
-    esp_crypto_base64_encode((unsigned char *) digest + 6,
-                             n,
-                             (size_t *) &out,
-                             (const unsigned char *) user_info,
-                             strlen(user_info));
-  }
-  ESP_FREE(user_info);
-  return digest;
+  sprintf(s_setCookie + pos, "; Path=/; HttpOnly; SameSite=Strict; Max-Age=%d", CONFIG_APP_WEB_SESSION_TIMEOUT);
+
+  httpd_resp_set_hdr(req, "Set-Cookie", s_setCookie);
 }
 
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////
 // info_get_handler
 //
@@ -153,6 +302,7 @@ info_get_handler(httpd_req_t *req)
 
   temp = (char *) ESP_CALLOC(1,80);
   if (NULL == temp) {
+    ESP_FREE(buf);
     return ESP_ERR_NO_MEM;
   }
 
@@ -579,6 +729,18 @@ info_get_handler(httpd_req_t *req)
     httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
   }
 
+  tcpsrv_latency_t latency;
+  if (VSCP_ERROR_SUCCESS == tcpsrv_getLatency(&latency)) {
+    sprintf(buf,
+            "<tr><td class=\"name\">VSCP link rcvloop latency:</td><td class=\"prop\">p50=%lu us p99=%lu us max=%lu "
+            "us (%lu events)</td></tr>",
+            (unsigned long) latency.p50,
+            (unsigned long) latency.p99,
+            (unsigned long) latency.max,
+            (unsigned long) latency.cnt);
+    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+  }
+
   sprintf(buf, "</table>");
   httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
 
@@ -813,6 +975,12 @@ upgrdlocal_post_handler(httpd_req_t *req)
   esp_ota_handle_t ota_handle;
   int remaining = req->content_len;
 
+  if (VSCP_ERROR_SUCCESS != imgcache_self_update()) {
+    ESP_LOGE(TAG, "OTA partition is in use by the image cache");
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Firmware update busy, try again later");
+    return ESP_FAIL;
+  }
+
   const esp_partition_t *ota_partition = esp_ota_get_next_update_partition(NULL);
   ESP_ERROR_CHECK(esp_ota_begin(ota_partition, OTA_SIZE_UNKNOWN, &ota_handle));
 
@@ -830,6 +998,8 @@ upgrdlocal_post_handler(httpd_req_t *req)
       // Serious Error: Abort OTA
       ESP_LOGE(TAG, "OTA aborted due to protocol error");
       httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Protocol Error");
+      esp_ota_abort(ota_handle);
+      imgcache_self_update_failed();
       return ESP_FAIL;
     }
 
@@ -837,6 +1007,8 @@ upgrdlocal_post_handler(httpd_req_t *req)
     if (esp_ota_write(ota_handle, (const void *) buf, recv_len) != ESP_OK) {
       ESP_LOGE(TAG, "OTA aborted due to flash error");
       httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Flash Error");
+      esp_ota_abort(ota_handle);
+      imgcache_self_update_failed();
       return ESP_FAIL;
     }
 
@@ -847,6 +1019,7 @@ upgrdlocal_post_handler(httpd_req_t *req)
   if (esp_ota_end(ota_handle) != ESP_OK || esp_ota_set_boot_partition(ota_partition) != ESP_OK) {
     ESP_LOGE(TAG, "OTA failed due to image activation error");
     httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Validation / Activation Error");
+    imgcache_self_update_failed();
     return ESP_FAIL;
   }
 
@@ -963,12 +1136,15 @@ esp_err_t
 upgrdSiblingslocal_post_handler(httpd_req_t *req)
 {
   char buf[1000];
-  uint8_t sha_256[32]                   = { 0 };
-  esp_ota_handle_t ota_handle;
+  imgcache_writer_t writer;
+  imgcache_entry_t image;
   int remaining = req->content_len;
 
-  const esp_partition_t *ota_partition = esp_ota_get_next_update_partition(NULL);
-  ESP_ERROR_CHECK(esp_ota_begin(ota_partition, OTA_SIZE_UNKNOWN, &ota_handle));
+  // The image is kept in the image cache
+  if (VSCP_ERROR_SUCCESS != imgcache_begin(req->content_len, &writer)) {
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "No room for image");
+    return ESP_FAIL;
+  }
 
   while (remaining > 0) {
 
@@ -985,13 +1161,15 @@ upgrdSiblingslocal_post_handler(httpd_req_t *req)
     else if (recv_len <= 0) {
       // Serious Error: Abort OTA
       ESP_LOGE(TAG, "OTA aborted due to protocol error");
+      imgcache_abort(&writer);
       httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Protocol Error");
       return ESP_FAIL;
     }
 
     // Successful Upload: Flash firmware chunk
-    if (esp_ota_write(ota_handle, (const void *) buf, recv_len) != ESP_OK) {
+    if (VSCP_ERROR_SUCCESS != imgcache_write(&writer, buf, recv_len)) {
       ESP_LOGE(TAG, "OTA aborted due to flash error");
+      imgcache_abort(&writer);
       httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Flash Error");
       return ESP_FAIL;
     }
@@ -999,19 +1177,17 @@ upgrdSiblingslocal_post_handler(httpd_req_t *req)
     remaining -= recv_len;
   }
 
-  // Validate and switch to new OTA image and reboot
-  if (esp_ota_end(ota_handle) != ESP_OK /*|| esp_ota_set_boot_partition(ota_partition) != ESP_OK*/) {
-    ESP_LOGE(TAG, "OTA failed due to image activation error");
-    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Validation / Activation Error");
+  // Validate image
+  if (VSCP_ERROR_SUCCESS != imgcache_end(&writer, NULL, &image)) {
+    ESP_LOGE(TAG, "OTA failed due to image validation error");
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Validation Error");
     return ESP_FAIL;
   }
 
   ESP_LOGD(TAG, "Send OTA to sibling(s)");
 
-  esp_partition_get_sha256(ota_partition, sha_256);
-
   // Send new firmware to clients
-  app_firmware_send(req->content_len, sha_256);
+  app_firmware_send(image.size, image.sha, NULL, 0);
 
   ESP_LOGD(TAG, "Images sent to sibling(s)");
 
@@ -1517,185 +1693,6 @@ config_get_handler(httpd_req_t *req)
 //                                    .handler = config_get_handler,
 //                                    .user_ctx = NULL };
 
-///////////////////////////////////////////////////////////////////////////////
-// config_module_get_handler
-//
-
-static esp_err_t
-config_module_get_handler(httpd_req_t *req)
-{
-  // esp_err_t rv;
-  char *buf;
-  // char *temp;
-
-  char *req_buf;
-  size_t req_buf_len;
-
-  buf = (char *) ESP_CALLOC(1,CHUNK_BUFSIZE);
-  if (NULL == buf) {
-    return ESP_ERR_NO_MEM;
-  }
-
-  // Get application info data
-  const esp_app_desc_t *appDescr = esp_app_get_description();
-
-  // Get header value string length and allocate memory for length + 1,
-  // extra byte for null termination
-  req_buf_len = httpd_req_get_hdr_value_len(req, "Host") + 1;
-  if (req_buf_len > 1) {
-    req_buf = ESP_MALLOC(req_buf_len);
-    // Copy null terminated value string into buffer
-    if (httpd_req_get_hdr_value_str(req, "Host", req_buf, req_buf_len) == ESP_OK) {
-      ESP_LOGD(TAG, "Found header => Host: %s", req_buf);
-    }
-    ESP_FREE(req_buf);
-  }
-
-  sprintf(buf, WEBPAGE_START_TEMPLATE, g_persistent.nodeName, "Module Configuration");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf, "<div><form id=but3 class=\"button\" action='/docfgmodule' method='get'><fieldset>");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf,
-          "Module name:<input type=\"text\" name=\"node_name\" maxlength=\"32\" size=\"20\" value=\"%s\" >",
-          g_persistent.nodeName);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  char *pmkstr = ESP_MALLOC(65);
-  for (int i = 0; i < sizeof(g_persistent.pmk); i++) {
-    sprintf(pmkstr + 2 * i, "%02X", g_persistent.pmk[i]);
-  }
-  sprintf(buf,
-          "Primay key (32 bytes hex):<input type=\"password\" name=\"key\" maxlength=\"64\" size=\"20\" value=\"%s\" >",
-          pmkstr);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  ESP_FREE(pmkstr);
-
-  sprintf(buf,
-          "Startup delay:<input type=\"text\" name=\"strtdly\" value=\"%d\" maxlength=\"2\" size=\"4\">",
-          g_persistent.startDelay);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf, "<button class=\"bgrn bgrn:hover\">Save</button></fieldset></form></div>");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf, WEBPAGE_END_TEMPLATE, appDescr->version, g_persistent.nodeName);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  httpd_resp_send_chunk(req, NULL, 0);
-
-  ESP_FREE(buf);
-
-  return ESP_OK;
-}
-
-// static const httpd_uri_t cfgModule = { .uri     = "/cfgmodule",
-//                                    .method  = HTTP_GET,
-//                                    .handler = config_module_get_handler,
-//                                    .user_ctx = NULL };
-
-///////////////////////////////////////////////////////////////////////////////
-// do_config_module_get_handler
-//
-
-static esp_err_t
-do_config_module_get_handler(httpd_req_t *req)
-{
-  esp_err_t rv;
-  char *buf;
-  size_t buf_len;
-
-  // Read URL query string length and allocate memory for length + 1,
-  // extra byte for null termination
-  buf_len = httpd_req_get_url_query_len(req) + 1;
-  if (buf_len > 1) {
-    buf = ESP_MALLOC(buf_len);
-    if (httpd_req_get_url_query_str(req, buf, buf_len) == ESP_OK) {
-
-      ESP_LOGD(TAG, "Found URL query => %s", buf);
-      char *param = ESP_MALLOC(WEBPAGE_PARAM_SIZE);
-      if (NULL == param) {
-        ESP_FREE(buf);
-        return ESP_ERR_ESPNOW_NO_MEM;
-      }
-
-      // name
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "node_name", param, WEBPAGE_PARAM_SIZE))) {
-        char *pdecoded = urlDecode(param);
-        if (NULL == pdecoded) {
-          ESP_FREE(param);
-          ESP_FREE(buf);
-          return ESP_ERR_ESPNOW_NO_MEM;
-        }
-        ESP_LOGD(TAG, "Found query parameter => name=%s", pdecoded);
-        strncpy(g_persistent.nodeName, pdecoded, 31);
-        ESP_FREE(pdecoded);
-
-        // setAccessPointParameters();
-
-        // Write changed value to persistent storage
-        rv = nvs_set_str(g_nvsHandle, "node_name", g_persistent.nodeName);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update node name");
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting node_name => rv=%d", rv);
-      }
-
-      // key
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "key", param, WEBPAGE_PARAM_SIZE))) {
-        uint8_t key_info[APP_KEY_LEN];
-        ESP_LOGD(TAG, "Found query parameter => key");
-        memset(key_info, 0, APP_KEY_LEN);
-        vscp_fwhlp_hex2bin(key_info, APP_KEY_LEN, param);
-        rv = espnow_set_key(key_info);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to write key. rv=%d", rv);
-        }
-        // Write changed value to persistent storage
-        // rv = nvs_set_blob(g_nvsHandle, "pmk", g_persistent.pmk, sizeof(g_persistent.pmk));
-        // if (rv != ESP_OK) {
-        //   ESP_LOGE(TAG, "Failed to write node pmk to nvs. rv=%d", rv);
-        // }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting node_name => rv=%d", rv);
-      }
-
-      // strtdly
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "strtdly", param, WEBPAGE_PARAM_SIZE))) {
-        ESP_LOGD(TAG, "Found query parameter => strtdly=%s", param);
-        g_persistent.startDelay = atoi(param);
-        // Write changed value to persistent storage
-        rv = nvs_set_u8(g_nvsHandle, "start_delay", g_persistent.startDelay);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update start delay");
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting strtdly => rv=%d", rv);
-      }
-
-      rv = nvs_commit(g_nvsHandle);
-      if (rv != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to commit updates to nvs\n");
-      }
-
-      ESP_FREE(param);
-    }
-
-    ESP_FREE(buf);
-  }
-  const char *resp_str =
-    "<html><head><meta charset='utf-8'><meta http-equiv=\"refresh\" content=\"1;url=cfgmodule\" "
-    "/><style>" WEBPAGE_STYLE_CSS "</style></head><body><h2 class=\"name\">saving module data...</h2></body></html>";
-  httpd_resp_send(req, resp_str, HTTPD_RESP_USE_STRLEN);
-
-  return ESP_OK;
-}
-
 ///////////////////////////////////////////////////////////////////////////////
 // print_auth_mode
 //
@@ -1907,11 +1904,9 @@ do_config_wifi_get_handler(httpd_req_t *req)
         ESP_LOGD(TAG, "Found query parameter => name=%s", pdecoded);
         strncpy(g_persistent.nodeName, pdecoded, 31);
         ESP_FREE(pdecoded);
-        // Write changed value to persistent storage
-        rv = nvs_set_str(g_nvsHandle, "node_name", g_persistent.nodeName);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update node name");
-        }
+
+        // Node name is part of compiled MQTT topics
+        mqtt_compile_topics();
       }
       else {
         ESP_LOGE(TAG, "Error getting node_name => rv=%d", rv);
@@ -1921,19 +1916,14 @@ do_config_wifi_get_handler(httpd_req_t *req)
       if (ESP_OK == (rv = httpd_query_key_value(buf, "strtdly", param, WEBPAGE_PARAM_SIZE))) {
         ESP_LOGD(TAG, "Found query parameter => strtdly=%s", param);
         g_persistent.startDelay = atoi(param);
-        // Write changed value to persistent storage
-        rv = nvs_set_u8(g_nvsHandle, "start_delay", g_persistent.startDelay);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update start delay");
-        }
       }
       else {
         ESP_LOGE(TAG, "Error getting strtdly => rv=%d", rv);
       }
 
-      rv = nvs_commit(g_nvsHandle);
-      if (rv != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to commit updates to nvs\n");
+      // Write changed values to persistent storage
+      if (VSCP_ERROR_SUCCESS != cfgstore_save()) {
+        ESP_LOGE(TAG, "Failed to save configuration");
       }
 
       ESP_FREE(param);
@@ -1952,1826 +1942,1290 @@ do_config_wifi_get_handler(httpd_req_t *req)
 // ----------------------------------------------------------------------------
 
 ///////////////////////////////////////////////////////////////////////////////
-// config_espnow_get_handler
+// upd_espnow_get_handler
+//
+// Update espnow configuration settings
 //
 
-static esp_err_t
-config_espnow_get_handler(httpd_req_t *req)
-{
-  // esp_err_t rv;
-  char *buf;
-  // char *temp;
+// static esp_err_t
+// upd_espnow_get_handler(httpd_req_t *req)
+// {
+//   char *buf;
+//   size_t buf_len;
 
-  char *req_buf;
-  size_t req_buf_len;
+//   // Get header value string length and allocate memory for length + 1,
+//   // extra byte for null termination
+//   buf_len = httpd_req_get_hdr_value_len(req, "Host") + 1;
+//   if (buf_len > 1) {
+//     buf = ESP_MALLOC(buf_len);
+//     // Copy null terminated value string into buffer
+//     if (httpd_req_get_hdr_value_str(req, "Host", buf, buf_len) == ESP_OK) {
+//       ESP_LOGD(TAG, "Found header => Host: %s", buf);
+//     }
+//     ESP_FREE(buf)
+//   }
 
-  buf = (char *) ESP_CALLOC(1,CHUNK_BUFSIZE);
-  if (NULL == buf) {
-    return ESP_ERR_NO_MEM;
-  }
+//   // Read URL query string length and allocate memory for length + 1,
+//   // extra byte for null termination
 
-  // Get application info data
-  const esp_app_desc_t *appDescr = esp_app_get_description();
-
-  // Get header value string length and allocate memory for length + 1,
-  // extra byte for null termination
-  req_buf_len = httpd_req_get_hdr_value_len(req, "Host") + 1;
-  if (req_buf_len > 1) {
-    req_buf = ESP_MALLOC(req_buf_len);
-    // Copy null terminated value string into buffer
-    if (httpd_req_get_hdr_value_str(req, "Host", req_buf, req_buf_len) == ESP_OK) {
-      ESP_LOGD(TAG, "Found header => Host: %s", req_buf);
-    }
-    ESP_FREE(req_buf);
-  }
-
-  sprintf(buf, WEBPAGE_START_TEMPLATE, g_persistent.nodeName, "ESPNOW Configuration");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf, "<div><form id=but3 class=\"button\" action='/docfgespnow' method='get'><fieldset>");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  // Enable
-  sprintf(buf, "<input type=\"checkbox\" name=\"enable\" value=\"true\" ");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  sprintf(buf, "%s><label for=\"lr\"> Enable</label>", g_persistent.espnowEnable ? "checked" : "");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  // Long range
-  sprintf(buf, "<br><input type=\"checkbox\" name=\"lr\" value=\"true\" ");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  sprintf(buf, "%s><label for=\"lr\"> Enable Long Range</label>", g_persistent.espnowLongRange ? "checked" : "");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  // Forward
-  sprintf(buf, "<br><input type=\"checkbox\" name=\"fw\" value=\"true\" ");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  sprintf(buf, "%s><label for=\"fw\"> Enable Frame Forward</label>", g_persistent.espnowForwardEnable ? "checked" : "");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  // Filter Adj Channel
-  sprintf(buf, "<br><input type=\"checkbox\" name=\"adjf\" value=\"true\" ");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  sprintf(buf,
-          "%s><label for=\"adjf\"> Filter Adj. Channel</label>",
-          g_persistent.espnowFilterAdjacentChannel ? "checked" : "");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  // Forward switch channel
-  sprintf(buf, "<br><input type=\"checkbox\" name=\"swchf\" value=\"true\" ");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  sprintf(buf,
-          "%s><label for=\"swchf\"> Forward Switch Channel</label>",
-          g_persistent.espnowForwardSwitchChannel ? "checked" : "");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  /*
-    // Encryption
-    sprintf(buf, "<br />Encryption:<select  name=\"enc\" >");
-    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-    sprintf(buf,
-            "<option value=\"0\" %s>None</option>",
-            (VSCP_ENCRYPTION_NONE == g_persistent.espnowEncryption) ? "selected" : "");
-    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-    sprintf(buf,
-            "<option value=\"1\" %s>AES-128</option>",
-            (VSCP_ENCRYPTION_AES128 == g_persistent.espnowEncryption) ? "selected" : "");
-    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-    sprintf(buf,
-            "<option value=\"2\" %s>AES-192</option>",
-            (VSCP_ENCRYPTION_AES192 == g_persistent.espnowEncryption) ? "selected" : "");
-    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-    sprintf(buf,
-            "<option value=\"3\" %s>AES-256</option>",
-            (VSCP_ENCRYPTION_AES256 == g_persistent.espnowEncryption) ? "selected" : "");
-    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-    sprintf(buf, "</select>");
-    httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  */
-
-  sprintf(buf, "<br>Queue size (32):<input type=\"text\" name=\"qsize\" value=\"%d\" >", g_persistent.espnowSizeQueue);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf,
-          "<br>Use channel (0 is current):<input type=\"text\" name=\"channel\" value=\"%d\" >",
-          g_persistent.espnowChannel);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf, "<br>Time to live (32):<input type=\"text\" name=\"ttl\" value=\"%d\" >", g_persistent.espnowTtl);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf,
-          "<br>Filter on RSSI (-67):<input type=\"text\" name=\"rssi\" value=\"%d\" >",
-          g_persistent.espnowFilterWeakSignal);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf, "<button class=\"bgrn bgrn:hover\">Save</button></fieldset></form></div><br>");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf, WEBPAGE_END_TEMPLATE, appDescr->version, g_persistent.nodeName);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  httpd_resp_send_chunk(req, NULL, 0);
-
-  ESP_FREE(buf);
-
-  return ESP_OK;
-}
-
-///////////////////////////////////////////////////////////////////////////////
-// do_config_espnow_get_handler
-//
-
-static esp_err_t
-do_config_espnow_get_handler(httpd_req_t *req)
-{
-  esp_err_t rv;
-  char *buf;
-  size_t buf_len;
-
-  // Read URL query string length and allocate memory for length + 1,
-  // extra byte for null termination
-  buf_len = httpd_req_get_url_query_len(req) + 1;
-  if (buf_len > 1) {
-    buf = ESP_MALLOC(buf_len);
-    if (httpd_req_get_url_query_str(req, buf, buf_len) == ESP_OK) {
-
-      ESP_LOGD(TAG, "Found URL query => %s", buf);
-      char *param = ESP_MALLOC(WEBPAGE_PARAM_SIZE);
-      if (NULL == param) {
-        return ESP_ERR_ESPNOW_NO_MEM;
-        ESP_FREE(param);
-      }
-
-      // Enable
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "enable", param, WEBPAGE_PARAM_SIZE))) {
-        ESP_LOGD(TAG, "Found query parameter => enable=%s", param);
-        if (NULL != strstr(param, "true")) {
-          g_persistent.espnowEnable = true;
-        }
-      }
-      else {
-        g_persistent.espnowEnable = false;
-      }
-
-      // Write changed value to persistent storage
-      rv = nvs_set_u8(g_nvsHandle, "drop_enable", g_persistent.espnowEnable);
-      if (rv != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to update espnow enable");
-      }
-
-      // Long range
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "lr", param, WEBPAGE_PARAM_SIZE))) {
-        ESP_LOGD(TAG, "Found query parameter => lr=%s", param);
-        if (NULL != strstr(param, "true")) {
-          g_persistent.espnowLongRange = true;
-        }
-      }
-      else {
-        g_persistent.espnowLongRange = false;
-      }
-
-      // Write changed value to persistent storage
-      rv = nvs_set_u8(g_nvsHandle, "drop_lr", g_persistent.espnowLongRange);
-      if (rv != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to update espnow long range");
-      }
-
-      // Forward
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "fw", param, WEBPAGE_PARAM_SIZE))) {
-        ESP_LOGD(TAG, "Found query parameter => fw=%s", param);
-        if (NULL != strstr(param, "true")) {
-          g_persistent.espnowForwardEnable = true;
-        }
-        else {
-          g_persistent.espnowForwardEnable = false;
-        }
-      }
-      else {
-        g_persistent.espnowForwardEnable = false;
-      }
-
-      // Write changed value to persistent storage
-      rv = nvs_set_u8(g_nvsHandle, "drop_fw", g_persistent.espnowForwardEnable);
-      if (rv != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to update espnow forward");
-      }
-
-      // Filter Adj. Channel
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "adjf", param, WEBPAGE_PARAM_SIZE))) {
-        ESP_LOGD(TAG, "Found query parameter => adjf=%s", param);
-        if (NULL != strstr(param, "true")) {
-          g_persistent.espnowFilterAdjacentChannel = true;
-        }
-        else {
-          g_persistent.espnowFilterAdjacentChannel = false;
-        }
-      }
-      else {
-        g_persistent.espnowFilterAdjacentChannel = false;
-      }
-
-      // Write changed value to persistent storage
-      rv = nvs_set_u8(g_nvsHandle, "drop_filt", g_persistent.espnowFilterAdjacentChannel);
-      if (rv != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to update espnow adj. freq. filter");
-      }
-
-      // Allow switching channel on forward
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "swchf", param, WEBPAGE_PARAM_SIZE))) {
-        ESP_LOGD(TAG, "Found query parameter => swchf=%s", param);
-        if (NULL != strstr(param, "true")) {
-          g_persistent.espnowForwardSwitchChannel = true;
-        }
-        else {
-          g_persistent.espnowForwardSwitchChannel = false;
-        }
-      }
-      else {
-        g_persistent.espnowForwardSwitchChannel = false;
-      }
-
-      // Write changed value to persistent storage
-      rv = nvs_set_u8(g_nvsHandle, "drop_swchf", g_persistent.espnowForwardSwitchChannel);
-      if (rv != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to update espnow adj. freq. filter");
-      }
-
-      // channel
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "channel", param, WEBPAGE_PARAM_SIZE))) {
-        ESP_LOGD(TAG, "Found query parameter => channel=%s", param);
-        g_persistent.espnowChannel = atoi(param);
-        // Write changed value to persistent storage
-        rv = nvs_set_u8(g_nvsHandle, "drop_ch", g_persistent.espnowChannel);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update espnow channel");
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting espnow channel => rv=%d", rv);
-      }
-
-      // ttl
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "ttl", param, WEBPAGE_PARAM_SIZE))) {
-        ESP_LOGD(TAG, "Found query parameter => ttl=%s", param);
-        g_persistent.espnowTtl = atoi(param);
-        // Write changed value to persistent storage
-        rv = nvs_set_u8(g_nvsHandle, "drop_ttl", g_persistent.espnowTtl);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update espnow ttl");
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting espnow ttl => rv=%d", rv);
-      }
-
-      // Queue size
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "qsize", param, WEBPAGE_PARAM_SIZE))) {
-        ESP_LOGD(TAG, "Found query parameter => qsize=%s", param);
-        g_persistent.espnowSizeQueue = atoi(param);
-        // Write changed value to persistent storage
-        rv = nvs_set_u8(g_nvsHandle, "drop_qsize", g_persistent.espnowSizeQueue);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update espnow qsize");
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting espnow queue size => rv=%d", rv);
-      }
-
-      // rssi
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "rssi", param, WEBPAGE_PARAM_SIZE))) {
-        ESP_LOGD(TAG, "Found query parameter => rssi=%s", param);
-        g_persistent.espnowFilterWeakSignal = atoi(param);
-        // Make shure it's negative
-        if (g_persistent.espnowFilterWeakSignal > 0) {
-          g_persistent.espnowFilterWeakSignal *= -1;
-        }
-        // Write changed value to persistent storage
-        rv = nvs_set_i8(g_nvsHandle, "drop_rssi", g_persistent.espnowFilterWeakSignal);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update espnow rssi");
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting espnow rssi => rv=%d", rv);
-      }
-
-      /*
-            // Encryption
-            if (ESP_OK == (rv = httpd_query_key_value(buf, "enc", param, WEBPAGE_PARAM_SIZE))) {
-              ESP_LOGD(TAG, "Found query parameter => enc=%s", param);
-              g_persistent.espnowEncryption = atoi(param);
-              rv                             = nvs_set_u8(g_nvsHandle, "drop_enc", g_persistent.espnowEncryption);
-              if (rv != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to update espnow encryption");
-              }
-            }
-            else {
-              ESP_LOGE(TAG, "Error getting espnow enc => rv=%d", rv);
-            }
-      */
-      rv = nvs_commit(g_nvsHandle);
-      if (rv != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to commit updates to nvs\n");
-      }
-
-      ESP_FREE(param);
-    }
+//   buf_len = httpd_req_get_url_query_len(req) + 1;
+//   if (buf_len > 1) {
+//     buf = ESP_MALLOC(buf_len);
+//     if (httpd_req_get_url_query_str(req, buf, buf_len) == ESP_OK) {
+//       ESP_LOGD(TAG, "Found URL query => %s", buf);
+//       char param[33];
+//       // Get value of expected key from query string
+//       if (httpd_query_key_value(buf, "key", param, sizeof(param)) == ESP_OK) {
+//         ESP_LOGD(TAG, "Found URL query parameter => key=%s", param);
+//       }
+//       if (httpd_query_key_value(buf, "ttl", param, sizeof(param)) == ESP_OK) {
+//         ESP_LOGD(TAG, "Found URL query parameter => ttl=%s", param);
+//       }
+//       // Enable packet forward functionality
+//       if (httpd_query_key_value(buf, "bforward", param, sizeof(param)) == ESP_OK) {
+//         ESP_LOGD(TAG, "Found URL query parameter => bforward=%s", param);
+//       }
+//       else {
+//         // Key 'bforward' is not found
+//       }
+//       // Enable Long Range
+//       if (httpd_query_key_value(buf, "blr", param, sizeof(param)) == ESP_OK) {
+//         ESP_LOGD(TAG, "Found URL query parameter => blr=%s", param);
+//       }
+//       else {
+//         // Key 'blr' is not found
+//       }
+//     }
+//     ESP_FREE(buf)
+//   }
 
-    ESP_FREE(buf);
-  }
-  const char *resp_str =
-    "<html><head><meta charset='utf-8'><meta http-equiv=\"refresh\" content=\"1;url=cfgespnow\" "
-    "/><style>" WEBPAGE_STYLE_CSS "</style></head><body><h2 class=\"name\">saving espnow data...</h2></body></html>";
-  httpd_resp_send(req, resp_str, HTTPD_RESP_USE_STRLEN);
+//   // httpd_resp_set_hdr(req, "Custom-Header-1", "Custom-Value-1");
 
-  return ESP_OK;
-}
+//   // Send response with custom headers and body set as the
+//   // string passed in user context
+//   const char *resp_str =
+//     "<html><head><meta http-equiv=\"refresh\" content=\"0; url='index.html'\" /></head><body>Save<body></html>";
+//   httpd_resp_send(req, resp_str, HTTPD_RESP_USE_STRLEN);
 
-// ----------------------------------------------------------------------------
+//   return ESP_OK;
+// }
 
 ///////////////////////////////////////////////////////////////////////////////
-// config_vscplink_get_handler
+// echo_post_handler
 //
-
-static esp_err_t
-config_vscplink_get_handler(httpd_req_t *req)
-{
-  // esp_err_t rv;
-  char *buf;
-  // char *temp;
-
-  char *req_buf;
-  size_t req_buf_len;
-
-  buf = (char *) ESP_CALLOC(1,CHUNK_BUFSIZE);
-  if (NULL == buf) {
-    return ESP_ERR_NO_MEM;
-  }
-
-  // Get application info data
-  const esp_app_desc_t *appDescr = esp_app_get_description();
-
-  // Get header value string length and allocate memory for length + 1,
-  // extra byte for null termination
-  req_buf_len = httpd_req_get_hdr_value_len(req, "Name") + 1;
-  if (req_buf_len > 1) {
-    req_buf = ESP_MALLOC(req_buf_len);
-    // Copy null terminated value string into buffer
-    if (httpd_req_get_hdr_value_str(req, "Host", req_buf, req_buf_len) == ESP_OK) {
-      ESP_LOGD(TAG, "Found header => Host: %s", req_buf);
-    }
-    ESP_FREE(req_buf);
-  }
-
-  sprintf(buf, WEBPAGE_START_TEMPLATE, g_persistent.nodeName, "VSCP Link Configuration");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf, "<div><form id=but3 class=\"button\" action='/docfgvscplink' method='get'><fieldset>");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  // Enable
-  sprintf(buf, "<input type=\"checkbox\" name=\"enable\" value=\"true\" ");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  sprintf(buf, "%s><label for=\"lr\"> Enable</label>", g_persistent.vscplinkEnable ? "checked" : "");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf, "<br><br>Host:<input type=\"text\" name=\"url\" value=\"%s\" >", g_persistent.vscplinkUrl);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf, "Port:<input type=\"text\" name=\"port\" value=\"%d\" >", g_persistent.vscplinkPort);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf, "Username:<input type=\"text\" name=\"user\" value=\"%s\" >", g_persistent.vscplinkUsername);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf, "Password:<input type=\"password\" name=\"password\" value=\"%s\" >", g_persistent.vscplinkPassword);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  char *pmkstr = ESP_MALLOC(65);
-  for (int i = 0; i < 32; i++) {
-    sprintf(pmkstr + 2 * i, "%02X", g_persistent.vscpLinkKey[i]);
-  }
-  sprintf(buf, "Security key (32 bytes hex):<input type=\"password\" name=\"key\" maxlength=\"64\" value=\"%s\" >", pmkstr);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  ESP_FREE(pmkstr);
-
-  sprintf(buf, "<button class=\"bgrn bgrn:hover\">Save</button></fieldset></form></div>");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf, WEBPAGE_END_TEMPLATE, appDescr->version, g_persistent.nodeName);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  httpd_resp_send_chunk(req, NULL, 0);
-
-  ESP_FREE(buf);
-
-  return ESP_OK;
-}
-
-///////////////////////////////////////////////////////////////////////////////
-// do_config_vscplink_get_handler
+// An HTTP POST handler
 //
 
 static esp_err_t
-do_config_vscplink_get_handler(httpd_req_t *req)
+echo_post_handler(httpd_req_t *req)
 {
-  esp_err_t rv;
-  char *buf;
-  size_t buf_len;
-
-  // Read URL query string length and allocate memory for length + 1,
-  // extra byte for null termination
-  buf_len = httpd_req_get_url_query_len(req) + 1;
-  if (buf_len > 1) {
-    buf = ESP_MALLOC(buf_len);
-    if (httpd_req_get_url_query_str(req, buf, buf_len) == ESP_OK) {
-
-      ESP_LOGD(TAG, "Found URL query => %s", buf);
-      char *param = ESP_MALLOC(WEBPAGE_PARAM_SIZE);
-      if (NULL == param) {
-        return ESP_ERR_ESPNOW_NO_MEM;
-        ESP_FREE(param);
-      }
-
-      // Enable
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "enable", param, WEBPAGE_PARAM_SIZE))) {
-        ESP_LOGD(TAG, "Found query parameter => enable=%s", param);
-        if (NULL != strstr(param, "true")) {
-          g_persistent.vscplinkEnable = true;
-        }
-      }
-      else {
-        g_persistent.vscplinkEnable = false;
-      }
-
-      // Write changed value to persistent storage
-      rv = nvs_set_u8(g_nvsHandle, "vscp_enable", g_persistent.vscplinkEnable);
-      if (rv != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to update vscp link enable");
-      }
-
-      // url
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "url", param, WEBPAGE_PARAM_SIZE))) {
-        ESP_LOGD(TAG, "Found query parameter => url=%s", param);
-        strncpy(g_persistent.vscplinkUrl, param, sizeof(g_persistent.vscplinkUrl) - 1);
-        // Write changed value to persistent storage
-        rv = nvs_set_str(g_nvsHandle, "vscp_url", g_persistent.vscplinkUrl);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update VSCP link url");
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting VSCP link URL => rv=%d", rv);
-      }
-
-      // port
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "port", param, WEBPAGE_PARAM_SIZE))) {
-        ESP_LOGD(TAG, "Found query parameter => port=%s", param);
-        g_persistent.vscplinkPort = atoi(param);
-        // Write changed value to persistent storage
-        rv = nvs_set_u16(g_nvsHandle, "vscp_port", g_persistent.vscplinkPort);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update VSCP link port");
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting VSCP link port => rv=%d", rv);
-      }
-
-      // username
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "user", param, WEBPAGE_PARAM_SIZE))) {
-        char *pdecoded = urlDecode(param);
-        if (NULL == pdecoded) {
-          ESP_FREE(param);
-          ESP_FREE(buf);
-          return ESP_ERR_ESPNOW_NO_MEM;
-        }
-        ESP_LOGD(TAG, "Found query parameter => user=%s", pdecoded);
-        strncpy(g_persistent.vscplinkUsername, pdecoded, sizeof(g_persistent.vscplinkUsername) - 1);
-        // Write changed value to persistent storage
-        rv = nvs_set_str(g_nvsHandle, "vscp_user", g_persistent.vscplinkUsername);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update VSCP link user");
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting VSCP link username => rv=%d", rv);
-      }
-
-      // password
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "password", param, WEBPAGE_PARAM_SIZE))) {
-        char *pdecoded = urlDecode(param);
-        if (NULL == pdecoded) {
-          ESP_FREE(param);
-          ESP_FREE(buf);
-          return ESP_ERR_ESPNOW_NO_MEM;
-        }
-        ESP_LOGD(TAG, "Found query parameter => password=%s", pdecoded);
-        strncpy(g_persistent.vscplinkPassword, pdecoded, sizeof(g_persistent.vscplinkPassword) - 1);
-        // Write changed value to persistent storage
-        rv = nvs_set_str(g_nvsHandle, "vscp_password", g_persistent.vscplinkPassword);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update VSCP link password err=%02X", rv);
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting VSCP link password => rv=%d", rv);
-      }
-
-      // key
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "key", param, WEBPAGE_PARAM_SIZE))) {
-        ESP_LOGD(TAG, "Found query parameter => key=%s", param);
-        memset(g_persistent.vscpLinkKey, 0, 32);
-        vscp_fwhlp_hex2bin(g_persistent.vscpLinkKey, 32, param);
-
-        // Write changed value to persistent storage
-        rv = nvs_set_blob(g_nvsHandle, "vscp_key", g_persistent.vscpLinkKey, sizeof(g_persistent.vscpLinkKey));
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to write VSCP link key to nvs. rv=%d", rv);
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting VSCP link key => rv=%d", rv);
-      }
+  char buf[100];
+  int ret, remaining = req->content_len;
 
-      rv = nvs_commit(g_nvsHandle);
-      if (rv != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to commit updates to nvs\n");
+  while (remaining > 0) {
+    // Read the data for the request
+    if ((ret = httpd_req_recv(req, buf, MIN(remaining, sizeof(buf)))) <= 0) {
+      if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+        // Retry receiving if timeout occurred
+        continue;
       }
-
-      ESP_FREE(param);
+      return ESP_FAIL;
     }
 
-    ESP_FREE(buf);
+    // Send back the same data
+    httpd_resp_send_chunk(req, buf, ret);
+    remaining -= ret;
+
+    // Log data received
+    ESP_LOGD(TAG, "=========== RECEIVED DATA ==========");
+    ESP_LOGD(TAG, "%.*s", ret, buf);
+    ESP_LOGD(TAG, "====================================");
   }
-  const char *resp_str =
-    "<html><head><meta charset='utf-8'><meta http-equiv=\"refresh\" content=\"1;url=cfgvscplink\" "
-    "/><style>" WEBPAGE_STYLE_CSS "</style></head><body><h2 class=\"name\">saving module data...</h2></body></html>";
-  httpd_resp_send(req, resp_str, HTTPD_RESP_USE_STRLEN);
 
+  // End response
+  httpd_resp_send_chunk(req, NULL, 0);
   return ESP_OK;
 }
 
-// ----------------------------------------------------------------------------
+static const httpd_uri_t echo = { .uri = "/echo", .method = HTTP_POST, .handler = echo_post_handler, .user_ctx = NULL };
 
 ///////////////////////////////////////////////////////////////////////////////
-// config_mqtt_get_handler
+// http_404_error_handler
+//
+// This handler allows the custom error handling functionality to be
+// tested from client side. For that, when a PUT request 0 is sent to
+// URI /ctrl, the /hello and /echo URIs are unregistered and following
+// custom error handler http_404_error_handler() is registered.
+// Afterwards, when /hello or /echo is requested, this custom error
+// handler is invoked which, after sending an error message to client,
+// either closes the underlying socket (when requested URI is /echo)
+// or keeps it open (when requested URI is /hello). This allows the
+// client to infer if the custom error handler is functioning as expected
+// by observing the socket state.
 //
 
-static esp_err_t
-config_mqtt_get_handler(httpd_req_t *req)
+esp_err_t
+http_404_error_handler(httpd_req_t *req, httpd_err_code_t err)
 {
-  // esp_err_t rv;
-  char *buf;
-  // char *temp;
-
-  char *req_buf;
-  size_t req_buf_len;
-
-  buf = (char *) ESP_CALLOC(1,CHUNK_BUFSIZE);
-  if (NULL == buf) {
-    return ESP_ERR_NO_MEM;
+  if (strcmp("/hello", req->uri) == 0) {
+    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "/hello URI is not available");
+    // Return ESP_OK to keep underlying socket open
+    return ESP_OK;
   }
-
-  // Get application info data
-  const esp_app_desc_t *appDescr = esp_app_get_description();
-
-  // Get header value string length and allocate memory for length + 1,
-  // extra byte for null termination
-  req_buf_len = httpd_req_get_hdr_value_len(req, "Host") + 1;
-  if (req_buf_len > 1) {
-    req_buf = ESP_MALLOC(req_buf_len);
-    // Copy null terminated value string into buffer
-    if (httpd_req_get_hdr_value_str(req, "Host", req_buf, req_buf_len) == ESP_OK) {
-      ESP_LOGD(TAG, "Found header => Host: %s", req_buf);
-    }
-    ESP_FREE(req_buf);
+  else if (strcmp("/echo", req->uri) == 0) {
+    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "/echo URI is not available");
+    // Return ESP_FAIL to close underlying socket
+    return ESP_FAIL;
   }
+  // For any other URI send 404 and close socket
+  httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Some 404 error message");
+  return ESP_FAIL;
+}
 
-  sprintf(buf, WEBPAGE_START_TEMPLATE, g_persistent.nodeName, "MQTT Configuration");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf, "<div><form id=but3 class=\"button\" action='/docfgmqtt' method='get'><fieldset>");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  // Enable
-  sprintf(buf, "<input type=\"checkbox\" name=\"enable\" value=\"true\" ");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  sprintf(buf, "%s><label for=\"lr\"> Enable</label>", g_persistent.mqttEnable ? "checked" : "");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf, "<br><br>Host:<input type=\"text\" name=\"url\" value=\"%s\" >", g_persistent.mqttUrl);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf, "Port:<input type=\"text\" name=\"port\" value=\"%d\" >", g_persistent.mqttPort);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf, "Client id:<input type=\"text\" name=\"client\" value=\"%s\" >", g_persistent.mqttClientid);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf, "Username:<input type=\"text\" name=\"user\" value=\"%s\" >", g_persistent.mqttUsername);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf, "Password:<input type=\"password\" name=\"password\" value=\"%s\" >", g_persistent.mqttPassword);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf, "Subscribe:<input type=\"text\" name=\"sub\" value=\"%s\" >", g_persistent.mqttSub);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf, "Publish:<input type=\"text\" name=\"pub\" value=\"%s\" >", g_persistent.mqttPub);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf, "<button class=\"bgrn bgrn:hover\">Save</button></fieldset></form></div>");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+///////////////////////////////////////////////////////////////////////////////
+// ctrl_put_handler
+//
+// An HTTP PUT handler. This demonstrates realtime
+// registration and deregistration of URI handlers
+//
 
-  sprintf(buf, WEBPAGE_END_TEMPLATE, appDescr->version, g_persistent.nodeName);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+static esp_err_t
+ctrl_put_handler(httpd_req_t *req)
+{
+  char buf;
+  int ret;
 
-  httpd_resp_send_chunk(req, NULL, 0);
+  if ((ret = httpd_req_recv(req, &buf, 1)) <= 0) {
+    if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+      httpd_resp_send_408(req);
+    }
+    return ESP_FAIL;
+  }
 
-  ESP_FREE(buf);
+  if (buf == '0') {
+    // URI handlers can be unregistered using the uri string
+    ESP_LOGD(TAG, "Unregistering /hello and /echo URIs");
+    httpd_unregister_uri(req->handle, "/hello");
+    httpd_unregister_uri(req->handle, "/echo");
+    // Register the custom error handler
+    httpd_register_err_handler(req->handle, HTTPD_404_NOT_FOUND, http_404_error_handler);
+  }
+  else {
+    ESP_LOGD(TAG, "Registering /hello and /echo URIs");
+    httpd_register_uri_handler(req->handle, &hello);
+    httpd_register_uri_handler(req->handle, &echo);
+    // Unregister custom error handler
+    httpd_register_err_handler(req->handle, HTTPD_404_NOT_FOUND, NULL);
+  }
 
+  // Respond with empty body
+  httpd_resp_send(req, NULL, 0);
   return ESP_OK;
 }
 
+// static const httpd_uri_t ctrl = { .uri = "/ctrl", .method = HTTP_PUT, .handler = ctrl_put_handler, .user_ctx =
+// NULL
+// };
+
 ///////////////////////////////////////////////////////////////////////////////
-// do_config_mqtt_get_handler
+// set_content_type_from_file
+//
+// Set HTTP response content type according to file extension
 //
 
 static esp_err_t
-do_config_mqtt_get_handler(httpd_req_t *req)
+set_content_type_from_file(httpd_req_t *req, const char *filename)
 {
-  esp_err_t rv;
-  char *buf;
-  size_t buf_len;
-
-  // Read URL query string length and allocate memory for length + 1,
-  // extra byte for null termination
-  buf_len = httpd_req_get_url_query_len(req) + 1;
-  if (buf_len > 1) {
-    buf = ESP_MALLOC(buf_len);
-    if (httpd_req_get_url_query_str(req, buf, buf_len) == ESP_OK) {
+  if (IS_FILE_EXT(filename, ".gz")) {
+    return httpd_resp_set_type(req, "application/gzip");
+  }
+  else if (IS_FILE_EXT(filename, ".html")) {
+    return httpd_resp_set_type(req, "text/html");
+  }
+  else if (IS_FILE_EXT(filename, ".css")) {
+    return httpd_resp_set_type(req, "text/css");
+  }
+  else if (IS_FILE_EXT(filename, ".jpeg")) {
+    return httpd_resp_set_type(req, "image/jpeg");
+  }
+  else if (IS_FILE_EXT(filename, ".png")) {
+    return httpd_resp_set_type(req, "image/png");
+  }
+  else if (IS_FILE_EXT(filename, ".ico")) {
+    return httpd_resp_set_type(req, "image/x-icon");
+  }
+  else if (IS_FILE_EXT(filename, ".js")) {
+    return httpd_resp_set_type(req, "text/javascript");
+  }
+  // For any other type always set as plain text
+  return httpd_resp_set_type(req, "text/plain");
+}
 
-      ESP_LOGD(TAG, "Found URL query => %s", buf);
-      char *param = ESP_MALLOC(WEBPAGE_PARAM_SIZE);
-      if (NULL == param) {
-        return ESP_ERR_ESPNOW_NO_MEM;
-        ESP_FREE(param);
-      }
+// ----------------------------------------------------------------------------
+//                              Static files
+// ----------------------------------------------------------------------------
 
-      // Enable
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "enable", param, WEBPAGE_PARAM_SIZE))) {
-        ESP_LOGD(TAG, "Found query parameter => enable=%s", param);
-        if (NULL != strstr(param, "true")) {
-          g_persistent.mqttEnable = true;
-        }
-      }
-      else {
-        g_persistent.mqttEnable = false;
-      }
+/*
+  Static files (style sheet, scripts, icons) are stored gzipped in the web
+  partition by the build. They are public and served without authentication.
+  A file is read from flash the first time it is requested and is then served
+  from RAM as long as it fits in the cache. The ETag is a hash of the content
+  so browsers can revalidate with a cheap conditional request.
 
-      // Write changed value to persistent storage
-      nvs_set_u8(g_nvsHandle, "mqtt_enable", g_persistent.mqttEnable);
-      if (rv != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to update MQTT enable");
-      }
+  The httpd server runs all handlers in one task so no locking is needed.
+*/
 
-      // url
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "url", param, WEBPAGE_PARAM_SIZE))) {
-        char *pdecoded = urlDecode(param);
-        if (NULL == pdecoded) {
-          ESP_FREE(param);
-          ESP_FREE(buf);
-          return ESP_ERR_ESPNOW_NO_MEM;
-        }
-        ESP_LOGD(TAG, "Found query parameter => url=%s", pdecoded);
-        strncpy(g_persistent.mqttUrl, pdecoded, sizeof(g_persistent.mqttUrl) - 1);
-        ESP_FREE(pdecoded);
-        // Write changed value to persistent storage
-        rv = nvs_set_str(g_nvsHandle, "mqtt_url", g_persistent.mqttUrl);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update MQTT url");
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting MQTT URL => rv=%d", rv);
-      }
+#define STATIC_BASE_PATH "/www"
+#define STATIC_MAX_FILES 8
+#define STATIC_ETAG_LEN  20
 
-      // port
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "port", param, WEBPAGE_PARAM_SIZE))) {
-        ESP_LOGD(TAG, "Found query parameter => port=%s", param);
-        g_persistent.mqttPort = atoi(param);
-        // Write changed value to persistent storage
-        rv = nvs_set_u16(g_nvsHandle, "mqtt_port", g_persistent.mqttPort);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update MQTT port");
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting MQTT port => rv=%d", rv);
-      }
+typedef struct {
+  char uri[CONFIG_SPIFFS_OBJ_NAME_LEN]; // Request path
+  char etag[STATIC_ETAG_LEN];           // Quoted content hash
+  bool bGzip;                           // Content is gzip encoded
+  size_t len;                           // Content length
+  uint8_t *pdata;                       // Content
+} static_file_t;
 
-      // clientid
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "client", param, WEBPAGE_PARAM_SIZE))) {
-        char *pdecoded = urlDecode(param);
-        if (NULL == pdecoded) {
-          ESP_FREE(param);
-          ESP_FREE(buf);
-          return ESP_ERR_ESPNOW_NO_MEM;
-        }
-        ESP_LOGD(TAG, "Found query parameter => clientid=%s", pdecoded);
-        strncpy(g_persistent.mqttClientid, pdecoded, sizeof(g_persistent.mqttClientid) - 1);
-        // Write changed value to persistent storage
-        rv = nvs_set_str(g_nvsHandle, "mqtt_cid", g_persistent.mqttClientid);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update MQTT clientid");
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting MQTT clientid => rv=%d", rv);
-      }
+static static_file_t s_staticFiles[STATIC_MAX_FILES];
+static int s_cntStaticFiles     = 0;
+static size_t s_sizeStaticCache = 0;
 
-      // user
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "user", param, WEBPAGE_PARAM_SIZE))) {
-        char *pdecoded = urlDecode(param);
-        if (NULL == pdecoded) {
-          ESP_FREE(param);
-          ESP_FREE(buf);
-          return ESP_ERR_ESPNOW_NO_MEM;
-        }
-        ESP_LOGD(TAG, "Found query parameter => user=%s", pdecoded);
-        strncpy(g_persistent.mqttUsername, pdecoded, sizeof(g_persistent.mqttUsername) - 1);
-        // Write changed value to persistent storage
-        rv = nvs_set_str(g_nvsHandle, "mqtt_user", g_persistent.mqttUsername);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update MQTT user");
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting MQTT user => rv=%d", rv);
-      }
+///////////////////////////////////////////////////////////////////////////////
+// is_static_uri
+//
+// Check if an URI refers to a static file
+//
 
-      // password
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "password", param, WEBPAGE_PARAM_SIZE))) {
-        char *pdecoded = urlDecode(param);
-        if (NULL == pdecoded) {
-          ESP_FREE(param);
-          ESP_FREE(buf);
-          return ESP_ERR_ESPNOW_NO_MEM;
-        }
-        ESP_LOGD(TAG, "Found query parameter => password=%s", pdecoded);
-        strncpy(g_persistent.mqttPassword, pdecoded, sizeof(g_persistent.mqttPassword) - 1);
-        // Write changed value to persistent storage
-        rv = nvs_set_str(g_nvsHandle, "mqtt_password", g_persistent.mqttPassword);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update MQTT password");
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting MQTT password => rv=%d", rv);
-      }
+static bool
+is_static_uri(const char *uri)
+{
+  char path[CONFIG_SPIFFS_OBJ_NAME_LEN];
+  size_t len = strcspn(uri, "?#");
 
-      // Subscribe
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "sub", param, WEBPAGE_PARAM_SIZE))) {
-        char *pdecoded = urlDecode(param);
-        if (NULL == pdecoded) {
-          ESP_FREE(param);
-          ESP_FREE(buf);
-          return ESP_ERR_ESPNOW_NO_MEM;
-        }
-        ESP_LOGD(TAG, "Found query parameter => sub=%s", pdecoded);
-        strncpy(g_persistent.mqttSub, pdecoded, sizeof(g_persistent.mqttSub) - 1);
-        ESP_FREE(pdecoded);
-        // Write changed value to persistent storage
-        rv = nvs_set_str(g_nvsHandle, "mqtt_sub", g_persistent.mqttSub);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update MQTT sub");
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting MQTT sub => rv=%d", rv);
-      }
+  if (len >= sizeof(path)) {
+    return false;
+  }
 
-      // Publish
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "pub", param, WEBPAGE_PARAM_SIZE))) {
-        char *pdecoded = urlDecode(param);
-        if (NULL == pdecoded) {
-          ESP_FREE(param);
-          ESP_FREE(buf);
-          return ESP_ERR_ESPNOW_NO_MEM;
-        }
-        ESP_LOGD(TAG, "Found query parameter => pub=%s", pdecoded);
-        strncpy(g_persistent.mqttPub, pdecoded, sizeof(g_persistent.mqttPub) - 1);
-        ESP_FREE(pdecoded);
-        // Write changed value to persistent storage
-        rv = nvs_set_str(g_nvsHandle, "mqtt_pub", g_persistent.mqttPub);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update MQTT pub");
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting MQTT pub => rv=%d", rv);
-      }
+  strlcpy(path, uri, len + 1);
 
-      rv = nvs_commit(g_nvsHandle);
-      if (rv != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to commit updates to nvs\n");
-      }
+  return IS_FILE_EXT(path, ".css") || IS_FILE_EXT(path, ".js") || IS_FILE_EXT(path, ".ico") ||
+         IS_FILE_EXT(path, ".png") || IS_FILE_EXT(path, ".jpeg");
+}
 
-      ESP_FREE(param);
-    }
+///////////////////////////////////////////////////////////////////////////////
+// make_etag
+//
+// FNV-1a hash of content as a quoted ETag
+//
 
-    ESP_FREE(buf);
-  }
-  const char *resp_str =
-    "<html><head><meta charset='utf-8'><meta http-equiv=\"refresh\" content=\"1;url=cfgmqtt\" "
-    "/><style>" WEBPAGE_STYLE_CSS "</style></head><body><h2 class=\"name\">saving module data...</h2></body></html>";
-  httpd_resp_send(req, resp_str, HTTPD_RESP_USE_STRLEN);
+static void
+make_etag(char *etag, size_t size, const uint8_t *pdata, size_t len)
+{
+  uint32_t hash = 2166136261u;
 
-  // vTaskDelay(2000 / portTICK_PERIOD_MS);
-  // vprintf_like_t logFunc = esp_log_set_vprintf(g_stdLogFunc);
-  // esp_wifi_stop();
-  // esp_wifi_deinit();
-  //  Configuration for the provisioning manager
-  // esp_wifi_restore();
-  // wifi_prov_mgr_reset_provisioning();
+  for (size_t i = 0; i < len; i++) {
+    hash = (hash ^ pdata[i]) * 16777619u;
+  }
 
-  return ESP_OK;
+  snprintf(etag, size, "\"%08lx\"", (unsigned long) hash);
 }
 
-// ----------------------------------------------------------------------------
-
 ///////////////////////////////////////////////////////////////////////////////
-// config_web_get_handler
+// load_static_file
+//
+// Read a static file into the cache. The gzipped variant is preferred.
 //
 
-static esp_err_t
-config_web_get_handler(httpd_req_t *req)
+static static_file_t *
+load_static_file(const char *uri)
 {
-  // esp_err_t rv;
-  char *buf;
-  // char *temp;
-
-  char *req_buf;
-  size_t req_buf_len;
+  char filepath[FILE_PATH_MAX];
+  struct stat file_stat;
+  static_file_t *pfile;
+  bool bGzip = true;
+  FILE *fd;
 
-  buf = (char *) ESP_CALLOC(1,CHUNK_BUFSIZE);
-  if (NULL == buf) {
-    return ESP_ERR_NO_MEM;
+  if (s_cntStaticFiles >= STATIC_MAX_FILES) {
+    ESP_LOGW(TAG, "No room for static file %s in cache", uri);
+    return NULL;
   }
 
-  // Get application info data
-  const esp_app_desc_t *appDescr = esp_app_get_description();
-
-  // Get header value string length and allocate memory for length + 1,
-  // extra byte for null termination
-  req_buf_len = httpd_req_get_hdr_value_len(req, "Host") + 1;
-  if (req_buf_len > 1) {
-    req_buf = ESP_MALLOC(req_buf_len);
-    // Copy null terminated value string into buffer
-    if (httpd_req_get_hdr_value_str(req, "Host", req_buf, req_buf_len) == ESP_OK) {
-      ESP_LOGD(TAG, "Found header => Host: %s", req_buf);
+  snprintf(filepath, sizeof(filepath), STATIC_BASE_PATH "%s.gz", uri);
+  if (-1 == stat(filepath, &file_stat)) {
+    bGzip = false;
+    snprintf(filepath, sizeof(filepath), STATIC_BASE_PATH "%s", uri);
+    if (-1 == stat(filepath, &file_stat)) {
+      return NULL;
     }
-    ESP_FREE(req_buf);
   }
 
-  sprintf(buf, WEBPAGE_START_TEMPLATE, g_persistent.nodeName, "Web server Configuration");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf, "<div><form id=but3 class=\"button\" action='/docfgweb' method='get'><fieldset>");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  // Enable
-  sprintf(buf, "<input type=\"checkbox\" name=\"enable\" value=\"true\" ");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  sprintf(buf, "%s><label for=\"lr\"> Enable</label>", g_persistent.webEnable ? "checked" : "");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-
-  sprintf(buf, "<br><br>Port:<input type=\"text\" name=\"port\" value=\"%d\" >", g_persistent.webPort);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+  if ((s_sizeStaticCache + file_stat.st_size) > CONFIG_APP_WEB_CACHE_SIZE) {
+    ESP_LOGW(TAG, "Static file %s (%ld bytes) does not fit in cache", uri, file_stat.st_size);
+    return NULL;
+  }
 
-  sprintf(buf, "Username:<input type=\"text\" name=\"user\" value=\"%s\" >", g_persistent.webUsername);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+  pfile = &s_staticFiles[s_cntStaticFiles];
+  pfile->pdata = ESP_MALLOC(file_stat.st_size);
+  if (NULL == pfile->pdata) {
+    return NULL;
+  }
 
-  sprintf(buf, "Password:<input type=\"password\" name=\"password\" value=\"%s\" >", g_persistent.webPassword);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+  if (NULL == (fd = fopen(filepath, "r"))) {
+    ESP_LOGE(TAG, "Failed to read existing file : %s", filepath);
+    ESP_FREE(pfile->pdata);
+    return NULL;
+  }
 
-  sprintf(buf, "<button class=\"bgrn bgrn:hover\">Save</button></fieldset></form></div>");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+  pfile->len = fread(pfile->pdata, 1, file_stat.st_size, fd);
+  fclose(fd);
 
-  sprintf(buf, WEBPAGE_END_TEMPLATE, appDescr->version, g_persistent.nodeName);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+  strlcpy(pfile->uri, uri, sizeof(pfile->uri));
+  pfile->bGzip = bGzip;
+  make_etag(pfile->etag, sizeof(pfile->etag), pfile->pdata, pfile->len);
 
-  httpd_resp_send_chunk(req, NULL, 0);
+  s_sizeStaticCache += pfile->len;
+  s_cntStaticFiles++;
 
-  ESP_FREE(buf);
+  ESP_LOGD(TAG, "Static file %s cached (%d bytes, gzip=%d)", uri, pfile->len, bGzip);
 
-  return ESP_OK;
+  return pfile;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// do_config_web_get_handler
+// static_get_handler
+//
+// Send a static file. Returns ESP_ERR_NOT_FOUND if there is no such file.
 //
 
 static esp_err_t
-do_config_web_get_handler(httpd_req_t *req)
+static_get_handler(httpd_req_t *req)
 {
-  esp_err_t rv;
-  char *buf;
-  size_t buf_len;
+  char filepath[FILE_PATH_MAX];
+  char etag[STATIC_ETAG_LEN];
+  char cacheControl[32];
+  static_file_t *pfile = NULL;
+  struct stat file_stat;
+  bool bGzip = true;
+  FILE *fd;
 
-  // Read URL query string length and allocate memory for length + 1,
-  // extra byte for null termination
-  buf_len = httpd_req_get_url_query_len(req) + 1;
-  if (buf_len > 1) {
-    buf = ESP_MALLOC(buf_len);
-    if (httpd_req_get_url_query_str(req, buf, buf_len) == ESP_OK) {
+  // Leave room for ".gz"
+  const char *uri = get_path_from_uri(filepath, STATIC_BASE_PATH, req->uri, sizeof(filepath) - 3);
+  if ((NULL == uri) || (strlen(uri) >= sizeof(s_staticFiles[0].uri))) {
+    return ESP_ERR_NOT_FOUND;
+  }
 
-      ESP_LOGD(TAG, "Found URL query => %s", buf);
-      char *param = ESP_MALLOC(WEBPAGE_PARAM_SIZE);
-      if (NULL == param) {
-        return ESP_ERR_ESPNOW_NO_MEM;
-        ESP_FREE(param);
-      }
+  for (int i = 0; i < s_cntStaticFiles; i++) {
+    if (0 == strcmp(s_staticFiles[i].uri, uri)) {
+      pfile = &s_staticFiles[i];
+      break;
+    }
+  }
 
-      // Enable
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "enable", param, WEBPAGE_PARAM_SIZE))) {
-        ESP_LOGD(TAG, "Found query parameter => enable=%s", param);
-        if (NULL != strstr(param, "true")) {
-          g_persistent.webEnable = true;
-        }
-      }
-      else {
-        g_persistent.webEnable = false;
-      }
+  if (NULL == pfile) {
+    pfile = load_static_file(uri);
+  }
 
-      // Write changed value to persistent storage
-      rv = nvs_set_u8(g_nvsHandle, "web_enable", g_persistent.webEnable);
-      if (rv != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to update web enable");
-      }
+  // Content type from requested name and not from the stored (.gz) file
+  set_content_type_from_file(req, uri);
 
-      // port
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "port", param, WEBPAGE_PARAM_SIZE))) {
-        ESP_LOGD(TAG, "Found query parameter => port=%s", param);
-        g_persistent.webPort = atoi(param);
-        // Write changed value to persistent storage
-        rv = nvs_set_u16(g_nvsHandle, "web_port", g_persistent.webPort);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update Web server port");
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting Web server port => rv=%d", rv);
+  if (NULL != pfile) {
+    strcpy(etag, pfile->etag);
+    bGzip = pfile->bGzip;
+  }
+  else {
+    // Not cached. Send from flash with an ETag from size and modification time.
+    size_t end = strlen(filepath);
+    strcpy(filepath + end, ".gz");
+    if (-1 == stat(filepath, &file_stat)) {
+      bGzip         = false;
+      filepath[end] = '\0';
+      if (-1 == stat(filepath, &file_stat)) {
+        return ESP_ERR_NOT_FOUND;
       }
+    }
+    snprintf(etag, sizeof(etag), "\"%lx%lx\"", (unsigned long) file_stat.st_size, (unsigned long) file_stat.st_mtime);
+  }
 
-      // user
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "user", param, WEBPAGE_PARAM_SIZE))) {
-        char *pdecoded = urlDecode(param);
-        if (NULL == pdecoded) {
-          ESP_FREE(param);
-          ESP_FREE(buf);
-          return ESP_ERR_ESPNOW_NO_MEM;
-        }
-        ESP_LOGD(TAG, "Found query parameter => user=%s", pdecoded);
-        strncpy(g_persistent.webUsername, pdecoded, sizeof(g_persistent.webUsername) - 1);
-        // Write changed value to persistent storage
-        rv = nvs_set_str(g_nvsHandle, "web_user", g_persistent.webUsername);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update Web server user");
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting Web server user => rv=%d", rv);
-      }
+  snprintf(cacheControl, sizeof(cacheControl), "public, max-age=%d", CONFIG_APP_WEB_MAX_AGE);
+  httpd_resp_set_hdr(req, "Cache-Control", cacheControl);
+  httpd_resp_set_hdr(req, "ETag", etag);
 
-      // password
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "password", param, WEBPAGE_PARAM_SIZE))) {
-        char *pdecoded = urlDecode(param);
-        if (NULL == pdecoded) {
-          ESP_FREE(param);
-          ESP_FREE(buf);
-          return ESP_ERR_ESPNOW_NO_MEM;
-        }
-        ESP_LOGD(TAG, "Found query parameter => password=%s", pdecoded);
-        strncpy(g_persistent.webPassword, pdecoded, sizeof(g_persistent.webPassword) - 1);
-        // Write changed value to persistent storage
-        rv = nvs_set_str(g_nvsHandle, "web_password", g_persistent.webPassword);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update Web server password");
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting Web server password => rv=%d", rv);
-      }
+  // Conditional request for content the browser already has
+  size_t buf_len = httpd_req_get_hdr_value_len(req, "If-None-Match") + 1;
+  if ((buf_len > 1) && (buf_len <= sizeof(etag))) {
+    char inm[sizeof(etag)];
+    if ((ESP_OK == httpd_req_get_hdr_value_str(req, "If-None-Match", inm, sizeof(inm))) && (0 == strcmp(inm, etag))) {
+      httpd_resp_set_status(req, "304 Not Modified");
+      return httpd_resp_send(req, NULL, 0);
+    }
+  }
 
-      rv = nvs_commit(g_nvsHandle);
-      if (rv != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to commit updates to nvs\n");
-      }
+  if (bGzip) {
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+  }
 
-      ESP_FREE(param);
-    }
+  if (NULL != pfile) {
+    return httpd_resp_send(req, (const char *) pfile->pdata, pfile->len);
+  }
 
-    ESP_FREE(buf);
+  if (NULL == (fd = fopen(filepath, "r"))) {
+    ESP_LOGE(TAG, "Failed to read existing file : %s", filepath);
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to read existing file");
+    return ESP_FAIL;
   }
-  const char *resp_str =
-    "<html><head><meta charset='utf-8'><meta http-equiv=\"refresh\" content=\"1;url=cfgweb\" "
-    "/><style>" WEBPAGE_STYLE_CSS "</style></head><body><h2 class=\"name\">saving module data...</h2></body></html>";
-  httpd_resp_send(req, resp_str, HTTPD_RESP_USE_STRLEN);
 
-  return ESP_OK;
-}
+  char *chunk = ESP_MALLOC(CHUNK_BUFSIZE);
+  if (NULL == chunk) {
+    fclose(fd);
+    httpd_resp_send_500(req);
+    return ESP_ERR_NO_MEM;
+  }
 
-// ----------------------------------------------------------------------------
+  size_t chunksize;
+  do {
+    chunksize = fread(chunk, 1, CHUNK_BUFSIZE, fd);
+    if ((chunksize > 0) && (ESP_OK != httpd_resp_send_chunk(req, chunk, chunksize))) {
+      ESP_LOGE(TAG, "File sending failed!");
+      fclose(fd);
+      ESP_FREE(chunk);
+      httpd_resp_sendstr_chunk(req, NULL);
+      return ESP_FAIL;
+    }
+  } while (chunksize != 0);
+
+  fclose(fd);
+  ESP_FREE(chunk);
+
+  return httpd_resp_send_chunk(req, NULL, 0);
+}
 
 ///////////////////////////////////////////////////////////////////////////////
-// config_log_get_handler
+// is_authenticated
+//
+// Check basic auth credentials of a request
 //
 
-static esp_err_t
-config_log_get_handler(httpd_req_t *req)
+static bool
+is_authenticated(httpd_req_t *req)
 {
-  // esp_err_t rv;
-  char *buf;
-  // char *temp;
+  char buf[AUTH_DIGEST_SIZE];
+  size_t len;
 
-  char *req_buf;
-  size_t req_buf_len;
+#ifdef CONFIG_APP_WEB_SESSION
+  if (session_check(req)) {
+    return true;
+  }
+#endif
 
-  buf = (char *) ESP_CALLOC(1,CHUNK_BUFSIZE);
-  if (NULL == buf) {
-    return ESP_ERR_NO_MEM;
+  len = httpd_req_get_hdr_value_len(req, "Authorization");
+  if (!len) {
+    ESP_LOGD(TAG, "No auth header received.");
+    return false;
   }
 
-  // Get application info data
-  const esp_app_desc_t *appDescr = esp_app_get_description();
+  // Can't match if it does not fit
+  if ((len >= sizeof(buf)) || (len != strlen(s_authDigest))) {
+    ESP_LOGE(TAG, "Not authenticated");
+    return false;
+  }
 
-  // Get header value string length and allocate memory for length + 1,
-  // extra byte for null termination
-  req_buf_len = httpd_req_get_hdr_value_len(req, "Host") + 1;
-  if (req_buf_len > 1) {
-    req_buf = ESP_MALLOC(req_buf_len);
-    // Copy null terminated value string into buffer
-    if (httpd_req_get_hdr_value_str(req, "Host", req_buf, req_buf_len) == ESP_OK) {
-      ESP_LOGD(TAG, "Found header => Host: %s", req_buf);
-    }
-    ESP_FREE(req_buf);
+  if (ESP_OK != httpd_req_get_hdr_value_str(req, "Authorization", buf, sizeof(buf))) {
+    ESP_LOGE(TAG, "No auth value received");
+    return false;
   }
 
-  sprintf(buf, WEBPAGE_START_TEMPLATE, g_persistent.nodeName, "Logging Configuration");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+  if (!auth_equal((const uint8_t *) buf, (const uint8_t *) s_authDigest, len)) {
+    ESP_LOGE(TAG, "Not authenticated");
+    return false;
+  }
 
-  sprintf(buf, "<div><form id=but3 class=\"button\" action='/docfglog' method='get'><fieldset>");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+#ifdef CONFIG_APP_WEB_SESSION
+  session_open(req);
+#endif
 
-  sprintf(buf, "<input type=\"checkbox\" id=\"stdout\"name=\"stdout\" value=\"true\" ");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  sprintf(buf, "%s><label for=\"stdout\"> Log to stdout</label>", g_persistent.logwrite2Stdout ? "checked" : "");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+  return true;
+}
 
-  sprintf(buf, "<br /><br />Log to:<select  name=\"type\" ");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  sprintf(buf, "<option value=\"0\" %s>none</option>", (ALPHA_LOG_NONE == g_persistent.logType) ? "selected" : "");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  sprintf(buf, "<option value=\"1\" %s>stdout</option>", (ALPHA_LOG_STD == g_persistent.logType) ? "selected" : "");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  sprintf(buf, "<option value=\"2\" %s>UDP</option>", (ALPHA_LOG_UDP == g_persistent.logType) ? "selected" : "");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  sprintf(buf, "<option value=\"3\" %s>TCP</option>", (ALPHA_LOG_TCP == g_persistent.logType) ? "selected" : "");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  sprintf(buf, "<option value=\"4\" %s>HTTP</option>", (ALPHA_LOG_HTTP == g_persistent.logType) ? "selected" : "");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  sprintf(buf, "<option value=\"5\" %s>MQTT</option>", (ALPHA_LOG_MQTT == g_persistent.logType) ? "selected" : "");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  sprintf(buf, "<option value=\"6\" %s>VSCP</option>", (ALPHA_LOG_VSCP == g_persistent.logType) ? "selected" : "");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  sprintf(buf, "></select>");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+///////////////////////////////////////////////////////////////////////////////
+// check_basic_auth
+//
+// Check basic auth credentials of a request. If not authenticated a 401
+// response is sent and ESP_FAIL returned.
+//
 
-  sprintf(buf, "Log level:<select name=\"level\" ");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  sprintf(buf, "<option value=\"1\" %s>error</option>", (ESP_LOG_ERROR == g_persistent.logLevel) ? "selected" : "");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  sprintf(buf, "<option value=\"2\" %s>warning</option>", (ESP_LOG_WARN == g_persistent.logLevel) ? "selected" : "");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  sprintf(buf, "<option value=\"3\" %s>info</option>", (ESP_LOG_INFO == g_persistent.logLevel) ? "selected" : "");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  sprintf(buf, "<option value=\"4\" %s>  debug</option>", (ESP_LOG_DEBUG == g_persistent.logLevel) ? "selected" : "");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  sprintf(buf, "<option value=\"5\" %s>verbose</option>", (ESP_LOG_VERBOSE == g_persistent.logLevel) ? "selected" : "");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
-  sprintf(buf, "></select>");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+static esp_err_t
+check_basic_auth(httpd_req_t *req)
+{
+  if (is_authenticated(req)) {
+    return ESP_OK;
+  }
 
-  sprintf(buf, "Max retries:<input type=\"text\" name=\"retries\" value=\"%d\" >", g_persistent.logRetries);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+  httpd_resp_set_status(req, HTTPD_401);
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Connection", "keep-alive");
+  httpd_resp_set_hdr(req, "WWW-Authenticate", "Basic realm=\"Alpha\"");
+  httpd_resp_send(req, NULL, 0);
 
-  sprintf(buf, "Destination (IP Addr):<input type=\"text\" name=\"url\" value=\"%s\" >", g_persistent.logUrl);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+  return ESP_FAIL;
+}
 
-  sprintf(buf, "Port:<input type=\"text\" name=\"port\" value=\"%d\" >", g_persistent.logPort);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+///////////////////////////////////////////////////////////////////////////////
+// default_get_handler
+//
+// Handler to download a file kept on the server
+//
 
-  sprintf(buf, "MQTT log Topic:<input type=\"text\" name=\"topic\" value=\"%s\" >", g_persistent.logMqttTopic);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+static esp_err_t
+default_get_handler(httpd_req_t *req)
+{
+  bool bSave;
+  const webcfg_page_t *ppage;
 
-  sprintf(buf, "<button class=\"bgrn bgrn:hover\">Save</button></fieldset></form></div>");
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+  ESP_LOGD(TAG, "uri : [%s]", req->uri);
 
-  sprintf(buf, WEBPAGE_END_TEMPLATE, appDescr->version, g_persistent.nodeName);
-  httpd_resp_send_chunk(req, buf, HTTPD_RESP_USE_STRLEN);
+  // Static files are public and served before authentication
+  if (is_static_uri(req->uri)) {
+    esp_err_t rv = static_get_handler(req);
+    if (ESP_ERR_NOT_FOUND == rv) {
+      httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File does not exist");
+      return ESP_OK;
+    }
+    return rv;
+  }
 
-  httpd_resp_send_chunk(req, NULL, 0);
+  //---------------------------------------------------------------------------
 
-  ESP_FREE(buf);
+  ESP_LOGD(TAG, "default_get_handler");
 
-  return ESP_OK;
-}
+  // 401 is sent if not authenticated
+  if (ESP_OK != check_basic_auth(req)) {
+    return ESP_OK;
+  }
 
-///////////////////////////////////////////////////////////////////////////////
-// do_config_log_get_handler
-//
+  // -----------------------------------------------------------------------------
 
-static esp_err_t
-do_config_log_get_handler(httpd_req_t *req)
-{
-  esp_err_t rv;
-  char *buf;
-  size_t buf_len;
+  if (0 == strncmp(req->uri, "/hello", 6)) {
+    ESP_LOGV(TAG, "--------- HELLO ---------\n");
+    return hello_get_handler(req);
+  }
 
-  // Read URL query string length and allocate memory for length + 1,
-  // extra byte for null termination
-  buf_len = httpd_req_get_url_query_len(req) + 1;
-  if (buf_len > 1) {
-    buf = ESP_MALLOC(buf_len);
-    if (httpd_req_get_url_query_str(req, buf, buf_len) == ESP_OK) {
+  if (0 == strncmp(req->uri, "/echo", 5)) {
+    ESP_LOGV(TAG, "--------- ECHO ---------\n");
+    return echo_post_handler(req);
+  }
 
-      ESP_LOGD(TAG, "Found URL query => %s", buf);
-      char *param = ESP_MALLOC(WEBPAGE_PARAM_SIZE);
-      if (NULL == param) {
-        return ESP_ERR_ESPNOW_NO_MEM;
-        ESP_FREE(param);
-      }
+  if (0 == strncmp(req->uri, "/ctrl", 5)) {
+    ESP_LOGV(TAG, "--------- CTRL ---------\n");
+    return ctrl_put_handler(req);
+  }
 
-      // stdout
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "stdout", param, WEBPAGE_PARAM_SIZE))) {
+  if (0 == strncmp(req->uri, "/index.html", 11)) {
+    ESP_LOGV(TAG, "--------- index ---------\n");
+    return mainpg_get_handler(req);
+  }
 
-        ESP_LOGD(TAG, "Found query parameter => stdout=%s", param);
+  if ((0 == strncmp(req->uri, "/", 1)) && (1 == strlen(req->uri))) {
+    ESP_LOGV(TAG, "--------- index /---------\n");
+    return mainpg_get_handler(req);
+  }
 
-        if (NULL != strstr(param, "true")) {
-          g_persistent.logwrite2Stdout = 1;
-        }
-        else {
-          g_persistent.logwrite2Stdout = 0;
-        }
-      }
-      else {
-        g_persistent.logwrite2Stdout = 0;
-      }
+  // ---------------------------------------------------------------
 
-      rv = nvs_set_u8(g_nvsHandle, "log_stdout", g_persistent.logwrite2Stdout);
-      if (rv != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to update log-stdout");
-      }
+  if (0 == strncmp(req->uri, "/config", 7)) {
+    ESP_LOGV(TAG, "--------- config ---------\n");
+    return config_get_handler(req);
+  }
 
-      // type
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "type", param, WEBPAGE_PARAM_SIZE))) {
-        ESP_LOGD(TAG, "Found query parameter => type=%s", param);
-        g_persistent.logType = atoi(param);
+  // Schema driven configuration pages
+  ppage = webcfg_find_page(req->uri, &bSave);
+  if (NULL != ppage) {
+    return bSave ? webcfg_save_get_handler(req, ppage) : webcfg_page_get_handler(req, ppage);
+  }
 
-        rv = nvs_set_u8(g_nvsHandle, "log_type", g_persistent.logType);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update log type");
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting log type => rv=%d", rv);
-      }
+  if (0 == strncmp(req->uri, "/cfgwifi", 8)) {
+    ESP_LOGV(TAG, "--------- cfgwifi ---------\n");
+    return config_wifi_get_handler(req);
+  }
 
-      // level
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "level", param, WEBPAGE_PARAM_SIZE))) {
-        ESP_LOGD(TAG, "Found query parameter => level=%s", param);
-        g_persistent.logLevel = atoi(param);
+  if (0 == strncmp(req->uri, "/docfgwifi", 10)) {
+    ESP_LOGV(TAG, "--------- docfgwifi ---------\n");
+    return do_config_wifi_get_handler(req);
+  }
 
-        rv = nvs_set_u8(g_nvsHandle, "log_level", g_persistent.logLevel);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update log level");
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting log level => rv=%d", rv);
-      }
+  // ---------------------------------------------------------------
 
-      // retries
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "retries", param, WEBPAGE_PARAM_SIZE))) {
-        ESP_LOGD(TAG, "Found query parameter => retries=%s", param);
-        g_persistent.logRetries = atoi(param);
+  if (0 == strncmp(req->uri, RESTAPI_URI_PREFIX, strlen(RESTAPI_URI_PREFIX))) {
+    ESP_LOGV(TAG, "--------- api ---------\n");
+    return restapi_get_handler(req);
+  }
 
-        rv = nvs_set_u8(g_nvsHandle, "log_retries", g_persistent.logRetries);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update log retries");
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting log retries => rv=%d", rv);
-      }
+  if (0 == strncmp(req->uri, "/info", 5)) {
+    ESP_LOGV(TAG, "--------- info ---------\n");
+    return info_get_handler(req);
+  }
 
-      // port
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "port", param, WEBPAGE_PARAM_SIZE))) {
-        ESP_LOGD(TAG, "Found query parameter => port=%s", param);
-        g_persistent.logPort = atoi(param);
+  if (0 == strncmp(req->uri, "/reset", 6)) {
+    ESP_LOGV(TAG, "--------- reset ---------\n");
+    return reset_get_handler(req);
+  }
 
-        rv = nvs_set_u8(g_nvsHandle, "log_port", g_persistent.logPort);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to update log port");
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting log port => rv=%d", rv);
-      }
+  if (0 == strncmp(req->uri, "/upgrade", 8)) {
+    ESP_LOGV(TAG, "--------- Upgrade main ---------\n");
+    return upgrade_get_handler(req);
+  }
 
-      // url
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "url", param, WEBPAGE_PARAM_SIZE))) {
-        ESP_LOGD(TAG, "Found query parameter => url=%s", param);
-        strncpy(g_persistent.logUrl, param, sizeof(g_persistent.logUrl));
+  if (0 == strncmp(req->uri, "/upgrdsrv", 9)) {
+    ESP_LOGV(TAG, "--------- Upgrade server ---------\n");
+    return upgrdsrv_get_handler(req);
+  }
 
-        rv = nvs_set_str(g_nvsHandle, "log_url", g_persistent.logUrl);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to save log URL");
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting log port => rv=%d", rv);
-      }
+  if (0 == strncmp(req->uri, "/upgrdlocal", 11)) {
+    ESP_LOGV(TAG, "--------- Upgrade local ---------\n");
+    return upgrdlocal_post_handler(req);
+  }
 
-      // MQTT topic
-      if (ESP_OK == (rv = httpd_query_key_value(buf, "topic", param, WEBPAGE_PARAM_SIZE))) {
-        char *pdecoded = urlDecode(param);
-        if (NULL == pdecoded) {
-          ESP_FREE(param);
-          ESP_FREE(buf);
-          return ESP_ERR_ESPNOW_NO_MEM;
-        }
-        ESP_LOGD(TAG, "Found query parameter => topic=%s", pdecoded);
-        strncpy(g_persistent.logMqttTopic, pdecoded, sizeof(g_persistent.logMqttTopic));
-        ESP_FREE(pdecoded);
+  if (0 == strncmp(req->uri, "/upgrdSibling", 13)) {
+    ESP_LOGV(TAG, "--------- Upgrade sibling(s) from server ---------\n");
+    return upgrdsibling_get_handler(req);
+  }
 
-        rv = nvs_set_str(g_nvsHandle, "log_mqtt_topic", g_persistent.logMqttTopic);
-        if (rv != ESP_OK) {
-          ESP_LOGE(TAG, "Failed to save log topic");
-        }
-      }
-      else {
-        ESP_LOGE(TAG, "Error getting log topic => rv=%d", rv);
-      }
+  if (0 == strncmp(req->uri, "/upgrdSiblingLocal", 18)) {
+    ESP_LOGV(TAG, "--------- Upgrade sibling(s) local ---------\n");
+    return upgrdSiblingslocal_post_handler(req);
+  }
 
-      ESP_FREE(param);
-    }
+  if (0 == strncmp(req->uri, "/provisioning", 13)) {
+    ESP_LOGV(TAG, "--------- Provisioning ---------\n");
+    return provisioning_get_handler(req);
+  }
 
-    ESP_FREE(buf);
+  if (0 == strncmp(req->uri, "/doprov", 7)) {
+    ESP_LOGV(TAG, "--------- doprov ---------\n");
+    return doprov_get_handler(req);
   }
-  const char *resp_str =
-    "<html><head><meta charset='utf-8'><meta http-equiv=\"refresh\" content=\"1;url=cfglog\" "
-    "/><style>" WEBPAGE_STYLE_CSS "</style></head><body><h2 class=\"name\">saving module data...</h2></body></html>";
-  httpd_resp_send(req, resp_str, HTTPD_RESP_USE_STRLEN);
 
   return ESP_OK;
 }
 
+// ----------------------------------------------------------------------------
+//                              Websocket events
+// ----------------------------------------------------------------------------
+
+/*
+  Websocket clients connected to /ws get a live stream of the events on the
+  event bus. Settings are given as query parameters on connect and can be
+  changed later by sending them in a text message
+
+    filter=priority,class,type[,GUID]  Same format as the VSCP link protocol
+    mask=priority,class,type[,GUID]    Same format as the VSCP link protocol
+    format=json|binary|cbor            Payload format (default json)
+
+  Accepted events are queued per client and sent in batches. A JSON batch is
+  an array of events in a text frame. Binary and CBOR batches are
+  concatenated items in a binary frame. Events are dropped (and counted) when
+  the queue of a client is full.
+*/
+
+typedef struct {
+  int fd;                 // Socket (-1 for free slot)
+  httpd_handle_t hd;      // Server the client is connected to
+  uint8_t format;         // Payload format (mqtt_format_t)
+  vscpEventFilter filter; // Filter for events
+  QueueHandle_t queue;    // Events waiting to be sent (vscpEvent *)
+  bool bSending;          // Set while the ws task sends to the client
+  int closeFd;            // Socket closed while sending, closed by the ws task (-1 for none)
+  websrv_ws_stats_t stats;
+} ws_client_t;
+
+static ws_client_t s_wsClients[CONFIG_APP_WS_MAX_CLIENTS];
+static SemaphoreHandle_t s_mutexWs = NULL; // Protects client slots
+static uint8_t *s_wsBuf            = NULL; // Batch buffer (used by ws task only)
+
 ///////////////////////////////////////////////////////////////////////////////
-// upd_espnow_get_handler
+// ws_parseFilter
 //
-// Update espnow configuration settings
+// Parse "priority,class,type[,GUID]"
 //
 
-// static esp_err_t
-// upd_espnow_get_handler(httpd_req_t *req)
-// {
-//   char *buf;
-//   size_t buf_len;
+static void
+ws_parseFilter(const char *str, uint8_t *ppriority, uint16_t *pclass, uint16_t *ptype, uint8_t *pguid)
+{
+  char *p;
 
-//   // Get header value string length and allocate memory for length + 1,
-//   // extra byte for null termination
-//   buf_len = httpd_req_get_hdr_value_len(req, "Host") + 1;
-//   if (buf_len > 1) {
-//     buf = ESP_MALLOC(buf_len);
-//     // Copy null terminated value string into buffer
-//     if (httpd_req_get_hdr_value_str(req, "Host", buf, buf_len) == ESP_OK) {
-//       ESP_LOGD(TAG, "Found header => Host: %s", buf);
-//     }
-//     ESP_FREE(buf)
-//   }
+  *ppriority = (uint8_t) strtoul(str, &p, 0);
+  if (',' != *p) {
+    return;
+  }
+  *pclass = (uint16_t) strtoul(p + 1, &p, 0);
+  if (',' != *p) {
+    return;
+  }
+  *ptype = (uint16_t) strtoul(p + 1, &p, 0);
+  if (',' != *p) {
+    return;
+  }
 
-//   // Read URL query string length and allocate memory for length + 1,
-//   // extra byte for null termination
+  p++;
+  for (int i = 0; i < 16; i++) {
+    pguid[i] = (uint8_t) strtoul(p, &p, 16);
+    if (':' != *p) {
+      break;
+    }
+    p++;
+  }
+}
 
-//   buf_len = httpd_req_get_url_query_len(req) + 1;
-//   if (buf_len > 1) {
-//     buf = ESP_MALLOC(buf_len);
-//     if (httpd_req_get_url_query_str(req, buf, buf_len) == ESP_OK) {
-//       ESP_LOGD(TAG, "Found URL query => %s", buf);
-//       char param[33];
-//       // Get value of expected key from query string
-//       if (httpd_query_key_value(buf, "key", param, sizeof(param)) == ESP_OK) {
-//         ESP_LOGD(TAG, "Found URL query parameter => key=%s", param);
-//       }
-//       if (httpd_query_key_value(buf, "ttl", param, sizeof(param)) == ESP_OK) {
-//         ESP_LOGD(TAG, "Found URL query parameter => ttl=%s", param);
-//       }
-//       // Enable packet forward functionality
-//       if (httpd_query_key_value(buf, "bforward", param, sizeof(param)) == ESP_OK) {
-//         ESP_LOGD(TAG, "Found URL query parameter => bforward=%s", param);
-//       }
-//       else {
-//         // Key 'bforward' is not found
-//       }
-//       // Enable Long Range
-//       if (httpd_query_key_value(buf, "blr", param, sizeof(param)) == ESP_OK) {
-//         ESP_LOGD(TAG, "Found URL query parameter => blr=%s", param);
-//       }
-//       else {
-//         // Key 'blr' is not found
-//       }
-//     }
-//     ESP_FREE(buf)
-//   }
+///////////////////////////////////////////////////////////////////////////////
+// ws_parseSettings
+//
+// Parse client settings from a query string. Must be called with the
+// websocket mutex held.
+//
 
-//   // httpd_resp_set_hdr(req, "Custom-Header-1", "Custom-Value-1");
+static void
+ws_parseSettings(ws_client_t *pclient, const char *query)
+{
+  char param[WEBPAGE_PARAM_SIZE];
+  vscpEventFilter *pfilter = &pclient->filter;
+
+  if (ESP_OK == httpd_query_key_value(query, "filter", param, sizeof(param))) {
+    char *pdecoded = urlDecode(param);
+    if (NULL != pdecoded) {
+      memset(pfilter->filter_GUID, 0, 16);
+      ws_parseFilter(pdecoded,
+                     &pfilter->filter_priority,
+                     &pfilter->filter_class,
+                     &pfilter->filter_type,
+                     pfilter->filter_GUID);
+      ESP_FREE(pdecoded);
+    }
+  }
 
-//   // Send response with custom headers and body set as the
-//   // string passed in user context
-//   const char *resp_str =
-//     "<html><head><meta http-equiv=\"refresh\" content=\"0; url='index.html'\" /></head><body>Save<body></html>";
-//   httpd_resp_send(req, resp_str, HTTPD_RESP_USE_STRLEN);
+  if (ESP_OK == httpd_query_key_value(query, "mask", param, sizeof(param))) {
+    char *pdecoded = urlDecode(param);
+    if (NULL != pdecoded) {
+      memset(pfilter->mask_GUID, 0, 16);
+      ws_parseFilter(pdecoded, &pfilter->mask_priority, &pfilter->mask_class, &pfilter->mask_type, pfilter->mask_GUID);
+      ESP_FREE(pdecoded);
+    }
+  }
 
-//   return ESP_OK;
-// }
+  if (ESP_OK == httpd_query_key_value(query, "format", param, sizeof(param))) {
+    if (0 == strcasecmp(param, "binary")) {
+      pclient->format = MQTT_FORMAT_BINARY;
+    }
+    else if (0 == strcasecmp(param, "cbor")) {
+      pclient->format = MQTT_FORMAT_CBOR;
+    }
+    else {
+      pclient->format = MQTT_FORMAT_JSON;
+    }
+  }
+}
 
 ///////////////////////////////////////////////////////////////////////////////
-// echo_post_handler
-//
-// An HTTP POST handler
+// ws_isEventAccepted
 //
 
-static esp_err_t
-echo_post_handler(httpd_req_t *req)
+static bool
+ws_isEventAccepted(const vscpEventFilter *pfilter, const vscpEvent *pev)
 {
-  char buf[100];
-  int ret, remaining = req->content_len;
+  if ((pfilter->filter_class ^ pev->vscp_class) & pfilter->mask_class) {
+    return false;
+  }
 
-  while (remaining > 0) {
-    // Read the data for the request
-    if ((ret = httpd_req_recv(req, buf, MIN(remaining, sizeof(buf)))) <= 0) {
-      if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
-        // Retry receiving if timeout occurred
-        continue;
-      }
-      return ESP_FAIL;
-    }
+  if ((pfilter->filter_type ^ pev->vscp_type) & pfilter->mask_type) {
+    return false;
+  }
 
-    // Send back the same data
-    httpd_resp_send_chunk(req, buf, ret);
-    remaining -= ret;
+  if ((pfilter->filter_priority ^ ((pev->head >> 5) & 0x07)) & pfilter->mask_priority) {
+    return false;
+  }
 
-    // Log data received
-    ESP_LOGD(TAG, "=========== RECEIVED DATA ==========");
-    ESP_LOGD(TAG, "%.*s", ret, buf);
-    ESP_LOGD(TAG, "====================================");
+  for (int i = 0; i < 16; i++) {
+    if ((pfilter->filter_GUID[i] ^ pev->GUID[i]) & pfilter->mask_GUID[i]) {
+      return false;
+    }
   }
 
-  // End response
-  httpd_resp_send_chunk(req, NULL, 0);
-  return ESP_OK;
+  return true;
 }
 
-static const httpd_uri_t echo = { .uri = "/echo", .method = HTTP_POST, .handler = echo_post_handler, .user_ctx = NULL };
-
 ///////////////////////////////////////////////////////////////////////////////
-// http_404_error_handler
+// ws_eventbus_cb
 //
-// This handler allows the custom error handling functionality to be
-// tested from client side. For that, when a PUT request 0 is sent to
-// URI /ctrl, the /hello and /echo URIs are unregistered and following
-// custom error handler http_404_error_handler() is registered.
-// Afterwards, when /hello or /echo is requested, this custom error
-// handler is invoked which, after sending an error message to client,
-// either closes the underlying socket (when requested URI is /echo)
-// or keeps it open (when requested URI is /hello). This allows the
-// client to infer if the custom error handler is functioning as expected
-// by observing the socket state.
+// Queue events from the event bus for the clients that accept them
 //
 
-esp_err_t
-http_404_error_handler(httpd_req_t *req, httpd_err_code_t err)
+static int
+ws_eventbus_cb(const vscpEvent *pev, void *userdata)
 {
-  if (strcmp("/hello", req->uri) == 0) {
-    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "/hello URI is not available");
-    // Return ESP_OK to keep underlying socket open
-    return ESP_OK;
-  }
-  else if (strcmp("/echo", req->uri) == 0) {
-    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "/echo URI is not available");
-    // Return ESP_FAIL to close underlying socket
-    return ESP_FAIL;
+  xSemaphoreTake(s_mutexWs, portMAX_DELAY);
+
+  for (int i = 0; i < CONFIG_APP_WS_MAX_CLIENTS; i++) {
+
+    ws_client_t *pclient = &s_wsClients[i];
+
+    if ((-1 == pclient->fd) || !ws_isEventAccepted(&pclient->filter, pev)) {
+      continue;
+    }
+
+    vscpEvent *pnew = vscp_fwhlp_mkEventCopy(pev);
+    if (NULL == pnew) {
+      pclient->stats.nDropped++;
+      continue;
+    }
+
+    if (pdTRUE != xQueueSend(pclient->queue, &pnew, 0)) {
+      vscp_fwhlp_deleteEvent(&pnew);
+      pclient->stats.nDropped++;
+    }
   }
-  // For any other URI send 404 and close socket
-  httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Some 404 error message");
-  return ESP_FAIL;
+
+  xSemaphoreGive(s_mutexWs);
+
+  return VSCP_ERROR_SUCCESS;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// ctrl_put_handler
-//
-// An HTTP PUT handler. This demonstrates realtime
-// registration and deregistration of URI handlers
+// ws_sendFrame
 //
 
 static esp_err_t
-ctrl_put_handler(httpd_req_t *req)
+ws_sendFrame(ws_client_t *pclient, httpd_handle_t hd, int fd, uint8_t format, size_t len, int cnt)
 {
-  char buf;
-  int ret;
+  esp_err_t rv;
+  httpd_ws_frame_t frame;
 
-  if ((ret = httpd_req_recv(req, &buf, 1)) <= 0) {
-    if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
-      httpd_resp_send_408(req);
-    }
-    return ESP_FAIL;
+  if (MQTT_FORMAT_JSON == format) {
+    s_wsBuf[len++] = ']';
   }
 
-  if (buf == '0') {
-    // URI handlers can be unregistered using the uri string
-    ESP_LOGD(TAG, "Unregistering /hello and /echo URIs");
-    httpd_unregister_uri(req->handle, "/hello");
-    httpd_unregister_uri(req->handle, "/echo");
-    // Register the custom error handler
-    httpd_register_err_handler(req->handle, HTTPD_404_NOT_FOUND, http_404_error_handler);
+  memset(&frame, 0, sizeof(httpd_ws_frame_t));
+  frame.final   = true;
+  frame.type    = (MQTT_FORMAT_JSON == format) ? HTTPD_WS_TYPE_TEXT : HTTPD_WS_TYPE_BINARY;
+  frame.payload = s_wsBuf;
+  frame.len     = len;
+
+  rv = httpd_ws_send_frame_async(hd, fd, &frame);
+
+  // Stats are also updated by the event bus callback
+  xSemaphoreTake(s_mutexWs, portMAX_DELAY);
+  if (ESP_OK == rv) {
+    pclient->stats.nSent += cnt;
+    pclient->stats.nFrames++;
   }
   else {
-    ESP_LOGD(TAG, "Registering /hello and /echo URIs");
-    httpd_register_uri_handler(req->handle, &hello);
-    httpd_register_uri_handler(req->handle, &echo);
-    // Unregister custom error handler
-    httpd_register_err_handler(req->handle, HTTPD_404_NOT_FOUND, NULL);
+    pclient->stats.nDropped += cnt;
   }
+  xSemaphoreGive(s_mutexWs);
 
-  // Respond with empty body
-  httpd_resp_send(req, NULL, 0);
-  return ESP_OK;
-}
+  if (ESP_OK != rv) {
+    ESP_LOGW(TAG, "Failed to send websocket frame to fd=%d rv=%d", fd, rv);
+    httpd_sess_trigger_close(hd, fd);
+  }
 
-// static const httpd_uri_t ctrl = { .uri = "/ctrl", .method = HTTP_PUT, .handler = ctrl_put_handler, .user_ctx =
-// NULL
-// };
+  return rv;
+}
 
 ///////////////////////////////////////////////////////////////////////////////
-// set_content_type_from_file
+// ws_sendBatch
 //
-// Set HTTP response content type according to file extension
+// Send queued events of a client in as few frames as possible
 //
 
-static esp_err_t
-set_content_type_from_file(httpd_req_t *req, const char *filename)
+static void
+ws_sendBatch(ws_client_t *pclient, httpd_handle_t hd, int fd, uint8_t format)
 {
-  if (IS_FILE_EXT(filename, ".gz")) {
-    return httpd_resp_set_type(req, "application/gzip");
-  }
-  else if (IS_FILE_EXT(filename, ".html")) {
-    return httpd_resp_set_type(req, "text/html");
-  }
-  else if (IS_FILE_EXT(filename, ".css")) {
-    return httpd_resp_set_type(req, "text/css");
-  }
-  else if (IS_FILE_EXT(filename, ".jpeg")) {
-    return httpd_resp_set_type(req, "image/jpeg");
-  }
-  else if (IS_FILE_EXT(filename, ".png")) {
-    return httpd_resp_set_type(req, "image/png");
-  }
-  else if (IS_FILE_EXT(filename, ".ico")) {
-    return httpd_resp_set_type(req, "image/x-icon");
+  int rv;
+  int cnt    = 0;
+  size_t len = 0;
+  vscpEvent *pev;
+  size_t extra = (MQTT_FORMAT_JSON == format) ? 1 : 0; // '[' or ',' before JSON events
+
+  while (pdTRUE == xQueuePeek(pclient->queue, &pev, 0)) {
+
+    size_t evlen;
+
+    // Keep room for ']' after JSON events
+    rv = mqtt_encode_payload(s_wsBuf + len + extra,
+                             CONFIG_APP_WS_FRAME_SIZE - len - extra - 1,
+                             format,
+                             pev,
+                             &evlen);
+    if (VSCP_ERROR_SUCCESS != rv) {
+      if (cnt) {
+        // Frame is full. Send it and try again.
+        if (ESP_OK != ws_sendFrame(pclient, hd, fd, format, len, cnt)) {
+          return;
+        }
+        cnt = 0;
+        len = 0;
+        continue;
+      }
+      // Does not fit even in an empty frame
+      xSemaphoreTake(s_mutexWs, portMAX_DELAY);
+      pclient->stats.nDropped++;
+      xSemaphoreGive(s_mutexWs);
+    }
+    else {
+      if (extra) {
+        s_wsBuf[len] = cnt ? ',' : '[';
+      }
+      len += extra + evlen;
+      cnt++;
+    }
+
+    xQueueReceive(pclient->queue, &pev, 0);
+    vscp_fwhlp_deleteEvent(&pev);
   }
-  else if (IS_FILE_EXT(filename, ".js")) {
-    return httpd_resp_set_type(req, "text/javascript");
+
+  if (cnt) {
+    ws_sendFrame(pclient, hd, fd, format, len, cnt);
   }
-  // For any other type always set as plain text
-  return httpd_resp_set_type(req, "text/plain");
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// default_get_handler
-//
-// Handler to download a file kept on the server
+// ws_task
 //
 
-static esp_err_t
-default_get_handler(httpd_req_t *req)
+static void
+ws_task(void *pvParameters)
 {
-  char filepath[FILE_PATH_MAX];
-  FILE *fd = NULL;
-  struct stat file_stat;
-  char *buf      = NULL;
-  size_t buf_len = 0;
+  int fd;
+  uint8_t format;
+  httpd_handle_t hd;
+  vscpEvent *pev;
 
-  ESP_LOGD(TAG, "uri : [%s]", req->uri);
+  for (;;) {
 
-  //---------------------------------------------------------------------------
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_APP_WS_BATCH_TIME));
 
-  ESP_LOGD(TAG, "default_get_handler");
+    for (int i = 0; i < CONFIG_APP_WS_MAX_CLIENTS; i++) {
 
-  buf_len = httpd_req_get_hdr_value_len(req, "Authorization") + 1;
-  if (buf_len > 1) {
-    buf = calloc(1, buf_len);
-    if (!buf) {
-      ESP_LOGE(TAG, "No enough memory for basic authorization");
-      return ESP_ERR_NO_MEM;
-    }
+      ws_client_t *pclient = &s_wsClients[i];
 
-    if (httpd_req_get_hdr_value_str(req, "Authorization", buf, buf_len) == ESP_OK) {
-      ESP_LOGD(TAG, "Found header => Authorization: %s", buf);
-    }
-    else {
-      ESP_LOGE(TAG, "No auth value received");
-    }
+      // The mutex is not held while sending, a slow client would stall the
+      // event bus and the server. While bSending is set ws_close leaves the
+      // socket open, so the fd can not be reused by a new session before
+      // the send is done.
+      xSemaphoreTake(s_mutexWs, portMAX_DELAY);
+      fd     = pclient->fd;
+      hd     = pclient->hd;
+      format = pclient->format;
 
-    char *auth_credentials = http_auth_basic(CONFIG_APP_DEFAULT_USER, CONFIG_APP_DEFAULT_PASSWORD);
-    if (!auth_credentials) {
-      ESP_LOGE(TAG, "No enough memory for basic authorization credentials");
-      ESP_FREE(buf);
-      return ESP_ERR_NO_MEM;
-    }
+      pclient->bSending = (-1 != fd) && (HTTPD_WS_CLIENT_WEBSOCKET == httpd_ws_get_fd_info(hd, fd));
+      xSemaphoreGive(s_mutexWs);
 
-    if (strncmp(auth_credentials, buf, buf_len)) {
-      ESP_LOGE(TAG, "Not authenticated");
-      httpd_resp_set_status(req, HTTPD_401);
-      httpd_resp_set_type(req, "application/json");
-      httpd_resp_set_hdr(req, "Connection", "keep-alive");
-      httpd_resp_set_hdr(req, "WWW-Authenticate", "Basic realm=\"Alpha\"");
-      httpd_resp_send(req, NULL, 0);
-    }
-    else {
-      ESP_LOGD(TAG, "------> Authenticated!");
-      /*char *basic_auth_resp = NULL;
-      httpd_resp_set_status(req, HTTPD_200);
-      httpd_resp_set_type(req, "application/json");
-      httpd_resp_set_hdr(req, "Connection", "keep-alive");
-      asprintf(&basic_auth_resp, "{\"authenticated\": true,\"user\": \"%s\"}", basic_auth_info->username);
-      if (!basic_auth_resp) {
-        ESP_LOGE(TAG, "No enough memory for basic authorization response");
-        ESP_FREE(auth_credentials);
-        ESP_FREE(buf)
-        return ESP_ERR_NO_MEM;
+      if (pclient->bSending) {
+        ws_sendBatch(pclient, hd, fd, format);
+
+        xSemaphoreTake(s_mutexWs, portMAX_DELAY);
+        pclient->bSending = false;
+        if (-1 != pclient->closeFd) {
+          close(pclient->closeFd);
+          pclient->closeFd = -1;
+        }
+        xSemaphoreGive(s_mutexWs);
+        continue;
+      }
+
+      // Events left from a closed client
+      while (pdTRUE == xQueueReceive(pclient->queue, &pev, 0)) {
+        vscp_fwhlp_deleteEvent(&pev);
       }
-      httpd_resp_send(req, basic_auth_resp, strlen(basic_auth_resp));
-      ESP_FREE(basic_auth_resp); */
     }
-    ESP_FREE(auth_credentials);
-    ESP_FREE(buf);
-  }
-  else {
-    ESP_LOGE(TAG, "No auth header received.");
-    httpd_resp_set_status(req, HTTPD_401);
-    httpd_resp_set_type(req, "application/json");
-    httpd_resp_set_hdr(req, "Connection", "keep-alive");
-    httpd_resp_set_hdr(req, "WWW-Authenticate", "Basic realm=\"Alpha\"");
-    httpd_resp_send(req, NULL, 0);
-    return ESP_OK;
   }
 
-  // -----------------------------------------------------------------------------
+  vTaskDelete(NULL);
+}
 
-  if (0 == strncmp(req->uri, "/hello", 6)) {
-    ESP_LOGV(TAG, "--------- HELLO ---------\n");
-    return hello_get_handler(req);
-  }
+///////////////////////////////////////////////////////////////////////////////
+// ws_open
+//
+// New websocket client
+//
 
-  if (0 == strncmp(req->uri, "/echo", 5)) {
-    ESP_LOGV(TAG, "--------- ECHO ---------\n");
-    return echo_post_handler(req);
+static esp_err_t
+ws_open(httpd_req_t *req)
+{
+  int fd             = httpd_req_to_sockfd(req);
+  ws_client_t *pclient = NULL;
+  char *query          = NULL;
+  size_t len           = httpd_req_get_url_query_len(req) + 1;
+
+  if (len > 1) {
+    query = ESP_MALLOC(len);
+    if ((NULL != query) && (ESP_OK != httpd_req_get_url_query_str(req, query, len))) {
+      ESP_FREE(query);
+      query = NULL;
+    }
   }
 
-  if (0 == strncmp(req->uri, "/ctrl", 5)) {
-    ESP_LOGV(TAG, "--------- CTRL ---------\n");
-    return ctrl_put_handler(req);
-  }
+  xSemaphoreTake(s_mutexWs, portMAX_DELAY);
 
-  if (0 == strncmp(req->uri, "/index.html", 11)) {
-    ESP_LOGV(TAG, "--------- index ---------\n");
-    return mainpg_get_handler(req);
+  // A slot is not reused while the ws task still sends to its old socket
+  for (int i = 0; i < CONFIG_APP_WS_MAX_CLIENTS; i++) {
+    if ((-1 == s_wsClients[i].fd) && !s_wsClients[i].bSending) {
+      pclient = &s_wsClients[i];
+      break;
+    }
   }
 
-  if ((0 == strncmp(req->uri, "/", 1)) && (1 == strlen(req->uri))) {
-    ESP_LOGV(TAG, "--------- index /---------\n");
-    return mainpg_get_handler(req);
+  if (NULL != pclient) {
+    pclient->hd     = req->handle;
+    pclient->format = MQTT_FORMAT_JSON;
+    memset(&pclient->filter, 0, sizeof(vscpEventFilter)); // Accept all
+    memset(&pclient->stats, 0, sizeof(websrv_ws_stats_t));
+    if (NULL != query) {
+      ws_parseSettings(pclient, query);
+    }
+    pclient->fd = fd;
   }
 
-  // ---------------------------------------------------------------
+  xSemaphoreGive(s_mutexWs);
 
-  if (0 == strncmp(req->uri, "/config", 7)) {
-    ESP_LOGV(TAG, "--------- config ---------\n");
-    return config_get_handler(req);
+  if (NULL != query) {
+    ESP_FREE(query);
   }
 
-  if (0 == strncmp(req->uri, "/cfgmodule", 10)) {
-    ESP_LOGV(TAG, "--------- cfgmodule ---------\n");
-    return config_module_get_handler(req);
+  if (NULL == pclient) {
+    ESP_LOGW(TAG, "No room for websocket client fd=%d", fd);
+    return ESP_FAIL;
   }
 
-  if (0 == strncmp(req->uri, "/docfgmodule", 12)) {
-    ESP_LOGV(TAG, "--------- docfgmodule ---------\n");
-    return do_config_module_get_handler(req);
-  }
+  ESP_LOGI(TAG, "Websocket client connected fd=%d", fd);
+  return ESP_OK;
+}
 
-  if (0 == strncmp(req->uri, "/cfgwifi", 8)) {
-    ESP_LOGV(TAG, "--------- cfgwifi ---------\n");
-    return config_wifi_get_handler(req);
-  }
+///////////////////////////////////////////////////////////////////////////////
+// ws_close
+//
+// Called when a socket is closed by the server
+//
 
-  if (0 == strncmp(req->uri, "/docfgwifi", 10)) {
-    ESP_LOGV(TAG, "--------- docfgwifi ---------\n");
-    return do_config_wifi_get_handler(req);
+static void
+ws_close(httpd_handle_t hd, int sockfd)
+{
+  if (NULL != s_mutexWs) {
+    xSemaphoreTake(s_mutexWs, portMAX_DELAY);
+    for (int i = 0; i < CONFIG_APP_WS_MAX_CLIENTS; i++) {
+      if (sockfd == s_wsClients[i].fd) {
+        s_wsClients[i].fd = -1;
+        ESP_LOGI(TAG, "Websocket client disconnected fd=%d", sockfd);
+        // The ws task closes the socket when it is done sending to it
+        if (s_wsClients[i].bSending) {
+          s_wsClients[i].closeFd = sockfd;
+          sockfd                 = -1;
+        }
+      }
+    }
+    xSemaphoreGive(s_mutexWs);
   }
 
-  if (0 == strncmp(req->uri, "/cfgespnow", 11)) {
-    ESP_LOGV(TAG, "--------- cfgespnow ---------\n");
-    return config_espnow_get_handler(req);
+  if (-1 != sockfd) {
+    close(sockfd);
   }
+}
 
-  if (0 == strncmp(req->uri, "/docfgespnow", 13)) {
-    ESP_LOGV(TAG, "--------- docfgespnow ---------\n");
-    return do_config_espnow_get_handler(req);
-  }
+///////////////////////////////////////////////////////////////////////////////
+// ws_handler
+//
 
-  if (0 == strncmp(req->uri, "/cfgvscplink", 11)) {
-    ESP_LOGV(TAG, "--------- cfgvscplink ---------\n");
-    return config_vscplink_get_handler(req);
-  }
+static esp_err_t
+ws_handler(httpd_req_t *req)
+{
+  esp_err_t rv;
+  httpd_ws_frame_t frame;
+  uint8_t buf[WEBPAGE_PARAM_SIZE * 2];
 
-  if (0 == strncmp(req->uri, "/docfgvscplink", 13)) {
-    ESP_LOGV(TAG, "--------- docfgvscplink ---------\n");
-    return do_config_vscplink_get_handler(req);
+  // Handshake
+  if (HTTP_GET == req->method) {
+    if (!is_authenticated(req)) {
+      return ESP_FAIL;
+    }
+    return ws_open(req);
   }
 
-  if (0 == strncmp(req->uri, "/cfgmqtt", 8)) {
-    ESP_LOGV(TAG, "--------- cfgmqtt ---------\n");
-    return config_mqtt_get_handler(req);
+  memset(&frame, 0, sizeof(httpd_ws_frame_t));
+  if (ESP_OK != (rv = httpd_ws_recv_frame(req, &frame, 0))) {
+    return rv;
   }
 
-  if (0 == strncmp(req->uri, "/docfgmqtt", 10)) {
-    ESP_LOGV(TAG, "--------- docfgmqtt ---------\n");
-    return do_config_mqtt_get_handler(req);
+  // Only short settings frames are expected from the client. The payload
+  // can not be skipped in pieces (httpd_ws_recv_frame wants the whole frame),
+  // so an oversized frame closes the session instead of desyncing it.
+  if (frame.len >= sizeof(buf)) {
+    ESP_LOGW(TAG, "Websocket frame too large (%u bytes), closing fd=%d", frame.len, httpd_req_to_sockfd(req));
+    return ESP_FAIL;
   }
 
-  if (0 == strncmp(req->uri, "/cfgweb", 7)) {
-    ESP_LOGV(TAG, "--------- cfgweb ---------\n");
-    return config_web_get_handler(req);
+  frame.payload = buf;
+  if (ESP_OK != (rv = httpd_ws_recv_frame(req, &frame, sizeof(buf) - 1))) {
+    return rv;
   }
+  buf[frame.len] = '\0';
 
-  if (0 == strncmp(req->uri, "/docfgweb", 9)) {
-    ESP_LOGV(TAG, "--------- docfgweb ---------\n");
-    return do_config_web_get_handler(req);
+  // Binary frames are read and ignored
+  if (HTTPD_WS_TYPE_TEXT != frame.type) {
+    return ESP_OK;
   }
 
-  if (0 == strncmp(req->uri, "/cfglog", 7)) {
-    ESP_LOGV(TAG, "--------- cfglog ---------\n");
-    return config_log_get_handler(req);
+  xSemaphoreTake(s_mutexWs, portMAX_DELAY);
+  for (int i = 0; i < CONFIG_APP_WS_MAX_CLIENTS; i++) {
+    if (httpd_req_to_sockfd(req) == s_wsClients[i].fd) {
+      ws_parseSettings(&s_wsClients[i], (const char *) buf);
+    }
   }
+  xSemaphoreGive(s_mutexWs);
 
-  if (0 == strncmp(req->uri, "/docfglog", 9)) {
-    ESP_LOGV(TAG, "--------- docfglog ---------\n");
-    return do_config_log_get_handler(req);
-  }
+  return ESP_OK;
+}
 
-  // ---------------------------------------------------------------
+///////////////////////////////////////////////////////////////////////////////
+// ws_init
+//
 
-  if (0 == strncmp(req->uri, "/info", 5)) {
-    ESP_LOGV(TAG, "--------- info ---------\n");
-    return info_get_handler(req);
+static int
+ws_init(void)
+{
+  if (NULL != s_mutexWs) {
+    return VSCP_ERROR_SUCCESS;
   }
 
-  if (0 == strncmp(req->uri, "/reset", 6)) {
-    ESP_LOGV(TAG, "--------- reset ---------\n");
-    return reset_get_handler(req);
+  s_wsBuf = ESP_MALLOC(CONFIG_APP_WS_FRAME_SIZE);
+  if (NULL == s_wsBuf) {
+    return VSCP_ERROR_MEMORY;
   }
 
-  if (0 == strncmp(req->uri, "/upgrade", 8)) {
-    ESP_LOGV(TAG, "--------- Upgrade main ---------\n");
-    return upgrade_get_handler(req);
+  for (int i = 0; i < CONFIG_APP_WS_MAX_CLIENTS; i++) {
+    memset(&s_wsClients[i], 0, sizeof(ws_client_t));
+    s_wsClients[i].fd      = -1;
+    s_wsClients[i].closeFd = -1;
+    s_wsClients[i].queue = xQueueCreate(CONFIG_APP_WS_QUEUE_SIZE, sizeof(vscpEvent *));
+    if (NULL == s_wsClients[i].queue) {
+      return VSCP_ERROR_MEMORY;
+    }
   }
 
-  if (0 == strncmp(req->uri, "/upgrdsrv", 9)) {
-    ESP_LOGV(TAG, "--------- Upgrade server ---------\n");
-    return upgrdsrv_get_handler(req);
+  s_mutexWs = xSemaphoreCreateMutex();
+  if (NULL == s_mutexWs) {
+    return VSCP_ERROR_MEMORY;
   }
 
-  if (0 == strncmp(req->uri, "/upgrdlocal", 11)) {
-    ESP_LOGV(TAG, "--------- Upgrade local ---------\n");
-    return upgrdlocal_post_handler(req);
+  if (pdPASS != xTaskCreate(ws_task, "ws", 4096, NULL, 5, NULL)) {
+    return VSCP_ERROR_MEMORY;
   }
 
-  if (0 == strncmp(req->uri, "/upgrdSibling", 13)) {
-    ESP_LOGV(TAG, "--------- Upgrade sibling(s) from server ---------\n");
-    return upgrdsibling_get_handler(req);
+  return eventbus_subscribe("wsbus", EVENTBUS_TRANSPORT_WEBSOCKET, 0, 0, ws_eventbus_cb, NULL, NULL);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// websrv_get_ws_stats
+//
+
+int
+websrv_get_ws_stats(int idx, websrv_ws_stats_t *pstats)
+{
+  int rv = VSCP_ERROR_SUCCESS;
+
+  // Check pointer
+  if (NULL == pstats) {
+    return VSCP_ERROR_INVALID_POINTER;
   }
 
-  if (0 == strncmp(req->uri, "/upgrdSiblingLocal", 18)) {
-    ESP_LOGV(TAG, "--------- Upgrade sibling(s) local ---------\n");
-    return upgrdSiblingslocal_post_handler(req);
+  if ((idx < 0) || (idx >= CONFIG_APP_WS_MAX_CLIENTS)) {
+    return VSCP_ERROR_INDEX_OOB;
   }
 
-  if (0 == strncmp(req->uri, "/provisioning", 13)) {
-    ESP_LOGV(TAG, "--------- Provisioning ---------\n");
-    return provisioning_get_handler(req);
+  if (NULL == s_mutexWs) {
+    return VSCP_ERROR_INIT_MISSING;
   }
 
-  if (0 == strncmp(req->uri, "/doprov", 7)) {
-    ESP_LOGV(TAG, "--------- doprov ---------\n");
-    return doprov_get_handler(req);
+  xSemaphoreTake(s_mutexWs, portMAX_DELAY);
+  if (-1 == s_wsClients[idx].fd) {
+    rv = VSCP_ERROR_UNKNOWN_ITEM;
+  }
+  else {
+    memcpy(pstats, &s_wsClients[idx].stats, sizeof(websrv_ws_stats_t));
+    pstats->nQueued = uxQueueMessagesWaiting(s_wsClients[idx].queue);
   }
+  xSemaphoreGive(s_mutexWs);
 
-  return ESP_OK;
+  return rv;
+}
 
-  // ------------------------------------------------------------------------------------------
+///////////////////////////////////////////////////////////////////////////////
+// mqttcert_post_handler
+//
+// Store the PEM certificate used to verify the MQTT broker. The request
+// body is the certificate. An empty body removes it. Used from
+//   curl -u user:password --data-binary @ca.pem http://<node>/mqttcert
+// The running MQTT client keeps its certificate. A reboot is required
+// for the new one to be used, the reply says so.
+//
 
-  // If name has trailing '/', respond with directory contents
-  if (0 == strcmp(req->uri, "/")) {
-    ESP_LOGD(TAG, "Set default uri");
-    strcpy((char *) req->uri, "/index.html");
-  }
+static esp_err_t
+mqttcert_post_handler(httpd_req_t *req)
+{
+  int rv;
+  char *pem;
+  size_t len = 0;
 
-  const char *filename = get_path_from_uri(filepath, "/spiffs", req->uri, sizeof(filepath));
-  if (!filename) {
-    ESP_LOGE(TAG, "Filename is too long");
-    // Respond with 500 Internal Server Error
-    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Filename too long");
-    return ESP_FAIL;
+  if (ESP_OK != check_basic_auth(req)) {
+    return ESP_OK;
   }
 
-  if (stat(filepath, &file_stat) == -1) {
-    // If file not present on SPIFFS check if URI
-    // corresponds to one of the hardcoded paths
-    if (strcmp(filename, "/index.html") == 0) {
-      // return index_html_get_handler(req);
-    }
-    else if (strcmp(filename, "/favicon.ico") == 0) {
-      // return favicon_get_handler(req);
-    }
-    ESP_LOGE(TAG, "Failed to stat file : %s", filepath);
-    // Respond with 404 Not Found
-    httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File does not exist");
+  if (req->content_len > CONFIG_APP_MQTT_CA_MAX_SIZE) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Certificate too large");
     return ESP_FAIL;
   }
 
-  fd = fopen(filepath, "r");
-  if (!fd) {
-    ESP_LOGE(TAG, "Failed to read existing file : %s", filepath);
-    // Respond with 500 Internal Server Error
-    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to read existing file");
-    return ESP_FAIL;
+  pem = ESP_MALLOC(req->content_len + 1);
+  if (NULL == pem) {
+    httpd_resp_send_500(req);
+    return ESP_ERR_NO_MEM;
   }
 
-  ESP_LOGD(TAG, "Sending file : %s (%ld bytes)...", filename, file_stat.st_size);
-  set_content_type_from_file(req, filename);
+  while (len < req->content_len) {
 
-  // Retrieve the pointer to chunk buffer for temporary storage
-  char *chunk = (char *) req->user_ctx;
-  size_t chunksize;
-  do {
-    // Read file in chunks into the chund buffer
-    memset(chunk, 0, sizeof(req->user_ctx));
-    chunksize = fread(chunk, 1, CHUNK_BUFSIZE, fd);
+    int recv_len = httpd_req_recv(req, pem + len, req->content_len - len);
 
-    if (chunksize > 0) {
-      // Send the buffer contents as HTTP response chunk
-      if (httpd_resp_send_chunk(req, chunk, chunksize) != ESP_OK) {
-        fclose(fd);
-        ESP_LOGE(TAG, "File sending failed!");
-        // Abort sending file
-        httpd_resp_sendstr_chunk(req, NULL);
-        // Respond with 500 Internal Server Error
-        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to send file");
-        return ESP_FAIL;
-      }
+    // Timeout Error: Just retry
+    if (recv_len == HTTPD_SOCK_ERR_TIMEOUT) {
+      continue;
+    }
+    else if (recv_len <= 0) {
+      ESP_LOGE(TAG, "Certificate upload aborted due to protocol error");
+      ESP_FREE(pem);
+      return ESP_FAIL;
     }
 
-    // Keep looping till the whole file is sent
-  } while (chunksize != 0);
+    len += recv_len;
+  }
+  pem[len] = '\0';
 
-  // Close file after sending complete
-  fclose(fd);
-  ESP_LOGD(TAG, "File sending complete");
+  rv = mqtt_set_server_cert(pem);
+  ESP_FREE(pem);
 
-  /* Respond with an empty chunk to signal HTTP response completion */
-#ifdef CONFIG_EXAMPLE_HTTPD_CONN_CLOSE_HEADER
-  httpd_resp_set_hdr(req, "Connection", "close");
-#endif
-  httpd_resp_send_chunk(req, NULL, 0);
-  return ESP_OK;
+  if (VSCP_ERROR_SUCCESS != rv) {
+    ESP_LOGE(TAG, "Failed to store MQTT server certificate rv=%d", rv);
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to store certificate");
+    return ESP_FAIL;
+  }
+
+  ESP_LOGI(TAG, "MQTT server certificate %s", len ? "stored" : "removed");
+  httpd_resp_set_type(req, "application/json");
+  return httpd_resp_sendstr(req,
+                            len ? "{\"cert\":\"stored\",\"reboot\":true}" : "{\"cert\":\"removed\",\"reboot\":true}");
 }
 
+static const httpd_uri_t mqttcert = { .uri      = "/mqttcert",
+                                      .method   = HTTP_POST,
+                                      .handler  = mqttcert_post_handler,
+                                      .user_ctx = NULL };
+
 ///////////////////////////////////////////////////////////////////////////////
 // start_webserver
 //
@@ -3793,6 +3247,15 @@ start_webserver(void)
 
   dfltconfig.max_uri_handlers = 20;
 
+  websrv_update_credentials();
+
+  // Websocket clients are released when their socket is closed
+  dfltconfig.close_fn = ws_close;
+
+  if (VSCP_ERROR_SUCCESS != ws_init()) {
+    ESP_LOGE(TAG, "Failed to initialize websocket event stream");
+  }
+
   // Start the httpd server
   ESP_LOGD(TAG, "Starting server on port: '%d'", dfltconfig.server_port);
   if (httpd_start(&srv, &dfltconfig) == ESP_OK) {
@@ -3811,14 +3274,23 @@ start_webserver(void)
                          .handler  = default_get_handler,
                          .user_ctx = NULL };
 
+    // Live event stream. Must be registered before the wildcard handler.
+    httpd_uri_t ws = { .uri          = "/ws",
+                       .method       = HTTP_GET,
+                       .handler      = ws_handler,
+                       .user_ctx     = NULL,
+                       .is_websocket = true };
+
     // httpd_register_uri_handler(srv, &hello);
     // httpd_register_uri_handler(srv, &echo);
     // httpd_register_uri_handler(srv, &ctrl);
     // httpd_register_uri_handler(srv, &mainpg);
+    httpd_register_uri_handler(srv, &ws);
     httpd_register_uri_handler(srv, &dflt);
 
     httpd_register_uri_handler(srv, &upgrdlocal);
     httpd_register_uri_handler(srv, &upgrdsiblinglocal);
+    httpd_register_uri_handler(srv, &mqttcert);
 
     // httpd_register_uri_handler(srv, &config);
     //  httpd_register_uri_handler(srv, &cfgModule);
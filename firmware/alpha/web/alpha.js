@@ -0,0 +1,2 @@
+function startUpload(){var e,t=document.getElementById("otafile").files;0==t.length?alert("No file selected!"):(document.getElementById("otafile").disabled=!0,document.getElementById("upload").disabled=!0,t=t[0],(e=new XMLHttpRequest).onreadystatechange=function(){4==e.readyState&&(200==e.status?(document.open(),document.write(e.responseText),document.close()):(0==e.status?alert("Server closed the connection abruptly!"):alert(e.status+" Error!"+e.responseText),location.reload()))},e.upload.onprogress=function(e){document.getElementById("progress").textContent="Progress: "+(e.loaded/e.total*100).toFixed(0)+"%"},e.open("POST","/upgrdlocal",!0),e.send(t))}
+function startUploadSibLocal(){var e,t=document.getElementById("otafile_sib").files;0==t.length?alert("No file selected!"):(document.getElementById("otafile_sib").disabled=!0,document.getElementById("upload_sib").disabled=!0,t=t[0],(e=new XMLHttpRequest).onreadystatechange=function(){4==e.readyState&&(200==e.status?(document.open(),document.write(e.responseText),document.close()):(0==e.status?alert("Server closed the connection abruptly!"):alert(e.status+" Error!"+e.responseText),location.reload()))},e.upload.onprogress=function(e){document.getElementById("progress_sib").textContent="Progress: "+(e.loaded/e.total*100).toFixed(0)+"%"},e.open("POST","/upgrdSiblingLocal",!0),e.send(t))}
@@ -56,6 +56,8 @@
 #include <vscp-type.h>
 
 #include "beta.h"
+#include "vscp-delta.h"
+#include "vscp-fota.h"
 
 #ifndef CONFIG_ESPNOW_VERSION
 #define ESPNOW_VERSION 2
@@ -465,17 +467,60 @@ readPersistentConfigs(void)
 //                                  OTA
 //-----------------------------------------------------------------------------
 
+///////////////////////////////////////////////////////////////////////////////
+// app_ota_resume_set
+//
+// Remember that a firmware transfer is in progress. The responder saves
+// the packet bitmap and image hash to flash as packets arrive, but it is
+// only started on request so after a restart it must be started again
+// for the transfer to continue.
+//
+
+static void
+app_ota_resume_set(bool resume)
+{
+  if (ESP_OK != nvs_set_u8(s_nvsHandle, "otaresume", resume ? 1 : 0)) {
+    ESP_LOGE(TAG, "Failed to save OTA resume state");
+    return;
+  }
+
+  nvs_commit(s_nvsHandle);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// app_ota_fec_done
+//
+// A broadcast firmware update is verified and set as boot partition
+//
+
+static void
+app_ota_fec_done(void)
+{
+  ESP_LOGI(TAG, "Broadcast firmware update done. Restarting");
+  app_ota_resume_set(false);
+  blink_switch_type(s_led_handle_green, BLINK_CONNECTED);
+  vTaskDelay(pdMS_TO_TICKS(2000));
+  esp_restart();
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // app_ota_responder_start
 //
+// Listen for both ack driven and broadcast (FEC) firmware updates
+//
 
 esp_err_t
 app_ota_responder_start()
 {
   espnow_ota_config_t ota_config = {
     .skip_version_check       = true,
-    .progress_report_interval = 10,
+    .progress_report_interval = CONFIG_APP_ESPNOW_OTA_SAVE_INTERVAL,
   };
+
+  if (VSCP_ERROR_SUCCESS != vscp_fota_receiver_start(app_ota_fec_done)) {
+    ESP_LOGW(TAG, "Broadcast firmware update not available");
+  }
+
   return espnow_ota_responder_start(&ota_config);
 }
 
@@ -486,9 +531,105 @@ app_ota_responder_start()
 esp_err_t
 app_ota_responder_stop()
 {
+  app_ota_resume_set(false);
+  vscp_fota_receiver_stop();
   return espnow_ota_responder_stop();
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// app_ota_resume
+//
+// Start the responder again if a transfer was interrupted by a restart.
+// The initiator asks for the packet bitmap and only send missing packets.
+//
+
+static void
+app_ota_resume(void)
+{
+  uint8_t resume = 0;
+
+  if ((ESP_OK != nvs_get_u8(s_nvsHandle, "otaresume", &resume)) || !resume) {
+    return;
+  }
+
+  ESP_LOGI(TAG, "Resuming interrupted firmware update");
+  if (ESP_OK == app_ota_responder_start()) {
+    blink_switch_type(s_led_handle_green, BLINK_UPDATING);
+    s_stateNode = BETA_STATE_OTA;
+    time_ota    = getMilliSeconds();
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// app_ota_delta_check
+//
+// A delta is received like a full image and stored as is in the update
+// partition. The responder then fails to set it as boot partition, but it
+// keeps running and its status is reset by the next status request of the
+// initiator, so the status can't tell when the delta is done. The digest
+// of the operation list in the delta header can. Rebuild the new image
+// from the delta and restart. If it can't be used the OTA window is opened
+// again so the alpha node can send the full image.
+//
+// The digest is only calculated when nothing was written since the last
+// call, not for every second of a running transfer.
+//
+
+static void
+app_ota_delta_check(void)
+{
+  int rv;
+  espnow_ota_status_t status;
+  static uint32_t lastWritten = UINT32_MAX;
+  static uint32_t lastChecked = UINT32_MAX;
+
+  // Nothing received since boot
+  if ((ESP_OK != espnow_ota_responder_get_status(&status)) || !status.total_size) {
+    return;
+  }
+
+  // Transfer still running
+  if (status.written_size != lastWritten) {
+    lastWritten = status.written_size;
+    lastChecked = UINT32_MAX;
+    return;
+  }
+
+  // This state has already been checked
+  if (status.written_size == lastChecked) {
+    return;
+  }
+  lastChecked = status.written_size;
+
+  if (!vscp_delta_complete(status.total_size)) {
+    return;
+  }
+
+  // The responder has dropped its saved state, nothing left to resume
+  app_ota_resume_set(false);
+
+  // No new transfer to the update partition while the image is rebuilt
+  espnow_set_config_for_data_type(ESPNOW_DATA_TYPE_OTA_DATA, false, NULL);
+  blink_switch_type(s_led_handle_green, BLINK_UPDATING);
+
+  rv = vscp_delta_apply(status.total_size);
+  if (VSCP_ERROR_SUCCESS == rv) {
+    ESP_LOGI(TAG, "Firmware updated from delta. Restarting");
+    blink_switch_type(s_led_handle_green, BLINK_CONNECTED);
+    vTaskDelay(pdMS_TO_TICKS(2000));
+    esp_restart();
+  }
+
+  ESP_LOGW(TAG, "Delta not applied rv=%d. Waiting for full image", rv);
+  if (ESP_OK == app_ota_responder_start()) {
+    s_stateNode = BETA_STATE_OTA;
+    time_ota    = getMilliSeconds();
+  }
+  else {
+    blink_switch_type(s_led_handle_green, BLINK_CONNECTED);
+  }
+}
+
 //-----------------------------------------------------------------------------
 //                                  SEC
 //-----------------------------------------------------------------------------
@@ -677,15 +818,20 @@ app_system_event_handler(void *arg, esp_event_base_t event_base, int32_t event_i
       case ESP_EVENT_ESPNOW_OTA_STARTED:
         ESP_LOGI(TAG, "ESP_EVENT_ESPNOW_OTA_STARTED");
         blink_switch_type(s_led_handle_green, BLINK_UPDATING);
+        app_ota_resume_set(true);
+        time_ota = getMilliSeconds();
         break;
 
       case ESP_EVENT_ESPNOW_OTA_STATUS: {
         uint32_t write_percentage = *((uint32_t *) event_data);
         ESP_LOGI(TAG, "ESP_EVENT_ESPNOW_OTA_STATUS  %ld", write_percentage);
+        // Keep the OTA window open while data is coming in
+        time_ota = getMilliSeconds();
       } break;
 
       case ESP_EVENT_ESPNOW_OTA_FINISH:
         ESP_LOGI(TAG, "ESP_EVENT_ESPNOW_OTA_FINISH");
+        app_ota_resume_set(false);
         blink_switch_type(s_led_handle_green, BLINK_CONNECTED);
         vTaskDelay(pdMS_TO_TICKS(2000));
         esp_restart();
@@ -867,6 +1013,9 @@ app_main()
   setenv("TZ", "GMT", 1);
   tzset();
 
+  // Continue a firmware update that was interrupted by a restart
+  app_ota_resume();
+
   while (1) {
     if ((BETA_STATE_VIRGIN == s_stateNode) && (ESP_OK == espnow_get_key(key_info))) {
       blink_switch_type(s_led_handle_green, BLINK_CONNECTED);
@@ -878,9 +1027,19 @@ app_main()
     vTaskDelay(pdMS_TO_TICKS(1000));
     taskYIELD();
 
+    // Apply a received firmware delta
+    app_ota_delta_check();
+
+    // Keep the OTA window open during a broadcast firmware update
+    if ((VSCP_FOTA_STATE_PREPARING == vscp_fota_receiver_get_state()) ||
+        (VSCP_FOTA_STATE_RECEIVING == vscp_fota_receiver_get_state())) {
+      time_ota = getMilliSeconds();
+    }
+
     // Check if OTA takes to long
     if ((BETA_STATE_OTA == s_stateNode) && ((getMilliSeconds() - time_ota) > 120000)) {
       ESP_LOGW(TAG, "OTA valid period over. Go back to IDLE");
+      app_ota_resume_set(false);
       s_stateNode = BETA_STATE_IDLE;
       blink_switch_type(s_led_handle_green, BLINK_CONNECTED);
     }
@@ -0,0 +1,461 @@
+/**
+ * @brief           Binary delta firmware update
+ * @file            vscp-delta.c
+ * @author          Ake Hedman, The VSCP Project, www.vscp.org
+ *
+ *********************************************************************/
+
+/* ******************************************************************************
+ * VSCP (Very Simple Control Protocol)
+ * http://www.vscp.org
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright © 2000-2025 Ake Hedman, the VSCP project <info@vscp.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  This file is part of VSCP - Very Simple Control Protocol
+ *  http://www.vscp.org
+ *
+ * ******************************************************************************
+ */
+
+#include <string.h>
+#include <sys/param.h>
+
+#include <esp_log.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <spi_flash_mmap.h>
+#include <mbedtls/sha256.h>
+
+#include <espnow_utils.h>
+
+#include <vscp.h>
+
+#include "vscp-delta.h"
+
+static const char *TAG = "delta";
+
+// Flash is read and written in blocks of this size
+#define DELTA_BLOCK_SIZE 1024
+
+#define DELTA_ALIGN_UP(x) (((x) + SPI_FLASH_SEC_SIZE - 1) & ~(SPI_FLASH_SEC_SIZE - 1))
+
+/*
+  Sequential reader for the operation list. The delta is read from flash
+  in small pieces so the size of it is not limited by free RAM.
+*/
+typedef struct {
+  const esp_partition_t *part; // Partition holding the delta
+  size_t pos;                  // Next offset to read
+  size_t end;                  // End of operation list
+} delta_reader_t;
+
+///////////////////////////////////////////////////////////////////////////////
+// delta_read
+//
+
+static int
+delta_read(delta_reader_t *prd, void *buf, size_t len)
+{
+  if (len > (prd->end - prd->pos)) {
+    ESP_LOGE(TAG, "Operation list is truncated");
+    return VSCP_ERROR_INVALID_FRAME;
+  }
+
+  if (ESP_OK != esp_partition_read(prd->part, prd->pos, buf, len)) {
+    return VSCP_ERROR_ERROR;
+  }
+
+  prd->pos += len;
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// delta_read_u32
+//
+
+static int
+delta_read_u32(delta_reader_t *prd, uint32_t *pval)
+{
+  int rv;
+  uint8_t buf[4];
+
+  if (VSCP_ERROR_SUCCESS != (rv = delta_read(prd, buf, sizeof(buf)))) {
+    return rv;
+  }
+
+  *pval = ((uint32_t) buf[3] << 24) | ((uint32_t) buf[2] << 16) | ((uint32_t) buf[1] << 8) | buf[0];
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// delta_check_body
+//
+// Calculate the digest of the operation list and compare it with the
+// one in the header.
+//
+
+static int
+delta_check_body(const esp_partition_t *part, size_t offset, const vscp_delta_hdr_t *phdr, uint8_t *buf)
+{
+  int rv = VSCP_ERROR_SUCCESS;
+  uint8_t digest[32];
+  mbedtls_sha256_context ctx;
+
+  mbedtls_sha256_init(&ctx);
+  mbedtls_sha256_starts(&ctx, 0);
+
+  for (size_t pos = 0; pos < phdr->bodySize; pos += DELTA_BLOCK_SIZE) {
+    size_t n = MIN(DELTA_BLOCK_SIZE, phdr->bodySize - pos);
+    if (ESP_OK != esp_partition_read(part, offset + pos, buf, n)) {
+      rv = VSCP_ERROR_ERROR;
+      break;
+    }
+    mbedtls_sha256_update(&ctx, buf, n);
+  }
+
+  mbedtls_sha256_finish(&ctx, digest);
+  mbedtls_sha256_free(&ctx);
+
+  if ((VSCP_ERROR_SUCCESS == rv) && memcmp(digest, phdr->bodyDigest, sizeof(digest))) {
+    rv = VSCP_ERROR_INVALID_FRAME;
+  }
+
+  return rv;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// delta_move
+//
+// Move the delta to the end of the partition so the new image can be
+// written from the start.
+//
+
+static int
+delta_move(const esp_partition_t *part, size_t size, size_t to, uint8_t *buf)
+{
+  if (ESP_OK != esp_partition_erase_range(part, to, part->size - to)) {
+    return VSCP_ERROR_WRITE_ERROR;
+  }
+
+  for (size_t pos = 0; pos < size; pos += DELTA_BLOCK_SIZE) {
+    size_t n = MIN(DELTA_BLOCK_SIZE, size - pos);
+    if (ESP_OK != esp_partition_read(part, pos, buf, n)) {
+      return VSCP_ERROR_ERROR;
+    }
+    if (ESP_OK != esp_partition_write(part, to + pos, buf, n)) {
+      return VSCP_ERROR_WRITE_ERROR;
+    }
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// delta_build
+//
+// Run the operation list and write the new image.
+//
+
+static int
+delta_build(delta_reader_t *prd,
+            const esp_partition_t *running,
+            const vscp_delta_hdr_t *phdr,
+            esp_ota_handle_t handle,
+            uint8_t *buf)
+{
+  int rv;
+  uint8_t op;
+  uint32_t offset;
+  uint32_t len;
+  size_t written = 0;
+
+  for (;;) {
+
+    if (VSCP_ERROR_SUCCESS != (rv = delta_read(prd, &op, 1))) {
+      return rv;
+    }
+
+    if (VSCP_DELTA_OP_END == op) {
+      break;
+    }
+
+    if (VSCP_DELTA_OP_COPY == op) {
+      if ((VSCP_ERROR_SUCCESS != (rv = delta_read_u32(prd, &offset))) ||
+          (VSCP_ERROR_SUCCESS != (rv = delta_read_u32(prd, &len)))) {
+        return rv;
+      }
+      if ((offset > phdr->srcSize) || (len > (phdr->srcSize - offset))) {
+        ESP_LOGE(TAG, "Copy outside source image offset=%lu len=%lu", (unsigned long) offset, (unsigned long) len);
+        return VSCP_ERROR_INVALID_FRAME;
+      }
+    }
+    else if (VSCP_DELTA_OP_DATA == op) {
+      if (VSCP_ERROR_SUCCESS != (rv = delta_read_u32(prd, &len))) {
+        return rv;
+      }
+    }
+    else {
+      ESP_LOGE(TAG, "Unknown operation %d", op);
+      return VSCP_ERROR_INVALID_FRAME;
+    }
+
+    if (len > (phdr->dstSize - written)) {
+      ESP_LOGE(TAG, "Target image overflow");
+      return VSCP_ERROR_INVALID_FRAME;
+    }
+
+    while (len) {
+      size_t n = MIN(DELTA_BLOCK_SIZE, len);
+      if (VSCP_DELTA_OP_COPY == op) {
+        if (ESP_OK != esp_partition_read(running, offset, buf, n)) {
+          return VSCP_ERROR_ERROR;
+        }
+        offset += n;
+      }
+      else if (VSCP_ERROR_SUCCESS != (rv = delta_read(prd, buf, n))) {
+        return rv;
+      }
+      if (ESP_OK != esp_ota_write(handle, buf, n)) {
+        return VSCP_ERROR_WRITE_ERROR;
+      }
+      written += n;
+      len -= n;
+    }
+  }
+
+  if (written != phdr->dstSize) {
+    ESP_LOGE(TAG, "Target image size %u expected %lu", (unsigned) written, (unsigned long) phdr->dstSize);
+    return VSCP_ERROR_INVALID_FRAME;
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_delta_check_header
+//
+
+int
+vscp_delta_check_header(const vscp_delta_hdr_t *phdr, size_t size)
+{
+  // Check pointer
+  if (NULL == phdr) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if ((VSCP_DELTA_MAGIC != phdr->magic) || (VSCP_DELTA_VERSION != phdr->version) ||
+      (sizeof(vscp_delta_hdr_t) != phdr->hdrsize)) {
+    return VSCP_ERROR_INVALID_FRAME;
+  }
+
+  if ((size < sizeof(vscp_delta_hdr_t)) || ((size - sizeof(vscp_delta_hdr_t)) != phdr->bodySize)) {
+    return VSCP_ERROR_INVALID_FRAME;
+  }
+
+  if (!phdr->srcSize || !phdr->dstSize) {
+    return VSCP_ERROR_INVALID_FRAME;
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_delta_is_source
+//
+
+bool
+vscp_delta_is_source(const vscp_delta_hdr_t *phdr, const esp_app_desc_t *pdesc)
+{
+  // Check pointers
+  if ((NULL == phdr) || (NULL == pdesc)) {
+    return false;
+  }
+
+  return (0 == strncmp(phdr->srcVersion, pdesc->version, sizeof(phdr->srcVersion))) &&
+         (0 == strncmp(phdr->srcProjectName, pdesc->project_name, sizeof(phdr->srcProjectName))) &&
+         (0 == strncmp(phdr->srcTime, pdesc->time, sizeof(phdr->srcTime))) &&
+         (0 == strncmp(phdr->srcDate, pdesc->date, sizeof(phdr->srcDate)));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_delta_pending
+//
+
+bool
+vscp_delta_pending(size_t size)
+{
+  vscp_delta_hdr_t hdr;
+  const esp_partition_t *update = esp_ota_get_next_update_partition(NULL);
+
+  if ((NULL == update) || (size < sizeof(hdr))) {
+    return false;
+  }
+
+  if (ESP_OK != esp_partition_read(update, 0, &hdr, sizeof(hdr))) {
+    return false;
+  }
+
+  return (VSCP_ERROR_SUCCESS == vscp_delta_check_header(&hdr, size));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_delta_complete
+//
+
+bool
+vscp_delta_complete(size_t size)
+{
+  bool bComplete = false;
+  uint8_t *buf;
+  vscp_delta_hdr_t hdr;
+  const esp_partition_t *update = esp_ota_get_next_update_partition(NULL);
+
+  if (!vscp_delta_pending(size) || (ESP_OK != esp_partition_read(update, 0, &hdr, sizeof(hdr)))) {
+    return false;
+  }
+
+  buf = ESP_MALLOC(DELTA_BLOCK_SIZE);
+  if (NULL == buf) {
+    return false;
+  }
+
+  bComplete = (VSCP_ERROR_SUCCESS == delta_check_body(update, sizeof(hdr), &hdr, buf));
+  ESP_FREE(buf);
+
+  return bComplete;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_delta_apply
+//
+
+int
+vscp_delta_apply(size_t size)
+{
+  int rv;
+  size_t tail;
+  uint8_t *buf;
+  uint8_t digest[32];
+  vscp_delta_hdr_t hdr;
+  delta_reader_t rd;
+  esp_ota_handle_t handle;
+  const esp_partition_t *running = esp_ota_get_running_partition();
+  const esp_partition_t *update  = esp_ota_get_next_update_partition(NULL);
+
+  if ((NULL == running) || (NULL == update)) {
+    return VSCP_ERROR_INIT_MISSING;
+  }
+
+  if ((size < sizeof(hdr)) || (ESP_OK != esp_partition_read(update, 0, &hdr, sizeof(hdr)))) {
+    return VSCP_ERROR_ERROR;
+  }
+
+  if (VSCP_ERROR_SUCCESS != (rv = vscp_delta_check_header(&hdr, size))) {
+    ESP_LOGE(TAG, "No valid delta in update partition");
+    return rv;
+  }
+
+  buf = ESP_MALLOC(DELTA_BLOCK_SIZE);
+  if (NULL == buf) {
+    return VSCP_ERROR_MEMORY;
+  }
+
+  ESP_LOGI(TAG,
+           "Delta %u bytes, %lu -> %lu bytes, source %.32s %.16s %.16s",
+           (unsigned) size,
+           (unsigned long) hdr.srcSize,
+           (unsigned long) hdr.dstSize,
+           hdr.srcVersion,
+           hdr.srcDate,
+           hdr.srcTime);
+
+  if (VSCP_ERROR_SUCCESS != (rv = delta_check_body(update, sizeof(hdr), &hdr, buf))) {
+    ESP_LOGE(TAG, "Delta is incomplete or corrupt");
+    goto EXIT;
+  }
+
+  // The delta is only valid for the image it was made from
+  if ((ESP_OK != esp_partition_get_sha256(running, digest)) || memcmp(digest, hdr.srcDigest, sizeof(digest)) ||
+      (hdr.srcSize > running->size)) {
+    ESP_LOGW(TAG, "Running image is not the source of the delta");
+    rv = VSCP_ERROR_UNKNOWN_ITEM;
+    goto EXIT;
+  }
+
+  // There must be room for both the new image and the delta
+  tail = (update->size - size) & ~(SPI_FLASH_SEC_SIZE - 1);
+  if ((size > update->size) || (tail < size) || (tail < DELTA_ALIGN_UP(hdr.dstSize))) {
+    ESP_LOGE(TAG, "Update partition too small for image and delta");
+    rv = VSCP_ERROR_BUFFER_TO_SMALL;
+    goto EXIT;
+  }
+
+  if (VSCP_ERROR_SUCCESS != (rv = delta_move(update, size, tail, buf))) {
+    ESP_LOGE(TAG, "Failed to move delta rv=%d", rv);
+    goto EXIT;
+  }
+
+  // Erases the start of the partition, including the old copy of the delta
+  if (ESP_OK != esp_ota_begin(update, hdr.dstSize, &handle)) {
+    rv = VSCP_ERROR_WRITE_ERROR;
+    goto EXIT;
+  }
+
+  rd.part = update;
+  rd.pos  = tail + sizeof(hdr);
+  rd.end  = tail + size;
+
+  if (VSCP_ERROR_SUCCESS != (rv = delta_build(&rd, running, &hdr, handle, buf))) {
+    esp_ota_abort(handle);
+    goto EXIT;
+  }
+
+  // Validates the image
+  if (ESP_OK != esp_ota_end(handle)) {
+    ESP_LOGE(TAG, "New image is not valid");
+    rv = VSCP_ERROR_INVALID_FRAME;
+    goto EXIT;
+  }
+
+  if ((ESP_OK != esp_partition_get_sha256(update, digest)) || memcmp(digest, hdr.dstDigest, sizeof(digest))) {
+    ESP_LOGE(TAG, "New image does not match target digest");
+    rv = VSCP_ERROR_INVALID_FRAME;
+    goto EXIT;
+  }
+
+  if (ESP_OK != esp_ota_set_boot_partition(update)) {
+    rv = VSCP_ERROR_ERROR;
+    goto EXIT;
+  }
+
+  ESP_LOGI(TAG, "New image written from delta");
+
+EXIT:
+  // Don't try the same delta again
+  if (VSCP_ERROR_SUCCESS != rv) {
+    esp_partition_erase_range(update, 0, SPI_FLASH_SEC_SIZE);
+  }
+
+  ESP_FREE(buf);
+  return rv;
+}
@@ -0,0 +1,164 @@
+/**
+ * @brief           Binary delta firmware update
+ * @file            vscp-delta.h
+ * @author          Ake Hedman, The VSCP Project, www.vscp.org
+ *
+ *********************************************************************/
+
+/* ******************************************************************************
+ * VSCP (Very Simple Control Protocol)
+ * http://www.vscp.org
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright © 2000-2025 Ake Hedman, the VSCP project <info@vscp.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  This file is part of VSCP - Very Simple Control Protocol
+ *  http://www.vscp.org
+ *
+ * ******************************************************************************
+ *
+ * A delta (patch) rebuilds a new firmware image from the image a node is
+ * running. It is made on a PC with tools/vscp-delta and sent to the nodes
+ * with the esp-now OTA protocol instead of the full image. The protocol
+ * stores it raw at the start of the update partition where
+ * vscp_delta_apply finds it and writes the new image.
+ *
+ * A delta is a header followed by a list of operations
+ *
+ *   VSCP_DELTA_OP_COPY - u32 offset, u32 length. Copy from running image.
+ *   VSCP_DELTA_OP_DATA - u32 length, data. New bytes.
+ *   VSCP_DELTA_OP_END  - End of list.
+ *
+ * All numbers are little endian.
+ */
+
+#ifndef VSCP_DELTA_H
+#define VSCP_DELTA_H
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <esp_app_desc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VSCP_DELTA_MAGIC   0x544C4456 // "VDLT"
+#define VSCP_DELTA_VERSION 1
+
+#define VSCP_DELTA_OP_END  0
+#define VSCP_DELTA_OP_COPY 1
+#define VSCP_DELTA_OP_DATA 2
+
+/**
+ * @brief Delta header
+ *
+ * Image digests are the SHA-256 appended to the images, the same value
+ * esp_partition_get_sha256 returns for an app partition. The body digest
+ * tells a complete delta from one where the transfer was stopped. The source
+ * application description is used to select nodes a delta is made for
+ * (esp-now OTA scans report it but not the digest).
+ */
+typedef struct __attribute__((packed)) {
+  uint32_t magic;          // VSCP_DELTA_MAGIC
+  uint16_t version;        // VSCP_DELTA_VERSION
+  uint16_t hdrsize;        // sizeof(vscp_delta_hdr_t)
+  uint32_t srcSize;        // Size of source image
+  uint32_t dstSize;        // Size of target image
+  uint32_t bodySize;       // Size of operation list
+  uint8_t srcDigest[32];   // Digest of source image
+  uint8_t dstDigest[32];   // Digest of target image
+  uint8_t bodyDigest[32];  // SHA-256 of operation list
+  char srcVersion[32];     // Source esp_app_desc_t version
+  char srcProjectName[32]; // Source esp_app_desc_t project_name
+  char srcTime[16];        // Source esp_app_desc_t time
+  char srcDate[16];        // Source esp_app_desc_t date
+} vscp_delta_hdr_t;
+
+/**
+ * @brief Check a delta header
+ *
+ * @param phdr Pointer to header
+ * @param size Size of delta including header
+ * @return VSCP_ERROR_SUCCESS if the header is valid, error code otherwise.
+ */
+int
+vscp_delta_check_header(const vscp_delta_hdr_t *phdr, size_t size);
+
+/**
+ * @brief Check if a delta is made for a node
+ *
+ * @param phdr Pointer to a valid header
+ * @param pdesc Application description reported by the node
+ * @return True if the node runs the source image of the delta.
+ */
+bool
+vscp_delta_is_source(const vscp_delta_hdr_t *phdr, const esp_app_desc_t *pdesc);
+
+/**
+ * @brief Check if the update partition holds a delta
+ *
+ * Only the header is checked. vscp_delta_apply verifies the body.
+ *
+ * @param size Size of the received delta
+ * @return True if a valid delta header is found at the start of the update partition.
+ */
+bool
+vscp_delta_pending(size_t size);
+
+/**
+ * @brief Check if the update partition holds a whole delta
+ *
+ * The header is checked and the digest of the operation list compared
+ * with the one in the header. Packets still missing give a mismatch.
+ *
+ * @param size Size of the received delta
+ * @return True if a complete delta is found at the start of the update partition.
+ */
+bool
+vscp_delta_complete(size_t size);
+
+/**
+ * @brief Rebuild the new image from a delta in the update partition
+ *
+ * The digest of the running image must match the source digest of the
+ * delta. The delta is moved to the end of the update partition and the
+ * new image is written from the start. The new image is verified against
+ * the target digest and set as boot partition. The caller restart the
+ * node. On failure the delta is erased and the boot partition is not
+ * changed.
+ *
+ * @param size Size of the received delta
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+vscp_delta_apply(size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,159 @@
+/**
+ * @brief           Binary trace of the VSCP esp-now hot path
+ * @file            vscp-espnow-trace.c
+ * @author          Ake Hedman, The VSCP Project, www.vscp.org
+ *
+ *********************************************************************/
+
+/* ******************************************************************************
+ * VSCP (Very Simple Control Protocol)
+ * http://www.vscp.org
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright © 2000-2025 Ake Hedman, the VSCP project <info@vscp.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  This file is part of VSCP - Very Simple Control Protocol
+ *  http://www.vscp.org
+ *
+ * ******************************************************************************
+ */
+
+#include <string.h>
+
+#include <esp_timer.h>
+
+#include "vscp-espnow-trace.h"
+
+#ifdef CONFIG_APP_ESPNOW_TRACE
+
+#define TRACE_SIZE CONFIG_APP_ESPNOW_TRACE_SIZE
+
+_Static_assert((TRACE_SIZE & (TRACE_SIZE - 1)) == 0, "CONFIG_APP_ESPNOW_TRACE_SIZE must be a power of two");
+_Static_assert(sizeof(vscp_espnow_trace_rec_t) == 16, "Trace record must be 16 bytes");
+
+static vscp_espnow_trace_rec_t s_traceRing[TRACE_SIZE];
+
+// Records written since boot. The slot of the next record is s_traceHead % TRACE_SIZE
+static uint32_t s_traceHead = 0;
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_espnow_trace_machash
+//
+// FNV-1a over the six address bytes folded to 16 bits.
+//
+
+uint16_t
+vscp_espnow_trace_machash(const uint8_t *mac)
+{
+  uint32_t hash = 2166136261;
+
+  if (NULL == mac) {
+    return 0;
+  }
+
+  for (int i = 0; i < 6; i++) {
+    hash ^= mac[i];
+    hash *= 16777619;
+  }
+
+  return (uint16_t) ((hash >> 16) ^ (hash & 0xffff));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_espnow_trace_add
+//
+
+void
+vscp_espnow_trace_add(uint8_t id,
+                      const uint8_t *mac,
+                      uint16_t vscp_class,
+                      uint16_t vscp_type,
+                      uint16_t len,
+                      int result,
+                      int8_t rssi,
+                      uint8_t channel)
+{
+  // Claim a slot. Concurrent writers always get different slots.
+  uint32_t idx                  = __atomic_fetch_add(&s_traceHead, 1, __ATOMIC_RELAXED);
+  vscp_espnow_trace_rec_t *prec = &s_traceRing[idx & (TRACE_SIZE - 1)];
+
+  prec->timestamp  = (uint32_t) esp_timer_get_time();
+  prec->id         = id;
+  prec->result     = (result > 127) ? 127 : ((result < -128) ? -128 : result);
+  prec->machash    = vscp_espnow_trace_machash(mac);
+  prec->vscp_class = vscp_class;
+  prec->vscp_type  = vscp_type;
+  prec->len        = len;
+  prec->rssi       = rssi;
+  prec->channel    = channel;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_espnow_trace_dump_size
+//
+
+size_t
+vscp_espnow_trace_dump_size(void)
+{
+  return sizeof(vscp_espnow_trace_hdr_t) + sizeof(s_traceRing);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_espnow_trace_dump
+//
+
+size_t
+vscp_espnow_trace_dump(uint8_t *buf, size_t size)
+{
+  vscp_espnow_trace_hdr_t hdr;
+  uint32_t head;
+  uint32_t count;
+
+  if ((NULL == buf) || (size < sizeof(vscp_espnow_trace_hdr_t))) {
+    return 0;
+  }
+
+  head  = __atomic_load_n(&s_traceHead, __ATOMIC_RELAXED);
+  count = (head < TRACE_SIZE) ? head : TRACE_SIZE;
+  if (count > (size - sizeof(vscp_espnow_trace_hdr_t)) / sizeof(vscp_espnow_trace_rec_t)) {
+    count = (size - sizeof(vscp_espnow_trace_hdr_t)) / sizeof(vscp_espnow_trace_rec_t);
+  }
+
+  hdr.magic     = VSCP_ESPNOW_TRACE_MAGIC;
+  hdr.version   = VSCP_ESPNOW_TRACE_VERSION;
+  hdr.recsize   = sizeof(vscp_espnow_trace_rec_t);
+  hdr.count     = count;
+  hdr.total     = head;
+  hdr.timestamp = (uint32_t) esp_timer_get_time();
+  memcpy(buf, &hdr, sizeof(hdr));
+
+  // Newest 'count' records, oldest first
+  for (uint32_t i = 0; i < count; i++) {
+    memcpy(buf + sizeof(hdr) + i * sizeof(vscp_espnow_trace_rec_t),
+           &s_traceRing[(head - count + i) & (TRACE_SIZE - 1)],
+           sizeof(vscp_espnow_trace_rec_t));
+  }
+
+  return sizeof(hdr) + count * sizeof(vscp_espnow_trace_rec_t);
+}
+
+#endif
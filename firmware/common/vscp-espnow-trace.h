@@ -0,0 +1,183 @@
+/**
+ * @brief           Binary trace of the VSCP esp-now hot path
+ * @file            vscp-espnow-trace.h
+ * @author          Ake Hedman, The VSCP Project, www.vscp.org
+ *
+ *********************************************************************/
+
+/* ******************************************************************************
+ * VSCP (Very Simple Control Protocol)
+ * http://www.vscp.org
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright © 2000-2025 Ake Hedman, the VSCP project <info@vscp.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  This file is part of VSCP - Very Simple Control Protocol
+ *  http://www.vscp.org
+ *
+ * ******************************************************************************
+ *
+ * Every frame sent or received over esp-now leaves a fixed size binary record
+ * in a RAM ring instead of a formatted log line. Writers never block or take a
+ * lock so it is cheap enough to keep enabled in production. The ring is dumped
+ * as is (header + records, little endian) and decoded on a PC with
+ * tools/vscp-espnow-trace.
+ */
+
+#ifndef VSCP_ESPNOW_TRACE_H
+#define VSCP_ESPNOW_TRACE_H
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VSCP_ESPNOW_TRACE_MAGIC   0x54524345 // "TRCE"
+#define VSCP_ESPNOW_TRACE_VERSION 1
+
+/**
+ * @brief Trace record ids
+ *
+ * Never renumber. The PC decoder depends on them.
+ */
+typedef enum {
+  VSCP_ESPNOW_TRACE_NONE = 0,
+  VSCP_ESPNOW_TRACE_RX,         // Frame received and accepted
+  VSCP_ESPNOW_TRACE_RX_INVALID, // Frame length or encryption type invalid
+  VSCP_ESPNOW_TRACE_RX_BAD_ID,  // Frame id invalid
+  VSCP_ESPNOW_TRACE_RX_OLD,     // Node time lower than reference time
+  VSCP_ESPNOW_TRACE_RX_DECODE,  // Frame could not be converted to an event
+  VSCP_ESPNOW_TRACE_RX_REPLAY,  // Frame timestamp out of range (replay protection)
+  VSCP_ESPNOW_TRACE_TX,         // Event sent (result is VSCP error code)
+  VSCP_ESPNOW_TRACE_TX_EX,      // Event ex sent (result is VSCP error code)
+  VSCP_ESPNOW_TRACE_PROBE,      // Probe response sent (result is VSCP error code)
+  VSCP_ESPNOW_TRACE_TIME_SYNC,  // System time set from alpha node
+} vscp_espnow_trace_id_t;
+
+/**
+ * @brief One trace record (16 bytes)
+ */
+typedef struct __attribute__((packed)) {
+  uint32_t timestamp;  // Microseconds since boot (low 32 bits)
+  uint8_t id;          // vscp_espnow_trace_id_t
+  int8_t result;       // Result/error code (clamped to -128..127)
+  uint16_t machash;    // Hash of peer MAC address
+  uint16_t vscp_class; // VSCP class
+  uint16_t vscp_type;  // VSCP type
+  uint16_t len;        // Frame length
+  int8_t rssi;         // RSSI for received frames, zero for sent frames
+  uint8_t channel;     // Channel for received frames, zero for sent frames
+} vscp_espnow_trace_rec_t;
+
+/**
+ * @brief Header in front of the records in a dump (20 bytes)
+ */
+typedef struct __attribute__((packed)) {
+  uint32_t magic;     // VSCP_ESPNOW_TRACE_MAGIC
+  uint16_t version;   // VSCP_ESPNOW_TRACE_VERSION
+  uint16_t recsize;   // sizeof(vscp_espnow_trace_rec_t)
+  uint32_t count;     // Number of records that follow, oldest first
+  uint32_t total;     // Records written since boot (total - count were overwritten)
+  uint32_t timestamp; // Microseconds since boot when the dump was taken
+} vscp_espnow_trace_hdr_t;
+
+#ifdef CONFIG_APP_ESPNOW_TRACE
+
+#define VSCP_ESPNOW_TRACE(id, mac, cls, type, len, result, rssi, ch)                                                   \
+  vscp_espnow_trace_add((id), (mac), (cls), (type), (len), (result), (rssi), (ch))
+
+/**
+ * @brief Add a record to the trace ring
+ *
+ * Lock free. Safe to call from any task, including the esp-now receive
+ * callback. Use the VSCP_ESPNOW_TRACE macro so the call goes away when
+ * tracing is disabled.
+ *
+ * @param id Record id (vscp_espnow_trace_id_t)
+ * @param mac Peer MAC address. Can be NULL.
+ * @param vscp_class VSCP class
+ * @param vscp_type VSCP type
+ * @param len Frame length
+ * @param result Result/error code
+ * @param rssi RSSI
+ * @param channel Channel
+ */
+void
+vscp_espnow_trace_add(uint8_t id,
+                      const uint8_t *mac,
+                      uint16_t vscp_class,
+                      uint16_t vscp_type,
+                      uint16_t len,
+                      int result,
+                      int8_t rssi,
+                      uint8_t channel);
+
+/**
+ * @brief Size of a full dump
+ *
+ * @return Number of bytes needed for header and all records in the ring.
+ */
+size_t
+vscp_espnow_trace_dump_size(void);
+
+/**
+ * @brief Dump the trace ring
+ *
+ * Writes a vscp_espnow_trace_hdr_t followed by the newest records that fit
+ * in the buffer, oldest first. The ring is not cleared and tracing goes on
+ * while it is dumped, records written during the dump may be torn.
+ *
+ * @param buf Buffer that get the dump
+ * @param size Size of buffer
+ * @return Number of bytes written. Zero if the buffer can't hold the header.
+ */
+size_t
+vscp_espnow_trace_dump(uint8_t *buf, size_t size);
+
+/**
+ * @brief Hash a MAC address the same way as in trace records
+ *
+ * @param mac MAC address (6 bytes). Can be NULL.
+ * @return 16-bit hash. Zero for NULL.
+ */
+uint16_t
+vscp_espnow_trace_machash(const uint8_t *mac);
+
+#else
+
+#define VSCP_ESPNOW_TRACE(id, mac, cls, type, len, result, rssi, ch)                                                   \
+  do {                                                                                                                 \
+  } while (0)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
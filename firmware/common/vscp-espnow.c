@@ -75,6 +75,7 @@
 #include <vscp.h>
 
 #include "vscp-espnow.h"
+#include "vscp-espnow-trace.h"
 
 #include "vscp-compiler.h"
 #include "vscp-projdefs.h"
@@ -1339,6 +1340,7 @@ vscp_espnow_sendEvent(const uint8_t *destAddr, const vscpEvent *pev, bool bSec,
   rv = VSCP_ERROR_SUCCESS;
 
 ERROR:
+  VSCP_ESPNOW_TRACE(VSCP_ESPNOW_TRACE_TX, destAddr, pev->vscp_class, pev->vscp_type, len, rv, 0, 0);
   ESP_FREE(pbuf);
   return rv;
 }
@@ -1354,8 +1356,6 @@ vscp_espnow_sendEventEx(const uint8_t *destAddr, const vscpEventEx *pex, bool bS
   uint8_t *pbuf;
   size_t len = vscp_espnow_getMinBufSizeEx(pex);
 
-  ESP_LOGI(TAG, "Send Event");
-
   // Need event
   if (NULL == pex) {
     ESP_LOGE(TAG, "Pointer to event ex is NULL");
@@ -1436,6 +1436,7 @@ vscp_espnow_sendEventEx(const uint8_t *destAddr, const vscpEventEx *pex, bool bS
   rv = VSCP_ERROR_SUCCESS;
 
 ERROR:
+  VSCP_ESPNOW_TRACE(VSCP_ESPNOW_TRACE_TX_EX, destAddr, pex->vscp_class, pex->vscp_type, len, rv, 0, 0);
   ESP_FREE(pbuf);
   return rv;
 }
@@ -1665,7 +1666,7 @@ vscp_espnow_data_cb(uint8_t *src_addr, uint8_t *data, size_t size, wifi_pkt_rx_c
     return;
   }
 
-  ESP_LOGI(TAG,
+  ESP_LOGD(TAG,
            "<<< 1.) Receive event from: " MACSTR " , RSSI %d Channel %d, espnow size %zd",
            MAC2STR((src_addr)),
            rx_ctrl->rssi,
@@ -1686,6 +1687,7 @@ vscp_espnow_data_cb(uint8_t *src_addr, uint8_t *data, size_t size, wifi_pkt_rx_c
 
     ESP_LOG_BUFFER_HEXDUMP(TAG, data, size, ESP_LOG_DEBUG);
 
+    VSCP_ESPNOW_TRACE(VSCP_ESPNOW_TRACE_RX_INVALID, src_addr, 0, 0, size, 0, rx_ctrl->rssi, rx_ctrl->channel);
     s_vscpEspNowStats.nRecvFrameFault++; // Increase receive frame faults
     return;
   }
@@ -1696,6 +1698,7 @@ vscp_espnow_data_cb(uint8_t *src_addr, uint8_t *data, size_t size, wifi_pkt_rx_c
              "Frame is invalid. id=%X,  protocol version=%d",
              (data[VSCP_ESPNOW_POS_ID] << 8) + data[VSCP_ESPNOW_POS_ID + 1],
              data[VSCP_ESPNOW_POS_ID + 1] & 0xf);
+    VSCP_ESPNOW_TRACE(VSCP_ESPNOW_TRACE_RX_BAD_ID, src_addr, 0, 0, size, 0, rx_ctrl->rssi, rx_ctrl->channel);
     return;
   }
 
@@ -1718,13 +1721,14 @@ vscp_espnow_data_cb(uint8_t *src_addr, uint8_t *data, size_t size, wifi_pkt_rx_c
   */
   if (node_time < VSCP_ESPNOW_REF_TIME) {
     ESP_LOGW(TAG, "Node time stamp is lower then reference time");
+    VSCP_ESPNOW_TRACE(VSCP_ESPNOW_TRACE_RX_OLD, src_addr, 0, 0, size, 0, rx_ctrl->rssi, rx_ctrl->channel);
     return;
   }
 
   // diff = abs(node_time - (int) tv_now.tv_sec);
   diff = node_time - tv_now.tv_sec;
 
-  ESP_LOGI(TAG, "node_time  node_time: %lld, tv_now: %lld ---------> diff: %ld\n", node_time, tv_now.tv_sec, diff);
+  ESP_LOGD(TAG, "node_time: %lld, tv_now: %lld, diff: %ld", node_time, tv_now.tv_sec, diff);
 
   vscpEvent *pev = vscp_fwhlp_newEvent();
   if (NULL == pev) {
@@ -1733,6 +1737,7 @@ vscp_espnow_data_cb(uint8_t *src_addr, uint8_t *data, size_t size, wifi_pkt_rx_c
   }
 
   if (VSCP_ERROR_SUCCESS != vscp_espnow_frameToEv(pev, data, size, rx_ctrl->timestamp)) {
+    VSCP_ESPNOW_TRACE(VSCP_ESPNOW_TRACE_RX_DECODE, src_addr, 0, 0, size, 0, rx_ctrl->rssi, rx_ctrl->channel);
     vscp_fwhlp_deleteEvent(&pev);
     return;
   }
@@ -1763,6 +1768,14 @@ vscp_espnow_data_cb(uint8_t *src_addr, uint8_t *data, size_t size, wifi_pkt_rx_c
       if (!memcmp(VSCP_ESPNOW_ADDR_PROBE_NODE, VSCP_ESPNOW_ADDR_NONE, 6)) {
         ESP_LOGI(TAG, "Sending probe event on channel %d", rx_ctrl->channel);
         int rv = vscp_espnow_send_probe_event(ESPNOW_ADDR_BROADCAST, rx_ctrl->channel, 1000);
+        VSCP_ESPNOW_TRACE(VSCP_ESPNOW_TRACE_PROBE,
+                          src_addr,
+                          VSCP_CLASS1_PROTOCOL,
+                          VSCP_TYPE_PROTOCOL_NEW_NODE_ONLINE,
+                          size,
+                          rv,
+                          rx_ctrl->rssi,
+                          rx_ctrl->channel);
         xEventGroupSetBits(s_vscp_espnow_event_group, VSCP_ESPNOW_WAIT_PROBE_RESPONSE_BIT);
         s_stateVscpEspNow   = VSCP_ESPNOW_STATE_IDLE;
         g_vscp_espnow_probe = true;
@@ -1770,6 +1783,14 @@ vscp_espnow_data_cb(uint8_t *src_addr, uint8_t *data, size_t size, wifi_pkt_rx_c
       else if (!memcmp(VSCP_ESPNOW_ADDR_PROBE_NODE, src_addr, 6)) {
         ESP_LOGI(TAG, "Sending addressed probe event on channel %d", rx_ctrl->channel);
         int rv = vscp_espnow_send_probe_event(src_addr, rx_ctrl->channel, 1000);
+        VSCP_ESPNOW_TRACE(VSCP_ESPNOW_TRACE_PROBE,
+                          src_addr,
+                          VSCP_CLASS1_PROTOCOL,
+                          VSCP_TYPE_PROTOCOL_NEW_NODE_ONLINE,
+                          size,
+                          rv,
+                          rx_ctrl->rssi,
+                          rx_ctrl->channel);
         xEventGroupSetBits(s_vscp_espnow_event_group, VSCP_ESPNOW_WAIT_PROBE_RESPONSE_BIT);
         s_stateVscpEspNow   = VSCP_ESPNOW_STATE_IDLE;
         g_vscp_espnow_probe = true;
@@ -1787,7 +1808,6 @@ vscp_espnow_data_cb(uint8_t *src_addr, uint8_t *data, size_t size, wifi_pkt_rx_c
   else if ((s_my_node_type == VSCP_DROPLET_BETA) || (s_my_node_type == VSCP_DROPLET_GAMMA)) {
 
     int ret;
-    printf("------------------------------------------------------------------\n");
     if ((node_type == VSCP_DROPLET_ALPHA) && (VSCP_ESPNOW_STATE_PROBE == s_stateVscpEspNow) &&
         (VSCP_CLASS1_PROTOCOL == pev->vscp_class) && (VSCP_TYPE_PROTOCOL_NEW_NODE_ONLINE == pev->vscp_type) &&
         (16 == pev->sizeData)) {
@@ -1854,10 +1874,18 @@ vscp_espnow_data_cb(uint8_t *src_addr, uint8_t *data, size_t size, wifi_pkt_rx_c
                                    ((uint32_t) pev->pdata[3] << 8) + pev->pdata[4]);
       tm.tv_usec = 0;
 
-      ESP_LOGI(TAG, "Setting/updating system time.");
+      ESP_LOGD(TAG, "Setting/updating system time.");
       if (-1 == settimeofday(&tm, NULL)) {
         ESP_LOGE(TAG, "Failed to set time.");
       }
+      VSCP_ESPNOW_TRACE(VSCP_ESPNOW_TRACE_TIME_SYNC,
+                        src_addr,
+                        pev->vscp_class,
+                        pev->vscp_type,
+                        size,
+                        (int) (tm.tv_sec - tv_now.tv_sec),
+                        rx_ctrl->rssi,
+                        rx_ctrl->channel);
 
       diff = 0;
       // diff = abs(node_time - tv_now.tv_sec);
@@ -1887,10 +1915,27 @@ vscp_espnow_data_cb(uint8_t *src_addr, uint8_t *data, size_t size, wifi_pkt_rx_c
 
   if (diff > 1) {
     ESP_LOGE(TAG, "Event have timestamp out of range. diff = %lu", diff);
+    VSCP_ESPNOW_TRACE(VSCP_ESPNOW_TRACE_RX_REPLAY,
+                      src_addr,
+                      pev->vscp_class,
+                      pev->vscp_type,
+                      size,
+                      (diff > 127) ? 127 : diff,
+                      rx_ctrl->rssi,
+                      rx_ctrl->channel);
     goto EXIT;
   }
 
-  ESP_LOGI(TAG,
+  VSCP_ESPNOW_TRACE(VSCP_ESPNOW_TRACE_RX,
+                    src_addr,
+                    pev->vscp_class,
+                    pev->vscp_type,
+                    size,
+                    0,
+                    rx_ctrl->rssi,
+                    rx_ctrl->channel);
+
+  ESP_LOGD(TAG,
            "<<< 2.) esp-now data received: len=%zd ch=%d src=" MACSTR
            " rssi=%d class=%d, type=%d size-data=%d timestamp=%lX",
            size,
@@ -1902,6 +1947,21 @@ vscp_espnow_data_cb(uint8_t *src_addr, uint8_t *data, size_t size, wifi_pkt_rx_c
            pev->sizeData,
            pev->timestamp);
 
+  // The frame only carries the nickname. Build the full GUID of the sending node
+  // (same layout as vscp_espnow_get_node_guid) so the event can be forwarded.
+  memset(pev->GUID, 0xff, 7);
+  pev->GUID[7] = 0xfe;
+  memcpy(pev->GUID + 8, src_addr, ESP_NOW_ETH_ALEN);
+
+  // Let the application forward the event (gateway)
+  if (NULL != s_vscp_event_handler_cb) {
+    vscp_espnow_rx_info_t info;
+    memcpy(info.src_addr, src_addr, ESP_NOW_ETH_ALEN);
+    info.node_type = node_type;
+    info.rssi      = rx_ctrl->rssi;
+    s_vscp_event_handler_cb(pev, &info);
+  }
+
   // Handle incomming events
   vscp_espnow_event_process(pev);
 
@@ -239,7 +239,17 @@ ESP_EVENT_DECLARE_BASE(VSCP_ESPNOW_EVENT); // declaration of the vscp espnow eve
 
 // Callback functions
 
-// Callback for esp-now received events
+/*
+  Information about the frame a received event came in. A pointer to this
+  structure is given as userdata to the VSCP event handler callback.
+*/
+typedef struct {
+  uint8_t src_addr[ESP_NOW_ETH_ALEN]; // MAC address of sending node
+  uint8_t node_type;                  // VSCP_DROPLET_ALPHA / VSCP_DROPLET_BETA / VSCP_DROPLET_GAMMA
+  int8_t rssi;                        // Signal strength for frame
+} vscp_espnow_rx_info_t;
+
+// Callback for esp-now received events (userdata is vscp_espnow_rx_info_t *)
 typedef void (*vscp_event_handler_cb_t)(const vscpEvent *pev, void *userdata);
 
 // Callback for client node attach to network
@@ -0,0 +1,1337 @@
+/**
+ * @brief           Forward error corrected broadcast firmware update
+ * @file            vscp-fota.c
+ * @author          Ake Hedman, The VSCP Project, www.vscp.org
+ *
+ *********************************************************************/
+
+/* ******************************************************************************
+ * VSCP (Very Simple Control Protocol)
+ * http://www.vscp.org
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright © 2000-2025 Ake Hedman, the VSCP project <info@vscp.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  This file is part of VSCP - Very Simple Control Protocol
+ *  http://www.vscp.org
+ *
+ * ******************************************************************************
+ */
+
+#include <string.h>
+#include <sys/param.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include <esp_log.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <esp_random.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+#include <spi_flash_mmap.h>
+
+#include <espnow.h>
+#include <espnow_ota.h>
+#include <espnow_utils.h>
+
+#include <vscp.h>
+
+#include "vscp-fota.h"
+
+static const char *TAG = "fota";
+
+// Message types
+#define FOTA_MSG_ANNOUNCE 1
+#define FOTA_MSG_DATA     2
+#define FOTA_MSG_QUERY    3
+#define FOTA_MSG_REPORT   4
+#define FOTA_MSG_END      5
+#define FOTA_MSG_STOP     0xff // Internal, receiver stop
+
+#define FOTA_MAX_NEEDS     60    // Needs in one report
+#define FOTA_RX_QUEUE_SIZE 32    // Frames waiting for the receiver task
+#define FOTA_IDLE_TIMEOUT  30000 // A session with no frames for this long (ms) is ended
+#define FOTA_QUERY_TIMEOUT 300   // Wait for a report (ms)
+#define FOTA_QUERY_TRIES   3     // Queries per node and round
+#define FOTA_LOST_ROUNDS   3     // Rounds without a report before a node is given up
+#define FOTA_REPAIR_MARGIN 1     // Extra repair symbols per generation in feedback rounds
+
+typedef struct __attribute__((packed)) {
+  uint8_t type;        // FOTA_MSG_ANNOUNCE
+  uint8_t version;     // VSCP_FOTA_VERSION
+  uint32_t session;    // Session id
+  uint8_t sha[32];     // Image digest
+  uint32_t size;       // Image size
+  uint16_t symbolSize; // VSCP_FOTA_SYMBOL_SIZE
+  uint8_t genSize;     // VSCP_FOTA_GEN_SIZE
+} fota_announce_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t type;     // FOTA_MSG_DATA
+  uint32_t session; // Session id
+  uint16_t gen;     // Generation
+  uint16_t idx;     // Symbol in generation (< VSCP_FOTA_GEN_SIZE) or repair symbol
+  uint8_t data[VSCP_FOTA_SYMBOL_SIZE];
+} fota_data_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t type;     // FOTA_MSG_QUERY or FOTA_MSG_END
+  uint32_t session; // Session id
+  uint8_t mac[6];   // Node that should answer (QUERY)
+} fota_query_t;
+
+typedef struct __attribute__((packed)) {
+  uint16_t gen;    // Generation
+  uint8_t deficit; // Symbols needed to rebuild it
+} fota_need_t;
+
+typedef struct __attribute__((packed)) {
+  uint8_t type;       // FOTA_MSG_REPORT
+  uint32_t session;   // Session id
+  uint8_t state;      // vscp_fota_state_t
+  uint16_t needTotal; // Generations not rebuilt
+  uint8_t cnt;        // Needs that follow
+  fota_need_t need[FOTA_MAX_NEEDS];
+} fota_report_t;
+
+_Static_assert(sizeof(fota_data_t) <= ESPNOW_DATA_LEN, "Symbol does not fit in an esp-now frame");
+_Static_assert(sizeof(fota_report_t) <= ESPNOW_DATA_LEN, "Report does not fit in an esp-now frame");
+
+// Frame on its way from the esp-now task to the receiver task
+typedef struct {
+  uint8_t mac[6];
+  size_t len;
+  uint8_t data[];
+} fota_frame_t;
+
+// Report on its way to the sender
+typedef struct {
+  uint8_t mac[6];
+  fota_report_t report;
+} fota_reply_t;
+
+// Repair symbol held until its generation can be rebuilt
+typedef struct {
+  uint16_t gen; // Generation, UINT16_MAX if free
+  uint16_t idx; // Repair symbol
+  uint8_t data[VSCP_FOTA_SYMBOL_SIZE];
+} fota_slot_t;
+
+// Receiver session
+typedef struct {
+  uint32_t session;             // Session id
+  uint8_t sha[32];              // Image digest
+  uint32_t size;                // Image size
+  uint32_t symbols;             // Symbols in image
+  uint16_t genCount;            // Generations in image
+  uint16_t genDone;             // Generations rebuilt
+  uint8_t state;                // vscp_fota_state_t
+  bool restart;                 // A new image is waiting to be started
+  const esp_partition_t *part;  // Update partition
+  uint8_t *have;                // Bitmap of symbols in flash
+  uint8_t *missing;             // Missing symbols per generation
+  fota_slot_t *pool;            // Repair symbols
+  uint8_t sender[6];            // MAC of sender
+} fota_rx_t;
+
+static const espnow_frame_head_t s_fotaDataHead = {
+  .broadcast        = true,
+  .retransmit_count = 1,
+};
+
+// Control frames are few, send them more than once
+static const espnow_frame_head_t s_fotaCtrlHead = {
+  .broadcast        = true,
+  .retransmit_count = 2,
+};
+
+static uint8_t s_gfExp[512];
+static uint8_t s_gfLog[256];
+
+static QueueHandle_t s_rxQueue           = NULL;
+static volatile bool s_rxEnabled         = false;
+static vscp_fota_done_cb_t s_rxDoneCb    = NULL;
+static fota_rx_t s_rx;
+static uint8_t s_selfMac[6];
+
+static QueueHandle_t s_txQueue     = NULL; // Reports to the sender, set while sending
+static SemaphoreHandle_t s_txMutex = NULL; // Guards s_txQueue against the receive callback
+
+///////////////////////////////////////////////////////////////////////////////
+// fota_gf_init
+//
+// GF(256) with polynomial 0x11d
+//
+
+static void
+fota_gf_init(void)
+{
+  uint16_t x = 1;
+
+  if (s_gfExp[0]) {
+    return;
+  }
+
+  for (int i = 0; i < 255; i++) {
+    s_gfExp[i] = (uint8_t) x;
+    s_gfLog[x] = (uint8_t) i;
+    x <<= 1;
+    if (x & 0x100) {
+      x ^= 0x11d;
+    }
+  }
+
+  for (int i = 255; i < 512; i++) {
+    s_gfExp[i] = s_gfExp[i - 255];
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// fota_gf_muladd
+//
+// dst += c * src
+//
+
+static void
+fota_gf_muladd(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+  if (!c) {
+    return;
+  }
+
+  int lc = s_gfLog[c];
+  for (size_t i = 0; i < len; i++) {
+    if (src[i]) {
+      dst[i] ^= s_gfExp[s_gfLog[src[i]] + lc];
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// fota_gf_scale
+//
+// p = c * p
+//
+
+static void
+fota_gf_scale(uint8_t *p, uint8_t c, size_t len)
+{
+  int lc = s_gfLog[c];
+  for (size_t i = 0; i < len; i++) {
+    if (p[i]) {
+      p[i] = s_gfExp[s_gfLog[p[i]] + lc];
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// fota_coeffs
+//
+// Coefficients of a repair symbol. Both sides generate them from the
+// session, generation and repair number so they are never sent.
+//
+
+static void
+fota_coeffs(uint32_t session, uint16_t gen, uint16_t idx, uint8_t *coef)
+{
+  uint32_t x = session ^ ((uint32_t) gen * 0x9E3779B1) ^ ((uint32_t) idx * 0x85EBCA6B);
+
+  // Mix so neighbour seeds give unrelated sequences
+  x ^= x >> 16;
+  x *= 0x7FEB352D;
+  x ^= x >> 15;
+  x *= 0x846CA68B;
+  x ^= x >> 16;
+  if (!x) {
+    x = 1;
+  }
+
+  for (int i = 0; i < VSCP_FOTA_GEN_SIZE; i++) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    coef[i] = 1 + (x % 255);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// fota_read_symbol
+//
+// Read one symbol of the image. The last symbol is padded with zeros.
+//
+
+static esp_err_t
+fota_read_symbol(vscp_fota_data_cb_t cb, const esp_partition_t *part, uint32_t size, uint32_t sym, uint8_t *buf)
+{
+  esp_err_t ret;
+  size_t offset = (size_t) sym * VSCP_FOTA_SYMBOL_SIZE;
+  size_t len    = MIN(VSCP_FOTA_SYMBOL_SIZE, size - offset);
+
+  ret = (NULL != cb) ? cb(offset, buf, len) : esp_partition_read(part, offset, buf, len);
+  memset(buf + len, 0, VSCP_FOTA_SYMBOL_SIZE - len);
+
+  return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// fota_recv_cb
+//
+// esp-now receive callback for both sender and receiver. Runs in the
+// esp-now task so frames are only copied and queued.
+//
+
+static esp_err_t
+fota_recv_cb(uint8_t *src_addr, void *data, size_t size, wifi_pkt_rx_ctrl_t *rx_ctrl)
+{
+  const uint8_t *p = (const uint8_t *) data;
+
+  if ((NULL == src_addr) || (NULL == data) || !size) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  if (FOTA_MSG_REPORT == p[0]) {
+    fota_reply_t reply;
+    if ((NULL == s_txMutex) || (size < offsetof(fota_report_t, need)) || (size > sizeof(fota_report_t))) {
+      return ESP_OK;
+    }
+    memset(&reply, 0, sizeof(reply));
+    memcpy(reply.mac, src_addr, 6);
+    memcpy(&reply.report, data, size);
+    // Late reports can arrive while the sender deletes the queue
+    xSemaphoreTake(s_txMutex, portMAX_DELAY);
+    if (NULL != s_txQueue) {
+      xQueueSend(s_txQueue, &reply, 0);
+    }
+    xSemaphoreGive(s_txMutex);
+    return ESP_OK;
+  }
+
+  if (!s_rxEnabled || (size > sizeof(fota_data_t))) {
+    return ESP_OK;
+  }
+
+  fota_frame_t *pframe = ESP_MALLOC(sizeof(fota_frame_t) + size);
+  if (NULL == pframe) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  memcpy(pframe->mac, src_addr, 6);
+  pframe->len = size;
+  memcpy(pframe->data, data, size);
+
+  // Dropped frames are what the repair symbols are for
+  if (pdTRUE != xQueueSend(s_rxQueue, &pframe, 0)) {
+    ESP_FREE(pframe);
+  }
+
+  return ESP_OK;
+}
+
+//-----------------------------------------------------------------------------
+//                                 Receiver
+//-----------------------------------------------------------------------------
+
+///////////////////////////////////////////////////////////////////////////////
+// fota_rx_free
+//
+
+static void
+fota_rx_free(void)
+{
+  ESP_FREE(s_rx.have);
+  ESP_FREE(s_rx.missing);
+  ESP_FREE(s_rx.pool);
+  memset(&s_rx, 0, sizeof(s_rx));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// fota_rx_gen_symbols
+//
+// Number of symbols in a generation (the last one can be short)
+//
+
+static int
+fota_rx_gen_symbols(uint16_t gen)
+{
+  return MIN(VSCP_FOTA_GEN_SIZE, s_rx.symbols - (uint32_t) gen * VSCP_FOTA_GEN_SIZE);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// fota_rx_report
+//
+
+static void
+fota_rx_report(void)
+{
+  fota_report_t report;
+  uint16_t stored[VSCP_FOTA_POOL_SIZE];
+  int nStored = 0;
+  int budget  = VSCP_FOTA_POOL_SIZE;
+
+  memset(&report, 0, sizeof(report));
+  report.type    = FOTA_MSG_REPORT;
+  report.session = s_rx.session;
+  report.state   = s_rx.state;
+
+  if (VSCP_FOTA_STATE_RECEIVING == s_rx.state) {
+
+    for (int i = 0; i < VSCP_FOTA_POOL_SIZE; i++) {
+      if (UINT16_MAX != s_rx.pool[i].gen) {
+        stored[nStored++] = s_rx.pool[i].gen;
+      }
+    }
+
+    for (uint16_t gen = 0; gen < s_rx.genCount; gen++) {
+      if (!s_rx.missing[gen]) {
+        continue;
+      }
+
+      report.needTotal++;
+      if ((report.cnt >= FOTA_MAX_NEEDS) || (budget <= 0)) {
+        continue;
+      }
+
+      // Repair symbols already held count, but at least one more is needed
+      int deficit = s_rx.missing[gen];
+      for (int i = 0; i < nStored; i++) {
+        if (stored[i] == gen) {
+          deficit--;
+        }
+      }
+
+      // Only ask for what the pool can hold, the rest is asked for next round
+      budget -= s_rx.missing[gen] + FOTA_REPAIR_MARGIN;
+      if (report.cnt && (budget < 0)) {
+        continue;
+      }
+
+      report.need[report.cnt].gen     = gen;
+      report.need[report.cnt].deficit = MAX(deficit, 1);
+      report.cnt++;
+    }
+  }
+
+  espnow_send(ESPNOW_DATA_TYPE_RESERVED,
+              ESPNOW_ADDR_BROADCAST,
+              &report,
+              offsetof(fota_report_t, need) + report.cnt * sizeof(fota_need_t),
+              &s_fotaCtrlHead,
+              pdMS_TO_TICKS(100));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// fota_rx_verify
+//
+// All symbols are in flash. Check the image and make it the boot image.
+//
+
+static void
+fota_rx_verify(void)
+{
+  uint8_t digest[32];
+
+  if ((ESP_OK == esp_partition_get_sha256(s_rx.part, digest)) && !memcmp(digest, s_rx.sha, sizeof(digest)) &&
+      (ESP_OK == esp_ota_set_boot_partition(s_rx.part))) {
+    ESP_LOGI(TAG, "Image received and verified");
+    s_rx.state   = VSCP_FOTA_STATE_DONE;
+    s_rx.restart = true;
+  }
+  else {
+    ESP_LOGE(TAG, "Image did not verify");
+    s_rx.state = VSCP_FOTA_STATE_FAILED;
+  }
+
+  ESP_FREE(s_rx.pool);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// fota_rx_gen_done
+//
+
+static void
+fota_rx_gen_done(uint16_t gen)
+{
+  for (int i = 0; i < VSCP_FOTA_POOL_SIZE; i++) {
+    if (gen == s_rx.pool[i].gen) {
+      s_rx.pool[i].gen = UINT16_MAX;
+    }
+  }
+
+  if (++s_rx.genDone == s_rx.genCount) {
+    fota_rx_verify();
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// fota_rx_write
+//
+
+static int
+fota_rx_write(uint32_t sym, const uint8_t *data)
+{
+  size_t offset = (size_t) sym * VSCP_FOTA_SYMBOL_SIZE;
+
+  if (ESP_OK != esp_partition_write(s_rx.part, offset, data, MIN(VSCP_FOTA_SYMBOL_SIZE, s_rx.size - offset))) {
+    ESP_LOGE(TAG, "Flash write failed at %u", (unsigned) offset);
+    return VSCP_ERROR_WRITE_ERROR;
+  }
+
+  s_rx.have[sym >> 3] |= 1 << (sym & 7);
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// fota_rx_decode
+//
+// Rebuild the missing symbols of a generation from the repair symbols
+// held for it. Known symbols are read back from flash and removed from
+// the repair symbols which leaves a system with one unknown per missing
+// symbol. Solved with Gaussian elimination. Returns false if there are
+// not yet enough independent repair symbols.
+//
+
+static bool
+fota_rx_decode(uint16_t gen)
+{
+  bool rv = false;
+  int k   = fota_rx_gen_symbols(gen);
+  int m   = 0;
+  int r   = 0;
+  uint8_t miss[VSCP_FOTA_GEN_SIZE];
+  int slot[VSCP_FOTA_POOL_SIZE];
+  uint8_t coef[VSCP_FOTA_GEN_SIZE];
+  uint32_t first = (uint32_t) gen * VSCP_FOTA_GEN_SIZE;
+
+  for (int i = 0; i < k; i++) {
+    if (!(s_rx.have[(first + i) >> 3] & (1 << ((first + i) & 7)))) {
+      miss[m++] = i;
+    }
+  }
+
+  for (int i = 0; i < VSCP_FOTA_POOL_SIZE; i++) {
+    if (gen == s_rx.pool[i].gen) {
+      slot[r++] = i;
+    }
+  }
+
+  if (!m || (r < m)) {
+    return false;
+  }
+
+  uint8_t *a   = ESP_MALLOC(r * m);
+  uint8_t *y   = ESP_MALLOC(r * VSCP_FOTA_SYMBOL_SIZE);
+  uint8_t *buf = ESP_MALLOC(VSCP_FOTA_SYMBOL_SIZE);
+  if ((NULL == a) || (NULL == y) || (NULL == buf)) {
+    goto EXIT;
+  }
+
+  // Remove known symbols from the repair symbols
+  for (int j = 0; j < r; j++) {
+    fota_slot_t *ps = &s_rx.pool[slot[j]];
+    uint8_t *yj     = y + j * VSCP_FOTA_SYMBOL_SIZE;
+
+    fota_coeffs(s_rx.session, gen, ps->idx, coef);
+    memcpy(yj, ps->data, VSCP_FOTA_SYMBOL_SIZE);
+
+    for (int i = 0, n = 0; i < k; i++) {
+      if ((n < m) && (miss[n] == i)) {
+        a[j * m + n++] = coef[i];
+        continue;
+      }
+      if (ESP_OK != fota_read_symbol(NULL, s_rx.part, s_rx.size, first + i, buf)) {
+        goto EXIT;
+      }
+      fota_gf_muladd(yj, buf, coef[i], VSCP_FOTA_SYMBOL_SIZE);
+    }
+  }
+
+  // Gaussian elimination
+  for (int c = 0; c < m; c++) {
+
+    int p = c;
+    while ((p < r) && !a[p * m + c]) {
+      p++;
+    }
+    if (p == r) {
+      goto EXIT; // Not independent yet, wait for more
+    }
+
+    if (p != c) {
+      for (int i = 0; i < m; i++) {
+        uint8_t t    = a[p * m + i];
+        a[p * m + i] = a[c * m + i];
+        a[c * m + i] = t;
+      }
+      memcpy(buf, y + p * VSCP_FOTA_SYMBOL_SIZE, VSCP_FOTA_SYMBOL_SIZE);
+      memcpy(y + p * VSCP_FOTA_SYMBOL_SIZE, y + c * VSCP_FOTA_SYMBOL_SIZE, VSCP_FOTA_SYMBOL_SIZE);
+      memcpy(y + c * VSCP_FOTA_SYMBOL_SIZE, buf, VSCP_FOTA_SYMBOL_SIZE);
+    }
+
+    uint8_t inv = s_gfExp[255 - s_gfLog[a[c * m + c]]];
+    fota_gf_scale(a + c * m, inv, m);
+    fota_gf_scale(y + c * VSCP_FOTA_SYMBOL_SIZE, inv, VSCP_FOTA_SYMBOL_SIZE);
+
+    for (int j = 0; j < r; j++) {
+      uint8_t f = a[j * m + c];
+      if ((j != c) && f) {
+        fota_gf_muladd(a + j * m, a + c * m, f, m);
+        fota_gf_muladd(y + j * VSCP_FOTA_SYMBOL_SIZE, y + c * VSCP_FOTA_SYMBOL_SIZE, f, VSCP_FOTA_SYMBOL_SIZE);
+      }
+    }
+  }
+
+  for (int c = 0; c < m; c++) {
+    if (VSCP_ERROR_SUCCESS != fota_rx_write(first + miss[c], y + c * VSCP_FOTA_SYMBOL_SIZE)) {
+      goto EXIT;
+    }
+  }
+
+  ESP_LOGD(TAG, "Generation %u rebuilt, %d symbols recovered", gen, m);
+  s_rx.missing[gen] = 0;
+  rv                = true;
+
+EXIT:
+  ESP_FREE(a);
+  ESP_FREE(y);
+  ESP_FREE(buf);
+  return rv;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// fota_rx_announce
+//
+
+static void
+fota_rx_announce(const uint8_t *mac, const fota_announce_t *pann)
+{
+  uint8_t digest[32];
+
+  if (pann->session == s_rx.session) {
+    fota_rx_report();
+    return;
+  }
+
+  if ((VSCP_FOTA_VERSION != pann->version) || (VSCP_FOTA_SYMBOL_SIZE != pann->symbolSize) ||
+      (VSCP_FOTA_GEN_SIZE != pann->genSize) || !pann->size) {
+    ESP_LOGW(TAG, "Unsupported session parameters");
+    return;
+  }
+
+  // A new session replaces the old one
+  fota_rx_free();
+  s_rx.session = pann->session;
+  s_rx.size    = pann->size;
+  memcpy(s_rx.sha, pann->sha, sizeof(s_rx.sha));
+  memcpy(s_rx.sender, mac, 6);
+
+  // Nothing to do if the image is already running
+  if ((ESP_OK == esp_partition_get_sha256(esp_ota_get_running_partition(), digest)) &&
+      !memcmp(digest, pann->sha, sizeof(digest))) {
+    ESP_LOGI(TAG, "Announced image is already running");
+    s_rx.state = VSCP_FOTA_STATE_DONE;
+    fota_rx_report();
+    return;
+  }
+
+  s_rx.part     = esp_ota_get_next_update_partition(NULL);
+  s_rx.symbols  = (pann->size + VSCP_FOTA_SYMBOL_SIZE - 1) / VSCP_FOTA_SYMBOL_SIZE;
+  s_rx.genCount = (s_rx.symbols + VSCP_FOTA_GEN_SIZE - 1) / VSCP_FOTA_GEN_SIZE;
+  if ((NULL == s_rx.part) || (pann->size > s_rx.part->size)) {
+    ESP_LOGE(TAG, "Image (%lu bytes) does not fit in update partition", (unsigned long) pann->size);
+    s_rx.state = VSCP_FOTA_STATE_FAILED;
+    fota_rx_report();
+    return;
+  }
+
+  s_rx.have    = ESP_CALLOC(1, (s_rx.symbols + 7) / 8);
+  s_rx.missing = ESP_MALLOC(s_rx.genCount);
+  s_rx.pool    = ESP_MALLOC(VSCP_FOTA_POOL_SIZE * sizeof(fota_slot_t));
+  if ((NULL == s_rx.have) || (NULL == s_rx.missing) || (NULL == s_rx.pool)) {
+    ESP_LOGE(TAG, "Out of memory for session");
+    s_rx.state = VSCP_FOTA_STATE_FAILED;
+    fota_rx_report();
+    return;
+  }
+
+  for (uint16_t gen = 0; gen < s_rx.genCount; gen++) {
+    s_rx.missing[gen] = fota_rx_gen_symbols(gen);
+  }
+  for (int i = 0; i < VSCP_FOTA_POOL_SIZE; i++) {
+    s_rx.pool[i].gen = UINT16_MAX;
+  }
+
+  ESP_LOGI(TAG,
+           "Session %08lx, %lu bytes in %u generations",
+           (unsigned long) s_rx.session,
+           (unsigned long) s_rx.size,
+           s_rx.genCount);
+
+  s_rx.state = VSCP_FOTA_STATE_PREPARING;
+  fota_rx_report();
+
+  // Saved esp-now OTA progress no longer matches the partition
+  espnow_ota_status_t status;
+  if ((ESP_OK == espnow_ota_responder_get_status(&status)) && status.total_size) {
+    espnow_ota_responder_stop();
+  }
+
+  // Symbols are written in any order so erase it all up front
+  if (ESP_OK !=
+      esp_partition_erase_range(s_rx.part,
+                                0,
+                                (s_rx.size + SPI_FLASH_SEC_SIZE - 1) & ~(SPI_FLASH_SEC_SIZE - 1))) {
+    ESP_LOGE(TAG, "Failed to erase update partition");
+    s_rx.state = VSCP_FOTA_STATE_FAILED;
+  }
+  else {
+    s_rx.state = VSCP_FOTA_STATE_RECEIVING;
+  }
+
+  fota_rx_report();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// fota_rx_data
+//
+
+static void
+fota_rx_data(const fota_data_t *pdata)
+{
+  if ((pdata->session != s_rx.session) || (VSCP_FOTA_STATE_RECEIVING != s_rx.state) ||
+      (pdata->gen >= s_rx.genCount) || !s_rx.missing[pdata->gen]) {
+    return;
+  }
+
+  if (pdata->idx < VSCP_FOTA_GEN_SIZE) {
+
+    uint32_t sym = (uint32_t) pdata->gen * VSCP_FOTA_GEN_SIZE + pdata->idx;
+    if ((sym >= s_rx.symbols) || (s_rx.have[sym >> 3] & (1 << (sym & 7)))) {
+      return;
+    }
+
+    if (VSCP_ERROR_SUCCESS != fota_rx_write(sym, pdata->data)) {
+      return;
+    }
+
+    if (!--s_rx.missing[pdata->gen]) {
+      fota_rx_gen_done(pdata->gen);
+      return;
+    }
+  }
+  else {
+
+    // Use a free slot or take one from the highest generation above this
+    // one. The sender repairs generations in order so the lowest incomplete
+    // generation always makes progress and the pool can't dead lock.
+    int i = -1;
+    for (int j = 0; j < VSCP_FOTA_POOL_SIZE; j++) {
+      if (UINT16_MAX == s_rx.pool[j].gen) {
+        i = j;
+        break;
+      }
+      if ((s_rx.pool[j].gen > pdata->gen) && ((i < 0) || (s_rx.pool[j].gen > s_rx.pool[i].gen))) {
+        i = j;
+      }
+    }
+    if (i < 0) {
+      return; // Pool full, the need is reported in the feedback phase
+    }
+
+    s_rx.pool[i].gen = pdata->gen;
+    s_rx.pool[i].idx = pdata->idx;
+    memcpy(s_rx.pool[i].data, pdata->data, VSCP_FOTA_SYMBOL_SIZE);
+  }
+
+  if (fota_rx_decode(pdata->gen)) {
+    fota_rx_gen_done(pdata->gen);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// fota_rx_end
+//
+
+static void
+fota_rx_end(void)
+{
+  bool restart = s_rx.restart;
+
+  ESP_LOGI(TAG, "Session %08lx ended, state %d", (unsigned long) s_rx.session, s_rx.state);
+  fota_rx_free();
+
+  if (restart && (NULL != s_rxDoneCb)) {
+    s_rxDoneCb();
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// fota_rx_task
+//
+
+static void
+fota_rx_task(void *pvParameters)
+{
+  fota_frame_t *pframe;
+  int64_t lastFrame = 0;
+
+  for (;;) {
+
+    if (pdTRUE != xQueueReceive(s_rxQueue, &pframe, pdMS_TO_TICKS(1000))) {
+      if (s_rx.session && ((esp_timer_get_time() - lastFrame) > (FOTA_IDLE_TIMEOUT * 1000LL))) {
+        ESP_LOGW(TAG, "Session timed out");
+        fota_rx_end();
+      }
+      continue;
+    }
+
+    lastFrame = esp_timer_get_time();
+
+    switch (pframe->data[0]) {
+
+      case FOTA_MSG_ANNOUNCE:
+        if (pframe->len >= sizeof(fota_announce_t)) {
+          fota_rx_announce(pframe->mac, (const fota_announce_t *) pframe->data);
+        }
+        break;
+
+      case FOTA_MSG_DATA:
+        if (pframe->len == sizeof(fota_data_t)) {
+          fota_rx_data((const fota_data_t *) pframe->data);
+        }
+        break;
+
+      case FOTA_MSG_QUERY: {
+        const fota_query_t *pq = (const fota_query_t *) pframe->data;
+        if ((pframe->len >= sizeof(fota_query_t)) && s_rx.session && (pq->session == s_rx.session) &&
+            !memcmp(pq->mac, s_selfMac, 6)) {
+          fota_rx_report();
+        }
+      } break;
+
+      case FOTA_MSG_END: {
+        const fota_query_t *pq = (const fota_query_t *) pframe->data;
+        if ((pframe->len >= offsetof(fota_query_t, mac)) && s_rx.session && (pq->session == s_rx.session)) {
+          fota_rx_end();
+        }
+      } break;
+
+      case FOTA_MSG_STOP:
+        if (s_rx.session) {
+          ESP_LOGI(TAG, "Receiver stopped, session dropped");
+          fota_rx_free();
+        }
+        break;
+    }
+
+    ESP_FREE(pframe);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_fota_receiver_start
+//
+
+int
+vscp_fota_receiver_start(vscp_fota_done_cb_t cb)
+{
+  fota_gf_init();
+
+  s_rxDoneCb = cb;
+  esp_wifi_get_mac(WIFI_IF_STA, s_selfMac);
+
+  if (NULL == s_rxQueue) {
+    s_rxQueue = xQueueCreate(FOTA_RX_QUEUE_SIZE, sizeof(fota_frame_t *));
+    if (NULL == s_rxQueue) {
+      return VSCP_ERROR_MEMORY;
+    }
+
+    if (pdPASS != xTaskCreate(fota_rx_task, "fota", 4096, NULL, 5, NULL)) {
+      vQueueDelete(s_rxQueue);
+      s_rxQueue = NULL;
+      return VSCP_ERROR_MEMORY;
+    }
+  }
+
+  s_rxEnabled = true;
+  if (ESP_OK != espnow_set_config_for_data_type(ESPNOW_DATA_TYPE_RESERVED, true, fota_recv_cb)) {
+    s_rxEnabled = false;
+    return VSCP_ERROR_ERROR;
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_fota_receiver_stop
+//
+
+int
+vscp_fota_receiver_stop(void)
+{
+  static uint8_t stop = FOTA_MSG_STOP;
+  fota_frame_t *pframe;
+
+  if (!s_rxEnabled) {
+    return VSCP_ERROR_SUCCESS;
+  }
+
+  s_rxEnabled = false;
+  if (NULL == s_txQueue) {
+    espnow_set_config_for_data_type(ESPNOW_DATA_TYPE_RESERVED, false, NULL);
+  }
+
+  // Let the receiver task drop the session
+  pframe = ESP_MALLOC(sizeof(fota_frame_t) + 1);
+  if (NULL != pframe) {
+    memset(pframe->mac, 0, 6);
+    pframe->len     = 1;
+    pframe->data[0] = stop;
+    if (pdTRUE != xQueueSend(s_rxQueue, &pframe, pdMS_TO_TICKS(1000))) {
+      ESP_FREE(pframe);
+    }
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_fota_receiver_get_state
+//
+
+vscp_fota_state_t
+vscp_fota_receiver_get_state(void)
+{
+  return (vscp_fota_state_t) s_rx.state;
+}
+
+//-----------------------------------------------------------------------------
+//                                  Sender
+//-----------------------------------------------------------------------------
+
+// Node as seen by the sender
+typedef struct {
+  uint8_t mac[6];
+  uint8_t state;  // vscp_fota_state_t
+  uint8_t misses; // Rounds in a row without a report
+} fota_node_t;
+
+///////////////////////////////////////////////////////////////////////////////
+// fota_tx_find
+//
+
+static fota_node_t *
+fota_tx_find(fota_node_t *nodes, size_t num, const uint8_t *mac)
+{
+  for (size_t i = 0; i < num; i++) {
+    if (!memcmp(nodes[i].mac, mac, 6)) {
+      return &nodes[i];
+    }
+  }
+
+  return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// fota_tx_collect
+//
+// Handle reports that arrive within 'ms'. If 'pwait' is set, return as
+// soon as that node has reported. Needs are merged into 'deficit' (the
+// largest need of any node per generation) when it is not NULL.
+//
+
+static bool
+fota_tx_collect(uint32_t session,
+                fota_node_t *nodes,
+                size_t num,
+                const fota_node_t *pwait,
+                uint8_t *deficit,
+                uint16_t genCount,
+                uint32_t ms)
+{
+  fota_reply_t reply;
+  TickType_t end = xTaskGetTickCount() + pdMS_TO_TICKS(ms);
+  TickType_t now;
+
+  while ((now = xTaskGetTickCount()) < end) {
+
+    if (pdTRUE != xQueueReceive(s_txQueue, &reply, end - now)) {
+      break;
+    }
+
+    if (reply.report.session != session) {
+      continue;
+    }
+
+    fota_node_t *pnode = fota_tx_find(nodes, num, reply.mac);
+    if (NULL == pnode) {
+      continue;
+    }
+
+    pnode->state  = reply.report.state;
+    pnode->misses = 0;
+
+    if ((NULL != deficit) && (VSCP_FOTA_STATE_RECEIVING == pnode->state)) {
+      for (int i = 0; (i < reply.report.cnt) && (i < FOTA_MAX_NEEDS); i++) {
+        fota_need_t *pneed = &reply.report.need[i];
+        if ((pneed->gen < genCount) && (pneed->deficit > deficit[pneed->gen])) {
+          deficit[pneed->gen] = pneed->deficit;
+        }
+      }
+    }
+
+    if (pnode == pwait) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// fota_tx_symbol
+//
+// Send a source symbol (idx < VSCP_FOTA_GEN_SIZE) or a repair symbol
+//
+
+static esp_err_t
+fota_tx_symbol(fota_data_t *pdata,
+               uint8_t *buf,
+               uint32_t session,
+               uint32_t size,
+               uint32_t symbols,
+               uint16_t gen,
+               uint16_t idx,
+               vscp_fota_data_cb_t cb)
+{
+  esp_err_t ret = ESP_OK;
+  uint8_t coef[VSCP_FOTA_GEN_SIZE];
+  uint32_t first = (uint32_t) gen * VSCP_FOTA_GEN_SIZE;
+  int k          = MIN(VSCP_FOTA_GEN_SIZE, symbols - first);
+
+  pdata->type    = FOTA_MSG_DATA;
+  pdata->session = session;
+  pdata->gen     = gen;
+  pdata->idx     = idx;
+
+  if (idx < VSCP_FOTA_GEN_SIZE) {
+    ret = fota_read_symbol(cb, NULL, size, first + idx, pdata->data);
+  }
+  else {
+    fota_coeffs(session, gen, idx, coef);
+    memset(pdata->data, 0, VSCP_FOTA_SYMBOL_SIZE);
+    for (int i = 0; i < k; i++) {
+      if (ESP_OK != (ret = fota_read_symbol(cb, NULL, size, first + i, buf))) {
+        break;
+      }
+      fota_gf_muladd(pdata->data, buf, coef[i], VSCP_FOTA_SYMBOL_SIZE);
+    }
+  }
+
+  if (ESP_OK != ret) {
+    ESP_LOGE(TAG, "Failed to read image data");
+    return ret;
+  }
+
+  return espnow_send(ESPNOW_DATA_TYPE_RESERVED,
+                     ESPNOW_ADDR_BROADCAST,
+                     pdata,
+                     sizeof(fota_data_t),
+                     &s_fotaDataHead,
+                     portMAX_DELAY);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_fota_send
+//
+
+int
+vscp_fota_send(const espnow_addr_t *addrs,
+               size_t num,
+               const uint8_t sha[32],
+               size_t size,
+               vscp_fota_data_cb_t cb,
+               const vscp_fota_config_t *pcfg,
+               vscp_fota_result_t *presult)
+{
+  int rv = VSCP_ERROR_SUCCESS;
+  size_t ready;
+  uint32_t session;
+  uint32_t symbols;
+  uint16_t genCount;
+  int64_t tsStart;
+  fota_node_t *nodes   = NULL;
+  uint8_t *deficit     = NULL;
+  uint16_t *nextRepair = NULL;
+  fota_data_t *pdata   = NULL;
+  uint8_t *buf         = NULL;
+  fota_announce_t ann;
+  fota_query_t query;
+
+  // Check pointers
+  if ((NULL == addrs) || (NULL == sha) || (NULL == cb) || (NULL == pcfg) || (NULL == presult)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  memset(presult, 0, sizeof(vscp_fota_result_t));
+
+  if (!num || !size) {
+    return VSCP_ERROR_PARAMETER;
+  }
+
+  if (NULL != s_txQueue) {
+    return VSCP_ERROR_INIT_MISSING; // Already sending
+  }
+
+  fota_gf_init();
+
+  // Created once and kept, the receive callback may still hold it
+  if (NULL == s_txMutex) {
+    s_txMutex = xSemaphoreCreateMutex();
+    if (NULL == s_txMutex) {
+      return VSCP_ERROR_MEMORY;
+    }
+  }
+
+  session  = esp_random();
+  symbols  = (size + VSCP_FOTA_SYMBOL_SIZE - 1) / VSCP_FOTA_SYMBOL_SIZE;
+  genCount = (symbols + VSCP_FOTA_GEN_SIZE - 1) / VSCP_FOTA_GEN_SIZE;
+
+  nodes      = ESP_CALLOC(num, sizeof(fota_node_t));
+  deficit    = ESP_MALLOC(genCount);
+  nextRepair = ESP_MALLOC(genCount * sizeof(uint16_t));
+  pdata      = ESP_MALLOC(sizeof(fota_data_t));
+  buf        = ESP_MALLOC(VSCP_FOTA_SYMBOL_SIZE);
+  s_txQueue  = xQueueCreate(FOTA_RX_QUEUE_SIZE, sizeof(fota_reply_t));
+  if ((NULL == nodes) || (NULL == deficit) || (NULL == nextRepair) || (NULL == pdata) || (NULL == buf) ||
+      (NULL == s_txQueue)) {
+    rv = VSCP_ERROR_MEMORY;
+    goto EXIT;
+  }
+
+  for (size_t i = 0; i < num; i++) {
+    memcpy(nodes[i].mac, addrs[i], 6);
+  }
+
+  for (uint16_t gen = 0; gen < genCount; gen++) {
+    nextRepair[gen] = VSCP_FOTA_GEN_SIZE;
+  }
+
+  if (ESP_OK != espnow_set_config_for_data_type(ESPNOW_DATA_TYPE_RESERVED, true, fota_recv_cb)) {
+    rv = VSCP_ERROR_ERROR;
+    goto EXIT;
+  }
+
+  ESP_LOGI(TAG,
+           "Session %08lx, %u bytes in %u generations to %u nodes",
+           (unsigned long) session,
+           (unsigned) size,
+           genCount,
+           (unsigned) num);
+
+  tsStart = esp_timer_get_time();
+
+  // Announce until all nodes are ready (or already run the image)
+  memset(&ann, 0, sizeof(ann));
+  ann.type       = FOTA_MSG_ANNOUNCE;
+  ann.version    = VSCP_FOTA_VERSION;
+  ann.session    = session;
+  ann.size       = size;
+  ann.symbolSize = VSCP_FOTA_SYMBOL_SIZE;
+  ann.genSize    = VSCP_FOTA_GEN_SIZE;
+  memcpy(ann.sha, sha, sizeof(ann.sha));
+
+  do {
+    espnow_send(ESPNOW_DATA_TYPE_RESERVED, ESPNOW_ADDR_BROADCAST, &ann, sizeof(ann), &s_fotaCtrlHead, portMAX_DELAY);
+    fota_tx_collect(session, nodes, num, NULL, NULL, genCount, 500);
+
+    ready = 0;
+    for (size_t i = 0; i < num; i++) {
+      if (nodes[i].state >= VSCP_FOTA_STATE_RECEIVING) {
+        ready++;
+      }
+    }
+  } while ((ready < num) && ((esp_timer_get_time() - tsStart) < (pcfg->prepareTime * 1000LL)));
+
+  ESP_LOGI(TAG, "%u of %u nodes ready", (unsigned) ready, (unsigned) num);
+  if (!ready) {
+    goto END;
+  }
+
+  // Broadcast pass, every generation with a fixed share of repair symbols
+  for (uint16_t gen = 0; gen < genCount; gen++) {
+    int k      = MIN(VSCP_FOTA_GEN_SIZE, symbols - (uint32_t) gen * VSCP_FOTA_GEN_SIZE);
+    int repair = (k * pcfg->redundancy + 99) / 100;
+
+    for (int i = 0; i < k + repair; i++) {
+      uint16_t idx = (i < k) ? i : nextRepair[gen]++;
+      if (ESP_OK != fota_tx_symbol(pdata, buf, session, size, symbols, gen, idx, cb)) {
+        rv = VSCP_ERROR_ERROR;
+        goto END;
+      }
+      presult->symbolsSent++;
+    }
+  }
+
+  // Feedback rounds, send the largest need of any node
+  for (int round = 0; round < pcfg->rounds; round++) {
+
+    size_t pending = 0;
+    uint32_t need  = 0;
+
+    memset(deficit, 0, genCount);
+
+    for (size_t i = 0; i < num; i++) {
+      fota_node_t *pnode = &nodes[i];
+
+      if ((VSCP_FOTA_STATE_DONE == pnode->state) || (VSCP_FOTA_STATE_FAILED == pnode->state) ||
+          (pnode->misses >= FOTA_LOST_ROUNDS)) {
+        continue;
+      }
+
+      query.type    = FOTA_MSG_QUERY;
+      query.session = session;
+      memcpy(query.mac, pnode->mac, 6);
+
+      bool answered = false;
+      for (int t = 0; (t < FOTA_QUERY_TRIES) && !answered; t++) {
+        espnow_send(ESPNOW_DATA_TYPE_RESERVED,
+                    ESPNOW_ADDR_BROADCAST,
+                    &query,
+                    sizeof(query),
+                    &s_fotaCtrlHead,
+                    portMAX_DELAY);
+        answered = fota_tx_collect(session, nodes, num, pnode, deficit, genCount, FOTA_QUERY_TIMEOUT);
+      }
+
+      if (!answered) {
+        pnode->misses++;
+      }
+
+      if ((VSCP_FOTA_STATE_DONE != pnode->state) && (VSCP_FOTA_STATE_FAILED != pnode->state) &&
+          (pnode->misses < FOTA_LOST_ROUNDS)) {
+        pending++;
+      }
+    }
+
+    for (uint16_t gen = 0; gen < genCount; gen++) {
+      need += deficit[gen];
+    }
+
+    ESP_LOGI(TAG, "Round %d: %u nodes pending, %lu symbols needed", round + 1, (unsigned) pending, (unsigned long) need);
+
+    if (!pending) {
+      break;
+    }
+
+    // Nodes that verify the image don't answer for a while
+    if (!need) {
+      vTaskDelay(pdMS_TO_TICKS(1000));
+      continue;
+    }
+
+    for (uint16_t gen = 0; gen < genCount; gen++) {
+      if (!deficit[gen]) {
+        continue;
+      }
+      for (int i = 0; i < deficit[gen] + FOTA_REPAIR_MARGIN; i++) {
+        if (ESP_OK != fota_tx_symbol(pdata, buf, session, size, symbols, gen, nextRepair[gen]++, cb)) {
+          rv = VSCP_ERROR_ERROR;
+          goto END;
+        }
+        presult->symbolsSent++;
+        presult->repairSent++;
+      }
+    }
+  }
+
+END:
+  // Nodes with a verified image restart
+  query.type    = FOTA_MSG_END;
+  query.session = session;
+  memset(query.mac, 0, 6);
+  for (int i = 0; i < 3; i++) {
+    espnow_send(ESPNOW_DATA_TYPE_RESERVED, ESPNOW_ADDR_BROADCAST, &query, sizeof(query), &s_fotaCtrlHead, portMAX_DELAY);
+  }
+
+  presult->unfinishedAddr = ESP_MALLOC(num * ESPNOW_ADDR_LEN);
+  for (size_t i = 0; i < num; i++) {
+    if (VSCP_FOTA_STATE_DONE == nodes[i].state) {
+      presult->successNum++;
+      continue;
+    }
+    if (VSCP_FOTA_STATE_FAILED == nodes[i].state) {
+      presult->failedNum++;
+    }
+    if (NULL != presult->unfinishedAddr) {
+      memcpy(presult->unfinishedAddr[presult->unfinishedNum++], nodes[i].mac, ESPNOW_ADDR_LEN);
+    }
+  }
+
+  ESP_LOGI(TAG,
+           "Session %08lx done in %lu s, %u ok, %u failed, %u unfinished, %lu symbols sent (%lu%% of image)",
+           (unsigned long) session,
+           (unsigned long) ((esp_timer_get_time() - tsStart) / 1000000),
+           (unsigned) presult->successNum,
+           (unsigned) presult->failedNum,
+           (unsigned) presult->unfinishedNum,
+           (unsigned long) presult->symbolsSent,
+           (unsigned long) (presult->symbolsSent * 100 / symbols));
+
+EXIT:
+  if (!s_rxEnabled) {
+    espnow_set_config_for_data_type(ESPNOW_DATA_TYPE_RESERVED, false, NULL);
+  }
+  if (NULL != s_txQueue) {
+    QueueHandle_t q;
+    xSemaphoreTake(s_txMutex, portMAX_DELAY);
+    q         = s_txQueue;
+    s_txQueue = NULL;
+    xSemaphoreGive(s_txMutex);
+    vQueueDelete(q);
+  }
+  ESP_FREE(nodes);
+  ESP_FREE(deficit);
+  ESP_FREE(nextRepair);
+  ESP_FREE(pdata);
+  ESP_FREE(buf);
+
+  return rv;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_fota_result_free
+//
+
+void
+vscp_fota_result_free(vscp_fota_result_t *presult)
+{
+  if (NULL == presult) {
+    return;
+  }
+
+  ESP_FREE(presult->unfinishedAddr);
+  memset(presult, 0, sizeof(vscp_fota_result_t));
+}
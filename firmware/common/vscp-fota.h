@@ -0,0 +1,191 @@
+/**
+ * @brief           Forward error corrected broadcast firmware update
+ * @file            vscp-fota.h
+ * @author          Ake Hedman, The VSCP Project, www.vscp.org
+ *
+ *********************************************************************/
+
+/* ******************************************************************************
+ * VSCP (Very Simple Control Protocol)
+ * http://www.vscp.org
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright © 2000-2025 Ake Hedman, the VSCP project <info@vscp.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  This file is part of VSCP - Very Simple Control Protocol
+ *  http://www.vscp.org
+ *
+ * ******************************************************************************
+ *
+ * Sends a firmware image to many nodes at once. The image is split in
+ * symbols (one per frame) and the symbols in generations of
+ * VSCP_FOTA_GEN_SIZE. Each generation is broadcast once followed by a few
+ * repair symbols. A repair symbol is a random linear combination (GF(256))
+ * of the symbols of its generation, so it can stand in for any lost
+ * symbol and one broadcast repair fixes different losses on different
+ * nodes. A node rebuilds a generation as soon as it holds as many symbols
+ * as it has lost.
+ *
+ * After the broadcast every node is asked how many symbols it still needs
+ * per generation. Only the largest need is sent, as new repair symbols,
+ * so airtime is close to one image no matter how many nodes listen.
+ *
+ * 1. ANNOUNCE (broadcast, repeated) - session, image size and digest.
+ *    Nodes erase the update partition and report back.
+ * 2. DATA (broadcast) - source and repair symbols.
+ * 3. QUERY/REPORT - each node in turn reports its needs.
+ * 4. END (broadcast) - nodes with a verified image restart.
+ *
+ * All frames use the ESPNOW_DATA_TYPE_RESERVED data type (also used by
+ * the esp-now iperf debug command, don't run both at the same time).
+ * Numbers are little endian.
+ */
+
+#ifndef VSCP_FOTA_H
+#define VSCP_FOTA_H
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <espnow.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VSCP_FOTA_VERSION     1
+#define VSCP_FOTA_SYMBOL_SIZE 200 // Image bytes per frame
+#define VSCP_FOTA_GEN_SIZE    32  // Symbols per generation
+#define VSCP_FOTA_POOL_SIZE   48  // Repair symbols a node can hold while it waits to rebuild a generation
+
+/**
+ * @brief Node states as reported to the sender
+ */
+typedef enum {
+  VSCP_FOTA_STATE_IDLE = 0,  // No session
+  VSCP_FOTA_STATE_PREPARING, // Erasing update partition
+  VSCP_FOTA_STATE_RECEIVING, // Collecting symbols
+  VSCP_FOTA_STATE_DONE,      // Image verified and set as boot partition (or already running)
+  VSCP_FOTA_STATE_FAILED,    // Image did not verify
+} vscp_fota_state_t;
+
+/**
+ * @brief Read image data. Same as the esp-now OTA data callback.
+ */
+typedef esp_err_t (*vscp_fota_data_cb_t)(size_t offset, void *dst, size_t size);
+
+/**
+ * @brief Called on a node when the new image is in place and can be started.
+ */
+typedef void (*vscp_fota_done_cb_t)(void);
+
+/**
+ * @brief Sender configuration
+ */
+typedef struct {
+  uint8_t redundancy;   // Repair symbols sent with each generation (percent of generation)
+  uint8_t rounds;       // Max number of feedback rounds
+  uint32_t prepareTime; // Max time (ms) nodes are given to prepare before data is sent
+} vscp_fota_config_t;
+
+/**
+ * @brief Sender result
+ */
+typedef struct {
+  size_t successNum;             // Nodes that have the image
+  size_t failedNum;              // Nodes where the image did not verify
+  size_t unfinishedNum;          // Nodes that did not get the image (including failed)
+  espnow_addr_t *unfinishedAddr; // MAC addresses of unfinished nodes
+  uint32_t symbolsSent;          // Symbols sent in total
+  uint32_t repairSent;           // Repair symbols sent in feedback rounds
+} vscp_fota_result_t;
+
+/**
+ * @brief Broadcast a firmware image to a set of nodes
+ *
+ * Blocks until all nodes have the image or the feedback rounds are used
+ * up. Nodes that did not make it are listed in the result so they can be
+ * served with the ack driven esp-now OTA.
+ *
+ * @param addrs Nodes to update
+ * @param num Number of nodes
+ * @param sha Digest of image (esp_partition_get_sha256)
+ * @param size Size of image
+ * @param cb Callback that read image data
+ * @param pcfg Pointer to configuration
+ * @param presult Pointer to result. Free with vscp_fota_result_free.
+ * @return VSCP_ERROR_SUCCESS if the session ran, error code otherwise.
+ */
+int
+vscp_fota_send(const espnow_addr_t *addrs,
+               size_t num,
+               const uint8_t sha[32],
+               size_t size,
+               vscp_fota_data_cb_t cb,
+               const vscp_fota_config_t *pcfg,
+               vscp_fota_result_t *presult);
+
+/**
+ * @brief Free a sender result
+ *
+ * @param presult Pointer to result
+ */
+void
+vscp_fota_result_free(vscp_fota_result_t *presult);
+
+/**
+ * @brief Start receiving broadcast firmware updates
+ *
+ * Can be called when already started.
+ *
+ * @param cb Called when a new image is verified and the sender has ended
+ *        the session (or gone quiet). Typically restarts the node.
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+vscp_fota_receiver_start(vscp_fota_done_cb_t cb);
+
+/**
+ * @brief Stop receiving broadcast firmware updates
+ *
+ * A session in progress is dropped.
+ *
+ * @return VSCP_ERROR_SUCCESS on success, error code otherwise.
+ */
+int
+vscp_fota_receiver_stop(void);
+
+/**
+ * @brief Get receiver state
+ *
+ * @return State of the current session, VSCP_FOTA_STATE_IDLE if none.
+ */
+vscp_fota_state_t
+vscp_fota_receiver_get_state(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,456 @@
+/*
+  File: main.c
+
+  Make a firmware delta for VSCP alpha/beta nodes
+  (firmware/common/vscp-delta.h). All fields are little endian.
+
+  This file is part of the VSCP (https://www.vscp.org)
+
+  The MIT License (MIT)
+  Copyright © 2022-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DELTA_MAGIC    0x544C4456
+#define DELTA_VERSION  1
+#define DELTA_HDR_SIZE 212
+
+#define OP_END  0
+#define OP_COPY 1
+#define OP_DATA 2
+
+#define IMAGE_MAGIC    0xE9
+#define APP_DESC_MAGIC 0xABCD5432
+#define APP_DESC_POS   32 // Image header + first segment header
+
+// Shortest copy worth an operation (a copy costs 9 bytes)
+#define MIN_MATCH  32
+#define HASH_BITS  22
+#define HASH_BLOCK 16
+
+typedef struct {
+  uint8_t *data;
+  size_t size;
+} image_t;
+
+static uint8_t *s_out   = NULL;
+static size_t s_outSize = 0;
+static size_t s_outCap  = 0;
+
+///////////////////////////////////////////////////////////////////////////////
+// SHA-256
+//
+
+typedef struct {
+  uint32_t h[8];
+} sha256_t;
+
+static const uint32_t s_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void
+sha256_block(sha256_t *ctx, const uint8_t *p)
+{
+  uint32_t w[64];
+  uint32_t a, b, c, d, e, f, g, h, t1, t2;
+
+  for (int i = 0; i < 16; i++) {
+    w[i] = ((uint32_t) p[4 * i] << 24) | ((uint32_t) p[4 * i + 1] << 16) | ((uint32_t) p[4 * i + 2] << 8) | p[4 * i + 3];
+  }
+  for (int i = 16; i < 64; i++) {
+    uint32_t s0 = ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i]        = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  a = ctx->h[0];
+  b = ctx->h[1];
+  c = ctx->h[2];
+  d = ctx->h[3];
+  e = ctx->h[4];
+  f = ctx->h[5];
+  g = ctx->h[6];
+  h = ctx->h[7];
+
+  for (int i = 0; i < 64; i++) {
+    t1 = h + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) + s_k[i] + w[i];
+    t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    h  = g;
+    g  = f;
+    f  = e;
+    e  = d + t1;
+    d  = c;
+    c  = b;
+    b  = a;
+    a  = t1 + t2;
+  }
+
+  ctx->h[0] += a;
+  ctx->h[1] += b;
+  ctx->h[2] += c;
+  ctx->h[3] += d;
+  ctx->h[4] += e;
+  ctx->h[5] += f;
+  ctx->h[6] += g;
+  ctx->h[7] += h;
+}
+
+static void
+sha256(const uint8_t *data, size_t size, uint8_t digest[32])
+{
+  static const uint32_t init[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+  sha256_t ctx;
+  uint8_t tail[128];
+  size_t rest = size % 64;
+  size_t tlen = (rest < 56) ? 64 : 128;
+  uint64_t bits = (uint64_t) size * 8;
+
+  memcpy(ctx.h, init, sizeof(init));
+
+  for (size_t i = 0; i + 64 <= size; i += 64) {
+    sha256_block(&ctx, data + i);
+  }
+
+  memset(tail, 0, sizeof(tail));
+  memcpy(tail, data + size - rest, rest);
+  tail[rest] = 0x80;
+  for (int i = 0; i < 8; i++) {
+    tail[tlen - 1 - i] = (uint8_t) (bits >> (8 * i));
+  }
+  sha256_block(&ctx, tail);
+  if (128 == tlen) {
+    sha256_block(&ctx, tail + 64);
+  }
+
+  for (int i = 0; i < 8; i++) {
+    digest[4 * i]     = (uint8_t) (ctx.h[i] >> 24);
+    digest[4 * i + 1] = (uint8_t) (ctx.h[i] >> 16);
+    digest[4 * i + 2] = (uint8_t) (ctx.h[i] >> 8);
+    digest[4 * i + 3] = (uint8_t) ctx.h[i];
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Output
+//
+
+static void
+put(const void *p, size_t len)
+{
+  if (s_outSize + len > s_outCap) {
+    s_outCap = 2 * (s_outCap + len);
+    s_out    = realloc(s_out, s_outCap);
+    if (NULL == s_out) {
+      fprintf(stderr, "Out of memory\n");
+      exit(1);
+    }
+  }
+  memcpy(s_out + s_outSize, p, len);
+  s_outSize += len;
+}
+
+static void
+put8(uint8_t val)
+{
+  put(&val, 1);
+}
+
+static void
+put16(uint16_t val)
+{
+  uint8_t buf[2] = { (uint8_t) val, (uint8_t) (val >> 8) };
+  put(buf, 2);
+}
+
+static void
+put32(uint32_t val)
+{
+  uint8_t buf[4] = { (uint8_t) val, (uint8_t) (val >> 8), (uint8_t) (val >> 16), (uint8_t) (val >> 24) };
+  put(buf, 4);
+}
+
+static uint32_t
+get32(const uint8_t *p)
+{
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// load_image
+//
+// Read a firmware image (.bin from the build directory) and check that
+// it has the digest appended that nodes report for their running image.
+//
+
+static int
+load_image(const char *path, image_t *pimg)
+{
+  FILE *f = fopen(path, "rb");
+  if (NULL == f) {
+    perror(path);
+    return -1;
+  }
+
+  fseek(f, 0, SEEK_END);
+  pimg->size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  pimg->data = malloc(pimg->size + 1);
+  if ((NULL == pimg->data) || (pimg->size != fread(pimg->data, 1, pimg->size, f))) {
+    fprintf(stderr, "%s: read failed\n", path);
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+
+  if ((pimg->size < APP_DESC_POS + 128) || (IMAGE_MAGIC != pimg->data[0]) ||
+      (APP_DESC_MAGIC != get32(pimg->data + APP_DESC_POS))) {
+    fprintf(stderr, "%s: not an ESP-IDF application image\n", path);
+    return -1;
+  }
+
+  // esp_image_header_t.hash_appended
+  if (1 != pimg->data[23]) {
+    fprintf(stderr, "%s: image has no appended SHA-256\n", path);
+    return -1;
+  }
+
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// hash_at
+//
+
+static uint32_t
+hash_at(const uint8_t *p)
+{
+  uint64_t a, b;
+  memcpy(&a, p, 8);
+  memcpy(&b, p + 8, 8);
+  return (uint32_t) (((a * 0x9E3779B97F4A7C15ULL) ^ (b * 0xC2B2AE3D27D4EB4FULL)) >> (64 - HASH_BITS));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// match_len
+//
+
+static size_t
+match_len(const image_t *src, size_t spos, const image_t *dst, size_t dpos)
+{
+  size_t n = 0;
+  while ((spos + n < src->size) && (dpos + n < dst->size) && (src->data[spos + n] == dst->data[dpos + n])) {
+    n++;
+  }
+  return n;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// encode
+//
+// Greedy encoder. Every position of the source is indexed by a hash of the
+// 16 bytes starting there. The target is walked and the longest of the
+// indexed match and the continuation of the last copy is used. Code that
+// moved when something before it changed is found as long copies with a
+// new offset.
+//
+
+static void
+encode(const image_t *src, const image_t *dst, size_t *pcopied)
+{
+  int32_t *table  = malloc(sizeof(int32_t) << HASH_BITS);
+  size_t pos      = 0;
+  size_t literal  = 0; // Start of pending new data
+  size_t nextSrc  = 0; // Source offset following the last copy
+  size_t lastDst  = 0; // Target offset following the last copy
+
+  if (NULL == table) {
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+  }
+
+  memset(table, 0xff, sizeof(int32_t) << HASH_BITS);
+  for (size_t i = 0; i + HASH_BLOCK <= src->size; i++) {
+    table[hash_at(src->data + i)] = (int32_t) i;
+  }
+
+  *pcopied = 0;
+
+  while (pos + HASH_BLOCK <= dst->size) {
+
+    size_t bestLen = 0;
+    size_t bestSrc = 0;
+
+    // Same distance from the last copy
+    size_t cand = nextSrc + (pos - lastDst);
+    if (cand < src->size) {
+      bestLen = match_len(src, cand, dst, pos);
+      bestSrc = cand;
+    }
+
+    int32_t idx = table[hash_at(dst->data + pos)];
+    if ((idx >= 0) && ((size_t) idx != cand)) {
+      size_t len = match_len(src, idx, dst, pos);
+      if (len > bestLen) {
+        bestLen = len;
+        bestSrc = idx;
+      }
+    }
+
+    if (bestLen < MIN_MATCH) {
+      pos++;
+      continue;
+    }
+
+    // Grow the match backwards into pending new data
+    while ((pos > literal) && (bestSrc > 0) && (src->data[bestSrc - 1] == dst->data[pos - 1])) {
+      pos--;
+      bestSrc--;
+      bestLen++;
+    }
+
+    if (pos > literal) {
+      put8(OP_DATA);
+      put32(pos - literal);
+      put(dst->data + literal, pos - literal);
+    }
+
+    put8(OP_COPY);
+    put32(bestSrc);
+    put32(bestLen);
+
+    *pcopied += bestLen;
+    pos += bestLen;
+    literal = pos;
+    nextSrc = bestSrc + bestLen;
+    lastDst = pos;
+  }
+
+  if (dst->size > literal) {
+    put8(OP_DATA);
+    put32(dst->size - literal);
+    put(dst->data + literal, dst->size - literal);
+  }
+
+  put8(OP_END);
+  free(table);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// main
+//
+
+int
+main(int argc, char **argv)
+{
+  image_t src;
+  image_t dst;
+  size_t copied;
+  uint8_t bodyDigest[32];
+  const uint8_t *desc;
+
+  if (4 != argc) {
+    fprintf(stderr, "Usage: vscp-delta old.bin new.bin out.delta\n");
+    return 1;
+  }
+
+  if (load_image(argv[1], &src) || load_image(argv[2], &dst)) {
+    return 1;
+  }
+
+  // Header is written when the body is known
+  s_outSize = DELTA_HDR_SIZE;
+  s_out     = calloc(1, DELTA_HDR_SIZE);
+  s_outCap  = DELTA_HDR_SIZE;
+
+  encode(&src, &dst, &copied);
+
+  sha256(s_out + DELTA_HDR_SIZE, s_outSize - DELTA_HDR_SIZE, bodyDigest);
+
+  size_t bodySize = s_outSize - DELTA_HDR_SIZE;
+  uint8_t *body   = s_out;
+  s_out           = NULL;
+  s_outSize       = 0;
+  s_outCap        = 0;
+
+  put32(DELTA_MAGIC);
+  put16(DELTA_VERSION);
+  put16(DELTA_HDR_SIZE);
+  put32(src.size);
+  put32(dst.size);
+  put32(bodySize);
+  put(src.data + src.size - 32, 32);
+  put(dst.data + dst.size - 32, 32);
+  put(bodyDigest, 32);
+
+  // esp_app_desc_t version, project_name, time, date
+  desc = src.data + APP_DESC_POS;
+  put(desc + 16, 32);
+  put(desc + 48, 32);
+  put(desc + 80, 16);
+  put(desc + 96, 16);
+
+  if (DELTA_HDR_SIZE != s_outSize) {
+    fprintf(stderr, "Internal error, header size %zu\n", s_outSize);
+    return 1;
+  }
+
+  put(body + DELTA_HDR_SIZE, bodySize);
+
+  FILE *f = fopen(argv[3], "wb");
+  if ((NULL == f) || (s_outSize != fwrite(s_out, 1, s_outSize, f))) {
+    perror(argv[3]);
+    return 1;
+  }
+  fclose(f);
+
+  printf("Source %.32s %.16s %.16s, %zu bytes\n", desc + 16, desc + 96, desc + 80, src.size);
+  printf("Target %.32s %.16s %.16s, %zu bytes\n",
+         dst.data + APP_DESC_POS + 16,
+         dst.data + APP_DESC_POS + 96,
+         dst.data + APP_DESC_POS + 80,
+         dst.size);
+  printf("Delta %zu bytes (%.1f%% of target), %zu bytes copied from source\n",
+         s_outSize,
+         100.0 * s_outSize / dst.size,
+         copied);
+
+  free(body);
+  free(s_out);
+  free(src.data);
+  free(dst.data);
+  return 0;
+}
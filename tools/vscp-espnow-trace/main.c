@@ -0,0 +1,184 @@
+/*
+  File: main.c
+
+  Decode a binary esp-now trace dump from a VSCP alpha/beta node
+  (firmware/common/vscp-espnow-trace.h). All fields are little endian.
+
+  This file is part of the VSCP (https://www.vscp.org)
+
+  The MIT License (MIT)
+  Copyright © 2022-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_MAGIC    0x54524345
+#define TRACE_VERSION  1
+#define TRACE_HDR_SIZE 20
+#define TRACE_REC_SIZE 16
+#define MAX_MACS       32
+
+// Must match vscp_espnow_trace_id_t
+static const char *s_names[] = { "none",      "rx", "rx-invalid", "rx-bad-id", "rx-old",   "rx-decode",
+                                 "rx-replay", "tx", "tx-ex",      "probe",     "time-sync" };
+
+static uint8_t s_macs[MAX_MACS][6];
+static uint16_t s_hashes[MAX_MACS];
+static int s_cntMacs = 0;
+
+static uint16_t
+get16(const uint8_t *p)
+{
+  return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+static uint32_t
+get32(const uint8_t *p)
+{
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+// Same as vscp_espnow_trace_machash
+static uint16_t
+machash(const uint8_t *mac)
+{
+  uint32_t hash = 2166136261u;
+
+  for (int i = 0; i < 6; i++) {
+    hash ^= mac[i];
+    hash *= 16777619u;
+  }
+
+  return (uint16_t) ((hash >> 16) ^ (hash & 0xffff));
+}
+
+static void
+usage(void)
+{
+  fprintf(stderr, "usage: vscp-espnow-trace [-m xx:xx:xx:xx:xx:xx]... file|-\n");
+  exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  FILE *fp;
+  const char *path = NULL;
+  uint8_t hdr[TRACE_HDR_SIZE];
+  uint8_t rec[TRACE_REC_SIZE];
+
+  for (int i = 1; i < argc; i++) {
+    if (0 == strcmp(argv[i], "-m")) {
+      unsigned int m[6];
+      if ((++i >= argc) || (s_cntMacs >= MAX_MACS) ||
+          (6 != sscanf(argv[i], "%x:%x:%x:%x:%x:%x", &m[0], &m[1], &m[2], &m[3], &m[4], &m[5]))) {
+        usage();
+      }
+      for (int j = 0; j < 6; j++) {
+        s_macs[s_cntMacs][j] = (uint8_t) m[j];
+      }
+      s_hashes[s_cntMacs] = machash(s_macs[s_cntMacs]);
+      s_cntMacs++;
+    }
+    else {
+      path = argv[i];
+    }
+  }
+
+  if (NULL == path) {
+    usage();
+  }
+
+  fp = strcmp(path, "-") ? fopen(path, "rb") : stdin;
+  if (NULL == fp) {
+    perror(path);
+    return 1;
+  }
+
+  if ((1 != fread(hdr, sizeof(hdr), 1, fp)) || (TRACE_MAGIC != get32(hdr))) {
+    fprintf(stderr, "Not an esp-now trace dump\n");
+    return 1;
+  }
+
+  if ((TRACE_VERSION != get16(hdr + 4)) || (TRACE_REC_SIZE != get16(hdr + 6))) {
+    fprintf(stderr, "Unsupported trace version %u (record size %u)\n", get16(hdr + 4), get16(hdr + 6));
+    return 1;
+  }
+
+  uint32_t count = get32(hdr + 8);
+  uint32_t total = get32(hdr + 12);
+  uint32_t now   = get32(hdr + 16);
+
+  printf("%u records, %u written since boot, %u overwritten\n", count, total, total - count);
+  printf("%10s %-10s %-17s %5s %5s %4s %6s %5s %3s\n", "age", "event", "peer", "class", "type", "len", "result",
+         "rssi", "ch");
+
+  for (uint32_t i = 0; i < count; i++) {
+    char peer[20];
+
+    if (1 != fread(rec, sizeof(rec), 1, fp)) {
+      fprintf(stderr, "Dump truncated after %u records\n", i);
+      return 1;
+    }
+
+    uint8_t id       = rec[4];
+    uint16_t hash    = get16(rec + 6);
+    const char *name = (id < sizeof(s_names) / sizeof(s_names[0])) ? s_names[id] : "?";
+
+    snprintf(peer, sizeof(peer), "%04x", hash);
+    for (int j = 0; j < s_cntMacs; j++) {
+      if (s_hashes[j] == hash) {
+        snprintf(peer,
+                 sizeof(peer),
+                 "%02x:%02x:%02x:%02x:%02x:%02x",
+                 s_macs[j][0],
+                 s_macs[j][1],
+                 s_macs[j][2],
+                 s_macs[j][3],
+                 s_macs[j][4],
+                 s_macs[j][5]);
+        break;
+      }
+    }
+
+    // Timestamps are the low 32 bits of the microsecond clock so the age is
+    // right as long as the record is less than 71 minutes old.
+    printf("%10.3f %-10s %-17s %5u %5u %4u %6d %5d %3u\n",
+           (uint32_t) (now - get32(rec)) / 1000.0,
+           name,
+           peer,
+           get16(rec + 8),
+           get16(rec + 10),
+           get16(rec + 12),
+           (int8_t) rec[5],
+           (int8_t) rec[14],
+           rec[15]);
+  }
+
+  if (stdin != fp) {
+    fclose(fp);
+  }
+
+  return 0;
+}